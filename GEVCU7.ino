@@ -183,7 +183,14 @@ void initializeDevices() {
     //this makes initialization easier but means a device could freeze the system. Might want to do
     //asynchronous or threaded messages at some point but that opens up many other cans of worms.
     deviceManager.sendMessage(DEVICE_ANY, INVALID, MSG_STARTUP, NULL); //allows each device to register its preference handler
-    deviceManager.sendMessage(DEVICE_ANY, INVALID, MSG_SETUP, NULL); //then use the preference handler to initialize only enabled devices
+    uint32_t setupStart = micros();
+    deviceManager.setupDevices(); //then use the preference handler to initialize only enabled devices, in dependency order
+    //the lookup counters cover the whole boot so far, including the system device which was set up earlier
+    Logger::info("Device setup took %u us. %u setting lookups took %u us total (%u us of that building key indexes)", micros() - setupStart,
+                 PrefHandler::getLookupCount(), PrefHandler::getLookupMicros(), PrefHandler::getIndexBuildMicros());
+    setupStart = micros();
+    deviceManager.buildNameIndex(); //everything has registered its config and status entries by now
+    deviceManager.recordBootStep("NAMEIDX", micros() - setupStart);
 }
 
 //called when the watchdog triggers because it was not reset properly. Probably means a hangup has occurred.
@@ -314,6 +321,9 @@ void setup() {
     Serial.print(" at ");
     Serial.println(__TIME__);
 
+    //milestones for the boot report printed once the system is ready
+    uint32_t stepStart = micros();
+
 #ifndef ASSUME_SDCARD_INSERTED
     if (digitalRead(SD_DETECT) == 0)
     {
@@ -330,7 +340,9 @@ void setup() {
         {
             sdCardPresent = true;
             Serial.println(" OK!");
+            uint32_t logStart = micros();
             Logger::initializeFile();
+            deviceManager.recordBootStep("LOGFILE", micros() - logStart);
             //if the system crashed we ought to decode all the breadcrumbs and save them into the logfile.
             //Maybe within the above function?
         }
@@ -371,30 +383,40 @@ void setup() {
         flashESP32("esp32_program.bin", 0x10000);
         flashESP32("esp32_website.bin", 0x290000ull);
     }
+    deviceManager.recordBootStep("SDCARD", micros() - stepStart);
 
     wdt.feed();
 
     tickHandler.setup();
 
+	stepStart = micros();
 	Wire.begin();
 	Logger::info("TWI init ok");
 	memCache = new MemCache();
 	Logger::info("add MemCache (id: %X, %X)", MEMCACHE, memCache);
 	memCache->setup();
+    persistJournal.setup(); //must come right after the memory cache so anyone can use restored values
+    deviceManager.recordBootStep("MEMCACHE", micros() - stepStart);
 
     //force the system device to be set enabled. ALWAYS. It would not be good if it weren't enabled!
+    stepStart = micros();
     Device *sysDev = deviceManager.getDeviceByID(SYSTEM);
     sysDev->earlyInit();
 	PrefHandler::setDeviceStatus(SYSTEM, true);
     //Also, the system device has to be initialized a bit early.    
     sysDev->setup();
+    deviceManager.recordBootStep("SYSTEM", micros() - stepStart);
 
     Logger::console("LogLevel: %i", sysConfig->logLevel);
 	//Logger::setLoglevel((Logger::LogLevel)sysConfig->logLevel);
+    stepStart = micros();
 	systemIO.setup();
+    deviceManager.recordBootStep("SYSIO", micros() - stepStart);
+    stepStart = micros();
 	canHandlerBus0.setup();
 	canHandlerBus1.setup();
     canHandlerBus2.setup();
+    deviceManager.recordBootStep("CANBUS", micros() - stepStart);
     //canHandlerBus0.setSWMode(SW_NORMAL); //you can't do this unless you do hardware mods.
 	Logger::info("SYSIO init ok");
     deviceManager.setup();
@@ -405,6 +427,7 @@ void setup() {
     //if (!crashHandler.bCrashed())
     //{
 	    initializeDevices();
+	    prefCompactor.setup(); //only after devices have loaded their settings so the key usage counts mean something
     //    Logger::debug("Initialized all devices successfully!");
     //}
     //else
@@ -418,7 +441,9 @@ void setup() {
 	//btDevice = static_cast<ADAFRUITBLE *>(deviceManager.getDeviceByID(ADABLUE));
     //deviceManager.sendMessage(DEVICE_WIFI, ADABLUE, MSG_CONFIG_CHANGE, NULL); //Load config into BLE interface
 
-	Logger::info("System Ready");
+	Logger::info("System Ready. Boot took %u ms", millis());
+    deviceManager.finishBoot();
+    Logger::setDeferred(true); //loop() is about to start draining the log ring so log calls can stop formatting
     crashHandler.addBreadcrumb(ENCODE_BREAD("BOOTD"));
 
     //just for testing. Don't uncomment for production roms
@@ -452,6 +477,8 @@ void loop() {
     
     //This needs to be called to handle sdCard writing though.
     Logger::loop();
+
+    deviceManager.processMessages(); //deliver any messages devices posted to each other
     
     //ESP32 would be our BT device now. Does it need a loop function?
     //if (btDevice) btDevice->loop();
@@ -0,0 +1,158 @@
+/*
+ * AnalogFilter.h
+ *
+ * Integer filters for the analog inputs, run on every sample the background sampler takes
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef ANALOG_FILTER_H_
+#define ANALOG_FILTER_H_
+
+#include <Arduino.h>
+#include "config.h"
+
+#define ANALOG_FILTER_MAX_MEDIAN    5
+#define ANALOG_FILTER_MAX_AVERAGE   CFG_ADC_RING_SIZE
+#define ANALOG_FILTER_MAX_SHIFT     8
+#define ANALOG_FILTER_FRACTION      8 //fraction bits the IIR keeps so small steps don't get lost
+
+/*
+Each sample goes through three stages, any of which can be turned off:
+  median of the last 3 or 5 samples - a single spike never makes it through
+  average of the last 1 to 16 medians - kept as a running sum so it costs the same at any length
+  first order IIR, y += (x - y) / 2^shift - smooths without keeping more samples, shift 0 is off
+All integer, the whole chain is a few dozen cycles so it runs on every sample from the sampler interrupt.
+*/
+class AnalogFilter
+{
+public:
+    AnalogFilter()
+    {
+        configure(1, 1, 0);
+    }
+
+    //lengths are clamped to what fits, an even median length goes up to the next odd one
+    void configure(uint8_t medianLen, uint8_t averageLen, uint8_t iirShift)
+    {
+        if (medianLen < 1) medianLen = 1;
+        if (medianLen > ANALOG_FILTER_MAX_MEDIAN) medianLen = ANALOG_FILTER_MAX_MEDIAN;
+        if (!(medianLen & 1)) medianLen++;
+        if (averageLen < 1) averageLen = 1;
+        if (averageLen > ANALOG_FILTER_MAX_AVERAGE) averageLen = ANALOG_FILTER_MAX_AVERAGE;
+        if (iirShift > ANALOG_FILTER_MAX_SHIFT) iirShift = ANALOG_FILTER_MAX_SHIFT;
+        this->medianLen = medianLen;
+        this->averageLen = averageLen;
+        this->iirShift = iirShift;
+        reset();
+    }
+
+    //forget the history, the next sample starts everything off again
+    void reset()
+    {
+        medianPos = 0;
+        averagePos = 0;
+        averageSum = 0;
+        iirState = 0;
+        primed = false;
+        output = 0;
+    }
+
+    int16_t process(int16_t sample)
+    {
+        if (!primed)
+        {
+            //fill every window with the first sample so nothing starts off dragged toward zero
+            for (int i = 0; i < ANALOG_FILTER_MAX_MEDIAN; i++) medianWin[i] = sample;
+            for (int i = 0; i < ANALOG_FILTER_MAX_AVERAGE; i++) averageWin[i] = sample;
+            averageSum = (int32_t)sample * averageLen;
+            iirState = (int32_t)sample << ANALOG_FILTER_FRACTION;
+            primed = true;
+        }
+
+        int16_t val = sample;
+        if (medianLen > 1)
+        {
+            medianWin[medianPos] = sample;
+            if (++medianPos >= medianLen) medianPos = 0;
+            val = (medianLen == 3) ? median3(medianWin[0], medianWin[1], medianWin[2]) : median5(medianWin);
+        }
+
+        if (averageLen > 1)
+        {
+            averageSum += val - averageWin[averagePos];
+            averageWin[averagePos] = val;
+            if (++averagePos >= averageLen) averagePos = 0;
+            val = (averageSum + averageLen / 2) / averageLen;
+        }
+
+        if (iirShift)
+        {
+            iirState += (((int32_t)val << ANALOG_FILTER_FRACTION) - iirState) >> iirShift;
+            val = (iirState + (1 << (ANALOG_FILTER_FRACTION - 1))) >> ANALOG_FILTER_FRACTION;
+        }
+
+        output = val;
+        return val;
+    }
+
+    int16_t value() const
+    {
+        return output;
+    }
+
+private:
+    int16_t medianWin[ANALOG_FILTER_MAX_MEDIAN];
+    int16_t averageWin[ANALOG_FILTER_MAX_AVERAGE];
+    int32_t averageSum;
+    int32_t iirState; //IIR output with ANALOG_FILTER_FRACTION extra bits
+    int16_t output;
+    uint8_t medianLen;
+    uint8_t medianPos;
+    uint8_t averageLen;
+    uint8_t averagePos;
+    uint8_t iirShift;
+    bool primed;
+
+    static inline int16_t median3(int16_t a, int16_t b, int16_t c)
+    {
+        if (a > b) { int16_t t = a; a = b; b = t; }
+        if (b > c) b = c;
+        return (a > b) ? a : b;
+    }
+
+    //sorting network, only as far as it takes to get the middle one
+    static inline int16_t median5(const int16_t *w)
+    {
+        int16_t a = w[0], b = w[1], c = w[2], d = w[3], e = w[4], t;
+        if (a > b) { t = a; a = b; b = t; }
+        if (d > e) { t = d; d = e; e = t; }
+        if (a > d) { t = a; a = d; d = t; t = b; b = e; e = t; }
+        //a is now the smallest of four and can't be the median, find the median of b, c, d, e without it
+        if (b > c) { t = b; b = c; c = t; }
+        if (b > d) { t = b; b = d; d = t; t = c; c = e; e = t; }
+        return (c < d) ? c : d;
+    }
+};
+
+#endif
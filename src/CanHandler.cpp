@@ -729,22 +729,30 @@ void CanHandler::detachAll(CanObserver *observer)
 void CanHandler::logFrame(const CAN_message_t &msg)
 {
     
-    if (Logger::isDebug()) {
-        Logger::debug("CAN: bus=%i id=%X dlc=%u ide=%X data=%X,%X,%X,%X,%X,%X,%X,%X",
-                      (int)canBusNode, msg.id, msg.len, msg.flags.extended,
-                      msg.buf[0], msg.buf[1], msg.buf[2], msg.buf[3],
-                      msg.buf[4], msg.buf[5], msg.buf[6], msg.buf[7]);
-    }
+    //frames have their own log level (CANHANDLER) so debugging a driver doesn't mean logging every frame
+    LOG_DEV_DEBUG(CANHANDLER, "CAN: bus=%i id=%X dlc=%u ide=%X data=%X,%X,%X,%X,%X,%X,%X,%X",
+                  (int)canBusNode, msg.id, msg.len, msg.flags.extended,
+                  msg.buf[0], msg.buf[1], msg.buf[2], msg.buf[3],
+                  msg.buf[4], msg.buf[5], msg.buf[6], msg.buf[7]);
 }
 
 void CanHandler::logFrame(const CANFD_message_t &msg_fd)
 {
-    if (Logger::isDebug()) {
-        String dataBytes;
-        for (int i = 0; i < msg_fd.len; i++) dataBytes += String(msg_fd.buf[i], HEX) + ",";
-        Logger::debug("CANFD: bus=%i id=%X dlc=%u ide=%X data=%s",
+    if (CFG_LOG_MIN_LEVEL <= Logger::Debug && Logger::isEnabled(CANHANDLER, Logger::Debug)) {
+        //hex the bytes into a stack buffer by hand, this runs for every frame so no Strings
+        static const char hexDigits[] = "0123456789ABCDEF";
+        char dataBytes[64 * 3 + 1];
+        int pos = 0;
+        for (int i = 0; i < msg_fd.len && i < 64; i++)
+        {
+            if (msg_fd.buf[i] > 0x0F) dataBytes[pos++] = hexDigits[msg_fd.buf[i] >> 4];
+            dataBytes[pos++] = hexDigits[msg_fd.buf[i] & 0x0F];
+            dataBytes[pos++] = ',';
+        }
+        dataBytes[pos] = 0;
+        Logger::debug(CANHANDLER, "CANFD: bus=%i id=%X dlc=%u ide=%X data=%s",
                       (int)canBusNode, msg_fd.id, msg_fd.len, msg_fd.flags.extended,
-                      dataBytes.c_str());
+                      dataBytes);
     }
 }
 
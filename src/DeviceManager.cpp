@@ -36,8 +36,12 @@
  */
 
 #include "DeviceManager.h"
+#include "SD.h"
+
+extern bool sdCardPresent;
 
 const char *CFG_VAR_TYPE_NAMES[7] = {"BYTE","STRING","INT16","UINT16","INT32","UINT32","FLOAT"};
+volatile uint32_t statusChangeCount = 0;
 
 DeviceManager::DeviceManager() {
     throttle = nullptr;
@@ -45,6 +49,28 @@ DeviceManager::DeviceManager() {
     motorController = nullptr;
     for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
         devices[i] = nullptr;
+    deviceGeneration = 0;
+    typeIndexValid = false;
+    for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++)
+    {
+        statusObservers[i] = nullptr;
+        observerInterval[i] = 0;
+    }
+    lastChangeCount = 0;
+    pendingEntries = 0;
+    dispatching = false;
+    lastDispatchMicros = 0;
+    maxDispatchMicros = 0;
+    statusMsgCount = 0;
+    nameIndexValid = false;
+    msgHead = msgTail = 0;
+    postedCount = 0;
+    droppedCount = 0;
+    maxMsgLatency = 0;
+    numLatencyTypes = 0;
+    maxQueueDepth = 0;
+    numBootSteps = 0;
+    bootReadyMillis = 0;
 }
 
 /*
@@ -55,6 +81,8 @@ void DeviceManager::addDevice(Device *device) {
         int8_t i = findDevice(NULL);
         if (i != -1) {
             devices[i] = device;
+            deviceGeneration++;
+            nameIndexValid = false;
         } else {
             Logger::error("unable to register device, max number of devices reached.");
         }
@@ -78,30 +106,11 @@ void DeviceManager::addDevice(Device *device) {
  * Remove the specified device from the list of registered devices
  */
 void DeviceManager::removeDevice(Device *device) {
-    int8_t i = findDevice(NULL);
+    int8_t i = findDevice(device);
     if (i != -1)
         devices[i] = NULL;
-    switch (device->getType()) {
-    case DEVICE_THROTTLE:
-        throttle = NULL;
-        break;
-    case DEVICE_BRAKE:
-        brake = NULL;
-        break;
-    case DEVICE_MOTORCTRL:
-        motorController = NULL;
-        break;
-    case DEVICE_ANY:
-    case DEVICE_BMS:
-    case DEVICE_CHARGER:
-    case DEVICE_DISPLAY:
-    case DEVICE_MISC:
-    case DEVICE_WIFI:
-    case DEVICE_IO:
-    case DEVICE_DCDC:
-    case DEVICE_NONE:
-        break;
-    }
+    deviceGeneration++;
+    nameIndexValid = false;
 }
 
 /*Add a new tick handler to the specified device. It should
@@ -151,53 +160,306 @@ void DeviceManager::sendMessage(DeviceType devType, DeviceId devId, uint32_t msg
     }
 }
 
-void DeviceManager::addStatusEntry(StatusEntry entry)
+/*
+ Sends MSG_SETUP to each enabled device one at a time instead of as a broadcast. Hardware phase devices
+ go first so slow bring up (like holding the ESP32 in reset) can be running while the rest set up, then
+ normal, then late. Inside a phase a device waits until every device of the types in its getDependencies()
+ list has been set up, otherwise registration order is kept. Dependencies on a later phase can't be met
+ early so they're ignored. If dependencies go around in a circle the first device left goes anyway.
+ The device's stored log level is loaded right before its MSG_SETUP. Every setup() is timed for the boot report.
+*/
+void DeviceManager::setupDevices()
 {
-    statusEntries.push_back(entry);
+    bool waiting[CFG_DEV_MGR_MAX_DEVICES];
+    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
+        waiting[i] = devices[i] && devices[i]->isEnabled();
+
+    for (int phase = PHASE_HARDWARE; phase <= PHASE_LATE; phase++)
+    {
+        while (true)
+        {
+            int first = -1, pick = -1;
+            for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES && pick == -1; i++)
+            {
+                if (!waiting[i] || devices[i]->getStartupPhase() != phase) continue;
+                if (first == -1) first = i;
+                bool ready = true;
+                const DeviceType *deps = devices[i]->getDependencies();
+                for (int d = 0; deps && deps[d] != DEVICE_NONE && ready; d++)
+                {
+                    for (int j = 0; j < CFG_DEV_MGR_MAX_DEVICES; j++)
+                    {
+                        if (j != i && waiting[j] && devices[j]->getStartupPhase() == phase && devices[j]->getType() == deps[d])
+                        {
+                            ready = false;
+                            break;
+                        }
+                    }
+                }
+                if (ready) pick = i;
+            }
+            if (first == -1) break; //nothing left in this phase
+            if (pick == -1)
+            {
+                Logger::warn("Circular startup dependency, setting up %s anyway", devices[first]->getShortName());
+                pick = first;
+            }
+
+            waiting[pick] = false;
+            Device *dev = devices[pick];
+            Logger::debug("Setting up device with ID %X (%s)", dev->getId(), dev->getShortName());
+            uint32_t start = micros();
+            dev->loadLogLevel(); //before setup so the device's own level covers its setup logging
+            dev->handleMessage(MSG_SETUP, NULL);
+            addBootStep(dev->getShortName(), micros() - start, phase);
+        }
+    }
 }
 
-//Since entries are put into the vector by copy we can't just search for this entry. We have to search for
-//the name of the status entry instead.
-void DeviceManager::removeStatusEntry(StatusEntry entry)
+//for timing the parts of boot that happen outside of device setup
+void DeviceManager::recordBootStep(const char *name, uint32_t elapsedMicros)
 {
-    removeStatusEntry(entry.statusName);
+    addBootStep(name, elapsedMicros, 0xFF);
+}
+
+void DeviceManager::addBootStep(const char *name, uint32_t elapsedMicros, uint8_t phase)
+{
+    if (numBootSteps >= CFG_BOOT_REPORT_STEPS) return;
+    bootSteps[numBootSteps].name = name;
+    bootSteps[numBootSteps].micros = elapsedMicros;
+    bootSteps[numBootSteps].phase = phase;
+    numBootSteps++;
+}
+
+//call once the system is ready. Stamps the ready time then puts the report on the console and the sdcard
+void DeviceManager::finishBoot()
+{
+    bootReadyMillis = millis();
+    printBootReport();
+    saveBootReport();
+}
+
+static const char *bootPhaseName(uint8_t phase)
+{
+    switch (phase)
+    {
+    case PHASE_HARDWARE:
+        return "hardware";
+    case PHASE_NORMAL:
+        return "normal";
+    case PHASE_LATE:
+        return "late";
+    }
+    return "system";
 }
 
-void DeviceManager::removeStatusEntry(String statusName)
+void DeviceManager::printBootReport()
 {
-    for (std::vector<StatusEntry>::iterator it = statusEntries.begin(); it != statusEntries.end(); ) {
-        if (it->statusName == statusName) statusEntries.erase(it);
-        else ++it;
+    uint32_t deviceTotal = 0;
+    Logger::console("Boot report (in the order things ran):");
+    for (int i = 0; i < numBootSteps; i++)
+    {
+        Logger::console("  %-10s %-8s %8u us", bootSteps[i].name, bootPhaseName(bootSteps[i].phase), bootSteps[i].micros);
+        if (bootSteps[i].phase != 0xFF) deviceTotal += bootSteps[i].micros;
     }
+    Logger::console("Device setup total %u us. System ready at %u ms", deviceTotal, bootReadyMillis);
+}
+
+//same thing as printBootReport but written over bootrep.txt so the last boot can be looked at later
+void DeviceManager::saveBootReport()
+{
+    if (!sdCardPresent) return;
+    FsFile file = SD.sdfs.open("bootrep.txt", O_RDWR | O_CREAT | O_TRUNC);
+    if (!file)
+    {
+        Logger::error("Could not create the boot report file");
+        return;
+    }
+    char line[64];
+    for (int i = 0; i < numBootSteps; i++)
+    {
+        int len = snprintf(line, sizeof(line), "%-10s %-8s %8lu us\n", bootSteps[i].name, bootPhaseName(bootSteps[i].phase),
+                           (unsigned long)bootSteps[i].micros);
+        file.write(line, min(len, (int)sizeof(line) - 1));
+    }
+    int len = snprintf(line, sizeof(line), "System ready at %lu ms\n", (unsigned long)bootReadyMillis);
+    file.write(line, min(len, (int)sizeof(line) - 1));
+    file.close();
+}
+
+/*
+ Queue up a message to be delivered later from the main loop instead of right now. Use this from tick
+ and message handlers so one slow device doesn't hold up the sender, and so nothing ends up sending
+ from inside its own handler. If devId is a real ID the message goes to that device. Otherwise it goes
+ to every enabled device matching devType, taken from the type index. message is only passed along as a
+ pointer so it has to still be valid when the message gets delivered. Not safe to call from an interrupt.
+ Returns false if the queue was full and the message was dropped.
+ */
+bool DeviceManager::postMessage(DeviceType devType, DeviceId devId, uint32_t msgType, void* message)
+{
+    uint16_t next = (msgHead + 1) % CFG_MSG_QUEUE_SIZE;
+    if (next == msgTail)
+    {
+        droppedCount++;
+        Logger::error("Message queue full, dropped message %X", msgType);
+        return false;
+    }
+    PostedMessage &msg = msgQueue[msgHead];
+    msg.msgType = msgType;
+    msg.message = message;
+    msg.postedAt = micros();
+    msg.devId = devId;
+    msg.devType = devType;
+    msgHead = next;
+    postedCount++;
+
+    uint16_t depth = (msgHead + CFG_MSG_QUEUE_SIZE - msgTail) % CFG_MSG_QUEUE_SIZE;
+    if (depth > maxQueueDepth) maxQueueDepth = depth;
+    return true;
+}
+
+void DeviceManager::deliverPosted(const PostedMessage &msg)
+{
+    if (msg.devId == INVALID)
+    {
+        //only the enabled devices of the type are looked at, not every slot. DEVICE_ANY goes through each type
+        int firstType = (msg.devType == DEVICE_ANY) ? 0 : msg.devType;
+        int lastType = (msg.devType == DEVICE_ANY) ? DEVICE_NONE : msg.devType;
+        for (int type = firstType; type <= lastType; type++)
+        {
+            //a handler can turn devices on or off, so ask again for each one instead of holding on to a count
+            for (uint8_t nth = 0; nth < countDeviceType((DeviceType)type); nth++)
+            {
+                Device *dev = getDeviceByType((DeviceType)type, nth);
+                if (dev) dev->handleMessage(msg.msgType, msg.message);
+            }
+        }
+        return;
+    }
+
+    Device *dev = getDeviceByID(msg.devId);
+    if (!dev) return;
+    if ( (msg.devType != DEVICE_ANY) && (msg.devType != dev->getType()) ) return;
+    //a device that just got disabled still needs to hear about it
+    if ( (msg.msgType != MSG_DISABLE) && !dev->isEnabled() ) return;
+    dev->handleMessage(msg.msgType, msg.message);
+}
+
+//Keeps the worst latency per message type so a fault stuck behind slow handlers shows up on its own
+//instead of hiding in the overall figure. Types past the first CFG_MSG_LATENCY_TYPES only count overall.
+void DeviceManager::recordLatency(uint32_t msgType, uint32_t latency)
+{
+    if (latency > maxMsgLatency) maxMsgLatency = latency;
+    int i = 0;
+    while (i < numLatencyTypes && msgLatency[i].msgType != msgType) i++;
+    if (i == numLatencyTypes)
+    {
+        if (numLatencyTypes == CFG_MSG_LATENCY_TYPES) return;
+        msgLatency[i].msgType = msgType;
+        msgLatency[i].count = 0;
+        msgLatency[i].maxLatency = 0;
+        numLatencyTypes++;
+    }
+    msgLatency[i].count++;
+    if (latency > msgLatency[i].maxLatency) msgLatency[i].maxLatency = latency;
+}
+
+//worst delivery latency seen for posted messages of this type, 0 if none were delivered yet
+uint32_t DeviceManager::getMaxMsgLatency(uint32_t msgType)
+{
+    for (int i = 0; i < numLatencyTypes; i++)
+        if (msgLatency[i].msgType == msgType) return msgLatency[i].maxLatency;
+    return 0;
+}
+
+/*
+ Delivers posted messages. Called from the main loop. Stops once CFG_MSG_LOOP_BUDGET microseconds
+ have gone by so a burst of messages can't starve everything else, the rest go on the next pass.
+ */
+void DeviceManager::processMessages()
+{
+    uint32_t startMicros = micros();
+    while (msgHead != msgTail)
+    {
+        //take it off the queue first, handlers are allowed to post more messages
+        PostedMessage msg = msgQueue[msgTail];
+        msgTail = (msgTail + 1) % CFG_MSG_QUEUE_SIZE;
+
+        deliverPosted(msg);
+
+        uint32_t now = micros();
+        recordLatency(msg.msgType, now - msg.postedAt);
+        if (now - startMicros > CFG_MSG_LOOP_BUDGET) break;
+    }
+}
+
+void DeviceManager::printMessageStats()
+{
+    Logger::console("Posted messages: %u sent, %u dropped. Most ever queued: %u of %u", postedCount, droppedCount,
+                    maxQueueDepth, CFG_MSG_QUEUE_SIZE - 1);
+    Logger::console("Worst delivery latency %u us", maxMsgLatency);
+    for (int i = 0; i < numLatencyTypes; i++)
+        Logger::console("  message %X: %u delivered, worst %u us", msgLatency[i].msgType, msgLatency[i].count, msgLatency[i].maxLatency);
+}
+
+void DeviceManager::addStatusEntry(const StatusEntry &entry)
+{
+    statusEntries.add(entry);
+    nameIndexValid = false;
+}
+
+//The registry doesn't keep StatusEntry records around so look this one up by name
+void DeviceManager::removeStatusEntry(const StatusEntry &entry)
+{
+    removeStatusEntry(entry.statusName);
+}
+
+void DeviceManager::removeStatusEntry(const char *statusName)
+{
+    statusEntries.remove(statusName);
+    nameIndexValid = false;
 }
 
 //if a device is unloaded it'd be necessary to remove all entries it added. We do that here.
 void DeviceManager::removeAllEntriesForDevice(Device *dev)
 {
-    for (std::vector<StatusEntry>::iterator it = statusEntries.begin(); it != statusEntries.end(); ) {
-        if (it->device == dev) statusEntries.erase(it);
-        else ++it;
-    }
+    statusEntries.removeDevice(dev);
+    nameIndexValid = false;
 }
 
 void DeviceManager::printAllStatusEntries()
 {
-    Device *dev;
     Logger::console("All status entries:");
-    for (std::vector<StatusEntry>::iterator it = statusEntries.begin(); it != statusEntries.end(); ++it) 
-    {
-        dev = (Device *)it->device;
-        Logger::console("Name: %s Type: %s   dev: %s", it->statusName.c_str(), CFG_VAR_TYPE_NAMES[it->varType], dev->getShortName());
-    }
+    statusEntries.forEachColumn([](auto &col) {
+        for (size_t i = 0; i < col.size(); i++)
+        {
+            Device *dev = col.info[i].device;
+            Logger::console("Name: %s Type: %s   dev: %s", col.info[i].name, CFG_VAR_TYPE_NAMES[col.varType],
+                            dev ? dev->getShortName() : "-");
+        }
+    });
+    Logger::console("%u entries, %u polled. Last dispatch pass %u us, max %u us. %u updates sent", statusEntries.size(),
+                    statusEntries.getPolledCount(), lastDispatchMicros, maxDispatchMicros, statusMsgCount);
 }
 
-bool DeviceManager::addStatusObserver(Device *dev)
+//minIntervalMs limits how often this observer hears about any one entry. Changes that come in faster than
+//that are held and only the latest value gets sent once the interval is up. 0 means every change.
+bool DeviceManager::addStatusObserver(Device *dev, uint16_t minIntervalMs)
 {
     for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++)
     {
-        if (!statusObservers[i] || (statusObservers[i] == dev) )
+        if (statusObservers[i] == dev)
+        {
+            observerInterval[i] = minIntervalMs;
+            return true;
+        }
+    }
+    for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++)
+    {
+        if (!statusObservers[i])
         {
             statusObservers[i] = dev;
+            observerInterval[i] = minIntervalMs;
             return true;
         }
     }
@@ -211,6 +473,8 @@ bool DeviceManager::removeStatusObserver(Device *dev)
         if (statusObservers[i] == dev)
         {
             statusObservers[i] = nullptr;
+            //don't leave updates queued up for whoever takes this slot next
+            statusEntries.clearPending(1 << i);
             return true;
         }
     }
@@ -223,28 +487,75 @@ void DeviceManager::dispatchToObservers(const StatusEntry &entry)
         if (statusObservers[i]) statusObservers[i]->handleMessage(MSG_CONFIG_CHANGE, &entry);
 }
 
-/*
-  Every tick we go through the entire list of status entries and see if there value has changed. 
-  If it has we need to issue a message to registered listeners. It may bear consideration that 
-  the observer callbacks should be done via a queue and not all at once instantly. This processor
-  is extremely fast but some entries are going to update all of the time and thus we could end up
-  with a huge number of calls here.
-*/
-void DeviceManager::handleTick()
+//Tell each observer about an entry if it is waiting on it and its rate limit allows. Observers that
+//are still inside their interval keep their pending bit and get picked up on a later pass.
+void DeviceManager::sendPending(const StatusEntry &entry, uint8_t &pending, uint32_t *lastSent, uint32_t now)
 {
-    double currVal = 0.0;
-    for (std::vector<StatusEntry>::iterator it = statusEntries.begin(); it != statusEntries.end(); ++it) 
+    for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++)
     {
-        currVal = it->getValueAsDouble();
-        if ( fabs(currVal - it->lastValue) > 0.001) //has the value changed?
+        uint8_t bit = 1 << i;
+        if (!(pending & bit)) continue;
+        if (!statusObservers[i])
         {
-            Logger::avalanche("Value of %s has changed", it->statusName.c_str());
-            dispatchToObservers(*it);
-            it->lastValue = currVal;
+            pending &= ~bit;
+            continue;
         }
+        if (observerInterval[i] && (now - lastSent[i]) < observerInterval[i]) continue;
+        pending &= ~bit;
+        lastSent[i] = now;
+        statusObservers[i]->handleMessage(MSG_CONFIG_CHANGE, &entry);
+        statusMsgCount++;
     }
 }
 
+/*
+  Sends out any status changes to the observers. Entries backed by a StatusVar only need their generation
+  compared, plain variables are compared as their own type. If no StatusVar anywhere has changed since last time, and there are no plain polled entries
+  or rate limited updates waiting, this returns right away without looking at the list at all.
+  This runs every tick but a device can also call it right after updating something that observers should
+  hear about immediately.
+*/
+void DeviceManager::dispatchStatusChanges()
+{
+    uint32_t changeCount = statusChangeCount;
+    if (changeCount == lastChangeCount && statusEntries.getPolledCount() == 0 && pendingEntries == 0) return;
+    if (dispatching) return; //an observer set off another pass. Whatever it changed gets caught next time
+    dispatching = true;
+    lastChangeCount = changeCount;
+
+    uint32_t startMicros = micros();
+    uint32_t now = millis();
+    uint8_t observerMask = 0;
+    for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++)
+        if (statusObservers[i]) observerMask |= (1 << i);
+
+    pendingEntries = 0;
+    statusEntries.forEachColumn([&](auto &col) {
+        for (size_t i = 0; i < col.size(); i++)
+        {
+            if (col.changed(i))
+            {
+                Logger::avalanche("Value of %s has changed", col.info[i].name);
+                col.pending[i] = observerMask;
+            }
+            if (col.pending[i])
+            {
+                sendPending(col.entryAt(i), col.pending[i], col.info[i].lastSent, now);
+                if (col.pending[i]) pendingEntries++;
+            }
+        }
+    });
+
+    lastDispatchMicros = micros() - startMicros;
+    if (lastDispatchMicros > maxDispatchMicros) maxDispatchMicros = lastDispatchMicros;
+    dispatching = false;
+}
+
+void DeviceManager::handleTick()
+{
+    dispatchStatusChanges();
+}
+
 void DeviceManager::setup()
 {
     tickHandler.detach(this);
@@ -252,10 +563,6 @@ void DeviceManager::setup()
     Logger::info("Adding tick handler for Device Manager");
 
     tickHandler.attach(this, 100000ul); //10 times per second
-
-    //this should be large enough that you don't cause it to have to enlarge but not so large
-    //that all RAM is taken up needlessly. So, tweak it in use to be big enough but not much more biggerer
-    statusEntries.reserve(200);
 }
 
 uint8_t DeviceManager::getNumThrottles() {
@@ -278,9 +585,10 @@ uint8_t DeviceManager::getNumDisplays() {
     return countDeviceType(DEVICE_DISPLAY);
 }
 
+//The throttle, brake and motor controller pointers are refreshed along with the type index so these
+//are just a generation check and a pointer read.
 Throttle *DeviceManager::getAccelerator() {
-    //try to find one if nothing registered. Cache it if we find one
-    if (!throttle) throttle = (Throttle *)getDeviceByType(DEVICE_THROTTLE);
+    refreshTypeIndex();
 
     //if there is no throttle then instantiate a dummy throttle
     //so down range code doesn't puke
@@ -293,8 +601,7 @@ Throttle *DeviceManager::getAccelerator() {
 }
 
 Throttle *DeviceManager::getBrake() {
-
-    if (!brake) brake = (Throttle *)getDeviceByType(DEVICE_BRAKE);
+    refreshTypeIndex();
 
     if (!brake)
     {
@@ -305,7 +612,7 @@ Throttle *DeviceManager::getBrake() {
 }
 
 MotorController *DeviceManager::getMotorController() {
-    if (!motorController) motorController = (MotorController *)getDeviceByType(DEVICE_MOTORCTRL);
+    refreshTypeIndex();
 
     if (!motorController)
     {
@@ -340,20 +647,66 @@ Device *DeviceManager::getDeviceByIdx(int idx)
 }
 
 /*
-The more object oriented version of the above function. Allows one to find the first device that matches
-a given type.
+The more object oriented version of the above function. Allows one to find the first enabled device that
+matches a given type, or the nth one if there are several. Comes straight out of the type index.
+*/
+Device *DeviceManager::getDeviceByType(DeviceType type, uint8_t nth)
+{
+    refreshTypeIndex();
+    if ((unsigned)type <= DEVICE_NONE && nth < (typeStart[type + 1] - typeStart[type])) return typeOrder[typeStart[type] + nth];
+    Logger::avalanche("getDeviceByType - No devices of type: %X", (int)type);
+    return 0; //NULL!
+}
+
+/*
+Something that keeps its own device pointers can hang on to this and compare it later. If it changed
+then devices came or went or were turned on or off and the pointers should be looked up again.
+*/
+uint32_t DeviceManager::getDeviceGeneration()
+{
+    return deviceGeneration + PrefHandler::getEnableGeneration();
+}
+
+/*
+Rebuilds the per type lists of enabled devices if anything changed since last time. Counting sort
+into one array: typeOrder[typeStart[t]] up to typeOrder[typeStart[t + 1]] are the devices of type t, in
+registration order. Cheap enough to call on every lookup when nothing has changed.
 */
-Device *DeviceManager::getDeviceByType(DeviceType type)
+void DeviceManager::refreshTypeIndex()
 {
+    uint32_t enableGen = PrefHandler::getEnableGeneration();
+    if (typeIndexValid && typeIndexGen == deviceGeneration && typeIndexEnableGen == enableGen) return;
+
+    uint8_t counts[DEVICE_NONE + 1];
+    uint8_t types[CFG_DEV_MGR_MAX_DEVICES];
+    for (int t = 0; t <= DEVICE_NONE; t++) counts[t] = 0;
     for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
     {
-        if (devices[i] && devices[i]->isEnabled())
-        {
-            if (devices[i]->getType() == type) return devices[i];
-        }
+        types[i] = DEVICE_NONE + 1; //not in the index
+        if (!devices[i] || !devices[i]->isEnabled()) continue;
+        DeviceType type = devices[i]->getType();
+        if ((unsigned)type > DEVICE_NONE) continue;
+        types[i] = type;
+        counts[type]++;
     }
-    Logger::avalanche("getDeviceByType - No devices of type: %X", (int)type);
-    return 0; //NULL!
+
+    typeStart[0] = 0;
+    for (int t = 0; t <= DEVICE_NONE; t++) typeStart[t + 1] = typeStart[t] + counts[t];
+    for (int t = 0; t <= DEVICE_NONE; t++) counts[t] = typeStart[t]; //now the next free spot for each type
+    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
+    {
+        if (types[i] > DEVICE_NONE) continue;
+        typeOrder[counts[types[i]]++] = devices[i];
+    }
+
+    throttle = (typeStart[DEVICE_THROTTLE + 1] > typeStart[DEVICE_THROTTLE]) ? (Throttle *)typeOrder[typeStart[DEVICE_THROTTLE]] : nullptr;
+    brake = (typeStart[DEVICE_BRAKE + 1] > typeStart[DEVICE_BRAKE]) ? (Throttle *)typeOrder[typeStart[DEVICE_BRAKE]] : nullptr;
+    motorController = (typeStart[DEVICE_MOTORCTRL + 1] > typeStart[DEVICE_MOTORCTRL]) ? (MotorController *)typeOrder[typeStart[DEVICE_MOTORCTRL]] : nullptr;
+
+    typeIndexGen = deviceGeneration;
+    typeIndexEnableGen = enableGen;
+    typeIndexValid = true;
+    Logger::debug("Device type index rebuilt");
 }
 
 /*
@@ -369,15 +722,12 @@ int8_t DeviceManager::findDevice(Device *device) {
 }
 
 /*
- * Count the number of registered devices of a certain type.
+ * Count the number of enabled devices of a certain type.
  */
 uint8_t DeviceManager::countDeviceType(DeviceType deviceType) {
-    uint8_t count = 0;
-    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
-        if (devices[i]->getType() == deviceType)
-            count++;
-    }
-    return count;
+    refreshTypeIndex();
+    if ((unsigned)deviceType > DEVICE_NONE) return 0;
+    return typeStart[deviceType + 1] - typeStart[deviceType];
 }
 
 /*
@@ -390,20 +740,181 @@ Outputs:
 */
 const ConfigEntry* DeviceManager::findConfigEntry(const char *settingName, Device **matchingDevice)
 {
+    return lookupConfigEntry(nullptr, settingName, matchingDevice);
+}
+
+//Same thing but only looks at the config entries of the given device, enabled or not.
+const ConfigEntry* DeviceManager::findConfigEntry(Device *dev, const char *settingName)
+{
+    return lookupConfigEntry(dev, settingName, nullptr);
+}
+
+//dev == nullptr means any enabled device
+const ConfigEntry* DeviceManager::lookupConfigEntry(Device *dev, const char *settingName, Device **matchingDevice)
+{
+    if (!nameIndexValid) buildNameIndex();
+
+    uint32_t hash = prefHash(settingName);
+    size_t mask = nameIndex.size() - 1;
+    for (size_t pos = hash & mask; nameIndex[pos].kind != NAME_EMPTY; pos = (pos + 1) & mask)
+    {
+        const NameIndexEntry &slot = nameIndex[pos];
+        if (slot.hash != hash || slot.kind != NAME_CONFIG) continue;
+        if (dev ? (slot.device != dev) : !slot.device->isEnabled()) continue;
+        const std::vector<ConfigEntry> *entries = slot.device->getConfigEntries();
+        if (slot.entryIdx >= entries->size()) continue;
+        const ConfigEntry *cfg = &entries->at(slot.entryIdx);
+        if (strcmp(settingName, cfg->cfgName.c_str())) continue;
+        if (matchingDevice) *matchingDevice = slot.device;
+        return cfg;
+    }
+
+    //Not in the index. A device can add config entries at any time without telling us so do it the slow
+    //way and if that finds it after all the index is out of date and gets rebuilt next time.
     for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++) {
-        if (devices[i] && devices[i]->isEnabled()) 
+        if (!devices[i]) continue;
+        if (dev ? (devices[i] != dev) : !devices[i]->isEnabled()) continue;
+        const std::vector<ConfigEntry> *entries = devices[i]->getConfigEntries();
+        for (size_t idx = 0; idx < entries->size(); idx++)
         {
-            const ConfigEntry *cfg = devices[i]->findConfigEntry(settingName);
-            if (cfg)
+            if (!strcmp(settingName, entries->at(idx).cfgName.c_str()))
             {
+                nameIndexValid = false;
                 if (matchingDevice) *matchingDevice = devices[i];
-                return cfg;
+                return &entries->at(idx);
             }
         }
     }
     return nullptr;
 }
 
+/*
+Parses valu and stores it into the variable behind the config entry if it is within the entry's limits.
+Strings are cut off at maxValue characters, which is the longest the buffer behind them can hold.
+Outputs:
+    0 if the value was stored, 1 if it was below the minimum, 2 if it was above the maximum
+*/
+int DeviceManager::setConfigValue(const ConfigEntry *entry, const char *valu)
+{
+    uint8_t ui8;
+    float fl;
+    int16_t i16;
+    int32_t i32;
+    uint16_t ui16;
+    uint32_t ui32;
+    size_t len;
+
+    int result = 0;
+    switch (entry->varType)
+    {
+    case CFG_ENTRY_VAR_TYPE::BYTE:
+        ui8 = (uint8_t)strtol(valu, NULL, 0);
+        if (ui8 < entry->minValue.u_int) result = 1;
+        else if (ui8 > entry->maxValue.u_int) result = 2;
+        else *(uint8_t *)entry->varPtr = ui8;
+        break;
+    case CFG_ENTRY_VAR_TYPE::FLOAT:
+        fl = strtof(valu, NULL);
+        if (fl < entry->minValue.floating) result = 1;
+        else if (fl > entry->maxValue.floating) result = 2;
+        else *(float *)entry->varPtr = fl;
+        break;
+    case CFG_ENTRY_VAR_TYPE::INT16:
+        i16 = (int16_t)strtol(valu, NULL, 0);
+        if (i16 < entry->minValue.s_int) result = 1;
+        else if (i16 > entry->maxValue.s_int) result = 2;
+        else *(int16_t *)entry->varPtr = i16;
+        break;
+    case CFG_ENTRY_VAR_TYPE::INT32:
+        i32 = (int32_t)strtol(valu, NULL, 0);
+        if (i32 < entry->minValue.s_int) result = 1;
+        else if (i32 > entry->maxValue.s_int) result = 2;
+        else *(int32_t *)entry->varPtr = i32;
+        break;
+    case CFG_ENTRY_VAR_TYPE::STRING:
+        len = strlen(valu);
+        if (len > entry->maxValue.u_int) len = entry->maxValue.u_int;
+        memcpy(entry->varPtr, valu, len);
+        ((char *)entry->varPtr)[len] = 0;
+        break;
+    case CFG_ENTRY_VAR_TYPE::UINT16:
+        ui16 = (uint16_t)strtol(valu, NULL, 0);
+        if (ui16 < entry->minValue.u_int) result = 1;
+        else if (ui16 > entry->maxValue.u_int) result = 2;
+        else *(uint16_t *)entry->varPtr = ui16;
+        break;
+    case CFG_ENTRY_VAR_TYPE::UINT32:
+        ui32 = (uint32_t)strtol(valu, NULL, 0);
+        if (ui32 < entry->minValue.u_int) result = 1;
+        else if (ui32 > entry->maxValue.u_int) result = 2;
+        else *(uint32_t *)entry->varPtr = ui32;
+        break;
+    }
+    return result;
+}
+
+//Fills out entry with the status entry of this name. Returns false if there is no such status entry
+bool DeviceManager::findStatusEntry(const char *statusName, StatusEntry *entry)
+{
+    if (!nameIndexValid) buildNameIndex();
+
+    uint32_t hash = prefHash(statusName);
+    size_t mask = nameIndex.size() - 1;
+    for (size_t pos = hash & mask; nameIndex[pos].kind != NAME_EMPTY; pos = (pos + 1) & mask)
+    {
+        const NameIndexEntry &slot = nameIndex[pos];
+        if (slot.hash != hash || slot.kind != NAME_STATUS) continue;
+        if (!statusEntries.getEntry((CFG_ENTRY_VAR_TYPE)slot.varType, slot.entryIdx, entry)) continue;
+        if (!strcmp(statusName, entry->statusName)) return true;
+    }
+    //status entries always invalidate the index when they come and go so no need to search further
+    return false;
+}
+
+/*
+  Builds the name lookup table over the config entries of every registered device and every status
+  entry. Runs once after MSG_SETUP when everything has been registered. Adding or removing devices or
+  status entries marks it out of date and the next lookup rebuilds it.
+*/
+void DeviceManager::buildNameIndex()
+{
+    uint32_t startMicros = micros();
+    size_t count = statusEntries.size();
+    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
+        if (devices[i]) count += devices[i]->getConfigEntries()->size();
+
+    size_t slots = 32;
+    while (slots < count * 2) slots <<= 1;
+    nameIndex.assign(slots, NameIndexEntry());
+
+    //devices go in list order so if two devices use the same name the first one wins like it always did
+    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
+    {
+        if (!devices[i]) continue;
+        const std::vector<ConfigEntry> *entries = devices[i]->getConfigEntries();
+        for (size_t idx = 0; idx < entries->size(); idx++)
+            nameIndexInsert(prefHash(entries->at(idx).cfgName.c_str()), devices[i], idx, NAME_CONFIG, 0);
+    }
+    statusEntries.forEachColumn([this](auto &col) {
+        for (size_t idx = 0; idx < col.size(); idx++)
+            nameIndexInsert(prefHash(col.info[idx].name), col.info[idx].device, idx, NAME_STATUS, col.varType);
+    });
+    nameIndexValid = true;
+    Logger::debug("Name index: %u names in %u slots, built in %u us", count, slots, micros() - startMicros);
+}
+
+void DeviceManager::nameIndexInsert(uint32_t hash, Device *dev, uint16_t entryIdx, uint8_t kind, uint8_t varType)
+{
+    size_t mask = nameIndex.size() - 1;
+    size_t pos = hash & mask;
+    while (nameIndex[pos].kind != NAME_EMPTY) pos = (pos + 1) & mask;
+    nameIndex[pos].hash = hash;
+    nameIndex[pos].device = dev;
+    nameIndex[pos].entryIdx = entryIdx;
+    nameIndex[pos].kind = kind;
+    nameIndex[pos].varType = varType;
+}
+
 //caller preallocates the json document and we fill it out
 //send only details for given deviceID
 //might need it to be enabled to actually get the details?
@@ -536,6 +1047,9 @@ void DeviceManager::createJsonDeviceList(DynamicJsonDocument &doc)
         case DeviceType::DEVICE_DCDC:
             devEntry["DeviceType"] = "DCDC";
             break;
+        case DeviceType::DEVICE_HVAC:
+            devEntry["DeviceType"] = "HVAC";
+            break;
         case DeviceType::DEVICE_ANY:
         case DeviceType::DEVICE_NONE:
             devEntry["DeviceType"] = "ERR";
@@ -35,24 +35,73 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "devices/Device.h"
 #include "Sys_Messages.h"
 #include "devices/DeviceTypes.h"
+#include "StatusRegistry.h"
 
 #define CALL_MEMBER_FN(object,ptrToMember)  ( ((const Device*)(object))->*(ptrToMember) )
 
 class MotorController; // cyclic reference between MotorController and DeviceManager
 
+enum NameKind {
+    NAME_EMPTY,
+    NAME_CONFIG,
+    NAME_STATUS
+};
+
+//One slot of the name index. A config slot points into that device's cfgEntries, a status slot
+//at a position in one of the status registry columns.
+struct NameIndexEntry
+{
+    uint32_t hash;
+    Device *device;
+    uint16_t entryIdx;
+    uint8_t kind; //NameKind, NAME_EMPTY marks an unused slot
+    uint8_t varType; //which status column for NAME_STATUS
+};
+
+//A message waiting in the posted queue. message has to stay valid until it is delivered
+struct PostedMessage
+{
+    uint32_t msgType;
+    void *message;
+    uint32_t postedAt; //micros() when it was queued
+    DeviceId devId;
+    DeviceType devType;
+};
+
+//Delivery latency of posted messages of one type
+struct MsgLatency
+{
+    uint32_t msgType;
+    uint32_t count; //delivered so far
+    uint32_t maxLatency; //worst time from postMessage() to delivery in microseconds
+};
+
+//One timed step of the boot, either a device setup() or a milestone from the main setup
+struct BootStep
+{
+    const char *name;
+    uint32_t micros;
+    uint8_t phase; //StartupPhase for devices, 0xFF for milestones
+};
+
 class DeviceManager: public TickObserver {
 public:
     DeviceManager();    // private constructor
     void addDevice(Device *device);
     void removeDevice(Device *device);
-    void addStatusEntry(StatusEntry entry);
-    void removeStatusEntry(StatusEntry entry);
-    void removeStatusEntry(String statusName);
+    void addStatusEntry(const StatusEntry &entry);
+    void removeStatusEntry(const StatusEntry &entry);
+    void removeStatusEntry(const char *statusName);
     void removeAllEntriesForDevice(Device *dev);
     void printAllStatusEntries();
     void sendMessage(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, void* message);
+    bool postMessage(DeviceType deviceType, DeviceId deviceId, uint32_t msgType, void* message);
+    void processMessages();
+    void printMessageStats();
+    uint32_t getMaxMsgLatency(uint32_t msgType);
     void dispatchToObservers(const StatusEntry &entry);
-    bool addStatusObserver(Device *dev);
+    void dispatchStatusChanges();
+    bool addStatusObserver(Device *dev, uint16_t minIntervalMs = 0);
     bool removeStatusObserver(Device *dev);
     uint8_t getNumThrottles();
     uint8_t getNumControllers();
@@ -63,14 +112,32 @@ public:
     Throttle *getBrake();
     MotorController *getMotorController();
     Device *getDeviceByID(DeviceId);
-    Device *getDeviceByType(DeviceType);
+    Device *getDeviceByType(DeviceType, uint8_t nth = 0);
+    uint32_t getDeviceGeneration();
     Device *getDeviceByIdx(int idx);
     void printDeviceList();
     void updateWifi();
     Device *updateWifiByID(DeviceId);
     const ConfigEntry* findConfigEntry(const char *settingName, Device **matchingDevice);
+    const ConfigEntry* findConfigEntry(Device *dev, const char *settingName);
+    int setConfigValue(const ConfigEntry *entry, const char *valu);
+    bool findStatusEntry(const char *statusName, StatusEntry *entry);
+
+    //calls fn(const StatusEntry &) for every registered status entry
+    template <typename F>
+    void forEachStatusEntry(F fn)
+    {
+        statusEntries.forEachColumn([&fn](auto &col) {
+            for (size_t i = 0; i < col.size(); i++) fn(col.entryAt(i));
+        });
+    }
+    void buildNameIndex();
     void handleTick();
     void setup();
+    void setupDevices();
+    void recordBootStep(const char *name, uint32_t elapsedMicros);
+    void finishBoot();
+    void printBootReport();
     void createJsonConfigDoc(DynamicJsonDocument &doc);
     void createJsonConfigDocForID(DynamicJsonDocument &doc, DeviceId id);
     void createJsonDeviceList(DynamicJsonDocument &doc);
@@ -79,13 +146,47 @@ protected:
 private:
     Device *devices[CFG_DEV_MGR_MAX_DEVICES];
     Device *statusObservers[CFG_STATUS_NUM_OBSERVERS];
+    uint16_t observerInterval[CFG_STATUS_NUM_OBSERVERS]; //minimum ms between updates of the same entry to that observer
 
     Throttle *throttle;
     Throttle *brake;
     MotorController *motorController;
-
-    std::vector<StatusEntry> statusEntries;
-
+    Device *typeOrder[CFG_DEV_MGR_MAX_DEVICES]; //enabled devices grouped by type, see refreshTypeIndex()
+    uint8_t typeStart[DEVICE_NONE + 2]; //where each type's run starts in typeOrder
+    uint32_t deviceGeneration; //bumped when devices are added or removed
+    uint32_t typeIndexGen; //deviceGeneration when the type index was built
+    uint32_t typeIndexEnableGen; //PrefHandler enable generation when the type index was built
+    bool typeIndexValid;
+
+    StatusRegistry statusEntries;
+    uint32_t lastChangeCount; //statusChangeCount as of the last dispatch pass
+    uint16_t pendingEntries; //entries held back by an observer rate limit
+    bool dispatching;
+    uint32_t lastDispatchMicros;
+    uint32_t maxDispatchMicros;
+    uint32_t statusMsgCount;
+    PostedMessage msgQueue[CFG_MSG_QUEUE_SIZE];
+    volatile uint16_t msgHead, msgTail;
+    uint32_t postedCount;
+    uint32_t droppedCount;
+    uint32_t maxMsgLatency;
+    MsgLatency msgLatency[CFG_MSG_LATENCY_TYPES]; //per message type, in the order each type was first seen
+    uint8_t numLatencyTypes;
+    uint16_t maxQueueDepth;
+    std::vector<NameIndexEntry> nameIndex; //open addressed, size is a power of two and at most half full
+    bool nameIndexValid;
+    BootStep bootSteps[CFG_BOOT_REPORT_STEPS];
+    uint8_t numBootSteps;
+    uint32_t bootReadyMillis;
+
+    void addBootStep(const char *name, uint32_t elapsedMicros, uint8_t phase);
+    void saveBootReport();
+    void deliverPosted(const PostedMessage &msg);
+    void recordLatency(uint32_t msgType, uint32_t latency);
+    void sendPending(const StatusEntry &entry, uint8_t &pending, uint32_t *lastSent, uint32_t now);
+    void nameIndexInsert(uint32_t hash, Device *dev, uint16_t entryIdx, uint8_t kind, uint8_t varType);
+    const ConfigEntry *lookupConfigEntry(Device *dev, const char *settingName, Device **matchingDevice);
+    void refreshTypeIndex();
     int8_t findDevice(Device *device);
     uint8_t countDeviceType(DeviceType deviceType);
     void __populateJsonEntry(DynamicJsonDocument &doc, Device *dev);
@@ -0,0 +1,199 @@
+/*
+ * EEPROMBackend.cpp
+ *
+Copyright (c) 2022 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "EEPROMBackend.h"
+#include "i2c_driver_wire.h"
+
+uint32_t EEPROMBackend::getSize()
+{
+    return EEPROM_TOTAL_SIZE;
+}
+
+AT24Backend::AT24Backend(uint8_t baseId)
+{
+    i2cBaseId = baseId;
+    lastId = baseId;
+}
+
+bool AT24Backend::readPage(uint32_t pageAddr, uint8_t *data)
+{
+    uint32_t address = pageAddr << 8;
+    uint8_t buffer[2];
+    uint8_t i2c_id;
+    uint16_t e;
+
+    buffer[0] = ((address & 0xFF00) >> 8);
+    buffer[1] = 0; //the pages are 256 bytes so the start of a page is always 00 for the LSB
+    i2c_id = i2cBaseId + ((address >> 16) & 0x03); //chip ID then the two upper bits of the address
+    Wire.beginTransmission(i2c_id);
+    Wire.write(buffer, 2);
+    Wire.endTransmission(false); //do NOT generate stop
+    Wire.requestFrom(i2c_id, EEPROM_PAGE_SIZE); //this will generate stop though.
+    for (e = 0; e < EEPROM_PAGE_SIZE; e++)
+    {
+        if (!Wire.available()) return false;
+        data[e] = Wire.read();
+    }
+    return true;
+}
+
+bool AT24Backend::write(uint32_t address, const uint8_t *data, uint16_t len)
+{
+    uint8_t buffer[EEPROM_PAGE_SIZE + 2];
+    uint16_t d;
+
+    if (len > EEPROM_PAGE_SIZE) return false;
+    buffer[0] = ((address & 0xFF00) >> 8);
+    buffer[1] = (address & 0x00FF);
+    lastId = i2cBaseId + ((address >> 16) & 0x03);
+    for (d = 0; d < len; d++) buffer[d + 2] = data[d];
+    Wire.beginTransmission(lastId);
+    Wire.write(buffer, len + 2);
+    return (Wire.endTransmission(true) == 0);
+}
+
+//Acknowledge polling. The chip doesn't ACK its address while an internal write cycle is running.
+bool AT24Backend::isBusy()
+{
+    Wire.beginTransmission(lastId);
+    return (Wire.endTransmission(true) != 0);
+}
+
+SimEEPROMBackend::SimEEPROMBackend(uint32_t writeCycleMicros)
+{
+    data = nullptr;
+    pageWrites = nullptr;
+    writeCycle = writeCycleMicros;
+    busy = false;
+    busyStart = 0;
+    powerLossArmed = false;
+    powered = true;
+    bytesUntilPowerLoss = 0;
+    totalWrites = 0;
+    totalReads = 0;
+}
+
+SimEEPROMBackend::~SimEEPROMBackend()
+{
+    if (data) delete[] data;
+    if (pageWrites) delete[] pageWrites;
+}
+
+//Allocate the storage. A blank chip reads as all 0xFF.
+bool SimEEPROMBackend::begin()
+{
+    if (!data) data = new uint8_t[EEPROM_TOTAL_SIZE];
+    if (!pageWrites) pageWrites = new uint32_t[EEPROM_TOTAL_SIZE / EEPROM_PAGE_SIZE];
+    if (!data || !pageWrites) return false;
+    memset(data, 0xFF, EEPROM_TOTAL_SIZE);
+    memset(pageWrites, 0, sizeof(uint32_t) * (EEPROM_TOTAL_SIZE / EEPROM_PAGE_SIZE));
+    totalWrites = 0;
+    totalReads = 0;
+    return true;
+}
+
+bool SimEEPROMBackend::readPage(uint32_t pageAddr, uint8_t *out)
+{
+    if (!data || !powered || isBusy()) return false; //real chip NAKs while busy
+    if (pageAddr >= (EEPROM_TOTAL_SIZE / EEPROM_PAGE_SIZE)) return false;
+    memcpy(out, data + (pageAddr << 8), EEPROM_PAGE_SIZE);
+    totalReads++;
+    return true;
+}
+
+bool SimEEPROMBackend::write(uint32_t address, const uint8_t *in, uint16_t len)
+{
+    if (!data || !powered || isBusy()) return false;
+    if (address >= EEPROM_TOTAL_SIZE || len > EEPROM_PAGE_SIZE) return false;
+
+    uint32_t pageBase = address & ~(uint32_t)(EEPROM_PAGE_SIZE - 1);
+    uint8_t offset = address & (EEPROM_PAGE_SIZE - 1);
+    for (uint16_t i = 0; i < len; i++)
+    {
+        if (powerLossArmed)
+        {
+            if (bytesUntilPowerLoss == 0)
+            {
+                powered = false;
+                powerLossArmed = false;
+                break;
+            }
+            bytesUntilPowerLoss--;
+        }
+        data[pageBase + offset] = in[i];
+        offset++; //uint8_t so it wraps within the page just like the chip's address counter
+    }
+    pageWrites[pageBase >> 8]++;
+    totalWrites++;
+    busy = true;
+    busyStart = micros();
+    return powered;
+}
+
+bool SimEEPROMBackend::isBusy()
+{
+    if (busy && (micros() - busyStart) >= writeCycle) busy = false;
+    return busy;
+}
+
+void SimEEPROMBackend::injectPowerLoss(uint32_t afterBytes)
+{
+    powerLossArmed = true;
+    bytesUntilPowerLoss = afterBytes;
+}
+
+void SimEEPROMBackend::restorePower()
+{
+    powered = true;
+    powerLossArmed = false;
+    busy = false;
+}
+
+bool SimEEPROMBackend::hasPower()
+{
+    return powered;
+}
+
+uint32_t SimEEPROMBackend::getPageWrites(uint32_t pageAddr)
+{
+    if (!pageWrites || pageAddr >= (EEPROM_TOTAL_SIZE / EEPROM_PAGE_SIZE)) return 0;
+    return pageWrites[pageAddr];
+}
+
+uint32_t SimEEPROMBackend::getTotalWrites()
+{
+    return totalWrites;
+}
+
+uint32_t SimEEPROMBackend::getTotalReads()
+{
+    return totalReads;
+}
+
+uint8_t *SimEEPROMBackend::getRawData()
+{
+    return data;
+}
@@ -0,0 +1,102 @@
+/*
+ * EEPROMBackend.h
+ *
+ * The storage underneath MemCache. The cache only ever asks for whole 256 byte pages to be read
+ * and for a run of bytes within one page to be written so that's all a backend has to provide.
+ * AT24Backend is the real I2C EEPROM on the board. SimEEPROMBackend keeps the whole thing in RAM
+ * and mimics the chip closely enough (write cycle time, writes wrapping within a page, losing power
+ * in the middle of a write) to exercise MemCache, PrefHandler and FaultHandler without hardware.
+ *
+Copyright (c) 2022 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef EEPROM_BACKEND_H_
+#define EEPROM_BACKEND_H_
+
+#include <Arduino.h>
+#include "config.h"
+
+#define EEPROM_PAGE_SIZE        256
+#define EEPROM_TOTAL_SIZE       (256ul * 1024ul)
+
+//Longest write cycle the datasheet allows. Used as an upper bound when waiting on a backend.
+#define EEPROM_MAX_WRITE_MS     10
+
+class EEPROMBackend {
+public:
+    //read the 256 byte page that starts at pageAddr * 256
+    virtual bool readPage(uint32_t pageAddr, uint8_t *data) = 0;
+    //write len bytes at address. Like the real chip, bytes past the end of the page wrap back to its start
+    virtual bool write(uint32_t address, const uint8_t *data, uint16_t len) = 0;
+    //true while the chip is still busy with an internal write cycle
+    virtual bool isBusy() = 0;
+    virtual uint32_t getSize();
+};
+
+//24AA025x / AT24CM02 style I2C EEPROM. The two upper address bits go into the I2C device ID.
+class AT24Backend : public EEPROMBackend {
+public:
+    AT24Backend(uint8_t baseId);
+    bool readPage(uint32_t pageAddr, uint8_t *data);
+    bool write(uint32_t address, const uint8_t *data, uint16_t len);
+    bool isBusy();
+
+private:
+    uint8_t i2cBaseId;
+    uint8_t lastId; //chip select used by the last write. Needed for acknowledge polling
+};
+
+//RAM backed stand in for the EEPROM. Uses 256KB of RAM when begun so don't leave it in production builds.
+class SimEEPROMBackend : public EEPROMBackend {
+public:
+    SimEEPROMBackend(uint32_t writeCycleMicros);
+    ~SimEEPROMBackend();
+    bool begin();
+    bool readPage(uint32_t pageAddr, uint8_t *data);
+    bool write(uint32_t address, const uint8_t *data, uint16_t len);
+    bool isBusy();
+
+    //Simulate losing power after the given number of further bytes have been programmed. The write
+    //in progress at that point is cut short and every write after it is silently dropped (just
+    //like the real chip with no power) until restorePower is called.
+    void injectPowerLoss(uint32_t afterBytes);
+    void restorePower();
+    bool hasPower();
+    uint32_t getPageWrites(uint32_t pageAddr); //write cycles each page has been through (wear)
+    uint32_t getTotalWrites();
+    uint32_t getTotalReads(); //pages read, each one an I2C transfer on the real chip
+    uint8_t *getRawData(); //direct access for tests to inspect or corrupt the contents
+
+private:
+    uint8_t *data;
+    uint32_t *pageWrites;
+    uint32_t writeCycle; //microseconds the chip stays busy after a write
+    uint32_t busyStart;
+    bool busy;
+    bool powerLossArmed;
+    bool powered;
+    uint32_t bytesUntilPowerLoss;
+    uint32_t totalWrites;
+    uint32_t totalReads;
+};
+
+#endif /* EEPROM_BACKEND_H_ */
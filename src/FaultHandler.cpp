@@ -26,6 +26,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "FaultHandler.h"
 #include "eeprom_layout.h"
+#include "PersistJournal.h"
 
 FaultHandler::FaultHandler()
 {
@@ -45,11 +46,12 @@ void FaultHandler::setup()
 }
 
 
-//Every tick update the global time and save it to EEPROM (delayed saving)
+//Every tick update the global time. It goes to the wear leveled journal instead of a fixed
+//EEPROM address as it changes constantly. The journal decides when it actually hits EEPROM.
 void FaultHandler::handleTick()
 {
     globalTime = baseTime + (millis() / 100);
-    memCache->Write(EE_FAULT_LOG + EEFAULT_RUNTIME, globalTime);
+    persistJournal.setValue(JV_RUNTIME, globalTime);
 }
 
 uint16_t FaultHandler::raiseFault(uint16_t device, uint16_t code, bool ongoing = false)
@@ -133,6 +135,8 @@ void FaultHandler::loadFromEEPROM()
         memCache->Read(EE_FAULT_LOG + EEFAULT_READPTR, &faultReadPointer);
         memCache->Read(EE_FAULT_LOG + EEFAULT_WRITEPTR, &faultWritePointer);
         memCache->Read(EE_FAULT_LOG + EEFAULT_RUNTIME, &globalTime);
+        //the journal is much more up to date than the legacy runtime location if it has anything
+        if (persistJournal.isValid()) globalTime = persistJournal.getValue(JV_RUNTIME);
         baseTime = globalTime;
         for (int i = 0; i < CFG_FAULT_HISTORY_SIZE; i++)
         {
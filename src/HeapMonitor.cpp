@@ -0,0 +1,67 @@
+/*
+ * HeapMonitor.cpp
+ *
+ * Counts heap calls and keeps track of how big the heap has gotten
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "HeapMonitor.h"
+#include "Logger.h"
+#include <malloc.h>
+
+static volatile uint32_t heapOps = 0;
+
+//newlib wraps every malloc, free and realloc in these. There are no threads here so the lock
+//itself has nothing to do, this just takes the chance to count.
+extern "C" void __malloc_lock(struct _reent *reent)
+{
+    heapOps++;
+}
+
+extern "C" void __malloc_unlock(struct _reent *reent)
+{
+}
+
+//number of heap calls made since boot
+uint32_t HeapMonitor::getOpCount()
+{
+    return heapOps;
+}
+
+//bytes currently handed out by malloc
+uint32_t HeapMonitor::getInUse()
+{
+    return mallinfo().uordblks;
+}
+
+//The heap never gives memory back to the system so its total size is as big as it has ever needed to be
+uint32_t HeapMonitor::getHighWater()
+{
+    return mallinfo().arena;
+}
+
+void HeapMonitor::printStats()
+{
+    Logger::console("Heap: %u bytes in use, grown to %u bytes at most, %u heap calls since boot", getInUse(), getHighWater(), getOpCount());
+}
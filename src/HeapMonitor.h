@@ -0,0 +1,48 @@
+/*
+ * HeapMonitor.h
+ *
+ * Counts heap calls and keeps track of how big the heap has gotten
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef HEAP_MONITOR_H_
+#define HEAP_MONITOR_H_
+
+#include <Arduino.h>
+
+/*
+There is no heap compaction so anything that allocates and frees over and over during a long drive
+slowly chops up the heap. This gives a way to see that happening. Every malloc, free and realloc goes
+through the newlib malloc lock so counting lock calls counts heap calls. Read the count before and after
+a piece of code and any difference means it touched the heap.
+*/
+class HeapMonitor {
+public:
+    static uint32_t getOpCount();
+    static uint32_t getInUse();
+    static uint32_t getHighWater();
+    static void printStats();
+};
+
+#endif
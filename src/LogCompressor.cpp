@@ -0,0 +1,194 @@
+/*
+ * LogCompressor.cpp
+ *
+ * LZ4 block compression for what goes to the sdcard
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LogCompressor.h"
+#include "Logger.h"
+
+//LZ4 frame: magic, then FLG (version 1, independent blocks), BD (64KB max block) and the header checksum
+const uint8_t LogCompressor::frameHeader[7] = {0x04, 0x22, 0x4D, 0x18, 0x60, 0x40, 0x82};
+const uint8_t LogCompressor::endMark[4] = {0, 0, 0, 0};
+
+#define MIN_MATCH       4
+#define LAST_LITERALS   5 //the format wants the last 5 bytes of a block to be literals
+#define MF_LIMIT        12 //and no match to start in the last 12
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t val;
+    memcpy(&val, p, 4);
+    return val;
+}
+
+static inline uint32_t hashOf(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - LOG_COMPRESS_HASH_BITS);
+}
+
+//lengths of 15 and up carry on in extra bytes of 255 each then the remainder
+static inline uint8_t *putLength(uint8_t *op, size_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+LogCompressor::LogCompressor()
+{
+    used = 0;
+    blocks = 0;
+    rawBytes = compressedBytes = compressCycles = 0;
+    maxCompressCycles = 0;
+}
+
+//Copies in as much as fits in the current block, returns how much that was
+size_t LogCompressor::append(const void *data, size_t len)
+{
+    size_t n = min(len, (size_t)(LOG_COMPRESS_BLOCK - used));
+    memcpy(block + used, data, n);
+    used += n;
+    return n;
+}
+
+size_t LogCompressor::pending()
+{
+    return used;
+}
+
+bool LogCompressor::isFull()
+{
+    return used == LOG_COMPRESS_BLOCK;
+}
+
+/*
+Compresses what has been collected into one frame block, its size first, and starts a new block.
+Returns the bytes of output() to write, 0 if nothing was pending. A block that didn't get any smaller
+is stored as it is which the size word says with its top bit.
+*/
+size_t LogCompressor::compress()
+{
+    if (!used) return 0;
+    uint32_t startCycles = ARM_DWT_CYCCNT;
+    uint32_t size = compressBlock(block, used, out + 4);
+    if (size >= used)
+    {
+        memcpy(out + 4, block, used);
+        size = used;
+        out[3] = 0x80;
+    }
+    else out[3] = 0;
+    out[0] = size;
+    out[1] = size >> 8;
+    out[2] = size >> 16;
+
+    blocks++;
+    rawBytes += used;
+    compressedBytes += size + 4;
+    used = 0;
+    uint32_t cycles = ARM_DWT_CYCCNT - startCycles;
+    compressCycles += cycles;
+    if (cycles > maxCompressCycles) maxCompressCycles = cycles;
+    return size + 4;
+}
+
+const uint8_t *LogCompressor::output()
+{
+    return out;
+}
+
+void LogCompressor::printStats()
+{
+    if (!blocks) return;
+    Logger::console("Compression: %lu blocks, %lu KB down to %lu KB (%lu%%). %lu cycles per block on average, %lu at most",
+                    blocks, (uint32_t)(rawBytes / 1024), (uint32_t)(compressedBytes / 1024),
+                    (uint32_t)(compressedBytes * 100 / rawBytes), (uint32_t)(compressCycles / blocks), maxCompressCycles);
+}
+
+/*
+One LZ4 block. Looks up the last place the next 4 bytes were seen, if they really match there the match is
+stretched both ways and written out with the literals in front of it. Otherwise move on, taking bigger
+steps the longer it has been since the last match so data that won't compress doesn't cost much.
+*/
+size_t LogCompressor::compressBlock(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    uint8_t *op = dst;
+    size_t ip = 0;
+    size_t anchor = 0; //start of the literals not written yet
+
+    if (len > MF_LIMIT)
+    {
+        memset(hashTable, 0, sizeof(hashTable));
+        size_t matchLimit = len - LAST_LITERALS;
+        while (ip + MF_LIMIT <= len)
+        {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hashOf(seq);
+            size_t ref = hashTable[h];
+            hashTable[h] = ip;
+            if (ref >= ip || read32(src + ref) != seq)
+            {
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+            {
+                ip--;
+                ref--;
+            }
+            size_t matchLen = MIN_MATCH;
+            while (ip + matchLen < matchLimit && src[ip + matchLen] == src[ref + matchLen]) matchLen++;
+
+            size_t litLen = ip - anchor;
+            uint8_t *token = op++;
+            *token = (litLen < 15 ? litLen : 15) << 4;
+            if (litLen >= 15) op = putLength(op, litLen - 15);
+            memcpy(op, src + anchor, litLen);
+            op += litLen;
+            uint16_t offset = ip - ref;
+            *op++ = offset;
+            *op++ = offset >> 8;
+            size_t extra = matchLen - MIN_MATCH;
+            *token |= (extra < 15 ? extra : 15);
+            if (extra >= 15) op = putLength(op, extra - 15);
+
+            ip += matchLen;
+            anchor = ip;
+        }
+    }
+
+    size_t litLen = len - anchor;
+    *op++ = (litLen < 15 ? litLen : 15) << 4;
+    if (litLen >= 15) op = putLength(op, litLen - 15);
+    memcpy(op, src + anchor, litLen);
+    op += litLen;
+    return op - dst;
+}
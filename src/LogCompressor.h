@@ -0,0 +1,74 @@
+/*
+ * LogCompressor.h
+ *
+ * LZ4 block compression for what goes to the sdcard
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LOG_COMPRESSOR_H_
+#define LOG_COMPRESSOR_H_
+
+#include <Arduino.h>
+
+#define LOG_COMPRESS_BLOCK      4096 //raw bytes per compressed block
+#define LOG_COMPRESS_HASH_BITS  12
+//worst case for a block that doesn't compress, plus the 4 byte block size in front
+#define LOG_COMPRESS_MAX_OUT    (LOG_COMPRESS_BLOCK + LOG_COMPRESS_BLOCK / 255 + 16 + 4)
+
+/*
+Collects bytes into a block and turns each full block into an LZ4 frame block. The file is a standard LZ4
+frame (independent blocks, no checksums) so "lz4 -d" on a PC reads it, or tools/gvlz4.py. Blocks don't
+depend on each other so if one gets dropped for lack of buffer space the rest still decompress.
+The compressor is the greedy single probe kind, far from the best ratio but text logs still shrink a lot
+and it only ever looks at each byte a couple of times.
+*/
+class LogCompressor {
+public:
+    LogCompressor();
+    size_t append(const void *data, size_t len);
+    size_t pending();
+    bool isFull();
+    size_t compress();
+    const uint8_t *output();
+    void printStats();
+
+    static const uint8_t frameHeader[7];
+    static const uint8_t endMark[4];
+
+private:
+    uint8_t block[LOG_COMPRESS_BLOCK];
+    uint8_t out[LOG_COMPRESS_MAX_OUT];
+    uint16_t hashTable[1 << LOG_COMPRESS_HASH_BITS];
+    uint16_t used;
+
+    uint32_t blocks;
+    uint64_t rawBytes;
+    uint64_t compressedBytes;
+    uint64_t compressCycles;
+    uint32_t maxCompressCycles;
+
+    size_t compressBlock(const uint8_t *src, size_t len, uint8_t *dst);
+};
+
+#endif
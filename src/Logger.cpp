@@ -28,6 +28,12 @@
 The astute might realize that the log level can be set from -1 to 3 not just 0-3.
 -1 level is called avalanche and it is what it says. This is extra debugging.
 You will get a LOT of traffic on the serial console if you do this.
+
+Once the system is up the log calls don't format anything. They copy the timestamp, level, device id,
+format string pointer and the raw arguments into a ring of binary records and return. loop() turns
+those into text for the serial console and the sdcard later. The format string has to be a literal
+(or otherwise stay around), string arguments are copied. Errors still go out right away so the last
+thing before a crash isn't sitting in the ring.
 */
 
 #include "Logger.h"
@@ -35,89 +41,683 @@ You will get a LOT of traffic on the serial console if you do this.
 #include "RingBuf.h"
 #include "DeviceManager.h"
 #include "devices/misc/SystemDevice.h"
+#include "HeapMonitor.h"
+#include "LogCompressor.h"
 
 extern bool sdCardPresent;
 FsFile logFile;
 
-// For efficiency the log has to be preallocated for a certain amount of space.
-//going to try not to do this. We don't need super high throughput for logging
-//and the log file could grow arbitrarily large
-#define LOG_FILE_SIZE 1000000  // 1M bytes.
-
-#define RING_BUF_CAPACITY 16 * 1024
+//Each log file gets this much contiguous space up front so writes never go looking for free clusters.
+//When it's full the log carries on in the next numbered file.
+#define LOG_FILE_SIZE (64ull * 1024 * 1024)
+#define LOG_MAX_WRITE_SECTORS 16 //most sectors written in one loop() pass when there's a backlog
+#define LOG_PARTIAL_INTERVAL 1000 //ms before a less than a sector backlog gets written anyway
+#define LOG_SYNC_INTERVAL 10000 //ms between directory/FAT updates, the data itself is on the card already
+
+#define RING_BUF_CAPACITY 32 * 1024
+//The longest line that gets printed is a full CANFD frame from CanHandler::logFrame(). The prefix is at most
+//"D(4294.967295) " and a 12 character short name in brackets, the frame text "CANFD: bus=2 id=1FFFFFFF dlc=64
+//ide=1 data=" and then up to two hex digits and a comma for each of the 64 bytes.
+#define LOG_PREFIX_SIZE (15 + 12 + 3)
+#define LOG_CANFD_SIZE (43 + 64 * 3)
+#define LOG_LINE_SIZE (LOG_PREFIX_SIZE + LOG_CANFD_SIZE + 1)
 #define LOG_FILENAME "GevcuLog"
+#ifdef CFG_LOG_COMPRESS
+#define LOG_FILE_EXT "lz4"
+#else
+#define LOG_FILE_EXT "txt"
+#endif
+#define LOG_INDEX_FILENAME "GevcuLog.idx"
 #define MAX_LOGFILES 200
 #define CFG_TICK_INTERVAL_SDLOGGING 40000
 
 // RingBuf for File type FsFile.
 RingBuf<FsFile, RING_BUF_CAPACITY> rb;
+#ifdef CFG_LOG_COMPRESS
+static LogCompressor logCompressor; //lines collect here and go into rb a compressed block at a time
+#endif
 
 uint32_t Logger::lastLogTime = 0;
+const int16_t *Logger::systemLevel = nullptr;
+uint8_t Logger::numDeviceLevels = 0;
+int8_t Logger::lowestDeviceLevel = Logger::Default;
+bool Logger::deferred = false;
+bool Logger::draining = false;
+
+//One deferred log message. The arguments follow it packed in the order the format string uses them.
+//Each takes 4 bytes (8 for doubles and long longs), a string is copied in with its terminator and
+//padded out to 4 bytes. A record with length 0 means the rest of the ring is unused, go back to the start.
+struct LogRecord
+{
+    uint16_t length; //whole record including arguments, always a multiple of 4
+    int8_t level;
+    uint8_t reserved;
+    uint16_t deviceId;
+    uint16_t reserved2;
+    uint32_t micros;
+    const char *format;
+};
+
+static uint8_t logRing[CFG_LOG_RING_SIZE] __attribute__((aligned(4)));
+static volatile uint32_t logHead = 0; //where the next record goes
+static volatile uint32_t logTail = 0; //oldest record not formatted yet
+static uint32_t logQueued = 0;
+static uint32_t logSyncDrains = 0; //times the ring filled up and a log call had to format everything itself
+static uint32_t logImmediate = 0; //ring full while already draining so the message went out directly
+static uint32_t logTooBig = 0; //messages with more arguments than a record holds, always sent directly
+static uint32_t logRingHighWater = 0;
+static uint32_t logDeferCycles = 0; //total and worst CPU cycles spent inside defer()
+static uint32_t logDeferMaxCycles = 0;
+static uint32_t logHeapOps = 0; //heap calls made from inside log(), should stay at zero
+
+static uint32_t logIndex = 0; //number of the log file being written this boot
+static uint32_t logIndexToDelete = 0; //old log loop() still has to get rid of, 0 for none
+static uint32_t logStartMicros = 0; //when initializeFile started, right after the card mounted
+static uint32_t logOpenMicros = 0; //how long initializeFile took
+static uint32_t logFirstWriteMicros = 0; //from the card mounting to the first sector going out
+static bool logPreallocated = false;
+static uint32_t logDroppedBytes = 0; //text that didn't fit in the sdcard ring buffer
+static uint64_t logBytesWritten = 0;
+static uint64_t logWriteMicros = 0; //time spent in writeOut, for the throughput figure
+static uint32_t logMaxLoopMicros = 0;
+static uint32_t logRotations = 0;
+
+#ifdef CFG_LOG_COMPRESS
+//Compresses the block collected so far into the sdcard buffer. A block that doesn't fit is dropped whole,
+//the ones after it still decompress.
+static void writeCompressedBlock()
+{
+    size_t raw = logCompressor.pending();
+    size_t len = logCompressor.compress();
+    if (!len) return;
+    if (rb.bytesFree() < len) logDroppedBytes += raw;
+    else rb.write(logCompressor.output(), len);
+}
 
-void Logger::initializeFile()
+static void compressToCard(const char *data, size_t len)
 {
-    char fn1[100];
-    char fn2[100];
-    //basically, rename all files one number higher than they were then start a new log with no numbers
-    //as the current log
-    for (int i = MAX_LOGFILES - 1; i > 0; i--)
+    while (len)
     {
-        snprintf(fn1, 200, "%s%d.txt", LOG_FILENAME, i);
-        snprintf(fn2, 200, "%s%d.txt", LOG_FILENAME, i - 1);
-        SD.sdfs.remove(fn1); //delete any file that may have been there
-        SD.sdfs.rename(fn2, fn1); //rename the file to the name we just (maybe) deleted
+        size_t n = logCompressor.append(data, len);
+        data += n;
+        len -= n;
+        if (logCompressor.isFull()) writeCompressedBlock();
     }
-    snprintf(fn1, 200, "%s1.txt", LOG_FILENAME);
-    snprintf(fn2, 200, "%s.txt", LOG_FILENAME);
-    SD.sdfs.remove(fn1);
-    SD.sdfs.rename(fn2, fn1);
+}
 
-    logFile = SD.sdfs.open(fn2, O_RDWR | O_CREAT | O_TRUNC);
-    if (!logFile) {
-        Serial.println("open failed\n");
+//Lines go into the compressor's block, the sdcard buffer gets them a compressed block at a time
+static void writeToCard(const char *line)
+{
+    compressToCard(line, strlen(line));
+    compressToCard("\r\n", 2);
+}
+#else
+//Puts a line into the buffer going to the sdcard. A line that doesn't fit is counted and thrown away whole
+//instead of leaving half a line in the file.
+static void writeToCard(const char *line)
+{
+    size_t len = strlen(line);
+    if (rb.bytesFree() < len + 2)
+    {
+        logDroppedBytes += len + 2;
         return;
     }
-    else Serial.println("File Opened OK");
-    // File must be pre-allocated to avoid huge
-    // delays searching for free clusters.
-    /*
-    if (!file.preAllocate(LOG_FILE_SIZE)) {
-        Serial.println("preAllocate failed\n");
-        file.close();
-        return;
+    rb.write((const uint8_t *)line, len);
+    rb.write((const uint8_t *)"\r\n", 2);
+}
+#endif
+
+//Skips over the flags, width, precision and length of one conversion, p is just past the '%'.
+//Returns a pointer to the conversion letter. longs counts 'l's, stars counts '*' that take an int argument.
+static const char *scanSpec(const char *p, uint8_t &longs, uint8_t &stars)
+{
+    longs = 0;
+    stars = 0;
+    while (*p && strchr("-+ #0123456789.*hlLzjt", *p))
+    {
+        if (*p == '*') stars++;
+        else if (*p == 'l') longs++;
+        p++;
+    }
+    return p;
+}
+
+static char levelChar(int8_t level)
+{
+    switch (level)
+    {
+    case Logger::Avalanche:
+        return '~';
+    case Logger::Debug:
+        return 'D';
+    case Logger::Info:
+        return 'I';
+    case Logger::Warn:
+        return 'W';
+    case Logger::Error:
+        return 'E';
+    }
+    return '?';
+}
+
+//The level letter, timestamp and device name every log line starts with. The timestamp is done
+//with integers as float formatting can end up in the heap.
+static size_t formatPrefix(char *out, size_t size, int8_t level, uint32_t timeMicros, uint16_t deviceId)
+{
+    size_t len = snprintf(out, size, "%c(%lu.%06lu) ", levelChar(level), (unsigned long)(timeMicros / 1000000ul),
+                          (unsigned long)(timeMicros % 1000000ul));
+    if (deviceId && len < size)
+    {
+        Device *dev = deviceManager.getDeviceByID((DeviceId)deviceId);
+        if (dev) len += snprintf(out + len, size - len, "[%s] ", dev->getShortName());
+        else if (deviceId == CANHANDLER) len += snprintf(out + len, size - len, "[CAN] ");
+        else len += snprintf(out + len, size - len, " ");
+    }
+    if (len >= size) len = size - 1;
+    return len;
+}
+
+//Rebuilds the text of a record the same way log() would have printed it. Each conversion gets its own snprintf
+//with the argument that was saved for it. Returns the length put in out.
+static size_t formatRecord(const LogRecord *rec, char *out, size_t size)
+{
+    size_t len = formatPrefix(out, size, rec->level, rec->micros, rec->deviceId);
+
+    const uint8_t *arg = (const uint8_t *)(rec + 1);
+    const char *p = rec->format;
+    char spec[24];
+    uint8_t longs, stars;
+    while (*p && len < size - 1)
+    {
+        if (*p != '%')
+        {
+            out[len++] = *p++;
+            continue;
+        }
+        const char *start = p;
+        p = scanSpec(p + 1, longs, stars);
+        if (!*p) break;
+
+        //copy the spec, putting the saved numbers in place of any '*'
+        size_t specLen = 0;
+        for (const char *q = start; q <= p && specLen < sizeof(spec) - 1; q++)
+        {
+            if (*q == '*')
+            {
+                int width;
+                memcpy(&width, arg, 4);
+                arg += 4;
+                specLen += snprintf(spec + specLen, sizeof(spec) - specLen, "%d", width);
+                if (specLen > sizeof(spec) - 1) specLen = sizeof(spec) - 1;
+            }
+            else spec[specLen++] = *q;
+        }
+        spec[specLen] = 0;
+
+        int n = 0;
+        switch (*p)
+        {
+        case '%':
+            n = snprintf(out + len, size - len, "%%");
+            break;
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            if (longs >= 2)
+            {
+                long long v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                n = snprintf(out + len, size - len, spec, v);
+            }
+            else if (longs == 1)
+            {
+                long v;
+                memcpy(&v, arg, sizeof(v));
+                arg += (sizeof(v) + 3) & ~3;
+                n = snprintf(out + len, size - len, spec, v);
+            }
+            else
+            {
+                int v;
+                memcpy(&v, arg, sizeof(v));
+                arg += 4;
+                n = snprintf(out + len, size - len, spec, v);
+            }
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        {
+            double v;
+            memcpy(&v, arg, sizeof(v));
+            arg += sizeof(v);
+            n = snprintf(out + len, size - len, spec, v);
+            break;
+        }
+        case 's':
+        {
+            const char *str = (const char *)arg;
+            size_t strSize = strlen(str) + 1;
+            arg += (strSize + 3) & ~3;
+            n = snprintf(out + len, size - len, spec, str);
+            break;
+        }
+        case 'p':
+        {
+            void *v;
+            memcpy(&v, arg, sizeof(v));
+            arg += (sizeof(v) + 3) & ~3;
+            n = snprintf(out + len, size - len, spec, v);
+            break;
+        }
+        }
+        if (n > 0) len += n;
+        if (len > size - 1) len = size - 1;
+        p++;
+    }
+    out[len] = 0;
+    return len;
+}
+
+static void logFileName(char *buf, size_t size, uint32_t index)
+{
+    snprintf(buf, size, "%s%06lu.%s", LOG_FILENAME, (unsigned long)index, LOG_FILE_EXT);
+}
+
+/*
+Every log file is named by a number that only ever goes up, kept in a small index file on the card.
+(The EEPROM isn't up yet this early in boot.) That is a couple of file operations instead of renaming
+every old log one number up. The log MAX_LOGFILES back from the new one gets deleted later by loop()
+so nobody waits on it, and keeping that up keeps the number of logs on the card bounded.
+*/
+static bool openNextLogFile()
+{
+    char fn[40];
+    FsFile idxFile = SD.sdfs.open(LOG_INDEX_FILENAME, O_RDWR | O_CREAT);
+    if (idxFile)
+    {
+        char num[12];
+        int len = idxFile.read(num, sizeof(num) - 1);
+        num[len > 0 ? len : 0] = 0;
+        logIndex = strtoul(num, NULL, 10) + 1;
+    }
+    else logIndex++;
+    //if the index file got lost don't write over logs that are already there
+    logFileName(fn, sizeof(fn), logIndex);
+    while (SD.sdfs.exists(fn)) logFileName(fn, sizeof(fn), ++logIndex);
+    if (idxFile)
+    {
+        char num[12];
+        int len = snprintf(num, sizeof(num), "%lu\n", (unsigned long)logIndex);
+        idxFile.seekSet(0);
+        idxFile.write(num, len);
+        idxFile.truncate();
+        idxFile.close();
     }
-    else Serial.println("File Pre_Alloc OK");
-    */
-    
-    // initialize the RingBuf.
+    if (logIndex > MAX_LOGFILES) logIndexToDelete = logIndex - MAX_LOGFILES;
+
+    logFile = SD.sdfs.open(fn, O_RDWR | O_CREAT | O_TRUNC);
+    if (!logFile) {
+        Serial.println("open failed\n");
+        return false;
+    }
+    Serial.printf("Opened log file %s\n", fn);
+    //Contiguous clusters mean sectors can go out back to back without the FAT being looked at. On FAT32 the
+    //file size is the whole allocation until it is truncated so what was written survives a power cut.
+    logPreallocated = logFile.preAllocate(LOG_FILE_SIZE);
+    if (!logPreallocated) Serial.println("preAllocate failed, log file will grow as it goes");
+#ifdef CFG_LOG_COMPRESS
+    rb.write(LogCompressor::frameHeader, sizeof(LogCompressor::frameHeader));
+#endif
+    return true;
+}
+
+//Gets everything still buffered into the file, cuts the unused preallocated space off the end and closes it
+static void closeLogFile()
+{
+    if (!logFile) return;
+#ifdef CFG_LOG_COMPRESS
+    writeCompressedBlock();
+    rb.write(LogCompressor::endMark, sizeof(LogCompressor::endMark));
+#endif
+    size_t n = rb.bytesUsed();
+    if (n) rb.writeOut(n);
+    if (logPreallocated) logFile.truncate();
+    logFile.close();
+}
+
+void Logger::initializeFile()
+{
+    logStartMicros = micros();
+    // initialize the RingBuf. It only keeps a pointer to logFile so this can come first
     rb.begin(&logFile);
+    if (!openNextLogFile()) return;
     Serial.println("Initialized RingBuff");
+    logOpenMicros = micros() - logStartMicros;
 
     //potentially save the breadcrumbs from the previous crash into the logfile here.
 }
 
-//if there is a sector to write or 1 second has gone by then save the data
+//number of this boot's log file, 0 if there isn't one. Other files written this boot can go by it too
+uint32_t Logger::getLogIndex()
+{
+    return logFile ? logIndex : 0;
+}
+
+/*
+Gets everything waiting, both in the log ring and in the sdcard buffer, into the file then closes it.
+For before a deliberate reboot. Nothing more goes to the card after this.
+*/
+void Logger::closeFile()
+{
+    if (!sdCardPresent || !logFile) return;
+    flush();
+    closeLogFile();
+}
+
+/*
+Writes whole sectors whenever there are any, more than one at a time if a backlog built up so bursts
+don't overrun the buffer. What's left over that isn't a whole sector goes out once a second. The
+directory entry and FAT only get synced every LOG_SYNC_INTERVAL which is where most of the time went
+when it was done after every sector.
+*/
 void Logger::loop()
 {
     static uint32_t lastWriteTime = 0;
-    if (!sdCardPresent) return;
+    static uint32_t lastSyncTime = 0;
+    static bool needSync = false;
+    uint32_t loopStart = micros();
+
+    drain(CFG_LOG_LOOP_BUDGET);
+    if (!sdCardPresent || !logFile) return;
+
+#ifdef CFG_LOG_COMPRESS
+    //a block that hasn't filled goes out at the partial interval too so a quiet log doesn't just sit in RAM
+    if (logCompressor.pending() && (millis() - lastWriteTime) > LOG_PARTIAL_INTERVAL) writeCompressedBlock();
+#endif
+
     size_t n = rb.bytesUsed();
-    int ret = 0;
-    //Serial.println(n);
-    //delay(100);
-    if ( ( (n >= 512) || ((millis() - lastWriteTime) > 1000) ) && !logFile.isBusy()) {
-      // Not busy only allows one sector before possible busy wait.
-      // Write one sector from RingBuf to file.
-      int writeBytes = min(n, 512u);
-      ret = rb.writeOut(writeBytes);
-      if (writeBytes != ret) {
-        Serial.printf("Writeout failed. Want to write %u bytes but wrote %u\n", writeBytes, ret);
-        logFile.close();
-        return;
-      }
-      else logFile.flush(); //make sure it is updated on disk
-      lastWriteTime = millis();
+    size_t writeBytes = 0;
+    if (n >= 512)
+    {
+        //Not busy means one sector can go without waiting. With a bigger backlog write more anyway, a
+        //short wait on the card is better than dropping lines.
+        size_t sectors = n / 512;
+        if (sectors > 1 || !logFile.isBusy())
+            writeBytes = min(sectors, (size_t)LOG_MAX_WRITE_SECTORS) * 512;
+    }
+    else if (n > 0 && (millis() - lastWriteTime) > LOG_PARTIAL_INTERVAL && !logFile.isBusy()) writeBytes = n;
+
+    if (writeBytes)
+    {
+        if (logFile.curPosition() + writeBytes > LOG_FILE_SIZE)
+        {
+            //this one is full, carry on in a new file. Whatever is buffered goes into the old one first so no line
+            //or compressed block gets split between the two. The buffer holds a pointer to logFile so it follows along
+            closeLogFile();
+            logRotations++;
+            openNextLogFile();
+            return;
+        }
+        uint32_t writeStart = micros();
+        size_t ret = rb.writeOut(writeBytes);
+        logWriteMicros += micros() - writeStart;
+        logBytesWritten += ret;
+        if (writeBytes != ret) {
+            Serial.printf("Writeout failed. Want to write %u bytes but wrote %u\n", writeBytes, ret);
+            logFile.close();
+            return;
+        }
+        if (!logFirstWriteMicros) logFirstWriteMicros = micros() - logStartMicros;
+        lastWriteTime = millis();
+        needSync = true;
     }
+    else if (needSync && (millis() - lastSyncTime) > LOG_SYNC_INTERVAL && !logFile.isBusy())
+    {
+        logFile.flush(); //directory entry and FAT
+        lastSyncTime = millis();
+        needSync = false;
+    }
+    else if (logIndexToDelete && !logFile.isBusy())
+    {
+        //nothing to write this time around so use the spare time to clear out the oldest log
+        char fn[40];
+        logFileName(fn, sizeof(fn), logIndexToDelete);
+        SD.sdfs.remove(fn);
+        logIndexToDelete = 0;
+    }
+
+    uint32_t loopTime = micros() - loopStart;
+    if (loopTime > logMaxLoopMicros) logMaxLoopMicros = loopTime;
+}
+
+/*
+ * Turn the deferred logging on or off. Off, every message is formatted and sent by the call that makes it,
+ * which is what boot uses since nothing would drain the ring until loop() starts.
+ */
+void Logger::setDeferred(bool defer)
+{
+    if (!defer) flush();
+    deferred = defer;
+}
+
+/*
+ * Format and send everything waiting in the ring right now
+ */
+void Logger::flush()
+{
+    drain(0xFFFFFFFF);
+}
+
+//Formats records out of the ring until it is empty or the time budget is used up
+void Logger::drain(uint32_t budgetMicros)
+{
+    if (draining) return;
+    draining = true;
+    char buff[LOG_LINE_SIZE];
+    uint32_t start = micros();
+    while (logTail != logHead)
+    {
+        const LogRecord *rec = (const LogRecord *)&logRing[logTail];
+        if (rec->length == 0)
+        {
+            logTail = 0;
+            continue;
+        }
+        formatRecord(rec, buff, sizeof(buff));
+        Serial.println(buff);
+        if (sdCardPresent) writeToCard(buff);
+        logTail = logTail + rec->length; //only let the space go once the text is out
+        if ((micros() - start) > budgetMicros) break;
+    }
+    draining = false;
+}
+
+/*
+ * Saves a log message into the ring without formatting it. Goes through the format string only to find
+ * out which arguments to pull and how big they are. Says whether it was queued, the ring was too full for it
+ * right now, or it has more arguments than a record can ever hold.
+ */
+Logger::DeferResult Logger::defer(DeviceId deviceId, LogLevel level, const char *format, va_list args)
+{
+    uint32_t startCycles = ARM_DWT_CYCCNT;
+    uint8_t record[CFG_LOG_MAX_RECORD] __attribute__((aligned(4)));
+    LogRecord *rec = (LogRecord *)record;
+    rec->level = level;
+    rec->reserved = 0;
+    rec->deviceId = (uint16_t)deviceId;
+    rec->reserved2 = 0;
+    rec->micros = micros();
+    rec->format = format;
+
+    uint8_t *arg = (uint8_t *)(rec + 1);
+    uint8_t *end = record + sizeof(record);
+    const char *p = format;
+    uint8_t longs, stars;
+    while ((p = strchr(p, '%')))
+    {
+        p = scanSpec(p + 1, longs, stars);
+        if (!*p) break;
+        //worst case this conversion needs 8 bytes for each star and the value, strings are cut to fit below
+        if (arg + 8 * (stars + 1) > end) return TooBig;
+        for (int i = 0; i < stars; i++)
+        {
+            int width = va_arg(args, int);
+            memcpy(arg, &width, 4);
+            arg += 4;
+        }
+        switch (*p)
+        {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            if (longs >= 2)
+            {
+                long long v = va_arg(args, long long);
+                memcpy(arg, &v, sizeof(v));
+                arg += sizeof(v);
+            }
+            else if (longs == 1)
+            {
+                long v = va_arg(args, long);
+                memcpy(arg, &v, sizeof(v));
+                arg += (sizeof(v) + 3) & ~3;
+            }
+            else
+            {
+                int v = va_arg(args, int);
+                memcpy(arg, &v, sizeof(v));
+                arg += 4;
+            }
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        {
+            double v = va_arg(args, double);
+            memcpy(arg, &v, sizeof(v));
+            arg += sizeof(v);
+            break;
+        }
+        case 's':
+        {
+            const char *str = va_arg(args, const char *);
+            if (!str) str = "(null)";
+            size_t room = end - arg - 1;
+            size_t strLen = strlen(str);
+            if (strLen > room) strLen = room;
+            memcpy(arg, str, strLen);
+            arg[strLen] = 0;
+            arg += (strLen + 1 + 3) & ~3;
+            break;
+        }
+        case 'p':
+        {
+            void *v = va_arg(args, void *);
+            memcpy(arg, &v, sizeof(v));
+            arg += (sizeof(v) + 3) & ~3;
+            break;
+        }
+        }
+        p++;
+    }
+    uint32_t len = arg - record;
+    rec->length = len;
+
+    //find room for it. The record can't be split so if it doesn't fit at the end it goes to the start.
+    noInterrupts();
+    uint32_t head = logHead;
+    uint32_t tail = logTail;
+    uint32_t pos;
+    if (head >= tail)
+    {
+        if (CFG_LOG_RING_SIZE - head > len) pos = head;
+        else if (tail > len)
+        {
+            ((LogRecord *)&logRing[head])->length = 0;
+            pos = 0;
+        }
+        else
+        {
+            interrupts();
+            return RingFull;
+        }
+    }
+    else if (tail - head > len) pos = head;
+    else
+    {
+        interrupts();
+        return RingFull;
+    }
+    memcpy(&logRing[pos], record, len);
+    logHead = pos + len;
+    logQueued++;
+    uint32_t used = (logHead + CFG_LOG_RING_SIZE - tail) % CFG_LOG_RING_SIZE;
+    if (used > logRingHighWater) logRingHighWater = used;
+    interrupts();
+
+    uint32_t cycles = ARM_DWT_CYCCNT - startCycles;
+    logDeferCycles += cycles;
+    if (cycles > logDeferMaxCycles) logDeferMaxCycles = cycles;
+    return Queued;
+}
+
+void Logger::printStats()
+{
+    Logger::console("Deferred logging is %s. %u messages queued, ring high water %u of %u bytes", deferred ? "on" : "off",
+                    logQueued, logRingHighWater, CFG_LOG_RING_SIZE);
+    Logger::console("Ring filled up %u times (%u messages sent directly), %u messages too big to queue", logSyncDrains, logImmediate, logTooBig);
+    if (logQueued)
+        Logger::console("Queueing took %u cycles on average, %u at worst", logDeferCycles / logQueued, logDeferMaxCycles);
+    Logger::console("Heap calls made while logging: %u", logHeapOps);
+    if (sdCardPresent)
+    {
+        Logger::console("Log file %u opened in %u us, first write %u us after the card mounted", logIndex, logOpenMicros, logFirstWriteMicros);
+        uint32_t kbPerSec = logWriteMicros ? (uint32_t)((logBytesWritten * 1000000ull / logWriteMicros) / 1024) : 0;
+        Logger::console("SD log: %u KB written at %u KB/s, %u bytes dropped, %u file changes, %s", (uint32_t)(logBytesWritten / 1024),
+                        kbPerSec, logDroppedBytes, logRotations, logPreallocated ? "preallocated" : "not preallocated");
+        Logger::console("Longest Logger::loop pass %u us", logMaxLoopMicros);
+#ifdef CFG_LOG_COMPRESS
+        logCompressor.printStats();
+#endif
+    }
+    HeapMonitor::printStats();
+}
+
+/*
+ * Times Logger::debug with four ints, first formatted on the spot like before and then deferred.
+ * Forces the log level to debug while it runs so the calls aren't just filtered out. Then times
+ * the same call with debug turned off.
+ */
+void Logger::benchmark()
+{
+    const int calls = 16;
+    uint32_t cycles[2];
+    int oldLevel = sysConfig ? sysConfig->logLevel : Debug;
+    bool oldDeferred = deferred;
+    setLoglevel(Debug);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        setDeferred(pass == 1);
+        uint32_t start = ARM_DWT_CYCCNT;
+        for (int i = 0; i < calls; i++) Logger::debug("Logger benchmark %i %i %i %i", i, i * 2, i * 3, i * 4);
+        cycles[pass] = (ARM_DWT_CYCCNT - start) / calls;
+    }
+    setDeferred(oldDeferred);
+
+    //and what a debug call costs when debug is off, called directly and through the macros
+    uint32_t offCycles[3];
+    volatile int arg = 1; //so the compiler can't fold the arguments away
+    setLoglevel(Info);
+    uint32_t start = ARM_DWT_CYCCNT;
+    for (int i = 0; i < calls; i++) Logger::debug("Logger benchmark %i %i %i %i", arg, arg, arg, arg);
+    offCycles[0] = (ARM_DWT_CYCCNT - start) / calls;
+    start = ARM_DWT_CYCCNT;
+    for (int i = 0; i < calls; i++) LOG_DEBUG("Logger benchmark %i %i %i %i", arg, arg, arg, arg);
+    offCycles[1] = (ARM_DWT_CYCCNT - start) / calls;
+    start = ARM_DWT_CYCCNT;
+    for (int i = 0; i < calls; i++) LOG_DEV_DEBUG(SYSTEM, "Logger benchmark %i %i %i %i", arg, arg, arg, arg);
+    offCycles[2] = (ARM_DWT_CYCCNT - start) / calls;
+    setLoglevel((LogLevel)oldLevel);
+
+    uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+    Logger::console("Logger::debug with four ints: %u cycles (%u ns) formatted on the spot, %u cycles (%u ns) deferred",
+                    cycles[0], cycles[0] * 1000 / cyclesPerMicro, cycles[1], cycles[1] * 1000 / cyclesPerMicro);
+    Logger::console("Same call with debug off: %u cycles direct, %u through LOG_DEBUG, %u through LOG_DEV_DEBUG",
+                    offCycles[0], offCycles[1], offCycles[2]);
 }
 
 /*
@@ -126,7 +726,7 @@ void Logger::loop()
  * 
  */
 void Logger::avalanche(const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Avalanche) )
+    if (!isEnabled(Avalanche))
         return;
     va_list args;
     va_start(args, message);
@@ -139,7 +739,7 @@ void Logger::avalanche(const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::avalanche(DeviceId deviceId, const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Avalanche) )
+    if (!isEnabled(deviceId, Avalanche))
         return;
     va_list args;
     va_start(args, message);
@@ -153,7 +753,7 @@ void Logger::avalanche(DeviceId deviceId, const char *message, ...) {
  *
  */
 void Logger::debug(const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Debug) )
+    if (!isEnabled(Debug))
         return;
     va_list args;
     va_start(args, message);
@@ -166,7 +766,7 @@ void Logger::debug(const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::debug(DeviceId deviceId, const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Debug) )
+    if (!isEnabled(deviceId, Debug))
         return;
     va_list args;
     va_start(args, message);
@@ -179,7 +779,7 @@ void Logger::debug(DeviceId deviceId, const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::info(const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Info) )
+    if (!isEnabled(Info))
         return;
     va_list args;
     va_start(args, message);
@@ -192,7 +792,7 @@ void Logger::info(const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::info(DeviceId deviceId, const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Info) )
+    if (!isEnabled(deviceId, Info))
         return;
     va_list args;
     va_start(args, message);
@@ -205,7 +805,7 @@ void Logger::info(DeviceId deviceId, const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::warn(const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Warn) )
+    if (!isEnabled(Warn))
         return;
     va_list args;
     va_start(args, message);
@@ -218,7 +818,7 @@ void Logger::warn(const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::warn(DeviceId deviceId, const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Warn) )
+    if (!isEnabled(deviceId, Warn))
         return;
     va_list args;
     va_start(args, message);
@@ -231,7 +831,7 @@ void Logger::warn(DeviceId deviceId, const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::error(const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Error) )
+    if (!isEnabled(Error))
         return;
     va_list args;
     va_start(args, message);
@@ -244,7 +844,7 @@ void Logger::error(const char *message, ...) {
  * printf() style, see Logger::log()
  */
 void Logger::error(DeviceId deviceId, const char *message, ...) {
-    if (sysConfig && (sysConfig->logLevel > Error) )
+    if (!isEnabled(deviceId, Error))
         return;
     va_list args;
     va_start(args, message);
@@ -254,13 +854,13 @@ void Logger::error(DeviceId deviceId, const char *message, ...) {
 
 /*
  * Output a comnsole message with a variable amount of parameters
- * printf() style, see Logger::logMessage()
+ * printf() style, see Logger::log()
  */
 void Logger::console(const char *message, ...) {
     va_list args;
     va_start(args, message);
-    char buff[200];
-    vsprintf(buff, message, args);
+    char buff[LOG_LINE_SIZE];
+    vsnprintf(buff, sizeof(buff), message, args);
     Serial.println(buff);
     va_end(args);
 }
@@ -304,67 +904,103 @@ boolean Logger::isDebug() {
 }
 
 /*
- * Output a log message (called by debug(), info(), warn(), error(), console())
- *
- * Supports printf() like syntax:
- *
+ * The system device hands over where its log level lives once it has loaded so the inline
+ * isEnabled() checks can see it without going through sysConfig.
  */
-void Logger::log(DeviceId deviceId, LogLevel level, const char *format, va_list args) {
-    lastLogTime = millis();
-    uint32_t thisTime = micros();
-    String outputString;// = String(lastLogTime) + " - ";
+void Logger::attachSystemLevel(const int16_t *level) {
+    systemLevel = level;
+}
+
+//Devices that have their own level. Small enough that a straight search is fine.
+struct DeviceLogLevel
+{
+    DeviceId id;
+    int8_t level;
+};
+static DeviceLogLevel deviceLevels[CFG_LOG_DEVICE_LEVELS];
 
-    switch (level) {
-    case Off:
+/*
+ * Give a device its own log level, or Default to have it follow the system level again.
+ */
+void Logger::setDeviceLogLevel(DeviceId deviceId, LogLevel level) {
+    int idx = 0;
+    while (idx < numDeviceLevels && deviceLevels[idx].id != deviceId) idx++;
+    if (level == Default)
+    {
+        if (idx < numDeviceLevels) deviceLevels[idx] = deviceLevels[--numDeviceLevels];
+    }
+    else if (idx < numDeviceLevels) deviceLevels[idx].level = level;
+    else if (numDeviceLevels < CFG_LOG_DEVICE_LEVELS)
+    {
+        deviceLevels[numDeviceLevels].id = deviceId;
+        deviceLevels[numDeviceLevels].level = level;
+        numDeviceLevels++;
+    }
+    else
+    {
+        Logger::error("No room for another device log level (%X)", deviceId);
         return;
-        break;
-    case Avalanche:
-        outputString += "~";
-        break;
-    case Debug:
-        //Serial.print("D");
-        outputString += "D";
-        break;
-    case Info:
-        //Serial.print("I");
-        outputString += "I";
-        break;
-    case Warn:
-        //Serial.print("W");
-        outputString += "W";
-        break;
-    case Error:
-        //Serial.print("E");
-        outputString += "E";
-        break;
     }
-    char buff[200];
-    snprintf(buff, 200, "(%f) ", thisTime / 1000000.0f);
-    outputString += buff;
 
-    if (deviceId)
-        outputString += printDeviceName(deviceId);
-        //Serial.print(printDeviceName(deviceId));
+    lowestDeviceLevel = Default;
+    for (int i = 0; i < numDeviceLevels; i++)
+        if (deviceLevels[i].level < lowestDeviceLevel) lowestDeviceLevel = deviceLevels[i].level;
+}
 
-    //outputString += logMessage(format, args);
-    //Serial.println(outputString);
-    vsnprintf(buff, 200, format, args);
-    outputString += buff;
-    //outputString += "\n";
-    Serial.println(outputString);
-    if (sdCardPresent) rb.println(outputString);
+Logger::LogLevel Logger::getDeviceLogLevel(DeviceId deviceId) {
+    for (int i = 0; i < numDeviceLevels; i++)
+        if (deviceLevels[i].id == deviceId) return (LogLevel)deviceLevels[i].level;
+    return Default;
 }
 
-/*
- * When the deviceId is specified when calling the logger, print the name
- * of the device after the log-level. This makes it easier to identify the
- * source of the logged message.
- */
-String Logger::printDeviceName(DeviceId deviceId) {
-    Device *dev = deviceManager.getDeviceByID(deviceId);
-    if (!dev) return String(" ");
-    String devString = String("[") + dev->getShortName() + String("] ");
-    return devString;
+bool Logger::checkDeviceLevel(DeviceId deviceId, LogLevel level) {
+    for (int i = 0; i < numDeviceLevels; i++)
+        if (deviceLevels[i].id == deviceId) return level >= deviceLevels[i].level;
+    return isEnabled(level);
 }
 
+/*
+ * Output a log message (called by debug(), info(), warn(), error(), console())
+ *
+ * Supports printf() like syntax:
+ *
+ */
+void Logger::log(DeviceId deviceId, LogLevel level, const char *format, va_list args) {
+    if (level == Off) return;
+    uint32_t heapOpsStart = HeapMonitor::getOpCount();
+    lastLogTime = millis();
+    bool queued = false;
+    if (deferred && level != Error)
+    {
+        //defer() uses up its copy of the arguments and they may be needed again below
+        va_list argsCopy;
+        va_copy(argsCopy, args);
+        DeferResult result = defer(deviceId, level, format, argsCopy);
+        va_end(argsCopy);
+        //ring is full. Empty it here so the order stays right, unless this interrupted a drain already going
+        if (result == RingFull && !draining)
+        {
+            logSyncDrains++;
+            flush();
+            va_copy(argsCopy, args);
+            result = defer(deviceId, level, format, argsCopy);
+            va_end(argsCopy);
+        }
+        queued = (result == Queued);
+        if (result == TooBig) logTooBig++; //would never fit no matter how empty the ring is
+        else if (!queued) logImmediate++;
+    }
+    //errors go out right away, but not ahead of the messages queued before them
+    else if (deferred && !draining) flush();
 
+    if (!queued)
+    {
+        //everything is built on the stack, nothing in here should touch the heap
+        char buff[LOG_LINE_SIZE];
+        size_t len = formatPrefix(buff, sizeof(buff), level, micros(), deviceId);
+        vsnprintf(buff + len, sizeof(buff) - len, format, args);
+        Serial.println(buff);
+        if (sdCardPresent) writeToCard(buff);
+    }
+    logHeapOps += HeapMonitor::getOpCount() - heapOpsStart;
+}
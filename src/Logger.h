@@ -35,7 +35,8 @@
 class Logger {
 public:
     enum LogLevel {
-        Avalanche = -1, Debug = 0, Info = 1, Warn = 2, Error = 3, Off = 4
+        Avalanche = -1, Debug = 0, Info = 1, Warn = 2, Error = 3, Off = 4,
+        Default = 5 //only for a device's own level, means it follows the system level
     };
     static void avalanche(const char *, ...);
     static void avalanche(DeviceId, const char *, ...);
@@ -52,16 +53,66 @@ public:
     static LogLevel getLogLevel();
     static uint32_t getLastLogTime();
     static boolean isDebug();
+    static void attachSystemLevel(const int16_t *level);
+    static void setDeviceLogLevel(DeviceId, LogLevel);
+    static LogLevel getDeviceLogLevel(DeviceId);
+
+    //Would a message at this level go out? Inline so a log call that's turned off costs a compare or two.
+    static inline bool isEnabled(LogLevel level)
+    {
+        return !systemLevel || level >= *systemLevel;
+    }
+
+    //Same but a device with its own level set uses that instead of the system level
+    static inline bool isEnabled(DeviceId deviceId, LogLevel level)
+    {
+        if (!numDeviceLevels) return isEnabled(level);
+        if (level < lowestDeviceLevel && !isEnabled(level)) return false;
+        return checkDeviceLevel(deviceId, level);
+    }
     static void initializeFile();
+    static void closeFile();
+    static uint32_t getLogIndex();
     static void loop();
+    static void setDeferred(bool);
+    static void flush();
+    static void printStats();
+    static void benchmark();
 private:
     static uint32_t lastLogTime;
+    static const int16_t *systemLevel; //points at the system device's LOGLEVEL once it has loaded
+    static uint8_t numDeviceLevels;
+    static int8_t lowestDeviceLevel; //lowest level any device has been given
+    static bool deferred;
+    static bool draining;
 
+    enum DeferResult { Queued, RingFull, TooBig };
     static void log(DeviceId, LogLevel, const char *format, va_list);
-    static String logMessage(const char *format, va_list args);
-    static String printDeviceName(DeviceId);
+    static DeferResult defer(DeviceId, LogLevel, const char *format, va_list);
+    static void drain(uint32_t budgetMicros);
+    static bool checkDeviceLevel(DeviceId, LogLevel);
 };
 
+/*
+Use these instead of calling Logger directly anywhere a message could come often, like once per CAN frame.
+When the level is off the arguments aren't even worked out, and anything below CFG_LOG_MIN_LEVEL drops
+out at compile time. The _DEV versions go by that device's own level if it has one.
+*/
+#define LOG_AT(level, fn, ...) do { if ((level) >= CFG_LOG_MIN_LEVEL && Logger::isEnabled(level)) Logger::fn(__VA_ARGS__); } while (0)
+#define LOG_DEV_AT(level, fn, id, ...) do { if ((level) >= CFG_LOG_MIN_LEVEL && Logger::isEnabled((DeviceId)(id), level)) \
+    Logger::fn((DeviceId)(id), __VA_ARGS__); } while (0)
+
+#define LOG_AVALANCHE(...) LOG_AT(Logger::Avalanche, avalanche, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(Logger::Debug, debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(Logger::Info, info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(Logger::Warn, warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(Logger::Error, error, __VA_ARGS__)
+#define LOG_DEV_AVALANCHE(id, ...) LOG_DEV_AT(Logger::Avalanche, avalanche, id, __VA_ARGS__)
+#define LOG_DEV_DEBUG(id, ...) LOG_DEV_AT(Logger::Debug, debug, id, __VA_ARGS__)
+#define LOG_DEV_INFO(id, ...) LOG_DEV_AT(Logger::Info, info, id, __VA_ARGS__)
+#define LOG_DEV_WARN(id, ...) LOG_DEV_AT(Logger::Warn, warn, id, __VA_ARGS__)
+#define LOG_DEV_ERROR(id, ...) LOG_DEV_AT(Logger::Error, error, id, __VA_ARGS__)
+
 #endif /* LOGGER_H_ */
 
 
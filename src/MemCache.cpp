@@ -25,12 +25,38 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "MemCache.h"
+#include "DeviceManager.h"
 #include <Watchdog_t4.h>
 
 extern WDT_T4<WDT3> wdt;
 
+//The real EEPROM on GEVCU7. 10100 is the chip ID, the two upper address bits are added to it per access.
+static AT24Backend defaultBackend(0b01010000);
+
 MemCache::MemCache()
 {
+    backend = &defaultBackend;
+    resetStats();
+}
+
+//Run the cache on top of some other storage. Mostly useful to put SimEEPROMBackend underneath for testing.
+MemCache::MemCache(EEPROMBackend *storage)
+{
+    backend = storage ? storage : &defaultBackend;
+    resetStats();
+}
+
+EEPROMBackend *MemCache::getBackend()
+{
+    return backend;
+}
+
+//Wait for the EEPROM to finish its internal write cycle. Polls the chip so it returns as soon as the
+//write is actually done (typically ~5ms) instead of always sitting out the worst case.
+void MemCache::waitWriteComplete()
+{
+    uint32_t start = millis();
+    while (backend->isBusy() && (millis() - start) <= EEPROM_MAX_WRITE_MS) ;
 }
 
 void MemCache::setup() {
@@ -39,12 +65,101 @@ void MemCache::setup() {
         pages[c].address = 0xFFFFFF; //maximum number. This is way over what our chip will actually support so it signals unused
         pages[c].age = 0;
         pages[c].dirty = false;
+        pages[c].dirtyLow = 0;
+        pages[c].dirtyHigh = 0;
     }
     //WriteTimer = 0;
 
+    registerStatusEntries();
+
     tickHandler.attach(this, CFG_TICK_INTERVAL_MEM_CACHE);
 }
 
+//The memory cache isn't a device but its counters are useful to anyone watching status entries
+//so they're registered on behalf of the system device.
+void MemCache::registerStatusEntries()
+{
+    Device *sysDev = deviceManager.getDeviceByID(SYSTEM);
+    if (!sysDev) return;
+    StatusEntry stat;
+    //        name                  var                    type                       obj
+    stat = {"CACHE_Hits", &stats.hits, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_Misses", &stats.misses, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_Evictions", &stats.evictions, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_DirtyEvictions", &stats.dirtyEvictions, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_Flushes", &stats.flushes, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_BytesWritten", &stats.bytesWritten, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_BlockedMicros", &stats.blockedMicros, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+    stat = {"CACHE_WriteFailures", &stats.writeFailures, CFG_ENTRY_VAR_TYPE::UINT32, sysDev};
+    deviceManager.addStatusEntry(stat);
+}
+
+const MemCacheStats *MemCache::getStats()
+{
+    return &stats;
+}
+
+void MemCache::resetStats()
+{
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.evictions = 0;
+    stats.dirtyEvictions = 0;
+    stats.flushes = 0;
+    stats.bytesWritten = 0;
+    stats.bytesRead = 0;
+    stats.blockedMicros = 0;
+    stats.writeFailures = 0;
+    for (int i = 0; i < EEPROM_NUM_PAGES; i++) accessMap[i] = 0;
+}
+
+//Dump the counters and the most used EEPROM pages to the console
+void MemCache::printStats()
+{
+    uint32_t total = stats.hits + stats.misses;
+    int numUsed = 0, numDirty = 0;
+
+    for (int c = 0; c < NUM_CACHED_PAGES; c++)
+    {
+        if (pages[c].address != 0xFFFFFF) numUsed++;
+        if (pages[c].dirty) numDirty++;
+    }
+
+    Logger::console("Memory cache: %i of %i pages used, %i dirty", numUsed, NUM_CACHED_PAGES, numDirty);
+    Logger::console("Hits: %u  Misses: %u  Hit rate: %.1f%%", stats.hits, stats.misses, total ? (100.0f * stats.hits) / total : 0.0f);
+    Logger::console("Evictions: %u  Dirty evictions: %u", stats.evictions, stats.dirtyEvictions);
+    Logger::console("Flushes: %u  Bytes written: %u  Bytes read: %u", stats.flushes, stats.bytesWritten, stats.bytesRead);
+    Logger::console("Time blocked on I2C: %u ms  Failed writes: %u", stats.blockedMicros / 1000, stats.writeFailures);
+
+    //Show the ten hottest pages. Simple repeated selection is fine for something run by hand.
+    Logger::console("Most accessed EEPROM pages:");
+    uint32_t lastCount = 0xFFFFFFFFul;
+    int lastPage = -1;
+    for (int n = 0; n < 10; n++)
+    {
+        int best = -1;
+        for (int p = 0; p < EEPROM_NUM_PAGES; p++)
+        {
+            if (accessMap[p] == 0) continue;
+            //strictly below the last one shown, or equal but later in the list so ties all get shown
+            if (accessMap[p] > lastCount || (accessMap[p] == lastCount && p <= lastPage)) continue;
+            if (best == -1 || accessMap[p] > accessMap[best]) best = p;
+        }
+        if (best == -1) break;
+        Logger::console("   Page %4i (addr 0x%05X): %u", best, best << 8, accessMap[best]);
+        lastCount = accessMap[best];
+        lastPage = best;
+    }
+}
+
+
 
 //Handle aging of dirty pages and flushing of aged out dirty pages
 void MemCache::handleTick()
@@ -66,10 +181,7 @@ void MemCache::FlushSinglePage()
     int c;
     for (c = 0; c<NUM_CACHED_PAGES; c++) {
         if (pages[c].dirty) {
-            cache_writepage(c);
-            pages[c].dirty = false;
-            pages[c].age = 0; //freshly flushed!
-            delay(10); //naughty! But, for testing we'll allow it. TODO: switch to non-blocking wait
+            cache_flush(c); //naughty, it waits out the write cycle! TODO: switch to non-blocking wait
             return;
         }
     }
@@ -82,9 +194,7 @@ void MemCache::FlushAllPages()
     int c;
     for (c = 0; c < NUM_CACHED_PAGES; c++) {
         if (pages[c].dirty) { //found a dirty page so flush it
-            cache_writepage(c);
-            pages[c].dirty = false;
-            delay(10); //10ms is longest it would take to write a page according to datasheet
+            cache_flush(c); //10ms is longest it would take to write a page according to datasheet
             wdt.feed();
         }
     }
@@ -92,12 +202,7 @@ void MemCache::FlushAllPages()
 
 //Flush a given page by the page ID. This is NOT by address so act accordingly. Likely no external code should ever use this
 void MemCache::FlushPage(uint8_t page) {
-    if (pages[page].dirty) {
-        cache_writepage(page);
-        pages[page].dirty = false;
-        pages[page].age = 0; //freshly flushed!
-        delay(10);
-    }
+    if (pages[page].dirty) cache_flush(page);
 }
 
 //Flush a page by taking an address within the page.
@@ -110,14 +215,19 @@ void MemCache::FlushAddress(uint32_t address) {
     if (c != 0xFF) FlushPage(c);
 }
 
+//True if the page holding this address is in the cache with changes not yet written to EEPROM.
+//Lets callers wait for the background flush instead of forcing a blocking one.
+boolean MemCache::IsAddressDirty(uint32_t address)
+{
+    uint8_t c = cache_hit(address >> 8);
+    return (c != 0xFF && pages[c].dirty);
+}
+
 //Like FlushPage but also marks the page invalid (unused) so if another read request comes it it'll have to be re-read from EEPROM
 void MemCache::InvalidatePage(uint8_t page)
 {
     if (page > NUM_CACHED_PAGES - 1) return; //invalid page, buddy!
-    if (pages[page].dirty) {
-        cache_writepage(page);
-        delay(10);
-    }
+    if (pages[page].dirty && !cache_flush(page)) return; //keep it, dropping it would lose the changes
     pages[page].dirty = false;
     pages[page].address = 0xFFFFFF;
     pages[page].age = 0;
@@ -175,13 +285,13 @@ boolean MemCache::Write(uint32_t address, uint8_t valu)
 
     addr = address >> 8; //kick it down to the page we're talking about
     c = cache_hit(addr);
+    cache_count(addr, c != 0xFF);
     if (c == 0xFF) 	{
-        c = cache_findpage(); //try to free up a page
-        if (c != 0xFF) c = cache_readpage(addr); //and populate it with the existing data
+        c = cache_readpage(addr, cache_findpage()); //free up a page and populate it with the existing data
     }
     if (c != 0xFF) {
         pages[c].data[(uint16_t)(address & 0x00FF)] = valu;
-        pages[c].dirty = true;
+        cache_markdirty(c, (uint8_t)(address & 0x00FF));
         pages[c].address = addr; //set this in case we actually are setting up a new cache page
         return true;
     }
@@ -219,19 +329,20 @@ boolean MemCache::Write(uint32_t address, double valu)
 boolean MemCache::Write(uint32_t address, const void* data, uint16_t len)
 {
     uint32_t addr;
-    uint8_t c;
+    uint8_t c = 0; //nothing to do for len 0, which counts as done
     uint16_t count;
 
     for (count = 0; count < len; count++) {
         addr = (address+count) >> 8; //kick it down to the page we're talking about
         c = cache_hit(addr);
+        if (count == 0 || ((address + count) & 0xFF) == 0) cache_count(addr, c != 0xFF); //first byte on this page
         if (c == 0xFF) {
-            c = cache_findpage(); //try to find a page that either isn't loaded or isn't dirty
-            if (c != 0xFF) c = cache_readpage(addr); //and populate it with the existing data
+            //find a page that either isn't loaded or isn't dirty and populate it with the existing data
+            c = cache_readpage(addr, cache_findpage());
         }
         if (c != 0xFF) { //could we find a suitable cache page to write to?
             pages[c].data[(uint16_t)((address+count) & 0x00FF)] = *(uint8_t *)( ((uint8_t *)data) + count);
-            pages[c].dirty = true;
+            cache_markdirty(c, (uint8_t)((address+count) & 0x00FF));
             pages[c].address = addr; //set this in case we actually are setting up a new cache page
         }
         else break;
@@ -248,9 +359,10 @@ boolean MemCache::Read(uint32_t address, uint8_t* valu)
 
     addr = address >> 8; //kick it down to the page we're talking about
     c = cache_hit(addr);
+    cache_count(addr, c != 0xFF);
 
     if (c == 0xFF) { //page isn't cached. Search the cache, potentially dump a page and bring this one in
-        c = cache_readpage(addr);
+        c = cache_readpage(addr, cache_findpage());
     }
 
     if (c != 0xFF) {
@@ -294,14 +406,15 @@ boolean MemCache::Read(uint32_t address, double* valu)
 boolean MemCache::Read(uint32_t address, void* data, uint16_t len)
 {
     uint32_t addr;
-    uint8_t c;
+    uint8_t c = 0; //nothing to do for len 0, which counts as done
     uint16_t count;
 
     for (count = 0; count < len; count++) {
         addr = (address + count) >> 8;
         c = cache_hit(addr);
+        if (count == 0 || ((address + count) & 0xFF) == 0) cache_count(addr, c != 0xFF); //first byte on this page
         if (c == 0xFF) { //page isn't cached. Search the cache, potentially dump a page and bring this one in
-            c = cache_readpage(addr);
+            c = cache_readpage(addr, cache_findpage());
         }
         if (c != 0xFF) {
             *(uint8_t *)( ((uint8_t *)data) + count) = pages[c].data[(uint16_t)((address + count) & 0x00FF)];
@@ -331,6 +444,28 @@ uint8_t MemCache::cache_hit(uint32_t address)
     return 0xFF;
 }
 
+//Record a hit or miss for an access to the given EEPROM page (address >> 8)
+void MemCache::cache_count(uint32_t addr, bool hit)
+{
+    if (hit) stats.hits++;
+    else stats.misses++;
+    if (addr < EEPROM_NUM_PAGES && accessMap[addr] < 0xFFFF) accessMap[addr]++;
+}
+
+//Widen the dirty span of a page to include the given offset and flag the page as dirty
+void MemCache::cache_markdirty(uint8_t page, uint8_t offset)
+{
+    if (!pages[page].dirty)
+    {
+        pages[page].dirty = true;
+        pages[page].dirtyLow = offset;
+        pages[page].dirtyHigh = offset;
+        return;
+    }
+    if (offset < pages[page].dirtyLow) pages[page].dirtyLow = offset;
+    if (offset > pages[page].dirtyHigh) pages[page].dirtyHigh = offset;
+}
+
 void MemCache::cache_age()
 {
     uint8_t c;
@@ -363,6 +498,7 @@ uint8_t MemCache::cache_findpage()
         }
     }
     if (old_c == 0xFF) { //no pages were not dirty - try to free one up
+        stats.dirtyEvictions++;
         FlushSinglePage(); //try to free up a page
         //now try to find the free page (if one was freed)
         old_v = 0;
@@ -376,6 +512,7 @@ uint8_t MemCache::cache_findpage()
     }
 
     //If we got to this point then we have a page to use
+    stats.evictions++;
     pages[old_c].age = 0;
     pages[old_c].dirty = false;
     pages[old_c].address = 0xFFFFFF; //mark it unused
@@ -383,32 +520,21 @@ uint8_t MemCache::cache_findpage()
     return old_c;
 }
 
-uint8_t MemCache::cache_readpage(uint32_t addr)
+//Load an EEPROM page into the cache slot picked by cache_findpage. Takes the slot instead of finding one
+//itself so a miss only goes through the eviction logic (and its stats) once.
+uint8_t MemCache::cache_readpage(uint32_t addr, uint8_t c)
 {
-    uint16_t c,d,e;
-    uint32_t address = addr << 8;
-    uint8_t buffer[3];
-    uint8_t i2c_id;
-    c = cache_findpage();
     Logger::avalanche("ReadPage");
     if (c != 0xFF) {
-        buffer[0] = ((address & 0xFF00) >> 8);
-        //buffer[1] = (address & 0x00FF);
-        buffer[1] = 0; //the pages are 256 bytes so the start of a page is always 00 for the LSB
-        i2c_id = 0b01010000 + ((address >> 16) & 0x03); //10100 is the chip ID then the two upper bits of the address
-        Wire.beginTransmission(i2c_id);
-        Wire.write(buffer, 2);
-        Wire.endTransmission(false); //do NOT generate stop
-        //delayMicroseconds(50); //give TWI some time to send and chip some time to get page
-        Wire.requestFrom(i2c_id, 256); //this will generate stop though.
-        for (e = 0; e < 256; e++)
+        uint32_t startMicros = micros();
+        bool ok = backend->readPage(addr, pages[c].data);
+        stats.blockedMicros += micros() - startMicros;
+        if (!ok)
         {
-            if(Wire.available())
-            {
-                d = Wire.read(); // receive a byte as character
-                pages[c].data[e] = d;
-            }
+            Logger::error("EEPROM read of page %u failed", addr);
+            return 0xFF; //page was already marked unused by cache_findpage
         }
+        stats.bytesRead += EEPROM_PAGE_SIZE;
         pages[c].address = addr;
         pages[c].age = 0;
         pages[c].dirty = false;
@@ -416,23 +542,43 @@ uint8_t MemCache::cache_readpage(uint32_t addr)
     return c;
 }
 
+//Writes only the dirty span of the page. The EEPROM page is 256 bytes as well so a span that starts
+//partway into the page never wraps. A single changed byte now costs 3 bytes on the bus instead of 258.
+//Blocked time is accounted by the callers as they also wait out the write cycle
 boolean MemCache::cache_writepage(uint8_t page)
 {
-    uint16_t d;
-    uint32_t addr;
-    uint8_t buffer[258];
-    uint8_t i2c_id;
-    addr = pages[page].address << 8;
-    buffer[0] = ((addr & 0xFF00) >> 8);
-    //buffer[1] = (addr & 0x00FF);
-    buffer[1] = 0; //pages are 256 bytes so LSB is always 0 for the start of a page
-    i2c_id = 0b01010000 + ((addr >> 16) & 0x03); //10100 is the chip ID then the two upper bits of the address
-    for (d = 0; d < 256; d++) {
-        buffer[d + 2] = pages[page].data[d];
+    uint16_t len;
+    uint8_t low = 0;
+    uint8_t high = 255;
+
+    if (pages[page].dirty)
+    {
+        low = pages[page].dirtyLow;
+        high = pages[page].dirtyHigh;
     }
-    Wire.beginTransmission(i2c_id);
-    Wire.write(buffer, 258);
-    Wire.endTransmission(true);
+    len = (uint16_t)(high - low) + 1;
+    stats.flushes++;
+    stats.bytesWritten += len;
+    return backend->write((pages[page].address << 8) + low, &pages[page].data[low], len);
+}
+
+//Write a dirty page out and wait for the chip to finish with it. Only a write the chip took makes the page
+//clean. If it didn't (NAK, bus trouble) the page stays dirty and gets another go once it has aged out again
+//instead of hammering a chip that isn't answering every tick.
+boolean MemCache::cache_flush(uint8_t page)
+{
+    uint32_t startMicros = micros();
+    boolean ok = cache_writepage(page);
+    waitWriteComplete();
+    stats.blockedMicros += micros() - startMicros;
+    pages[page].age = 0; //freshly flushed, or at least tried
+    if (!ok)
+    {
+        stats.writeFailures++;
+        Logger::error("EEPROM write of page %u failed", pages[page].address);
+        return false;
+    }
+    pages[page].dirty = false;
     return true;
 }
 
@@ -442,29 +588,21 @@ boolean MemCache::cache_writepage(uint8_t page)
 
 void MemCache::nukeFromOrbit()
 {
-    uint16_t d;
-    uint32_t addr;
-    uint8_t buffer[258];
-    uint8_t i2c_id;
+    uint8_t buffer[EEPROM_PAGE_SIZE];
 
-    for (d = 0; d < 256; d++) buffer[d+2] = 0xFF;
+    memset(buffer, 0xFF, EEPROM_PAGE_SIZE);
 
-    for (int page = 0; page < 1024; page++)
+    for (uint32_t page = 0; page < (backend->getSize() / EEPROM_PAGE_SIZE); page++)
     {
-        addr = page * 256;
-        buffer[0] = ((addr & 0xFF00) >> 8);
-        buffer[1] = 0; //pages are 256 bytes so LSB is always 0 for the start of a page
-        i2c_id = 0b01010000 + ((addr >> 16) & 0x03); //10100 is the chip ID then the two upper bits of the address
-        Wire.beginTransmission(i2c_id);
-        Wire.write(buffer, 258);
-        Wire.endTransmission(true);
-        delay(11);
+        backend->write(page * EEPROM_PAGE_SIZE, buffer, EEPROM_PAGE_SIZE);
+        waitWriteComplete();
         wdt.feed();
     }
     //system should be forceably rebooted here to ensure nothing tries to write to eeprom
     //or access anything.
     //TODO: this is rather violent. In most cases there should be a soft shutdown where we try to signal everyone
     //that the ship is about to sink.
+    Logger::closeFile();
     REBOOT;
 }
 
@@ -33,6 +33,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "config.h"
 #include "TickHandler.h"
 #include "i2c_driver_wire.h"
+#include "EEPROMBackend.h"
 
 //Total # of allowable pages to cache. Limits RAM usage
 //note that a page is 256 bytes so 4 pages is a kilobyte. Don't go nuts here
@@ -56,10 +57,27 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define CFG_TICK_INTERVAL_MEM_CACHE                 40000
 
+//Total number of 256 byte pages in the EEPROM chip (256KB)
+#define EEPROM_NUM_PAGES   1024
+
 //Current parameters as of 26th of August 2021 = 128 * 40ms * 60 = 307.2 seconds to flush = about 10 years EEPROM life
 //Note that this is 10 years STRAIGHT. As in, you never turned it off for 10 years and every chance it got it wrote the page.
 //This should be plenty of EEPROM life.
 
+//Running counters to judge how well the cache is sized and tuned. Everything counts up from boot
+//(or the last resetStats call). Hits and misses are counted once per page touched by an access, not per byte.
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions; //a loaded page had to be dropped to make room for another
+    uint32_t dirtyEvictions; //room could only be made by writing out a dirty page first
+    uint32_t flushes; //number of page write transactions sent to EEPROM
+    uint32_t bytesWritten; //data bytes sent to EEPROM (not counting the 2 address bytes)
+    uint32_t bytesRead; //data bytes read from EEPROM
+    uint32_t blockedMicros; //time spent waiting on I2C transfers and EEPROM write cycles
+    uint32_t writeFailures; //page writes the EEPROM didn't take. The page stays dirty and is tried again
+} MemCacheStats;
+
 class MemCache: public TickObserver {
 public:
     void setup();
@@ -73,7 +91,11 @@ public:
     void InvalidateAll();
     void AgeFullyPage(uint8_t page);
     void AgeFullyAddress(uint32_t address);
+    boolean IsAddressDirty(uint32_t address);
     void nukeFromOrbit();
+    const MemCacheStats *getStats();
+    void resetStats();
+    void printStats();
 
     boolean Write(uint32_t address, uint8_t valu);
     boolean Write(uint32_t address, uint16_t valu);
@@ -91,23 +113,39 @@ public:
     boolean Read(uint32_t address, void* data, uint16_t len);
 
     MemCache();
+    MemCache(EEPROMBackend *storage);
+    EEPROMBackend *getBackend();
 
 private:
+    //dirtyLow and dirtyHigh bound the bytes changed since the page was loaded or last written.
+    //Only that span gets sent to the EEPROM on write back. A single span is deliberate: every
+    //I2C write transaction costs a full EEPROM write cycle (~5ms) which is worth far more than
+    //the bytes in any gap between two dirty spans on the same page.
     typedef struct {
         uint8_t data[256];
         uint32_t address; //address of start of page
         uint8_t age; //
         boolean dirty;
+        uint8_t dirtyLow; //first dirty byte within the page (only valid if dirty)
+        uint8_t dirtyHigh; //last dirty byte within the page (inclusive, only valid if dirty)
     } PageCache;
 
     PageCache pages[NUM_CACHED_PAGES];
+    EEPROMBackend *backend;
+    void waitWriteComplete();
     boolean isWriting();
     uint8_t cache_hit(uint32_t address);
     void cache_age();
     uint8_t cache_findpage();
-    uint8_t cache_readpage(uint32_t addr);
+    uint8_t cache_readpage(uint32_t addr, uint8_t slot);
     boolean cache_writepage(uint8_t page);
+    boolean cache_flush(uint8_t page);
+    void cache_markdirty(uint8_t page, uint8_t offset);
+    void cache_count(uint32_t addr, bool hit);
+    void registerStatusEntries();
     uint8_t agingTimer;
+    MemCacheStats stats;
+    uint16_t accessMap[EEPROM_NUM_PAGES]; //per EEPROM page access counts. Saturates at 65535
 };
 
 #endif /* MEM_CACHE_H_ */
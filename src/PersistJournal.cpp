@@ -0,0 +1,179 @@
+/*
+ * PersistJournal.cpp
+ *
+Copyright (c) 2022 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "PersistJournal.h"
+#include "Heartbeat.h"
+
+PersistJournal::PersistJournal()
+{
+    for (int i = 0; i < JOURNAL_NUM_VALUES; i++) values[i] = 0;
+    sequence = 0;
+    writeSlot = 0;
+    pending = false;
+    valid = false;
+    tickCount = 0;
+}
+
+/*
+Records are written in slot order and every record gets the next sequence number. So, reading the
+sequence numbers across the slots gives a run of increasing numbers up to the newest record followed
+either by erased slots (first lap) or by the older, smaller numbers of the previous lap. That means
+the newest record can be found with a binary search instead of reading every slot. Only ~10 records
+(and so ~10 cache pages) are touched at boot instead of all 128 pages of the journal.
+*/
+void PersistJournal::setup()
+{
+    JOURNAL_RECORD rec;
+    uint32_t firstSeq;
+    int32_t low, high, mid, newest;
+
+    tickHandler.detach(this);
+
+    Logger::info("Initializing persistent journal");
+
+    valid = false;
+    firstSeq = readSequence(0);
+    if (firstSeq == 0xFFFFFFFFul) //nothing was ever written. Start fresh.
+    {
+        sequence = 0;
+        writeSlot = 0;
+    }
+    else
+    {
+        //find the last slot in the run that starts at slot 0
+        low = 0;
+        high = JOURNAL_NUM_RECORDS - 1;
+        while (low < high)
+        {
+            mid = (low + high + 1) / 2;
+            uint32_t seq = readSequence(mid);
+            if (seq != 0xFFFFFFFFul && seq >= firstSeq) low = mid;
+            else high = mid - 1;
+        }
+        newest = low;
+
+        //If power died during the last write that record will fail the checksum. Step backward
+        //to the last good one. Only a handful of records could possibly be bad so don't go far.
+        for (int tries = 0; tries < 4; tries++)
+        {
+            int32_t slot = (newest - tries + JOURNAL_NUM_RECORDS) % JOURNAL_NUM_RECORDS;
+            if (readRecord(slot, &rec))
+            {
+                for (int i = 0; i < JOURNAL_NUM_VALUES; i++) values[i] = rec.values[i];
+                valid = true;
+                //carry on from the good record so the next commit writes over the bad one. Its sequence number
+                //may be half written garbage and must not be counted up from or left where the search can see it
+                newest = slot;
+                break;
+            }
+        }
+        sequence = readSequence(newest);
+        writeSlot = (newest + 1) % JOURNAL_NUM_RECORDS;
+        if (valid) Logger::info("Journal restored from sequence %u, next slot %u", sequence, writeSlot);
+        else Logger::error("Journal had no valid record near slot %u. Values reset.", newest);
+    }
+
+    //piggyback on the heartbeat interval so as to not create another timer
+    tickHandler.attach(this, CFG_TICK_INTERVAL_HEARTBEAT);
+}
+
+void PersistJournal::handleTick()
+{
+    if (++tickCount < JOURNAL_COMMIT_TICKS) return;
+    tickCount = 0;
+    commit();
+}
+
+uint32_t PersistJournal::getValue(JournalValue which)
+{
+    if (which >= JOURNAL_NUM_VALUES) return 0;
+    return values[which];
+}
+
+//only updates RAM. The value is written at the next commit.
+void PersistJournal::setValue(JournalValue which, uint32_t value)
+{
+    if (which >= JOURNAL_NUM_VALUES) return;
+    if (values[which] == value) return;
+    values[which] = value;
+    pending = true;
+}
+
+bool PersistJournal::isValid()
+{
+    return valid;
+}
+
+//Append a new snapshot record if anything changed. The record is written into the cache and then
+//its page is aged fully so the memory cache writes it (just the 32 byte span) on its next tick.
+void PersistJournal::commit()
+{
+    JOURNAL_RECORD rec;
+
+    if (!pending) return;
+
+    sequence++;
+    if (sequence == 0xFFFFFFFFul) sequence = 0; //0xFFFFFFFF is reserved for erased slots
+    rec.sequence = sequence;
+    for (int i = 0; i < JOURNAL_NUM_VALUES; i++) rec.values[i] = values[i];
+    memset(rec.reserved, 0xFF, sizeof(rec.reserved));
+    rec.checksum = calcChecksum(&rec);
+
+    memCache->Write(slotAddress(writeSlot), &rec, JOURNAL_RECORD_SIZE);
+    memCache->AgeFullyAddress(slotAddress(writeSlot));
+
+    writeSlot = (writeSlot + 1) % JOURNAL_NUM_RECORDS;
+    pending = false;
+}
+
+uint32_t PersistJournal::slotAddress(uint16_t slot)
+{
+    return EE_JOURNAL_START + ((uint32_t)slot * JOURNAL_RECORD_SIZE);
+}
+
+uint32_t PersistJournal::readSequence(uint16_t slot)
+{
+    uint32_t seq;
+    if (!memCache->Read(slotAddress(slot), &seq)) return 0xFFFFFFFFul;
+    return seq;
+}
+
+bool PersistJournal::readRecord(uint16_t slot, JOURNAL_RECORD *rec)
+{
+    if (!memCache->Read(slotAddress(slot), rec, JOURNAL_RECORD_SIZE)) return false;
+    if (rec->sequence == 0xFFFFFFFFul) return false;
+    return (calcChecksum(rec) == rec->checksum);
+}
+
+uint8_t PersistJournal::calcChecksum(const JOURNAL_RECORD *rec)
+{
+    const uint8_t *bytes = (const uint8_t *)rec;
+    uint8_t accum = 0;
+    for (int i = 0; i < JOURNAL_RECORD_SIZE - 1; i++) accum += bytes[i];
+    return accum;
+}
+
+PersistJournal persistJournal;
@@ -0,0 +1,95 @@
+/*
+ * PersistJournal.h
+ *
+ * A small log structured journal for values that change all of the time and need to survive
+ * power cycles (runtime, watt hour counters, SOC). Instead of rewriting one fixed address
+ * every update (and burning out that one EEPROM page) each update appends a full snapshot record
+ * with a sequence number. The records march through the whole journal region so the wear is
+ * spread over every page there. At boot the newest valid record is found and its values restored.
+ *
+Copyright (c) 2022 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PERSIST_JOURNAL_H_
+#define PERSIST_JOURNAL_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "eeprom_layout.h"
+#include "MemCache.h"
+#include "TickHandler.h"
+#include "Logger.h"
+
+extern MemCache *memCache;
+
+//Each record is exactly 32 bytes so 8 of them fit evenly into a 256 byte EEPROM page and a record
+//never straddles two pages. That keeps every update down to a single I2C write transaction.
+#define JOURNAL_RECORD_SIZE     32
+#define JOURNAL_NUM_RECORDS     (EE_JOURNAL_SIZE / JOURNAL_RECORD_SIZE)
+#define JOURNAL_NUM_VALUES      4
+
+//How many heartbeat ticks (2 seconds each) between journal commits. 5 = every 10 seconds.
+//At that rate each of the 128 journal pages sees 8 writes per 1024 commits which works out to
+//about 68 writes per page per day of continuous running. A 1M cycle EEPROM then lasts ~40 years.
+#define JOURNAL_COMMIT_TICKS    5
+
+enum JournalValue {
+    JV_RUNTIME = 0, //tenths of a second the system has ever been running. Kept by FaultHandler
+    JV_WH_OUT = 1, //watt hours drawn from the pack. Integrated by MotorController from DC volts and amps
+    JV_WH_IN = 2, //watt hours put back into the pack by regen. Same
+    JV_SOC = 3 //tenths of a percent. Last state of charge the BMS reported
+};
+
+typedef struct {
+    uint32_t sequence; //0xFFFFFFFF means this slot has never been written
+    uint32_t values[JOURNAL_NUM_VALUES];
+    uint8_t reserved[11]; //pads the record out to JOURNAL_RECORD_SIZE
+    uint8_t checksum; //additive checksum of the preceding 31 bytes
+} JOURNAL_RECORD;
+
+class PersistJournal : public TickObserver {
+public:
+    PersistJournal();
+    void setup();
+    void handleTick();
+    uint32_t getValue(JournalValue which);
+    void setValue(JournalValue which, uint32_t value);
+    void commit();
+    bool isValid();
+
+private:
+    bool readRecord(uint16_t slot, JOURNAL_RECORD *rec);
+    uint32_t readSequence(uint16_t slot);
+    uint8_t calcChecksum(const JOURNAL_RECORD *rec);
+    uint32_t slotAddress(uint16_t slot);
+
+    uint32_t values[JOURNAL_NUM_VALUES];
+    uint32_t sequence; //sequence number of the most recent record written or found
+    uint16_t writeSlot; //where the next record will go
+    bool pending; //values changed since the last commit
+    bool valid; //did we find a valid record at boot?
+    uint8_t tickCount;
+};
+
+extern PersistJournal persistJournal;
+
+#endif /* PERSIST_JOURNAL_H_ */
@@ -28,11 +28,27 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "PrefHandler.h"
+#include <algorithm>
+
+uint32_t PrefHandler::lookupCount = 0;
+uint32_t PrefHandler::enableGeneration = 0;
+uint32_t PrefHandler::lookupMicros = 0;
+uint32_t PrefHandler::indexBuildMicros = 0;
+std::vector<PrefHandler *> PrefHandler::handlers;
+uint16_t PrefHandler::deviceTable[DEVICE_TABLE_ENTRIES];
+bool PrefHandler::deviceTableLoaded = false;
 
 PrefHandler::PrefHandler() {
     lkg_address = EE_MAIN_OFFSET; //default to normal mode
     base_address = 0;
+    position = 0;
+    generation = 0;
+    txBuffer = nullptr;
+    txChanges = 0;
+    compactChanges = 0;
+    compactState = COMPACT_IDLE;
     semKeyLookup = false;
+    invalidateIndex();
 }
 
 bool PrefHandler::isEnabled()
@@ -42,8 +58,10 @@ bool PrefHandler::isEnabled()
 
 void PrefHandler::setEnabledStatus(bool en)
 {
-    uint16_t id = 0;
+    if (position <= 0) return; //no slot in the table, don't clobber the magic number
+    uint16_t id = deviceTable[position];
 
+    if (enabled != en) enableGeneration++;
     enabled = en;
 
     if (enabled) {
@@ -53,29 +71,36 @@ void PrefHandler::setEnabledStatus(bool en)
         id &= 0x7FFF; //clear enabled bit
     }
 
-    memCache->Write(EE_DEVICE_TABLE + (2 * position), id);
+    writeDeviceTableEntry(position, id);
 }
 
 void PrefHandler::dumpDeviceTable()
 {
-    uint16_t id;
-    
-    for (int x = 0; x < 64; x++) 
+    checkTableValidity();
+    for (int x = 0; x < DEVICE_TABLE_ENTRIES; x++) 
     {
-        memCache->Read(EE_DEVICE_TABLE + (2 * x), &id);
-        Logger::console("Device ID: %X, Enabled = %X", id & 0x7FFF, id & 0x8000);
+        Logger::console("Device ID: %X, Enabled = %X", deviceTable[x] & 0x7FFF, deviceTable[x] & 0x8000);
     }
 }
 
+//Makes sure the device table in EEPROM is valid and pulls it into RAM. Only the first call does any work,
+//every PrefHandler after that just uses the RAM copy.
 void PrefHandler::checkTableValidity()
 {
     uint16_t id;
     uint8_t failures = 0;
 
+    if (deviceTableLoaded) return;
+
     while (failures < 3)
     {
         memCache->Read(EE_DEVICE_TABLE, &id);
-        if (id == 0xDEAD) return;
+        if (id == 0xDEAD)
+        {
+            memCache->Read(EE_DEVICE_TABLE, deviceTable, sizeof(deviceTable));
+            deviceTableLoaded = true;
+            return;
+        }
         failures++;
         delay(5); //just a small delay
         memCache->InvalidateAll(); //clear the cache so the next read is from EEPROM not the cache
@@ -85,12 +110,30 @@ void PrefHandler::checkTableValidity()
     initDevTable();
 }
 
+//Changes go to the RAM copy and straight through to the cache so the two never disagree
+void PrefHandler::writeDeviceTableEntry(int pos, uint16_t val)
+{
+    deviceTable[pos] = val;
+    memCache->Write(EE_DEVICE_TABLE + (2 * pos), val);
+}
+
+//Returns the table slot holding the given device ID or -1 if it has none.
+//Slot 0 is the magic number so it is never a match.
+int PrefHandler::findDeviceSlot(uint16_t device)
+{
+    checkTableValidity();
+    for (int x = 1; x < DEVICE_TABLE_ENTRIES; x++) {
+        if ((deviceTable[x] & 0x7FFF) == (device & 0x7FFF)) return x;
+    }
+    return -1;
+}
+
 void PrefHandler::processAutoEntry(uint16_t val, uint16_t pos)
 {
     if (val < 0x7FFF) val = val | 0x8000; //automatically set enabled bit
         else val = 0;
 
-    memCache->Write(EE_DEVICE_TABLE + (2 * pos), val);
+    writeDeviceTableEntry(pos, val);
 
     if (val == 0) return;
     val &= 0x7FFF;
@@ -101,8 +144,6 @@ void PrefHandler::processAutoEntry(uint16_t val, uint16_t pos)
 
 void PrefHandler::initDevTable()
 {
-    uint16_t id;
-    
     Logger::console("Initializing EEPROM device table");
     
     //First six are done from entries in config.h to automatically enable those devices
@@ -114,60 +155,69 @@ void PrefHandler::initDevTable()
     processAutoEntry(AUTO_ENABLE_DEV6, 6);
         
     //initialize table with zeros
-    id = 0;
-    for (int x = 7; x < 64; x++) {
-        memCache->Write(EE_DEVICE_TABLE + (2 * x), id);
+    for (int x = 7; x < DEVICE_TABLE_ENTRIES; x++) {
+        writeDeviceTableEntry(x, 0);
     }
 
     //write out magic entry
-    id = 0xDEAD;
-    memCache->Write(EE_DEVICE_TABLE, id);
+    writeDeviceTableEntry(0, 0xDEAD);
     memCache->FlushAllPages();
+    deviceTableLoaded = true;
 }
 
-//Given a device ID we must search the 64 entry table found in EEPROM to see if the device
-//has a spot in EEPROM. If it does not then add it
+//Given a device ID we must search the 64 entry device table to see if the device
+//has a spot in EEPROM. If it does not then add it. The table is read from EEPROM and checked
+//once by the first handler created. Everyone after that searches the RAM copy.
 PrefHandler::PrefHandler(DeviceId id_in) {
     uint16_t id;
 
     enabled = false;
+    generation = 0;
+    txBuffer = nullptr;
+    txChanges = 0;
+    compactChanges = 0;
+    compactState = COMPACT_IDLE;
     semKeyLookup = false;
+    invalidateIndex();
+    handlers.push_back(this);
 
-    checkTableValidity();
-
-    for (int x = 1; x < 64; x++) {
-        memCache->Read(EE_DEVICE_TABLE + (2 * x), &id);
-        if ((id & 0x7FFF) == ((int)id_in)) {
-            base_address = EE_DEVICES_BASE + (EE_DEVICE_SIZE * x);
-            lkg_address = EE_MAIN_OFFSET;
-            if (id & 0x8000) enabled = true;
-            position = x;
-            deviceID = (uint16_t)id_in;
-            Logger::debug("Device ID: %X was found in device table at entry: %i", (int)id_in, x);
-            return;
+    int x = findDeviceSlot((uint16_t)id_in);
+    if (x > 0) {
+        id = deviceTable[x];
+        base_address = EE_DEVICES_BASE + (EE_DEVICE_SIZE * x);
+        lkg_address = EE_MAIN_OFFSET;
+        if (id & 0x8000)
+        {
+            enabled = true;
+            enableGeneration++;
         }
+        position = x;
+        deviceID = (uint16_t)id_in;
+        Logger::debug("Device ID: %X was found in device table at entry: %i", (int)id_in, x);
+        selectActiveCopy();
+        return;
     }
 
     //if we got here then there was no entry for this device in the table yet.
     //try to find an empty spot and place it there.
-    for (int x = 1; x < 64; x++) {
-        memCache->Read(EE_DEVICE_TABLE + (2 * x), &id);
-        if (id == 0) {
+    for (x = 1; x < DEVICE_TABLE_ENTRIES; x++) {
+        if (deviceTable[x] == 0) {
             base_address = EE_DEVICES_BASE + (EE_DEVICE_SIZE * x);
             lkg_address = EE_MAIN_OFFSET;
             enabled = false; //default to devices being off until the user says otherwise
             id = (int)id_in;
-            memCache->Write(EE_DEVICE_TABLE + (2*x), id);
+            writeDeviceTableEntry(x, id);
             position = x;
             deviceID = (uint16_t)id_in;
             //immediately store our ID into the proper place
-            memCache->Write(EE_DEVICE_ID + base_address + lkg_address, deviceID);
+            blockWrite(EE_DEVICE_ID, deviceID);
             Logger::info("Device ID: %X was placed into device table at entry: %i", (int)id, x);
             return;
         }
     }
 
     //we found no matches and could not allocate a space. This is bad. Error out here
+    position = 0;
     base_address = 0xF0F0;
     lkg_address = EE_MAIN_OFFSET;
     Logger::error("PrefManager - Device Table Full!!!");
@@ -178,87 +228,459 @@ PrefHandler::PrefHandler(DeviceId id_in) {
 //returns true if it could make the change, false if it could not.
 bool PrefHandler::setDeviceStatus(uint16_t device, bool enabled)
 {
-    uint16_t id;
-    for (int x = 1; x < CFG_DEV_MGR_MAX_DEVICES; x++) {
-        memCache->Read(EE_DEVICE_TABLE + (2 * x), &id);
-        if ((id & 0x7FFF) == (device & 0x7FFF)) {
-            Logger::avalanche("Found a device record to edit");
-            if (enabled) {
-                id |= 0x8000;
-            }
-            else {
-                id &= 0x7FFF;
-            }
-            Logger::avalanche("ID to write: %X", id);
-            memCache->Write(EE_DEVICE_TABLE + (2 * x), id);
-            return true;
+    int x = findDeviceSlot(device);
+    if (x < 0) return false;
+
+    uint16_t id = deviceTable[x];
+    Logger::avalanche("Found a device record to edit");
+    if (enabled) {
+        id |= 0x8000;
+    }
+    else {
+        id &= 0x7FFF;
+    }
+    Logger::avalanche("ID to write: %X", id);
+    writeDeviceTableEntry(x, id);
+    return true;
+}
+
+PrefHandler::~PrefHandler() {
+    prefCompactor.cancel(this);
+    handlers.erase(std::remove(handlers.begin(), handlers.end(), this), handlers.end());
+    delete[] txBuffer;
+}
+
+//Figures out which of the two copies of the device block is the current one. A copy only counts if
+//it has our device ID and a generation that matches its check word, and if both do the newer one wins.
+//The header is written last on commit so a copy whose header is good was completely written.
+//Blocks that were never committed through a transaction have no valid header and stay on the main copy.
+void PrefHandler::selectActiveCopy()
+{
+    uint32_t mainGen, lkgGen;
+    bool mainOk = copyValid(EE_MAIN_OFFSET, &mainGen);
+    bool lkgOk = copyValid(EE_LKG_OFFSET, &lkgGen);
+
+    lkg_address = EE_MAIN_OFFSET;
+    generation = mainOk ? mainGen : 0;
+    if (lkgOk && (!mainOk || (int32_t)(lkgGen - mainGen) > 0))
+    {
+        lkg_address = EE_LKG_OFFSET;
+        generation = lkgGen;
+        Logger::debug("Device %X is using the alternate settings copy, generation %u", deviceID, generation);
+    }
+}
+
+bool PrefHandler::copyValid(uint32_t copyAddress, uint32_t *gen)
+{
+    uint8_t header[EE_HEADER_END];
+    uint16_t storedID;
+    uint32_t check;
+
+    memCache->Read(base_address + copyAddress, header, EE_HEADER_END);
+    memcpy(&storedID, header + EE_DEVICE_ID, 2);
+    memcpy(gen, header + EE_GENERATION, 4);
+    memcpy(&check, header + EE_GENERATION_CHECK, 4);
+    return (storedID == deviceID && check == ~(*gen));
+}
+
+//All access to the device block goes through these two so that an open transaction sees
+//its own staged changes and nothing reaches EEPROM until it is committed.
+bool PrefHandler::blockRead(uint32_t offset, void *data, uint16_t len)
+{
+    if (offset + len > EE_DEVICE_SIZE) return false;
+    if (txBuffer)
+    {
+        memcpy(data, txBuffer + offset, len);
+        return true;
+    }
+    return memCache->Read(offset + base_address + lkg_address, data, len);
+}
+
+bool PrefHandler::blockWrite(uint32_t offset, const void *data, uint16_t len)
+{
+    if (offset + len > EE_DEVICE_SIZE) return false;
+    if (txBuffer)
+    {
+        memcpy(txBuffer + offset, data, len);
+        txChanges++;
+        return true;
+    }
+    return memCache->Write(offset + base_address + lkg_address, data, len);
+}
+
+//Starts staging every change to this device's settings in RAM. Nothing is written until
+//commitTransaction() so a power loss part way through a save can't leave a half written block.
+bool PrefHandler::beginTransaction()
+{
+    if (txBuffer)
+    {
+        Logger::error("Settings transaction already open for device %X", deviceID);
+        return false;
+    }
+    uint8_t *buffer = new uint8_t[EE_DEVICE_SIZE];
+    memCache->Read(base_address + lkg_address, buffer, EE_DEVICE_SIZE);
+    txBuffer = buffer;
+    return true;
+}
+
+//Writes the staged block into the copy that isn't active. Only bytes that differ from what that copy
+//already holds get written and the header with the new generation and checksum goes last. Until that
+//header lands the old copy stays the newest valid one, so the switch over is atomic.
+bool PrefHandler::commitTransaction()
+{
+    uint32_t startTime = micros();
+
+    if (!txBuffer || compactState != COMPACT_IDLE) return false;
+
+    uint32_t target = otherCopy();
+    uint32_t newGen = generation + 1;
+
+    writeStagedBody(target);
+    for (int page = 0; page < EE_DEVICE_SIZE; page += 256) memCache->FlushAddress(base_address + target + page);
+    writeStagedHeader(target, newGen);
+    memCache->FlushAddress(base_address + target);
+    finishCommit(target, newGen);
+
+    Logger::debug("Committed settings for device %X, generation %u, in %u us", deviceID, generation, micros() - startTime);
+    return true;
+}
+
+void PrefHandler::abortTransaction()
+{
+    if (!txBuffer) return;
+    delete[] txBuffer;
+    txBuffer = nullptr;
+    compactState = COMPACT_IDLE;
+    invalidateIndex(); //may have indexed keys that only existed in the staged image
+}
+
+bool PrefHandler::needsCompaction()
+{
+    if (!indexValid || deadBytes == 0) return false;
+    return (deadBytes >= PREF_COMPACT_DEAD_BYTES || (EE_DEVICE_SIZE - tailOffset) < PREF_COMPACT_MIN_FREE);
+}
+
+//Rebuilds the staged image with only the live records, busiest keys first so they share the first
+//cache page, and erases everything after them. Dead records and records that never got a value are dropped.
+void PrefHandler::compactStaged()
+{
+    uint8_t *packed = new uint8_t[EE_DEVICE_SIZE];
+    std::vector<PrefIndexEntry> live;
+
+    findEmptySettingLoc(); //settle the length of the newest record first
+    live.reserve(indexCount);
+    for (const PrefIndexEntry &entry : keyIndex)
+    {
+        if (entry.offset) live.push_back(entry);
+    }
+    std::sort(live.begin(), live.end(), [](const PrefIndexEntry &a, const PrefIndexEntry &b) {
+        if (a.hits != b.hits) return a.hits > b.hits;
+        return a.offset < b.offset;
+    });
+
+    memcpy(packed, txBuffer, SETTINGS_START);
+    memset(packed + SETTINGS_START, 0xFF, EE_DEVICE_SIZE - SETTINGS_START);
+
+    invalidateIndex();
+    keyIndex.resize(32);
+    uint16_t out = SETTINGS_START;
+    for (const PrefIndexEntry &entry : live)
+    {
+        uint8_t len = txBuffer[entry.offset + 4];
+        if (len == 0 || entry.offset + 5 + len > EE_DEVICE_SIZE) continue;
+        memcpy(packed + out, txBuffer + entry.offset, 5 + len);
+        indexInsert(entry.hash, out, entry.hits);
+        out += 5 + len;
+    }
+
+    memcpy(txBuffer, packed, EE_DEVICE_SIZE);
+    delete[] packed;
+    tailOffset = out;
+    indexValid = true;
+    txChanges++;
+}
+
+//Stages a compacted copy of the block. From here on compactStep() gets it written to the
+//inactive copy a little at a time and switches over once the header is down.
+bool PrefHandler::startCompaction()
+{
+    if (compactState != COMPACT_IDLE || txBuffer) return false;
+    uint16_t oldTail = tailOffset;
+    uint16_t oldDead = deadBytes;
+    beginTransaction();
+    compactStaged();
+    compactState = COMPACT_WRITE_BODY;
+    Logger::info("Compacting settings for device %X. %u bytes used, %u of them dead. Now %u bytes", deviceID, oldTail, oldDead, tailOffset);
+    return true;
+}
+
+//One step of a background commit. Returns false once there is nothing left to do.
+bool PrefHandler::compactStep()
+{
+    uint32_t target = otherCopy();
+
+    switch (compactState)
+    {
+    case COMPACT_IDLE:
+        return false;
+    case COMPACT_WRITE_BODY:
+        writeStagedBody(target);
+        for (int page = 0; page < EE_DEVICE_SIZE; page += 256) memCache->AgeFullyAddress(base_address + target + page);
+        compactChanges = txChanges;
+        compactState = COMPACT_WAIT_BODY;
+        break;
+    case COMPACT_WAIT_BODY:
+        if (txChanges != compactChanges) compactState = COMPACT_WRITE_BODY; //settings were saved meanwhile. Catch the target up
+        else if (!targetDirty(target, false))
+        {
+            writeStagedHeader(target, generation + 1);
+            memCache->AgeFullyAddress(base_address + target);
+            compactState = COMPACT_WAIT_HEADER;
         }
+        break;
+    case COMPACT_WAIT_HEADER:
+        if (targetDirty(target, true)) break;
+        if (txChanges != compactChanges)
+        {
+            //settings were saved after the header went out. The compacted copy is complete as of that header so it
+            //becomes the active one, and the late changes get committed to the other copy the same way with a new header
+            lkg_address = target;
+            generation++;
+            compactState = COMPACT_WRITE_BODY;
+            break;
+        }
+        finishCommit(target, generation + 1);
+        Logger::info("Settings for device %X compacted", deviceID);
+        return false;
+    }
+    return true;
+}
+
+uint32_t PrefHandler::otherCopy()
+{
+    return (lkg_address == EE_MAIN_OFFSET) ? EE_LKG_OFFSET : EE_MAIN_OFFSET;
+}
+
+//Copies everything but the header from the staged image into the target copy, skipping bytes that already match
+void PrefHandler::writeStagedBody(uint32_t target)
+{
+    uint8_t current[EE_DEVICE_SIZE];
+
+    memCache->Read(base_address + target, current, EE_DEVICE_SIZE);
+    for (int i = EE_HEADER_END; i < EE_DEVICE_SIZE;)
+    {
+        if (current[i] == txBuffer[i])
+        {
+            i++;
+            continue;
+        }
+        int runStart = i;
+        while (i < EE_DEVICE_SIZE && current[i] != txBuffer[i]) i++;
+        memCache->Write(base_address + target + runStart, txBuffer + runStart, i - runStart);
+    }
+}
+
+void PrefHandler::writeStagedHeader(uint32_t target, uint32_t newGen)
+{
+    uint32_t check = ~newGen;
+    uint8_t accum = 0;
+
+    memcpy(txBuffer + EE_DEVICE_ID, &deviceID, 2);
+    memcpy(txBuffer + EE_GENERATION, &newGen, 4);
+    memcpy(txBuffer + EE_GENERATION_CHECK, &check, 4);
+    for (int i = 1; i < EE_DEVICE_SIZE; i++) accum += txBuffer[i];
+    txBuffer[EE_CHECKSUM] = accum;
+    memCache->Write(base_address + target, txBuffer, EE_HEADER_END);
+}
+
+//true if any page of the target copy (or just its header page) still has to be written back
+bool PrefHandler::targetDirty(uint32_t target, bool headerOnly)
+{
+    int end = headerOnly ? 1 : EE_DEVICE_SIZE;
+    for (int page = 0; page < end; page += 256)
+    {
+        if (memCache->IsAddressDirty(base_address + target + page)) return true;
     }
     return false;
 }
 
-PrefHandler::~PrefHandler() {
+void PrefHandler::finishCommit(uint32_t target, uint32_t newGen)
+{
+    delete[] txBuffer;
+    txBuffer = nullptr;
+    compactState = COMPACT_IDLE;
+    lkg_address = target;
+    generation = newGen;
+    //the key index was kept up to date against the staged image which is now the active copy so it's still good
+}
+
+bool PrefHandler::inTransaction()
+{
+    return (txBuffer != nullptr);
 }
 
 void PrefHandler::LKG_mode(bool mode) {
+    uint32_t oldAddress = lkg_address;
     if (mode) lkg_address = EE_LKG_OFFSET;
     else lkg_address = EE_MAIN_OFFSET;
+    //main and LKG are separate blocks with their own layout so the index has to be redone
+    if (oldAddress != lkg_address) invalidateIndex();
 }
 
-//given a hash value it looks for that in the table. If it finds
-//the hash it'll return 5 bytes higher which skips the hash and length
-//so the return location will be the start of the actual value itself.
-uint32_t PrefHandler::findSettingLocation(uint32_t hash)
+uint32_t PrefHandler::getEnableGeneration()
 {
-    while (semKeyLookup);
-    semKeyLookup = true;
-    Logger::avalanche("Key lookup for %x", hash);
+    return enableGeneration;
+}
+
+uint32_t PrefHandler::getLookupCount()
+{
+    return lookupCount;
+}
+
+uint32_t PrefHandler::getLookupMicros()
+{
+    return lookupMicros;
+}
+
+uint32_t PrefHandler::getIndexBuildMicros()
+{
+    return indexBuildMicros;
+}
+
+void PrefHandler::invalidateIndex()
+{
+    keyIndex.clear();
+    keyIndex.shrink_to_fit();
+    indexCount = 0;
+    tailOffset = SETTINGS_START;
+    tailOpen = false;
+    deadBytes = 0;
+    indexValid = false;
+}
+
+//Walks the whole settings block once and remembers where every record starts so that
+//lookups don't have to walk it over and over through the memory cache. This is done the first time
+//a setting is looked up so devices that never load their config never pay for it.
+void PrefHandler::buildKeyIndex()
+{
+    uint32_t startTime = micros();
     uint32_t readHash;
     uint8_t readLength;
-    for (uint32_t idx = SETTINGS_START; idx < EE_DEVICE_SIZE;)
+    uint32_t idx;
+
+    invalidateIndex();
+    keyIndex.resize(32);
+
+    for (idx = SETTINGS_START; idx < EE_DEVICE_SIZE;)
+    {
+        blockRead((uint32_t)idx, &readHash);
+        if (readHash == 0xFFFFFFFFul) break; //end of the used records
+        blockRead((uint32_t)idx + 4, &readLength);
+        if (readHash == PREF_DEAD_HASH || readLength == 0) deadBytes += 5 + readLength;
+        if (readHash != PREF_DEAD_HASH) indexInsert(readHash, idx);
+        idx += 5 + readLength;
+    }
+    tailOffset = (idx < EE_DEVICE_SIZE) ? idx : EE_DEVICE_SIZE;
+    indexValid = true;
+
+    indexBuildMicros += micros() - startTime;
+    Logger::avalanche("Built key index for device %X. %u keys, free space starts at %u", deviceID, indexCount, tailOffset);
+}
+
+//Linear probing into a table kept at most half full. Duplicate hashes keep the first record
+//which is the same one the old linear search through EEPROM would have found.
+void PrefHandler::indexInsert(uint32_t hash, uint16_t offset, uint16_t hits)
+{
+    if ((uint32_t)(indexCount + 1) * 2 > keyIndex.size())
     {
-        memCache->Read((uint32_t)idx + base_address + lkg_address, &readHash);
-        if (readHash == hash) //matched! return the address + 5 which is the start of the actual value
+        std::vector<PrefIndexEntry> oldIndex;
+        oldIndex.swap(keyIndex);
+        keyIndex.resize(oldIndex.size() ? oldIndex.size() * 2 : 32);
+        indexCount = 0;
+        for (const PrefIndexEntry &entry : oldIndex)
         {
-            semKeyLookup = false;
-            return (idx + 5);
+            if (entry.offset) indexInsert(entry.hash, entry.offset, entry.hits);
+        }
+    }
+
+    uint32_t mask = keyIndex.size() - 1;
+    for (uint32_t slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        if (keyIndex[slot].offset == 0)
+        {
+            keyIndex[slot].hash = hash;
+            keyIndex[slot].offset = offset;
+            keyIndex[slot].hits = hits;
+            indexCount++;
+            return;
         }
-        //otherwise, read length then skip the 4 for hash, 1 for length, and length too.
-        idx += 4;
-        memCache->Read((uint32_t)idx + base_address + lkg_address, &readLength);
-        idx += 1 + readLength;
+        if (keyIndex[slot].hash == hash) return;
     }
+}
+
+PrefIndexEntry *PrefHandler::indexEntry(uint32_t hash)
+{
+    if (!indexValid) buildKeyIndex();
+    uint32_t mask = keyIndex.size() - 1;
+    for (uint32_t slot = hash & mask; keyIndex[slot].offset != 0; slot = (slot + 1) & mask)
+    {
+        if (keyIndex[slot].hash == hash) return &keyIndex[slot];
+    }
+    return nullptr;
+}
+
+//Returns where the record with the given hash starts within the block or 0 if it isn't in the index
+uint16_t PrefHandler::indexLookup(uint32_t hash)
+{
+    PrefIndexEntry *entry = indexEntry(hash);
+    if (!entry) return 0;
+    if (entry->hits < 0xFFFF) entry->hits++;
+    return entry->offset;
+}
+
+//given a hash value it looks for that in the key index. If it finds
+//the hash it'll return 5 bytes higher which skips the hash and length
+//so the return location will be the start of the actual value itself.
+uint32_t PrefHandler::findSettingLocation(uint32_t hash)
+{
+    while (semKeyLookup);
+    semKeyLookup = true;
+    Logger::avalanche("Key lookup for %x", hash);
+    uint16_t offset = indexLookup(hash);
     semKeyLookup = false;
+    if (offset) return (offset + 5); //matched! return the address + 5 which is the start of the actual value
     return 0xFFFFFFFFul;
 }
 
-//Works similarly to above but finds a hash value that has not been initialized and
-//returns the address of the hash value (not 5 higher as with the above function)
+//Returns the address where a new record can be placed (the address of the hash value, not 5 higher
+//as with the above function). Records are only ever appended so this is just the end of the used area.
+//If the newest record was created before its length was known then skip past it now that it is.
 uint32_t PrefHandler::findEmptySettingLoc()
 {
-    uint32_t readHash;
     uint8_t readLength;
-    for (uint32_t idx = SETTINGS_START; idx < EE_DEVICE_SIZE;)
+    if (!indexValid) buildKeyIndex();
+    if (tailOpen)
     {
-        memCache->Read((uint32_t)idx + base_address + lkg_address, &readHash);
-        Logger::avalanche("Read Hash = %x", readHash);
-        if (readHash == 0xFFFFFFFFul) //it's empty! Return this exact address
-        {
-            return (idx);
-        }
-        //otherwise, read length then skip the 4 for hash, 1 for length, and length too.
-        idx += 4;
-        memCache->Read((uint32_t)idx + base_address + lkg_address, &readLength);
+        blockRead((uint32_t)tailOffset + 4, &readLength);
         Logger::avalanche("Read length: %u", readLength);
-        idx += 1 + readLength;
+        tailOffset += 5 + readLength;
+        tailOpen = false;
     }
-    return 0xFFFFFFFFul;
+    if (tailOffset >= EE_DEVICE_SIZE) return 0xFFFFFFFFul;
+    return tailOffset;
 }
 
 uint32_t PrefHandler::keyToAddress(const char *key, bool createIfNecessary)
 {
     Logger::avalanche("Key look up for %s", key);
-    uint32_t hash = fnvHash(key);
+    uint32_t address = hashToAddress(fnvHash(key), createIfNecessary);
+    Logger::avalanche("Key: %s Returned Addr: %x", key, address);
+    return address;
+}
+
+uint32_t PrefHandler::hashToAddress(uint32_t hash, bool createIfNecessary)
+{
+    uint32_t startTime = micros();
     uint32_t address = findSettingLocation(hash);
     if (address >= EE_DEVICE_SIZE) 
     {
@@ -269,132 +691,119 @@ uint32_t PrefHandler::keyToAddress(const char *key, bool createIfNecessary)
             if (address >= EE_DEVICE_SIZE) return 0xFFFFFFFFul;
             //write the hash value to this entry because it's new
             Logger::avalanche("Setting stored at %x", address);
-            memCache->Write((uint32_t)address + base_address + lkg_address, hash);
+            blockWrite((uint32_t)address, hash);
+            indexInsert(hash, address);
+            tailOpen = true; //findEmptySettingLoc will skip past it once the length has been written
             uint8_t len = 0; //don't know length yet. Set it to zero.
             address += 4; //increment past hash location
-            memCache->Write((uint32_t)address + base_address + lkg_address, len);
+            blockWrite((uint32_t)address, len);
             address += 1; //increment past length too
         }
     }
-    Logger::avalanche("Key: %s Returned Addr: %x", key, address);
+    lookupCount++;
+    lookupMicros += micros() - startTime;
     return address;
 }
 
-bool PrefHandler::write(const char *key, uint8_t val) {
-    uint32_t address = keyToAddress(key, true);
+//Common code for all the fixed size writes. Sets the length of a brand new record or makes sure
+//the existing record is the same size before the value goes into the memory cache.
+bool PrefHandler::writeValue(const char *key, uint32_t hash, const void *val, uint8_t dataLength, uint8_t recordLength)
+{
+    uint32_t address = hashToAddress(hash, true);
+    if (address >= EE_DEVICE_SIZE)
+    {
+        Logger::error("No room left to store variable %s!", key);
+        return false;
+    }
     uint8_t len;
-    memCache->Read((uint32_t)address + base_address + lkg_address - 1, &len);
+    blockRead((uint32_t)address - 1, &len);
     if (len == 0)
     {
-        len = 1;
-        memCache->Write((uint32_t)address + base_address + lkg_address - 1, len);
+        len = recordLength;
+        blockWrite((uint32_t)address - 1, len);
     }
-    else if (len != 1)
+    else if (len != recordLength)
     {
-        Logger::error("Attempt to write improper length to variable %s!", key);
-        return false;
+        return moveRecord(key, hash, address - 5, len, val, dataLength, recordLength);
     }
     //then return whether we could write the value into the memory cache
-    return memCache->Write((uint32_t)address + base_address + lkg_address, val);
+    return blockWrite((uint32_t)address, val, dataLength);
 }
 
-bool PrefHandler::write(const char *key, uint16_t val) {
-    uint32_t address = keyToAddress(key, true);
-    uint8_t len;
-    memCache->Read((uint32_t)address + base_address + lkg_address - 1, &len);
-    if (len == 0)
+//The setting changed size so it can't stay where it is. Write a complete new record at the end of the
+//block and only then kill the old one. If power goes in between, the old record is found first on the
+//next boot and the setting simply keeps its old value.
+bool PrefHandler::moveRecord(const char *key, uint32_t hash, uint32_t oldOffset, uint8_t oldLength, const void *val, uint8_t dataLength, uint8_t recordLength)
+{
+    uint32_t newOffset = findEmptySettingLoc();
+    if (newOffset >= EE_DEVICE_SIZE || newOffset + 5 + recordLength > EE_DEVICE_SIZE)
     {
-        len = 2;
-        memCache->Write((uint32_t)address + base_address + lkg_address - 1, len);
+        Logger::error("No room to resize variable %s!", key);
+        return false;
     }
-    else if (len != 2)
+    uint32_t deadHash = PREF_DEAD_HASH;
+    blockWrite(newOffset, hash);
+    blockWrite(newOffset + 4, recordLength);
+    blockWrite(newOffset + 5, val, dataLength);
+    //the cache writes pages back in slot order, not in the order they were changed. Outside of a transaction
+    //the new record has to be on the chip before the old one is killed or a power loss could leave neither
+    if (!txBuffer)
     {
-        Logger::error("Attempt to write improper length to variable %s!", key);
-        return false;
+        memCache->FlushAddress(base_address + lkg_address + newOffset);
+        memCache->FlushAddress(base_address + lkg_address + newOffset + 4 + recordLength);
     }
-    //then return whether we could write the value into the memory cache    
-    return memCache->Write((uint32_t)address + base_address + lkg_address, val);
+    blockWrite(oldOffset, deadHash);
+
+    tailOffset = newOffset + 5 + recordLength;
+    indexEntry(hash)->offset = newOffset;
+    deadBytes += 5 + oldLength;
+    Logger::info("Variable %s changed size from %u to %u bytes and was moved", key, oldLength, recordLength);
+    return true;
+}
+
+bool PrefHandler::write(const char *key, uint8_t val) {
+    return writeValue(key, fnvHash(key), &val, sizeof(val), sizeof(val));
+}
+
+bool PrefHandler::write(const char *key, uint16_t val) {
+    return writeValue(key, fnvHash(key), &val, sizeof(val), sizeof(val));
 }
 
 bool PrefHandler::write(const char *key, uint32_t val) {
-    uint32_t address = keyToAddress(key, true);
-    uint8_t len;
-    memCache->Read((uint32_t)address + base_address + lkg_address - 1, &len);
-    if (len == 0)
-    {
-        len = 4;
-        memCache->Write((uint32_t)address + base_address + lkg_address - 1, len);
-    }
-    else if (len != 4)
-    {
-        Logger::error("Attempt to write improper length to variable %s!", key);
-        return false;
-    }
-    //then return whether we could write the value into the memory cache    
-    return memCache->Write((uint32_t)address + base_address + lkg_address, val);
+    return writeValue(key, fnvHash(key), &val, sizeof(val), sizeof(val));
 }
 
 bool PrefHandler::write(const char *key, float val) {
-    uint32_t address = keyToAddress(key, true);    
-    uint8_t len;
-    memCache->Read((uint32_t)address + base_address + lkg_address - 1, &len);
-    if (len == 0)
-    {
-        len = 4;
-        memCache->Write((uint32_t)address + base_address + lkg_address - 1, len);
-    }
-    else if (len != 4)
-    {
-        Logger::error("Attempt to write improper length to variable %s!", key);
-        return false;
-    }
-    //then return whether we could write the value into the memory cache    
-    return memCache->Write((uint32_t)address + base_address + lkg_address, val);
+    return writeValue(key, fnvHash(key), &val, sizeof(val), sizeof(val));
 }
 
 bool PrefHandler::write(const char *key, double val) {
-    uint32_t address = keyToAddress(key, true);
-    uint8_t len;
-    memCache->Read((uint32_t)address + base_address + lkg_address - 1, &len);
-    if (len == 0)
-    {
-        len = 8;
-        memCache->Write((uint32_t)address + base_address + lkg_address - 1, len);
-    }
-    else if (len != 8)
+    return writeValue(key, fnvHash(key), &val, sizeof(val), sizeof(val));
+}
+
+//Saves every setting in the table. The hashes were worked out at compile time and the values
+//all land in the same one or two cached pages so they go out together on the next flush.
+bool PrefHandler::write(const PrefBinding *prefs, size_t count)
+{
+    bool ok = true;
+    for (size_t i = 0; i < count; i++)
     {
-        Logger::error("Attempt to write improper length to variable %s!", key);
-        return false;
+        if (!writeValue(prefs[i].key, prefs[i].hash, prefs[i].var, prefs[i].length, prefs[i].length)) ok = false;
     }
-    //then return whether we could write the value into the memory cache    
-    return memCache->Write((uint32_t)address + base_address + lkg_address, val);
+    return ok;
 }
 
-
 bool PrefHandler::write(const char *key, const char *val, size_t maxlen) {
-    uint32_t address = keyToAddress(key, true);    
-    uint8_t len;
     size_t stringLen = strlen(val);
     if (stringLen > maxlen) stringLen = maxlen;
-    memCache->Read((uint32_t)address + base_address + lkg_address - 1, &len);
-    if (len == 0)
-    {
-        len = maxlen + 1;
-        memCache->Write((uint32_t)address + base_address + lkg_address - 1, len);
-    }
-    else if (len != (maxlen + 1))
-    {
-        Logger::error("Attempt to write improper length to variable %s!", key);
-        return false;
-    }
-    //then return whether we could write the value into the memory cache    
-    return memCache->Write((uint32_t)address + base_address + lkg_address, val, stringLen + 1);
+    //the record is sized for the longest string plus terminator but only the actual string gets written
+    return writeValue(key, fnvHash(key), val, stringLen + 1, maxlen + 1);
 }
 
 
 bool PrefHandler::read(const char *key, uint8_t *val, uint8_t defval) {
     uint32_t address = keyToAddress(key, false);
-    if (address < EE_DEVICE_SIZE) return memCache->Read((uint32_t)address + base_address + lkg_address, val);
+    if (address < EE_DEVICE_SIZE) return blockRead((uint32_t)address, val);
     else 
     {
         *val = defval;
@@ -404,7 +813,7 @@ bool PrefHandler::read(const char *key, uint8_t *val, uint8_t defval) {
 
 bool PrefHandler::read(const char *key, uint16_t *val, uint16_t defval) {
     uint32_t address = keyToAddress(key, false);
-    if (address < EE_DEVICE_SIZE) return memCache->Read((uint32_t)address + base_address + lkg_address, val);
+    if (address < EE_DEVICE_SIZE) return blockRead((uint32_t)address, val);
     else 
     {
         *val = defval;
@@ -414,7 +823,7 @@ bool PrefHandler::read(const char *key, uint16_t *val, uint16_t defval) {
 
 bool PrefHandler::read(const char *key, uint32_t *val, uint32_t defval) {
     uint32_t address = keyToAddress(key, false);
-    if (address < EE_DEVICE_SIZE) return memCache->Read((uint32_t)address + base_address + lkg_address, val);
+    if (address < EE_DEVICE_SIZE) return blockRead((uint32_t)address, val);
     else 
     {
         *val = defval;
@@ -424,7 +833,7 @@ bool PrefHandler::read(const char *key, uint32_t *val, uint32_t defval) {
 
 bool PrefHandler::read(const char *key, float *val, float defval) {
     uint32_t address = keyToAddress(key, false);
-    if (address < EE_DEVICE_SIZE) return memCache->Read((uint32_t)address + base_address + lkg_address, val);
+    if (address < EE_DEVICE_SIZE) return blockRead((uint32_t)address, val);
     else 
     {
         *val = defval;
@@ -434,7 +843,7 @@ bool PrefHandler::read(const char *key, float *val, float defval) {
 
 bool PrefHandler::read(const char *key, double *val, double defval) {
     uint32_t address = keyToAddress(key, false);
-    if (address < EE_DEVICE_SIZE) return memCache->Read((uint32_t)address + base_address + lkg_address, val);
+    if (address < EE_DEVICE_SIZE) return blockRead((uint32_t)address, val);
     else 
     {
         *val = defval;
@@ -449,7 +858,7 @@ bool PrefHandler::read(const char *key, char *val, const char* defval)
     {
         uint8_t c;
         int i = 0;
-        while ( memCache->Read((uint32_t)address + base_address + lkg_address + i, &c) )
+        while ( blockRead((uint32_t)address + i, &c) )
         {
             *val++ = c;
             i++;
@@ -465,13 +874,42 @@ bool PrefHandler::read(const char *key, char *val, const char* defval)
     }
 }
 
+//Loads every setting in the table with a single read of the used part of the settings block
+//instead of a lookup and cache read per key. Anything that isn't stored yet, or was stored
+//with a different size, gets its default.
+bool PrefHandler::read(const PrefBinding *prefs, size_t count)
+{
+    uint8_t block[EE_DEVICE_SIZE];
+    uint32_t startTime = micros();
+
+    while (semKeyLookup);
+    semKeyLookup = true;
+    uint32_t end = findEmptySettingLoc(); //also builds the index if need be
+    if (end > EE_DEVICE_SIZE) end = EE_DEVICE_SIZE;
+    if (end > SETTINGS_START) blockRead((uint32_t)SETTINGS_START, block + SETTINGS_START, end - SETTINGS_START);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t offset = indexLookup(prefs[i].hash);
+        if (offset && (uint32_t)(offset + 5 + prefs[i].length) <= end && block[offset + 4] == prefs[i].length)
+        {
+            memcpy(prefs[i].var, block + offset + 5, prefs[i].length);
+        }
+        else memcpy(prefs[i].var, prefs[i].defval, prefs[i].length);
+    }
+    semKeyLookup = false;
+
+    lookupCount += count;
+    lookupMicros += micros() - startTime;
+    return true;
+}
+
 uint8_t PrefHandler::calcChecksum() {
-    uint16_t counter;
+    uint8_t block[EE_DEVICE_SIZE];
     uint8_t accum = 0;
-    uint8_t temp;
-    for (counter = 1; counter < EE_DEVICE_SIZE; counter++) {
-        memCache->Read((uint32_t)counter + base_address + lkg_address, &temp);
-        accum += temp;
+    blockRead(0, block, EE_DEVICE_SIZE);
+    for (int counter = 1; counter < EE_DEVICE_SIZE; counter++) {
+        accum += block[counter];
     }
     return accum;
 }
@@ -481,7 +919,7 @@ void PrefHandler::saveChecksum() {
     uint8_t csum;
     csum = calcChecksum();
     Logger::debug("New checksum: %x", csum);
-    memCache->Write(EE_CHECKSUM + base_address + lkg_address, csum);
+    blockWrite(EE_CHECKSUM, csum);
 }
 
 bool PrefHandler::checksumValid() {
@@ -489,7 +927,7 @@ bool PrefHandler::checksumValid() {
     uint8_t stored_chk, calc_chk;
     uint16_t stored_id;
 
-    memCache->Read(EE_CHECKSUM + base_address + lkg_address, &stored_chk);
+    blockRead(EE_CHECKSUM, &stored_chk);
     
     calc_chk = calcChecksum();
     
@@ -501,11 +939,11 @@ bool PrefHandler::checksumValid() {
 
     Logger::info("Checksum matches Value: %X", calc_chk);
     
-    memCache->Read(EE_DEVICE_ID + base_address + lkg_address, &stored_id);
+    blockRead(EE_DEVICE_ID, &stored_id);
     if (stored_id == 0xFFFF) //didn't used to store the device ID properly so fix that
     {
         stored_id = deviceID;
-        memCache->Write(EE_DEVICE_ID + base_address + lkg_address, deviceID);
+        blockWrite(EE_DEVICE_ID, deviceID);
     }
     if (stored_id != deviceID)
     {
@@ -518,35 +956,82 @@ bool PrefHandler::checksumValid() {
 
 void PrefHandler::forceCacheWrite()
 {
+    if (txBuffer) return; //commitTransaction does the flushing
     memCache->FlushAllPages();
 }
 
 //Use FNV-1a hash to turn an input string into a 32 bit hash value.
 uint32_t PrefHandler::fnvHash(const char *input)
 {
-    uint32_t hash = 2166136261ul;
-    char c;
-    while (*input)
-    {
-        c = *input++;
-        c = toupper(c); //force all names to uppercase just to make it consistent
-        hash = hash ^ c;
-        hash = hash * 16777619;
-    }
-    return hash;
+    return prefHash(input);
 }
 
 //Resets the EEPROM storage for this particular PrefHandler instance. Everything will be reset
 //to 0xFF's and the cache flushed so the settings will be fresh thereafter. 
 void PrefHandler::resetEEPROM()
 {
+    abortTransaction();
     //write over all the settings 32 bits at a time
     uint32_t val = 0xFFFFFFFFul;
     for (uint32_t idx = SETTINGS_START; idx < EE_DEVICE_SIZE; idx = idx + 4)
     {
-        memCache->Write((uint32_t)idx + base_address + lkg_address, val);
+        blockWrite((uint32_t)idx, val);
     }
+    //and make sure the other copy can't come back as the newer valid one on the next boot
+    uint16_t noID = 0;
+    uint32_t other = (lkg_address == EE_MAIN_OFFSET) ? EE_LKG_OFFSET : EE_MAIN_OFFSET;
+    memCache->Write(EE_DEVICE_ID + base_address + other, noID);
     memCache->FlushAllPages();
+    invalidateIndex();
 }
 
 
+
+
+PrefCompactor::PrefCompactor()
+{
+    current = nullptr;
+    nextHandler = 0;
+    forceCount = 0;
+}
+
+void PrefCompactor::setup()
+{
+    tickHandler.detach(this);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_MEM_CACHE);
+}
+
+void PrefCompactor::compactAll()
+{
+    nextHandler = 0;
+    forceCount = PrefHandler::handlers.size();
+}
+
+void PrefCompactor::cancel(PrefHandler *handler)
+{
+    if (current == handler) current = nullptr;
+}
+
+//Either pushes the block being compacted along one step or checks one more handler to see
+//if its block needs it. Only handlers that have been used since boot are looked at.
+void PrefCompactor::handleTick()
+{
+    if (current)
+    {
+        if (current->compactStep()) return;
+        current = nullptr;
+    }
+
+    if (PrefHandler::handlers.empty()) return;
+    if (nextHandler >= PrefHandler::handlers.size()) nextHandler = 0;
+    PrefHandler *handler = PrefHandler::handlers[nextHandler++];
+    bool force = false;
+    if (forceCount)
+    {
+        forceCount--;
+        force = handler->indexValid;
+    }
+    if ((force || handler->needsCompaction()) && handler->startCompaction()) current = handler;
+}
+
+PrefCompactor prefCompactor;
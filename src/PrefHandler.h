@@ -30,11 +30,13 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define PREF_HANDLER_H_
 
 #include <Arduino.h>
+#include <vector>
 #include "config.h"
 #include "eeprom_layout.h"
 #include "MemCache.h"
 #include "devices/DeviceTypes.h"
 #include "Logger.h"
+#include "TickHandler.h"
 
 //normal or Last Known Good configuration
 #define PREF_MODE_NORMAL  false
@@ -44,8 +46,66 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //After that are 17 reserved bytes.
 #define SETTINGS_START  20
 
+//number of 16 bit entries in the device table at EE_DEVICE_TABLE. Entry 0 holds the 0xDEAD magic
+#define DEVICE_TABLE_ENTRIES  64
+
+//A record whose key moved because the setting changed size gets this as its hash. Its length is left
+//alone so walking the block still works. Compaction drops these.
+#define PREF_DEAD_HASH  0ul
+
+//Compact a block in the background once this many bytes are tied up in dead records
+//or once there's less free space than this left at the end of the block
+#define PREF_COMPACT_DEAD_BYTES  64
+#define PREF_COMPACT_MIN_FREE    96
+
 extern MemCache *memCache;
 
+//FNV-1a over the upper cased key. constexpr so that keys known at compile time get hashed by the compiler
+//and only the 32 bit hash ends up in flash. PrefHandler::fnvHash uses this too so both always agree.
+constexpr uint32_t prefHash(const char *key)
+{
+    uint32_t hash = 2166136261ul;
+    while (*key)
+    {
+        uint8_t c = (uint8_t)*key++;
+        if (c >= 'a' && c <= 'z') c -= ('a' - 'A');
+        hash = hash ^ c;
+        hash = hash * 16777619ul;
+    }
+    return hash;
+}
+
+//Describes one stored setting: its key (only kept around for error messages), the precomputed hash,
+//and the default to use if it has never been saved. Declare these static constexpr, like:
+//static constexpr Pref<uint16_t> prefRegenMin("RegenMin", 270);
+template <typename T>
+struct Pref {
+    const char *key;
+    uint32_t hash;
+    T defval;
+    constexpr Pref(const char *k, T def) : key(k), hash(prefHash(k)), defval(def) {}
+};
+
+//Ties a Pref to the variable that holds it so a whole device configuration can be loaded or saved
+//from one table. The types have to match exactly which catches a setting stored with the wrong size.
+struct PrefBinding {
+    const char *key;
+    uint32_t hash;
+    void *var;
+    const void *defval;
+    uint8_t length;
+    template <typename T>
+    PrefBinding(const Pref<T> &pref, T *v) : key(pref.key), hash(pref.hash), var(v), defval(&pref.defval), length(sizeof(T)) {}
+};
+
+//One slot in the in-RAM key index. Offset is where the record (its hash) starts within the device
+//block. Records can never start below SETTINGS_START so an offset of 0 marks an empty slot.
+struct PrefIndexEntry {
+    uint32_t hash;
+    uint16_t offset;
+    uint16_t hits; //lookups since boot. Compaction moves the busiest keys to the front of the block
+};
+
 class PrefHandler {
 public:
 
@@ -65,6 +125,8 @@ public:
     bool read(const char *key, float *val, float defval);
     bool read(const char *key, double *val, double defval);
     bool read(const char *key, char *val, const char* defval);
+    bool read(const PrefBinding *prefs, size_t count);
+    bool write(const PrefBinding *prefs, size_t count);
 
     uint8_t calcChecksum();
     void saveChecksum();
@@ -76,24 +138,106 @@ public:
     static bool setDeviceStatus(uint16_t device, bool enabled);
     static void dumpDeviceTable();
     static void initDevTable();
-    void checkTableValidity();
+    static void checkTableValidity();
+    bool beginTransaction();
+    bool commitTransaction();
+    void abortTransaction();
+    bool inTransaction();
+    bool needsCompaction();
+    static uint32_t getLookupCount();
+    static uint32_t getLookupMicros();
+    static uint32_t getIndexBuildMicros();
+    static uint32_t getEnableGeneration();
 
 private:
+    friend class PrefCompactor;
+
+    //states for compacting in the background, see compactStep()
+    enum CompactState {
+        COMPACT_IDLE,
+        COMPACT_WRITE_BODY,
+        COMPACT_WAIT_BODY,
+        COMPACT_WAIT_HEADER
+    };
+
     uint32_t base_address; //base address for the parent device
-    uint32_t lkg_address;
+    uint32_t lkg_address; //which copy of the device block is active, EE_MAIN_OFFSET or EE_LKG_OFFSET
+    uint32_t generation; //save generation of the active copy
+    uint8_t *txBuffer; //staged image of the whole block while a transaction is open, otherwise null
     uint16_t deviceID; //device ID of the device that registered this pref handler instance
     bool use_lkg; //use last known good config?
     bool enabled;
     int position; //position within the device table
     volatile bool semKeyLookup;
+    std::vector<PrefIndexEntry> keyIndex; //open addressed hash->offset table, size is always a power of two
+    uint16_t indexCount;
+    uint16_t tailOffset; //where the next record goes, or where the newest record starts if tailOpen
+    bool tailOpen; //newest record was created but its length wasn't known yet at the time
+    bool indexValid;
+    uint16_t deadBytes; //bytes taken up by dead records and records that never got a value
+    uint32_t txChanges; //bumped on every staged write so background commits can tell if they are behind
+    uint32_t compactChanges; //txChanges as of the last body write of a background commit
+    CompactState compactState;
+
+    static uint32_t lookupCount;
+    static uint32_t lookupMicros;
+    static uint32_t indexBuildMicros;
+    static uint32_t enableGeneration; //bumped whenever any device turns on or off so cached device lists know to refresh
 
     uint32_t fnvHash(const char *input);
     uint32_t findSettingLocation(uint32_t hash);
     uint32_t findEmptySettingLoc();
     uint32_t keyToAddress(const char *key, bool createIfNecessary);
+    uint32_t hashToAddress(uint32_t hash, bool createIfNecessary);
+    uint16_t indexLookup(uint32_t hash);
+    bool writeValue(const char *key, uint32_t hash, const void *val, uint8_t dataLength, uint8_t recordLength);
+    bool moveRecord(const char *key, uint32_t hash, uint32_t oldOffset, uint8_t oldLength, const void *val, uint8_t dataLength, uint8_t recordLength);
+    void buildKeyIndex();
+    void indexInsert(uint32_t hash, uint16_t offset, uint16_t hits = 0);
+    PrefIndexEntry *indexEntry(uint32_t hash);
+    void compactStaged();
+    bool startCompaction();
+    bool compactStep();
+    uint32_t otherCopy();
+    void writeStagedBody(uint32_t target);
+    void writeStagedHeader(uint32_t target, uint32_t newGen);
+    bool targetDirty(uint32_t target, bool headerOnly);
+    void finishCommit(uint32_t target, uint32_t newGen);
+    void invalidateIndex();
+    void selectActiveCopy();
+    bool copyValid(uint32_t copyAddress, uint32_t *gen);
+    bool blockRead(uint32_t offset, void *data, uint16_t len);
+    bool blockWrite(uint32_t offset, const void *data, uint16_t len);
+    template <typename T> bool blockRead(uint32_t offset, T *val) { return blockRead(offset, (void *)val, sizeof(T)); }
+    template <typename T> bool blockWrite(uint32_t offset, T val) { return blockWrite(offset, (const void *)&val, sizeof(T)); }
     static void processAutoEntry(uint16_t val, uint16_t pos);
+    static void writeDeviceTableEntry(int pos, uint16_t val);
+    static int findDeviceSlot(uint16_t device);
+
+    static std::vector<PrefHandler *> handlers; //every device handler, so the compactor can find them
+    static uint16_t deviceTable[DEVICE_TABLE_ENTRIES]; //RAM copy of the device table, loaded and checked once
+    static bool deviceTableLoaded;
 };
 
+//Looks through all the device settings blocks in the background and compacts any that have built up
+//dead records or are nearly full. Runs on the memory cache tick and never waits on the EEPROM itself,
+//it lets the cache write pages back on its own schedule.
+class PrefCompactor : public TickObserver {
+public:
+    PrefCompactor();
+    void setup();
+    void handleTick();
+    void compactAll(); //queue every block, even ones that don't need it, so hot keys get moved up front
+    void cancel(PrefHandler *handler);
+
+private:
+    PrefHandler *current; //handler being compacted right now
+    size_t nextHandler; //where to resume looking for work
+    size_t forceCount; //how many more handlers to compact whether they need it or not
+};
+
+extern PrefCompactor prefCompactor;
+
 #endif
 
 
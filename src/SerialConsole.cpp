@@ -193,69 +193,17 @@ void SerialConsole::updateSetting(const char *settingName, char *valu)
 {
     Device *deviceMatched;
     const ConfigEntry *entry = deviceManager.findConfigEntry(settingName, &deviceMatched);
-    uint8_t ui8;
-    float fl;
-    int16_t i16;
-    int32_t i32;
-    uint16_t ui16;
-    uint32_t ui32;
-
-    int result = 0;
+
     if (!entry)
     {
         Logger::console("No such configuration parameter exists!");
         return;
     }
-    switch (entry->varType)
-    {
-    case CFG_ENTRY_VAR_TYPE::BYTE:
-        ui8 = (uint8_t)strtol(valu, NULL, 0);
-        if (ui8 < entry->minValue.u_int) result = 1;
-        else if (ui8 > entry->maxValue.u_int) result = 2;
-        else *(uint8_t *)entry->varPtr = ui8;
-        break;
-    case CFG_ENTRY_VAR_TYPE::FLOAT:
-        fl = strtof(valu, NULL);
-        if (fl < entry->minValue.floating) result = 1;
-        else if (fl > entry->maxValue.floating) result = 2;
-        else *(float *)entry->varPtr = fl;
-        break;
-    case CFG_ENTRY_VAR_TYPE::INT16:
-        i16 = (int16_t)strtol(valu, NULL, 0);
-        if (i16 < entry->minValue.s_int) result = 1;
-        else if (i16 > entry->maxValue.s_int) result = 2;
-        else *(int16_t *)entry->varPtr = i16;
-        break;
-    case CFG_ENTRY_VAR_TYPE::INT32:
-        i32 = (int32_t)strtol(valu, NULL, 0);
-        if (i32 < entry->minValue.s_int) result = 1;
-        else if (i32 > entry->maxValue.s_int) result = 2;
-        else *(int32_t *)entry->varPtr = i32;
-        break;
-    case CFG_ENTRY_VAR_TYPE::STRING:
-        //this is an interesting one. It's easy in principle but we don't know
-        //the actual size of the storage buffer so it could overwrite memory.
-        //If this GEVCU thing gets popular it might be necessary to fix this
-        //otherwise this is the entry point to smashing the stack for fun and profit.
-        strcpy((char *)entry->varPtr, valu);
-        break;
-    case CFG_ENTRY_VAR_TYPE::UINT16:
-        ui16 = (uint16_t)strtol(valu, NULL, 0);
-        if (ui16 < entry->minValue.u_int) result = 1;
-        else if (ui16 > entry->maxValue.u_int) result = 2;
-        else *(uint16_t *)entry->varPtr = ui16;
-        break;
-    case CFG_ENTRY_VAR_TYPE::UINT32:
-        ui32 = (uint32_t)strtol(valu, NULL, 0);
-        if (ui32 < entry->minValue.u_int) result = 1;
-        else if (ui32 > entry->maxValue.u_int) result = 2;
-        else *(uint32_t *)entry->varPtr = ui32;
-        break;
-    }
+    int result = deviceManager.setConfigValue(entry, valu);
     if (result == 0) //value was stored
     {
         Logger::console("%s was set as value for parameter %s", valu, settingName);
-        deviceMatched->saveConfiguration();
+        deviceMatched->commitConfiguration();
     }
     if (result == 1) //value was too low
     {
@@ -290,6 +238,16 @@ void SerialConsole::printMenu() {
     Logger::console("   JSONDUMP=1 - Read config of every enabled device and store it in JSON format to sdcard");
     Logger::console("   JSONREAD=1 - Read JSON file from sdCard and update all devices accordingly");
     Logger::console("   NUKE=1 - Resets all device settings in EEPROM. You have been warned.");
+    Logger::console("   M = show EEPROM memory cache statistics");
+    Logger::console("   CACHESTATS=0 - Reset EEPROM memory cache statistics");
+    Logger::console("   S = list status entries and status dispatch timing");
+    Logger::console("   P = show posted device message queue statistics");
+    Logger::console("   R = show the boot report (setup time of each device and boot step)");
+    Logger::console("   G = show logging statistics and heap usage");
+    Logger::console("   g = time Logger::debug formatted on the spot against deferred");
+    Logger::console("   T = show status recorder bytes and time per sample");
+    Logger::console("   COMPACT=1 - Compact all device settings blocks in the background");
+    Logger::console("   DEVLOG=<id>,<level> - log level for one device (0x7400 for CAN frames). 5 goes back to the system level");
 
     deviceManager.printDeviceList();
 
@@ -314,6 +272,8 @@ void SerialConsole::printMenu() {
 
     Logger::console("\nANALOG AND DIGITAL IO\n");
     Logger::console("   A = Autocompensate ADC inputs");
+    Logger::console("   D = show digital IO state and I2C transactions per second");
+    Logger::console("   I = show analog sampler load, sample rates and read cost");
     Logger::console("   J = set all digital outputs low");
     Logger::console("   K = set all digital outputs high");
 
@@ -441,6 +401,38 @@ void SerialConsole::handleConfigCmd() {
                         systemIO.getDigitalOutput(0), systemIO.getDigitalOutput(1), systemIO.getDigitalOutput(2), systemIO.getDigitalOutput(3), 
                         systemIO.getDigitalOutput(4), systemIO.getDigitalOutput(5), systemIO.getDigitalOutput(6), systemIO.getDigitalOutput(7));
 
+    } else if (cmdString == String("DEVLOG")) {
+        //DEVLOG=id shows the level, DEVLOG=id,level sets it. -1 is avalanche, 5 clears the override
+        char *end;
+        uint16_t id = strtol(strVal, &end, 0);
+        if (*end != ',')
+        {
+            Logger::console("Log level for ID %X: %d", id, Logger::getDeviceLogLevel(id));
+        }
+        else
+        {
+            int level = strtol(end + 1, NULL, 0);
+            Device *dev = deviceManager.getDeviceByID(id);
+            SystemDevice *sysDev = (SystemDevice *)deviceManager.getDeviceByID(SYSTEM);
+            if (level < -1 || level > Logger::Default)
+            {
+                Logger::console("Log level must be between -1 and 5");
+            }
+            else if (dev)
+            {
+                dev->setLogLevel(level);
+                Logger::console("Log level for %s set to %d", dev->getShortName(), level);
+            }
+            else if (id == CANHANDLER && sysDev)
+            {
+                sysDev->setCanLogLevel(level);
+                Logger::console("Log level for CAN frames set to %d", level);
+            }
+            else
+            {
+                Logger::console("Invalid device ID (%X, %d)", id, id);
+            }
+        }
     } else if (cmdString == String("NUKE")) {
         if (newValue == 1) {
             Logger::console("Start of EEPROM Nuke");
@@ -448,6 +440,16 @@ void SerialConsole::handleConfigCmd() {
             memCache->nukeFromOrbit(); //then completely erase EEPROM
             Logger::console("Device settings have been nuked. Reboot to reload default settings");
         }
+    } else if (cmdString == String("CACHESTATS")) {
+        if (newValue == 0) {
+            memCache->resetStats();
+            Logger::console("Memory cache statistics reset");
+        }
+    } else if (cmdString == String("COMPACT")) {
+        if (newValue == 1) {
+            prefCompactor.compactAll();
+            Logger::console("Device settings will be compacted in the background");
+        }
     } else if (cmdString == String("DUMP")) {
         if (newValue == 1) {
             generateEEPROMBinary();
@@ -517,7 +519,7 @@ void SerialConsole::handleShortCmd() {
         break;
     case 'Z': // save throttle settings
         if (accelerator) {
-            accelerator->saveConfiguration();
+            accelerator->commitConfiguration();
         }
         break;
     case 'b':
@@ -528,7 +530,7 @@ void SerialConsole::handleShortCmd() {
         break;
     case 'B':
         if (brake != NULL) {
-            brake->saveConfiguration();
+            brake->commitConfiguration();
         }
         break;
     
@@ -537,7 +539,7 @@ void SerialConsole::handleShortCmd() {
         {
             systemIO.calibrateADCOffset(i, true);
         }        
-        sysDev->saveConfiguration();
+        sysDev->commitConfiguration();
         systemIO.setup_ADC_params(); //change takes immediate effect
         break;
     case 'a':
@@ -549,6 +551,36 @@ void SerialConsole::handleShortCmd() {
     case 'Q':
         PrefHandler::initDevTable();
         break;
+    case 'M':
+        memCache->printStats();
+        break;
+    case 'S':
+        deviceManager.printAllStatusEntries();
+        break;
+    case 'P':
+        deviceManager.printMessageStats();
+        break;
+    case 'R':
+        deviceManager.printBootReport();
+        break;
+    case 'G':
+        Logger::printStats();
+        break;
+    case 'g':
+        Logger::benchmark();
+        break;
+    case 'D':
+        systemIO.printDigitalStats();
+        break;
+    case 'I':
+        systemIO.printADCStats();
+        break;
+    case 'T':
+    {
+        StatusRecorder *recorder = (StatusRecorder *)deviceManager.getDeviceByID(STATUSRECORDER);
+        if (recorder) recorder->printStats();
+        break;
+    }
     }
 }
 
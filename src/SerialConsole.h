@@ -41,6 +41,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "devices/io/ThrottleDetector.h"
 #include "devices/bms/BatteryManager.h"
 #include "devices/misc/Precharger.h"
+#include "devices/misc/SystemDevice.h"
+#include "devices/misc/StatusRecorder.h"
 
 class SerialConsole {
 public:
@@ -0,0 +1,127 @@
+/*
+ * StatusRegistry.cpp
+ *
+ * Packed storage for all registered status entries.
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "StatusRegistry.h"
+#include "Logger.h"
+
+StatusRegistry::StatusRegistry() : bytes(BYTE), strings(STRING), int16s(INT16), uint16s(UINT16),
+    int32s(INT32), uint32s(UINT32), floats(FLOAT)
+{
+    polledCount = 0;
+}
+
+void StatusRegistry::add(const StatusEntry &entry)
+{
+    if (!entry.varPtr || !entry.statusName)
+    {
+        Logger::error("Status entry is missing its name or variable, not registered");
+        return;
+    }
+
+    switch (entry.varType)
+    {
+    case BYTE:
+        bytes.add(entry);
+        break;
+    case STRING:
+        strings.add(entry);
+        break;
+    case INT16:
+        int16s.add(entry);
+        break;
+    case UINT16:
+        uint16s.add(entry);
+        break;
+    case INT32:
+        int32s.add(entry);
+        break;
+    case UINT32:
+        uint32s.add(entry);
+        break;
+    case FLOAT:
+        floats.add(entry);
+        break;
+    }
+    if (!entry.genPtr) polledCount++;
+}
+
+uint16_t StatusRegistry::remove(const char *name)
+{
+    uint16_t removed = 0;
+    uint16_t polledRemoved = 0;
+    forEachColumn([&](auto &col) {
+        removed += col.removeIf([name](const StatusInfo &inf) { return !strcmp(inf.name, name); }, polledRemoved);
+    });
+    polledCount -= polledRemoved;
+    return removed;
+}
+
+uint16_t StatusRegistry::removeDevice(Device *dev)
+{
+    uint16_t removed = 0;
+    uint16_t polledRemoved = 0;
+    forEachColumn([&](auto &col) {
+        removed += col.removeIf([dev](const StatusInfo &inf) { return inf.device == dev; }, polledRemoved);
+    });
+    polledCount -= polledRemoved;
+    return removed;
+}
+
+//Used when an observer goes away so whoever takes its slot next doesn't get its leftover updates
+void StatusRegistry::clearPending(uint8_t observerBit)
+{
+    forEachColumn([observerBit](auto &col) {
+        for (size_t i = 0; i < col.size(); i++) col.pending[i] &= ~observerBit;
+    });
+}
+
+//idx is the position within the column for that type, like the name index keeps
+bool StatusRegistry::getEntry(CFG_ENTRY_VAR_TYPE type, size_t idx, StatusEntry *entry)
+{
+    bool found = false;
+    forEachColumn([&](auto &col) {
+        if (col.varType == type && idx < col.size())
+        {
+            *entry = col.entryAt(idx);
+            found = true;
+        }
+    });
+    return found;
+}
+
+size_t StatusRegistry::size()
+{
+    size_t total = 0;
+    forEachColumn([&total](auto &col) { total += col.size(); });
+    return total;
+}
+
+uint16_t StatusRegistry::getPolledCount()
+{
+    return polledCount;
+}
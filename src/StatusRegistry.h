@@ -0,0 +1,199 @@
+/*
+ * StatusRegistry.h
+ *
+ * Packed storage for all registered status entries. DeviceManager owns one of these.
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef STATUS_REGISTRY_H_
+#define STATUS_REGISTRY_H_
+
+#include <Arduino.h>
+#include <vector>
+#include "config.h"
+#include "devices/DeviceTypes.h"
+
+//How the last seen value of a status variable is kept and compared. Numbers are kept as themselves,
+//strings get a copy of the text so a change can be found with an exact compare.
+template <typename T>
+struct StatusValue
+{
+    typedef T Stored;
+    static bool same(const T *var, const Stored &last) { return *var == last; }
+    static void store(Stored &last, const T *var) { last = *var; }
+};
+
+template <>
+struct StatusValue<char>
+{
+    typedef String Stored;
+    static bool same(const char *var, const Stored &last) { return strcmp(var, last.c_str()) == 0; }
+    static void store(Stored &last, const char *var) { last = var; }
+};
+
+//The parts of an entry that aren't needed to find out if it changed
+struct StatusInfo
+{
+    const char *name;
+    Device *device;
+    uint32_t lastSent[CFG_STATUS_NUM_OBSERVERS]; //millis() when each observer last got this entry, for rate limiting
+};
+
+/*
+All status entries of one variable type, kept as parallel arrays. A dispatch pass mostly walks the var,
+generation and last value arrays which are small and packed together, and compares in the native type
+instead of going through a double. Order doesn't matter so removing an entry moves the last one into its spot.
+*/
+template <typename T>
+class StatusColumn
+{
+public:
+    typedef typename StatusValue<T>::Stored Stored;
+
+    const CFG_ENTRY_VAR_TYPE varType;
+    std::vector<const T *> vars;
+    std::vector<const volatile uint32_t *> gens; //null for a plain variable that has to be compared every pass
+    std::vector<uint32_t> lastGens;
+    std::vector<Stored> lastValues;
+    std::vector<uint8_t> pending; //bit per observer that still has to be told about a change
+    std::vector<StatusInfo> info;
+
+    StatusColumn(CFG_ENTRY_VAR_TYPE type) : varType(type) {}
+
+    size_t size() const { return vars.size(); }
+
+    void add(const StatusEntry &entry)
+    {
+        const T *var = (const T *)entry.varPtr;
+        vars.push_back(var);
+        gens.push_back(entry.genPtr);
+        lastGens.push_back(entry.genPtr ? *entry.genPtr : 0);
+        lastValues.push_back(Stored());
+        StatusValue<T>::store(lastValues.back(), var);
+        pending.push_back(0);
+        StatusInfo newInfo;
+        newInfo.name = entry.statusName;
+        newInfo.device = entry.device;
+        for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++) newInfo.lastSent[i] = 0;
+        info.push_back(newInfo);
+    }
+
+    void removeAt(size_t idx)
+    {
+        size_t last = vars.size() - 1;
+        if (idx != last)
+        {
+            vars[idx] = vars[last];
+            gens[idx] = gens[last];
+            lastGens[idx] = lastGens[last];
+            lastValues[idx] = lastValues[last];
+            pending[idx] = pending[last];
+            info[idx] = info[last];
+        }
+        vars.pop_back();
+        gens.pop_back();
+        lastGens.pop_back();
+        lastValues.pop_back();
+        pending.pop_back();
+        info.pop_back();
+    }
+
+    //Has this entry changed since the last time we asked? StatusVars only need their generation checked.
+    bool changed(size_t idx)
+    {
+        if (gens[idx])
+        {
+            uint32_t gen = *gens[idx];
+            if (gen == lastGens[idx]) return false;
+            lastGens[idx] = gen;
+        }
+        else if (StatusValue<T>::same(vars[idx], lastValues[idx])) return false;
+        StatusValue<T>::store(lastValues[idx], vars[idx]);
+        return true;
+    }
+
+    //removes every entry the predicate matches, returns how many went and how many of those were polled
+    template <typename F>
+    uint16_t removeIf(F match, uint16_t &polledRemoved)
+    {
+        uint16_t removed = 0;
+        size_t idx = 0;
+        while (idx < size())
+        {
+            if (match(info[idx]))
+            {
+                if (!gens[idx]) polledRemoved++;
+                removeAt(idx); //the last entry now sits at idx so don't move on
+                removed++;
+            }
+            else idx++;
+        }
+        return removed;
+    }
+
+    StatusEntry entryAt(size_t idx) const
+    {
+        StatusEntry entry(info[idx].name, (void *)vars[idx], varType, info[idx].device);
+        entry.genPtr = gens[idx];
+        return entry;
+    }
+};
+
+class StatusRegistry
+{
+public:
+    StatusRegistry();
+    void add(const StatusEntry &entry);
+    uint16_t remove(const char *name);
+    uint16_t removeDevice(Device *dev);
+    void clearPending(uint8_t observerBit);
+    bool getEntry(CFG_ENTRY_VAR_TYPE type, size_t idx, StatusEntry *entry);
+    size_t size();
+    uint16_t getPolledCount();
+
+    //calls fn once for each column. fn has to take any StatusColumn<T>&, a generic lambda does that
+    template <typename F>
+    void forEachColumn(F fn)
+    {
+        fn(bytes);
+        fn(strings);
+        fn(int16s);
+        fn(uint16s);
+        fn(int32s);
+        fn(uint32s);
+        fn(floats);
+    }
+
+private:
+    StatusColumn<uint8_t> bytes;
+    StatusColumn<char> strings;
+    StatusColumn<int16_t> int16s;
+    StatusColumn<uint16_t> uint16s;
+    StatusColumn<int32_t> int32s;
+    StatusColumn<uint32_t> uint32s;
+    StatusColumn<float> floats;
+    uint16_t polledCount; //entries that aren't StatusVars and so get compared on every pass
+};
+
+#endif
@@ -51,6 +51,17 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //really does nothing. The Teensy processor actually could basically saturate the 480mbit USB connection if it wanted to.
 #define CFG_SERIAL_SPEED 115200
 
+/*
+ * LOGGING
+ */
+//Calls through the LOG_ macros in Logger.h below this level are compiled out completely.
+//-1 = avalanche (keep everything), 0 = debug, 1 = info and so on. Release builds might use 1.
+#define CFG_LOG_MIN_LEVEL -1
+
+//Write the sdcard log LZ4 compressed (GevcuLogNNNNNN.lz4) instead of as plain text. Files come out at roughly
+//a third of the size for the cost of compressing a 4K block every so often. Read them with "lz4 -d" or tools/gvlz4.py
+//#define CFG_LOG_COMPRESS
+
 //The defines that used to be here to configure devices are gone now.
 //The EEPROM stores which devices to bring up at start up and all
 //devices are programmed into the firware at the same time.
@@ -67,7 +78,20 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CFG_TIMER_NUM_OBSERVERS	    16 // the maximum number of supported observers per timer
 #define CFG_TIMER_USE_QUEUING	    // if defined, TickHandler uses a queuing buffer instead of direct calls from interrupts - MUCH safer!
 #define CFG_TIMER_BUFFER_SIZE	    100 // the size of the queuing buffer for TickHandler
+#define CFG_ADC_SAMPLE_INTERVAL     50 // microseconds between analog sampler interrupts. Each input comes around every 8 of them
+#define CFG_ADC_RING_SIZE           16 // samples kept per analog input, power of 2
+#define CFG_PCA_REFRESH_INTERVAL    50 // ms between reads of the digital inputs when DIG_INT hasn't asked for one sooner
 #define CFG_FAULT_HISTORY_SIZE	    50 //number of faults to store in eeprom. A circular buffer so the last 50 faults are always stored.
+#define CFG_MSG_QUEUE_SIZE          32 // posted device messages waiting for the main loop
+#define CFG_MSG_LATENCY_TYPES       16 // posted message types that get their own delivery latency figures
+#define CFG_MSG_LOOP_BUDGET         500 // microseconds of posted message delivery per main loop pass, at least one message always goes
+#define CFG_LOG_RING_SIZE           8192 // bytes of log records waiting to be formatted from the main loop
+#define CFG_LOG_MAX_RECORD          256 // largest single deferred log record, long string arguments get cut to fit
+#define CFG_LOG_LOOP_BUDGET         1000 // microseconds of log formatting per main loop pass, at least one record always goes
+#define CFG_LOG_DEVICE_LEVELS       16 // devices that can have their own log level at once
+#define CFG_BOOT_REPORT_STEPS       48 // timed boot steps (device setups and milestones) kept for the boot report
+#define CFG_RECORDER_MAX_CHANNELS   64 // status entries the status recorder can sample at once
+#define CFG_RECORDER_BUFFER_SIZE    16384 // bytes of encoded samples waiting to go out to the sdcard
 
 /*
  * PIN ASSIGNMENT
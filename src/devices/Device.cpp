@@ -26,6 +26,7 @@
 
 #include "Device.h"
 #include "../DeviceManager.h"
+#include "../Logger.h"
 
 Device::Device() {
     deviceConfiguration = NULL;
@@ -62,8 +63,9 @@ void Device::disableDevice()
         canHandlerBus1.detachAll(obs);
         canHandlerBus2.detachAll(obs);
     }
-    //send disable message to the device in case it wants to do anything fancy
-    deviceManager.sendMessage(DEVICE_ANY, this->getId(), MSG_DISABLE, NULL);
+    //send disable message to the device in case it wants to do anything fancy. Posted, not sent, as
+    //this usually gets called from inside one of the device's own handlers
+    deviceManager.postMessage(DEVICE_ANY, this->getId(), MSG_DISABLE, NULL);
 }
 
 const char* Device::getCommonName() {
@@ -83,6 +85,7 @@ uint32_t Device::getTickInterval() {
 
 //just bubbles up the value from the preference handler.
 bool Device::isEnabled() {
+    if (!prefsHandler) return false; //not through MSG_STARTUP yet
     return prefsHandler->isEnabled();
 }
 
@@ -107,12 +110,34 @@ DeviceId Device::getId() {
     return INVALID;
 }
 
+StartupPhase Device::getStartupPhase() {
+    return PHASE_NORMAL;
+}
+
+//Device types this one uses and so wants set up before itself. A list ending in DEVICE_NONE or nullptr for none
+const DeviceType *Device::getDependencies() {
+    return nullptr;
+}
+
 void Device::loadConfiguration() {
 }
 
 void Device::saveConfiguration() {
 }
 
+//Runs saveConfiguration as a single settings transaction. All the writes are staged in RAM and then go
+//out to the inactive copy of the device block in one go, so pulling power mid save keeps the old settings.
+//If the block is being compacted in the background the writes just join that commit.
+void Device::commitConfiguration() {
+    if (!prefsHandler || prefsHandler->inTransaction() || !prefsHandler->beginTransaction())
+    {
+        saveConfiguration();
+        return;
+    }
+    saveConfiguration();
+    prefsHandler->commitTransaction();
+}
+
 DeviceConfiguration *Device::getConfiguration() {
     //if (!this->deviceConfiguration) this->loadConfiguration(); //try to load configuration if it hasn't been done yet.
     return this->deviceConfiguration;
@@ -131,20 +156,30 @@ void Device::zapConfiguration()
 {
     prefsHandler->resetEEPROM();
     loadConfiguration(); //then try to reload configuration to bring it back to defaults
+    loadLogLevel();
 }
 
+//Every device can have its own log level. Stored like the system level, a byte with 255 for avalanche.
+//Not part of loadConfiguration since plenty of drivers override that without calling up to Device.
+void Device::loadLogLevel()
+{
+    if (!prefsHandler) return;
+    uint8_t level;
+    prefsHandler->read("DevLogLevel", &level, Logger::Default);
+    Logger::setDeviceLogLevel(getId(), (Logger::LogLevel)(int8_t)level);
+}
+
+//Logger::Default puts the device back on the system level
+void Device::setLogLevel(int8_t level)
+{
+    Logger::setDeviceLogLevel(getId(), (Logger::LogLevel)level);
+    if (prefsHandler) prefsHandler->write("DevLogLevel", (uint8_t)level);
+}
+
+//goes through the device manager's name index instead of searching cfgEntries
 const ConfigEntry* Device::findConfigEntry(const char *settingName)
 {
-    for (size_t idx = 0; idx < cfgEntries.size(); idx++)
-    {
-        //Serial.printf("%s %s\n", settingName, ent.cfgName.c_str());
-        if (!strcmp(settingName, cfgEntries.at(idx).cfgName.c_str()))
-        {
-            //Serial.printf("Found it. Address is %x\n", &entries->at(idx));
-            return &cfgEntries.at(idx);
-        }
-    }
-    return nullptr;
+    return deviceManager.findConfigEntry(this, settingName);
 }
 
 
@@ -46,6 +46,14 @@ class DeviceConfiguration {
 
 };
 
+//Devices get set up one phase at a time. Within a phase a device is set up after every enabled device
+//of the types it depends on. See DeviceManager::setupDevices()
+enum StartupPhase {
+    PHASE_HARDWARE,  //slow external hardware that should start coming up as early as possible
+    PHASE_NORMAL,    //most devices
+    PHASE_LATE       //things that mostly just watch other devices
+};
+
 /*
  * A abstract class for all Devices.
  */
@@ -58,6 +66,8 @@ public:
     virtual void disableDevice();
     virtual DeviceType getType();
     virtual DeviceId getId();
+    virtual StartupPhase getStartupPhase();
+    virtual const DeviceType *getDependencies();
     void handleTick();
     bool isEnabled();
     virtual uint32_t getTickInterval();
@@ -66,11 +76,14 @@ public:
 
     virtual void loadConfiguration();
     virtual void saveConfiguration();
+    void commitConfiguration();
     DeviceConfiguration *getConfiguration();
     void zapConfiguration();
     void setConfiguration(DeviceConfiguration *);
     const std::vector<ConfigEntry> *getConfigEntries();
     const ConfigEntry* findConfigEntry(const char *settingName);
+    void loadLogLevel();
+    void setLogLevel(int8_t level);
 
 protected:
     PrefHandler *prefsHandler;
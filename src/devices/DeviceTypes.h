@@ -28,6 +28,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define DEVICE_TYPES_H_
 
 #include <Arduino.h>
+#include "../config.h"
 
 class Device;
 typedef String (Device::*DescribeValue)();
@@ -85,7 +86,7 @@ struct ConfigEntry
     void *varPtr; //pointer to the variable whose value we'd like to get or set
     CFG_ENTRY_VAR_TYPE varType; //what sort of variable were we pointing to?
     minMaxType minValue; //minimum acceptable value
-    minMaxType maxValue; //maximum acceptable value
+    minMaxType maxValue; //maximum acceptable value. For strings the most characters the buffer holds, not counting the terminator
     uint8_t precision; //number of decimal places to display. Obv. 0 for integers
     DescribeValue descFunc; //if this function pointer is non-null it'll be used to turn values into strings.
 };
@@ -101,79 +102,122 @@ be updated. But, the StatusManager would not be doing the updating. It should al
 to register callbacks that would happen when a status entry is updated. In this way something like the
 esp32 could receive a callback only when things update and thus updates would only happen when necessary.
 */
+
+//Bumped by every StatusVar that changes value. DeviceManager compares this against what it saw last time
+//so it can skip looking through the status entries at all when nothing has changed. Defined in DeviceManager.cpp
+extern volatile uint32_t statusChangeCount;
+
+template <typename T> struct StatusVarType;
+template <> struct StatusVarType<uint8_t> { static const CFG_ENTRY_VAR_TYPE type = BYTE; };
+template <> struct StatusVarType<bool> { static const CFG_ENTRY_VAR_TYPE type = BYTE; };
+template <> struct StatusVarType<int16_t> { static const CFG_ENTRY_VAR_TYPE type = INT16; };
+template <> struct StatusVarType<uint16_t> { static const CFG_ENTRY_VAR_TYPE type = UINT16; };
+template <> struct StatusVarType<int32_t> { static const CFG_ENTRY_VAR_TYPE type = INT32; };
+template <> struct StatusVarType<uint32_t> { static const CFG_ENTRY_VAR_TYPE type = UINT32; };
+template <> struct StatusVarType<float> { static const CFG_ENTRY_VAR_TYPE type = FLOAT; };
+
+/*
+A status variable that knows when it has been changed. Use it in place of the plain variable for anything
+registered as a StatusEntry and assign to it as normal. Writing a new value bumps its generation so
+DeviceManager only has to compare two integers to see if it changed instead of converting and comparing
+every entry on every tick. The value has to stay the first member, StatusEntry points straight at it.
+Note that this is a class, pass it to printf style functions with .get() or a cast.
+*/
+template <typename T>
+class StatusVar
+{
+public:
+    StatusVar() : value(), generation(0) {}
+    StatusVar(T val) : value(val), generation(0) {}
+
+    StatusVar &operator=(T newVal)
+    {
+        if (newVal != value)
+        {
+            value = newVal;
+            generation++;
+            statusChangeCount++;
+        }
+        return *this;
+    }
+    StatusVar &operator=(const StatusVar &other) { return *this = other.get(); }
+    StatusVar &operator+=(T val) { return *this = value + val; }
+    StatusVar &operator-=(T val) { return *this = value - val; }
+    StatusVar &operator*=(T val) { return *this = value * val; }
+    StatusVar &operator/=(T val) { return *this = value / val; }
+    operator T() const { return value; }
+    T get() const { return value; }
+    T *ptr() { return &value; }
+    const volatile uint32_t *generationPtr() const { return &generation; }
+
+private:
+    StatusVar(const StatusVar &) = delete; //copying would split the value from its registered entry
+    T value;
+    volatile uint32_t generation;
+};
+
+//This is only the description a device hands to DeviceManager::addStatusEntry and what observers get handed
+//with MSG_CONFIG_CHANGE. DeviceManager keeps the registered entries in its own packed form, see StatusRegistry.h
 struct StatusEntry
 {
-    String statusName;
+    const char *statusName; //not copied! Use a string literal or something else that lives as long as the entry
     void *varPtr;
     CFG_ENTRY_VAR_TYPE varType;
-    double lastValue;
     Device *device;
+    const volatile uint32_t *genPtr; //generation of the StatusVar behind varPtr or null for a plain variable
 
     StatusEntry()
     {
-        statusName = String();
+        statusName = nullptr;
         varPtr = nullptr;
         varType = CFG_ENTRY_VAR_TYPE::BYTE;
-        lastValue = 0.0;
         device = nullptr;
+        genPtr = nullptr;
     }
 
-    StatusEntry(String name, void *ptr, CFG_ENTRY_VAR_TYPE type, double val, Device *dev)
+    StatusEntry(const char *name, void *ptr, CFG_ENTRY_VAR_TYPE type, Device *dev)
     {
         statusName = name;
         varPtr = ptr;
         varType = type;
-        lastValue = val;
         device = dev;
+        genPtr = nullptr;
     }
 
-    double getValueAsDouble()
+    template <typename T>
+    StatusEntry(const char *name, StatusVar<T> *var, Device *dev)
     {
-        double out;
-        if (varType == BYTE)
-        {
-            uint8_t v = *((uint8_t*)varPtr);
-            out = (double)v;
-            return out;
-        }
-        if (varType == STRING) //this one is special. Sum all characters to give a numeric result
-        {
-            char *str = (char *)varPtr;
-            while (str) out += *str++;
-            return out;
-        }
-        if (varType == INT16)
-        {
-            int16_t v = *((int16_t*)varPtr);
-            out = (double)v;
-            return out;
-        }
-        if (varType == UINT16)
-        {
-            uint16_t v = *((uint16_t*)varPtr);
-            out = (double)v;
-            return out;
-        }
-        if (varType == INT32)
+        statusName = name;
+        varPtr = var->ptr();
+        varType = StatusVarType<T>::type;
+        device = dev;
+        genPtr = var->generationPtr();
+    }
+
+    double getValueAsDouble() const
+    {
+        switch (varType)
         {
-            int32_t v = *((int32_t*)varPtr);
-            out = (double)v;
-            return out;
-        }
-        if (varType == UINT32)
+        case BYTE:
+            return (double)*((uint8_t *)varPtr);
+        case STRING: //this one is special. Sum all characters to give a numeric result
         {
-            uint32_t v = *((uint32_t*)varPtr);
-            out = (double)v;
+            double out = 0.0;
+            for (const char *str = (const char *)varPtr; *str; str++) out += *str;
             return out;
         }
-        if (varType == FLOAT)
-        {
-            float v = *((float*)varPtr);
-            out = (double)v;
-            return out;
+        case INT16:
+            return (double)*((int16_t *)varPtr);
+        case UINT16:
+            return (double)*((uint16_t *)varPtr);
+        case INT32:
+            return (double)*((int32_t *)varPtr);
+        case UINT32:
+            return (double)*((uint32_t *)varPtr);
+        case FLOAT:
+            return (double)*((float *)varPtr);
         }
-        out = 0.0;
-        return out;
+        return 0.0;
     }
 };
 
@@ -198,6 +242,7 @@ of all registered devices and get the list that way.
 #define SYSTEM 0x7100
 #define HEARTBEAT 0x7200
 #define MEMCACHE 0x7300
+#define CANHANDLER 0x7400 //not a device but CAN frame logging gets its own log level under this ID
 #define INVALID 0xFFFF
 
 typedef uint16_t DeviceId;
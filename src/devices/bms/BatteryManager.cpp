@@ -27,6 +27,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "BatteryManager.h"
+#include "../../PersistJournal.h"
 
 BatteryManager::BatteryManager() : Device()
 {
@@ -43,8 +44,9 @@ DeviceType BatteryManager::getType() {
     return (DEVICE_BMS);
 }
 
+//Keep the last state of charge in the journal so it is known right away after a restart
 void BatteryManager::handleTick() {
-    
+    persistJournal.setValue(JV_SOC, (uint32_t)(SOC * 10.0f));
 }
 
 void BatteryManager::setup() {
@@ -69,6 +71,9 @@ void BatteryManager::setup() {
     entry = {"TEMPLIMLO", "Low limit for pack and cell temperature in degrees C", &config->lowTempLimit, CFG_ENTRY_VAR_TYPE::FLOAT, {.floating = -255.0}, {.floating = 255.0}, 1, nullptr};
     cfgEntries.push_back(entry);
 
+    //until the BMS reports in, start from the state of charge it reported last
+    if (persistJournal.isValid()) SOC = persistJournal.getValue(JV_SOC) / 10.0f;
+
 #ifndef USE_HARD_CODED
     if (prefsHandler->checksumValid()) { //checksum is good, read in the values stored in EEPROM
     }
@@ -58,12 +58,12 @@ void ChargeController::setup()
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name              var         type                  prevVal  obj
-    stat = {"CHGR_OutputV", &outputVoltage, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    //        name              var         obj
+    stat = StatusEntry("CHGR_OutputV", &outputVoltage, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"CHGR_OutputC", &outputCurrent, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("CHGR_OutputC", &outputCurrent, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"CHGR_Temperature", &deviceTemperature, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("CHGR_Temperature", &deviceTemperature, this);
     deviceManager.addStatusEntry(stat);
 }
 
@@ -61,9 +61,9 @@ public:
     virtual void saveConfiguration();
 
 protected:
-    float outputVoltage;
-    float outputCurrent;
-    float deviceTemperature;
+    StatusVar<float> outputVoltage;
+    StatusVar<float> outputCurrent;
+    StatusVar<float> deviceTemperature;
     bool isEnabled;
     bool isFaulted;
 };
@@ -58,12 +58,12 @@ void DCDCController::setup()
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name              var         type                  prevVal  obj
-    stat = {"DC_OutputV", &outputVoltage, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    //        name              var         obj
+    stat = StatusEntry("DC_OutputV", &outputVoltage, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"DC_OutputC", &outputCurrent, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("DC_OutputC", &outputCurrent, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"DC_Temperature", &deviceTemperature, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("DC_Temperature", &deviceTemperature, this);
     deviceManager.addStatusEntry(stat);
 }
 
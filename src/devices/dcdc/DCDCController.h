@@ -62,9 +62,9 @@ public:
     virtual void saveConfiguration();
 
 protected:
-    float outputVoltage;
-    float outputCurrent;
-    float deviceTemperature;
+    StatusVar<float> outputVoltage;
+    StatusVar<float> outputCurrent;
+    StatusVar<float> deviceTemperature;
     bool isEnabled;
     bool isFaulted;
 };
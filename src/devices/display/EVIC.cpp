@@ -409,6 +409,11 @@ DeviceId EVIC::getId() {
     return (EVICTUS);
 }
 
+const DeviceType *EVIC::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_MOTORCTRL, DEVICE_NONE};
+    return deps;
+}
+
 
 void EVIC::loadConfiguration() {
     //EVICConfiguration *config = (EVICConfiguration *)getConfiguration();
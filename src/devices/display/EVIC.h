@@ -64,6 +64,7 @@ public:
     void timestamp();
     DeviceType getType();
     DeviceId getId();
+    const DeviceType *getDependencies();
 
     char *getTimeRunning();
     void loadConfiguration();
@@ -484,6 +484,11 @@ DeviceId UDSController::getId() {
     return UDSCONTROLLER;
 }
 
+const DeviceType *UDSController::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_MOTORCTRL, DEVICE_NONE};
+    return deps;
+}
+
 void UDSController::loadConfiguration() {
     UDSConfiguration *config = (UDSConfiguration *) getConfiguration();
 
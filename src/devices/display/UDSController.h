@@ -115,6 +115,7 @@ public:
     void handleCanFrame(const CAN_message_t &frame);
     void handleIsoTP(const ISOTP_data &iso_config, const uint8_t *buf);
     DeviceId getId();
+    const DeviceType *getDependencies();
 
     void loadConfiguration();
     void saveConfiguration();
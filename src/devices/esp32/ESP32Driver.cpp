@@ -180,6 +180,8 @@ ESP32Driver::ESP32Driver() : Device()
     desiredState = ESP32NS::RESET;
     systemAlive = false;
     systemEnabled = false;
+    resetStep = 0;
+    resetStepTime = 0;
 }
 
 void ESP32Driver::earlyInit()
@@ -198,13 +200,13 @@ void ESP32Driver::setup()
     ESP32Configuration *config = (ESP32Configuration *) getConfiguration();
 
     ConfigEntry entry;
-    entry = {"ESP32-SSID", "Set SSID to create or connect to", &config->ssid, CFG_ENTRY_VAR_TYPE::STRING, 0, 4096, 0, nullptr};
+    entry = {"ESP32-SSID", "Set SSID to create or connect to", &config->ssid, CFG_ENTRY_VAR_TYPE::STRING, 0, sizeof(config->ssid) - 1, 0, nullptr};
     cfgEntries.push_back(entry);
 
-    entry = {"ESP32-PW", "Set WiFi password / WPA2 Key", &config->ssid_pw, CFG_ENTRY_VAR_TYPE::STRING, 0, 4096, 0, nullptr};
+    entry = {"ESP32-PW", "Set WiFi password / WPA2 Key", &config->ssid_pw, CFG_ENTRY_VAR_TYPE::STRING, 0, sizeof(config->ssid_pw) - 1, 0, nullptr};
     cfgEntries.push_back(entry);
 
-    entry = {"ESP32-HOSTNAME", "Set wireless host name (mDNS / OTA)", &config->hostName, CFG_ENTRY_VAR_TYPE::STRING, 0, 4096, 0, nullptr};
+    entry = {"ESP32-HOSTNAME", "Set wireless host name (mDNS / OTA)", &config->hostName, CFG_ENTRY_VAR_TYPE::STRING, 0, sizeof(config->hostName) - 1, 0, nullptr};
     cfgEntries.push_back(entry);
 
     entry = {"ESP32-MODE", "Set ESP32 Mode (0 = Create AP, 1 = Connect to SSID)", &config->esp32_mode, CFG_ENTRY_VAR_TYPE::BYTE, 0, 1, 0, nullptr};
@@ -225,6 +227,10 @@ void ESP32Driver::setup()
     pinMode(ESP32_BOOT, OUTPUT);
     digitalWrite(ESP32_ENABLE, LOW); //start in reset
     digitalWrite(ESP32_BOOT, HIGH); //use normal mode not bootloader mode (bootloader is active low)
+    //the reset is timed from here so the hold runs while the rest of the devices are being set up
+    currState = ESP32NS::RESET;
+    resetStep = 0;
+    resetStepTime = millis();
     desiredState = ESP32NS::NORMAL;
     //without a large read buffer this tick would have to be fast - like 4ms fast. With a large read buffer
     //the timing can be relaxed. It may be useful to directly catch the serial interrupt callback but then
@@ -252,14 +258,27 @@ void ESP32Driver::handleTick() {
     {
         if (desiredState == ESP32NS::NORMAL)
         {
-            //TODO: this is naughty code! No delays allowed! Refactor this to remove the delays (use state machine?)
-            digitalWrite(ESP32_BOOT, HIGH);
-            digitalWrite(ESP32_ENABLE, LOW);
-            delay(40);
-            digitalWrite(ESP32_ENABLE, HIGH);
-            if (sysConfig->systemType == GEVCU7B) delay(400); //seems we have to wait this long otherwise it won't stick
-            else delay(40);
-            currState = ESP32NS::NORMAL;
+            //stepped off the tick instead of sitting in delay() so nothing else has to wait on the module
+            uint32_t now = millis();
+            if (resetStep == 0)
+            {
+                if (now - resetStepTime >= 40) //hold in reset at least 40ms
+                {
+                    digitalWrite(ESP32_ENABLE, HIGH);
+                    resetStep = 1;
+                    resetStepTime = now;
+                }
+            }
+            else
+            {
+                //GEVCU7B seems to need 400ms after release otherwise it won't stick
+                uint32_t bootWait = (sysConfig->systemType == GEVCU7B) ? 400 : 40;
+                if (now - resetStepTime >= bootWait)
+                {
+                    resetStep = 0;
+                    currState = ESP32NS::NORMAL;
+                }
+            }
         }
     }
     crashHandler.updateBreadcrumb(2); //nothing above would add a breadcrumb so update the existing one
@@ -377,9 +396,37 @@ void ESP32Driver::sendDeviceDetails(uint16_t deviceID)
     //Serial.println();
 }
 
+//The ESP32 changed a setting: {"DeviceID":4096, "CfgName":"SomeSetting", "Valu":"New Value"}
 void ESP32Driver::processConfigReply(JsonDocument* doc)
 {
+    uint16_t devID = (*doc)["DeviceID"];
+    const char *cfgName = (*doc)["CfgName"];
+    Device *dev = deviceManager.getDeviceByID(devID);
+    if (!dev || !cfgName) return;
 
+    const ConfigEntry *cfgEntry = deviceManager.findConfigEntry(dev, cfgName);
+    if (!cfgEntry)
+    {
+        Logger::error("ESP32 tried to set unknown parameter %s for device %X", cfgName, devID);
+        return;
+    }
+
+    //the value is checked against the entry's limits the same as when it is set from the serial console.
+    //It may come as a string or a number so turn it into text first
+    char valu[130];
+    JsonVariant jsonValu = (*doc)["Valu"];
+    if (jsonValu.isNull()) return;
+    if (jsonValu.is<const char *>()) snprintf(valu, sizeof(valu), "%s", jsonValu.as<const char *>());
+    else serializeJson(jsonValu, valu, sizeof(valu));
+
+    int result = deviceManager.setConfigValue(cfgEntry, valu);
+    if (result != 0)
+    {
+        Logger::error("ESP32 tried to set parameter %s %s its limit", cfgName, (result == 1) ? "below" : "above");
+        return;
+    }
+    Logger::info("ESP32 set parameter %s", cfgName);
+    dev->commitConfiguration();
 }
 
 
@@ -387,6 +434,11 @@ DeviceId ESP32Driver::getId() {
     return (ESP32);
 }
 
+//set up first so the module reset runs while everything else comes up
+StartupPhase ESP32Driver::getStartupPhase() {
+    return PHASE_HARDWARE;
+}
+
 uint32_t ESP32Driver::getTickInterval()
 {
     return 5000;
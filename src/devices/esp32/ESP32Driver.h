@@ -37,6 +37,8 @@ public:
     void processSerial();
 
     DeviceId getId();
+    StartupPhase getStartupPhase();
+
     uint32_t getTickInterval();
 
     virtual void loadConfiguration();
@@ -50,6 +52,8 @@ private:
     String bufferedLine;
     ESP32NS::ESP32_STATE currState;
     ESP32NS::ESP32_STATE desiredState;
+    uint8_t resetStep; //0 = holding in reset, 1 = released and waiting for it to boot
+    uint32_t resetStepTime; //millis() when the current reset step started
     bool systemAlive;
     bool systemEnabled;
     uint8_t serialReadBuffer[1024];
@@ -47,8 +47,8 @@ void HVACController::setup()
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name              var         type                  prevVal  obj
-    stat = {"HVAC_ClimateTemp", &currentTemperature, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    //        name              var         type                  obj
+    stat = {"HVAC_ClimateTemp", &currentTemperature, CFG_ENTRY_VAR_TYPE::FLOAT, this};
     deviceManager.addStatusEntry(stat);
 }
 
@@ -114,6 +114,12 @@ DeviceId PotGearSelector::getId() {
     return (POTGEARSEL);
 }
 
+//sets the gear on the motor controller
+const DeviceType *PotGearSelector::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_MOTORCTRL, DEVICE_NONE};
+    return deps;
+}
+
 uint32_t PotGearSelector::getTickInterval()
 {
     return TICK_POTGEAR;
@@ -28,6 +28,7 @@ public:
     void earlyInit();
     void handleTick();
     DeviceId getId();
+    const DeviceType *getDependencies();
     DeviceType getType();
     uint32_t getTickInterval();
 
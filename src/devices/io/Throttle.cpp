@@ -26,6 +26,7 @@
  */
 
 #include "Throttle.h"
+#include <array>
 #include "../../DeviceManager.h"
 
 /*
@@ -62,8 +63,8 @@ void Throttle::setup()
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name              var         type             prevVal  obj
-    stat = {"Throttle_Level", &level, CFG_ENTRY_VAR_TYPE::INT16, 0, this};
+    //        name              var         obj
+    stat = StatusEntry("Throttle_Level", &level, this);
     deviceManager.addStatusEntry(stat);
 }
 
@@ -227,19 +228,35 @@ int16_t Throttle::calculatePedalPosition(RawSignalData*) {
 /*
  * Load the config parameters which are required by all throttles
  */
+//Everything the throttle keeps in EEPROM. Load and save both use this table so they can't get out of step.
+static constexpr Pref<uint16_t> prefRegenMin("RegenMin", 270);
+static constexpr Pref<uint16_t> prefRegenMax("RegenMax", 0);
+static constexpr Pref<uint16_t> prefForwardStart("ForwardStart", 280);
+static constexpr Pref<uint16_t> prefMapPoint("MapPoint", 750);
+static constexpr Pref<uint8_t> prefCreep("Creep", 0);
+static constexpr Pref<uint8_t> prefMinAccelRegen("MinAccelRegen", 0);
+static constexpr Pref<uint8_t> prefMaxAccelRegen("MaxAccelRegen", 70);
+
+static std::array<PrefBinding, 7> bindPrefs(ThrottleConfiguration *config)
+{
+    return {{
+        {prefRegenMin, &config->positionRegenMinimum},
+        {prefRegenMax, &config->positionRegenMaximum},
+        {prefForwardStart, &config->positionForwardMotionStart},
+        {prefMapPoint, &config->positionHalfPower},
+        {prefCreep, &config->creep},
+        {prefMinAccelRegen, &config->minimumRegen},
+        {prefMaxAccelRegen, &config->maximumRegen}
+    }};
+}
+
 void Throttle::loadConfiguration() {
     ThrottleConfiguration *config = (ThrottleConfiguration *) getConfiguration();
 
     Device::loadConfiguration(); // call parent
 
-    //if (prefsHandler->checksumValid()) { //checksum is good, read in the values stored in EEPROM
-        prefsHandler->read("RegenMin", &config->positionRegenMinimum, 270);
-        prefsHandler->read("RegenMax", &config->positionRegenMaximum, 0);
-        prefsHandler->read("ForwardStart", &config->positionForwardMotionStart, 280);
-        prefsHandler->read("MapPoint", &config->positionHalfPower, 750);
-        prefsHandler->read("Creep", &config->creep, 0);
-        prefsHandler->read("MinAccelRegen", &config->minimumRegen, 0);
-        prefsHandler->read("MaxAccelRegen", &config->maximumRegen, 70);
+    auto prefs = bindPrefs(config);
+    prefsHandler->read(prefs.data(), prefs.size());
     
     Logger::debug(THROTTLE, "RegenMax: %i RegenMin: %i Fwd: %i Map: %i", config->positionRegenMaximum, config->positionRegenMinimum,
                   config->positionForwardMotionStart, config->positionHalfPower);
@@ -254,13 +271,8 @@ void Throttle::saveConfiguration() {
 
     Device::saveConfiguration(); // call parent
 
-    prefsHandler->write("RegenMin", config->positionRegenMinimum);
-    prefsHandler->write("RegenMax", config->positionRegenMaximum);
-    prefsHandler->write("ForwardStart", config->positionForwardMotionStart);
-    prefsHandler->write("MapPoint", config->positionHalfPower);
-    prefsHandler->write("Creep", config->creep);
-    prefsHandler->write("MinAccelRegen", config->minimumRegen);
-    prefsHandler->write("MaxAccelRegen", config->maximumRegen);
+    auto prefs = bindPrefs(config);
+    prefsHandler->write(prefs.data(), prefs.size());
     prefsHandler->saveChecksum();
 
     Logger::console("Throttle configuration saved");
@@ -119,7 +119,7 @@ protected:
     int32_t normalizeInput(int32_t, int32_t, int32_t);    
 
 private:
-    int16_t level; // the final signed throttle level. [-1000, 1000] in permille of maximum
+    StatusVar<int16_t> level; // the final signed throttle level. [-1000, 1000] in permille of maximum
 };
 
 #endif
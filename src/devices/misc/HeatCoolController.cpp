@@ -26,6 +26,9 @@
 
 #include "HeatCoolController.h"
 
+//status entry names are kept by pointer so they can't be built on the stack. One per cooling zone.
+static const char *coolOnNames[COOL_ZONES] = {"HC_CoolOn0", "HC_CoolOn1", "HC_CoolOn2"};
+
 /*
  * Constructor
  */
@@ -93,14 +96,13 @@ void HeatCoolController::setup() {
         entry = {buff, "Output used for this zone (255=Disabled)", &config->coolPins[i], CFG_ENTRY_VAR_TYPE::BYTE, 0, 255, 0, nullptr};
         cfgEntries.push_back(entry);
 
-        snprintf(buff, 30, "HC_CoolOn%u", i);
-        stat = {buff, &isCoolOn[i], CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+        stat = {coolOnNames[i], &isCoolOn[i], CFG_ENTRY_VAR_TYPE::BYTE, this};
         deviceManager.addStatusEntry(stat);
     }
 
-    stat = {"HC_HeatOn", &isHeatOn, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"HC_HeatOn", &isHeatOn, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"HC_PumpOn", &isPumpOn, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"HC_PumpOn", &isPumpOn, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);    
 
     tickHandler.attach(this, CFG_TICK_INTERVAL_HEATCOOL);
@@ -201,6 +203,12 @@ DeviceId HeatCoolController::getId() {
     return (HEATCOOL);
 }
 
+//zone temperatures come from the BMS, motor controller and DC/DC
+const DeviceType *HeatCoolController::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_BMS, DEVICE_MOTORCTRL, DEVICE_DCDC, DEVICE_NONE};
+    return deps;
+}
+
 DeviceType HeatCoolController::getType()
 {
     return DEVICE_MISC;
@@ -75,6 +75,7 @@ public:
     void earlyInit();
     void handleTick();
     DeviceId getId();
+    const DeviceType *getDependencies();
     DeviceType getType();
 
     void loadConfiguration();
@@ -116,6 +116,12 @@ DeviceId LightController::getId() {
     return (LIGHTCTRL);
 }
 
+//reverse and brake lights follow the motor controller and pedals
+const DeviceType *LightController::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_MOTORCTRL, DEVICE_THROTTLE, DEVICE_BRAKE, DEVICE_NONE};
+    return deps;
+}
+
 DeviceType LightController::getType()
 {
     return DEVICE_MISC;
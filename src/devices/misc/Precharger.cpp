@@ -70,8 +70,8 @@ void Precharger::setup() {
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name                       var         type               prevVal  obj
-    stat = {"IsPrechargeComplete", &isPrecharged, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    //        name                       var         type               obj
+    stat = {"IsPrechargeComplete", &isPrecharged, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
 
     tickHandler.attach(this, CFG_TICK_INTERVAL_PRECHARGE);
@@ -173,6 +173,12 @@ DeviceId Precharger::getId() {
     return (PRECHARGER);
 }
 
+//watches pack and inverter voltage to know when precharge is done
+const DeviceType *Precharger::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_BMS, DEVICE_MOTORCTRL, DEVICE_NONE};
+    return deps;
+}
+
 DeviceType Precharger::getType()
 {
     return DEVICE_MISC;
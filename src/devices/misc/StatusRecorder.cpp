@@ -0,0 +1,421 @@
+/*
+ * StatusRecorder.cpp - samples chosen status entries at a fixed rate into a compact binary file
+ on the sdcard for drive analysis.
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+/*
+File layout, everything little endian:
+  header: "GVREC", version byte (1), uint16 sample rate, uint8 channel count,
+          then per channel: uint8 type (CFG_ENTRY_VAR_TYPE), uint8 name length, name
+  rows:   'K' uint32 micros, every channel in full
+          'D' varint micros since last row, bitmap of changed channels, the changed channels
+          'S' varint micros since last row, nothing changed
+Integers are written as zigzag varints, the value itself in a 'K' row and the difference in a 'D' row.
+Floats are always their 4 raw bytes. String entries aren't recorded.
+*/
+
+#include "StatusRecorder.h"
+#include "SD.h"
+#include "RingBuf.h"
+
+extern bool sdCardPresent;
+
+static FsFile recFile;
+static RingBuf<FsFile, CFG_RECORDER_BUFFER_SIZE> recBuf;
+
+//row tags
+#define REC_KEYFRAME  'K'
+#define REC_DELTA     'D'
+#define REC_SAME      'S'
+
+//room for the biggest row there can be. 10 bytes is the longest varint of a 64 bit value
+#define REC_MAX_ROW (1 + 10 + (CFG_RECORDER_MAX_CHANNELS + 7) / 8 + CFG_RECORDER_MAX_CHANNELS * 10)
+
+static inline uint8_t *putVarint(uint8_t *out, uint64_t val)
+{
+    while (val >= 0x80)
+    {
+        *out++ = (uint8_t)val | 0x80;
+        val >>= 7;
+    }
+    *out++ = (uint8_t)val;
+    return out;
+}
+
+//small negative numbers stay small: 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+static inline uint64_t zigzag(int64_t val)
+{
+    return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t readChannel(const void *ptr, uint8_t type)
+{
+    switch (type)
+    {
+    case BYTE:
+        return *(const uint8_t *)ptr;
+    case INT16:
+        return *(const int16_t *)ptr;
+    case UINT16:
+        return *(const uint16_t *)ptr;
+    case INT32:
+        return *(const int32_t *)ptr;
+    case UINT32:
+        return *(const uint32_t *)ptr;
+    case FLOAT:
+        return *(const uint32_t *)ptr; //just the bits, they are stored as is
+    }
+    return 0;
+}
+
+StatusRecorder::StatusRecorder() : Device() {
+    commonName = "Status Recorder";
+    shortName = "StatRec";
+    numChannels = 0;
+    recording = false;
+    samples = keyframes = droppedSamples = 0;
+    bytesEncoded = sampleCycles = bytesWritten = 0;
+    maxSampleCycles = writeMicros = 0;
+}
+
+void StatusRecorder::earlyInit()
+{
+    prefsHandler = new PrefHandler(STATUSRECORDER);
+}
+
+void StatusRecorder::setup() {
+    tickHandler.detach(this);
+
+    Logger::info("add device: Status Recorder (id: %X, %X)", STATUSRECORDER, this);
+
+    loadConfiguration();
+
+    Device::setup(); //call base class
+
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+
+    cfgEntries.reserve(2);
+
+    ConfigEntry entry;
+    entry = {"RECRATE", "Status recorder samples per second (0 = not recording)", &config->sampleRate, CFG_ENTRY_VAR_TYPE::UINT16, 0, 200, 0, nullptr};
+    cfgEntries.push_back(entry);
+    entry = {"RECENTRIES", "Comma separated status entries to record, * for all", &config->entryList, CFG_ENTRY_VAR_TYPE::STRING, 0, sizeof(config->entryList) - 1, 0, nullptr};
+    cfgEntries.push_back(entry);
+
+    startRecording();
+}
+
+//Runs in the late startup phase so every other device has registered its status entries by now
+StartupPhase StatusRecorder::getStartupPhase() {
+    return PHASE_LATE;
+}
+
+void StatusRecorder::handleTick() {
+    sample();
+    writeOut();
+}
+
+void StatusRecorder::disableDevice()
+{
+    stopRecording();
+    Device::disableDevice();
+}
+
+//Starts a new file with the channels and rate currently configured. Any recording already going is finished first.
+void StatusRecorder::startRecording()
+{
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+
+    stopRecording();
+    if (!config->sampleRate) return;
+    if (!sdCardPresent)
+    {
+        Logger::warn(STATUSRECORDER, "No sdcard, not recording");
+        return;
+    }
+
+    selectChannels();
+    if (!numChannels)
+    {
+        Logger::warn(STATUSRECORDER, "None of the status entries to record were found");
+        return;
+    }
+    if (!openFile()) return;
+
+    recording = true;
+    needKeyframe = true;
+    needSync = false;
+    lastWriteTime = lastSyncTime = millis();
+    tickHandler.attach(this, 1000000ul / config->sampleRate);
+}
+
+//Gets everything buffered out to the card and closes the file
+void StatusRecorder::stopRecording()
+{
+    tickHandler.detach(this);
+    if (!recording) return;
+    recording = false;
+    recBuf.sync();
+    recFile.close();
+}
+
+void StatusRecorder::selectChannels()
+{
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+    numChannels = 0;
+
+    if (!strcmp(config->entryList, "*"))
+    {
+        deviceManager.forEachStatusEntry([this](const StatusEntry &entry) { addChannel(entry); });
+        return;
+    }
+
+    char list[sizeof(config->entryList)];
+    strcpy(list, config->entryList);
+    char *save;
+    for (char *name = strtok_r(list, ", ", &save); name; name = strtok_r(NULL, ", ", &save))
+    {
+        StatusEntry entry;
+        if (deviceManager.findStatusEntry(name, &entry)) addChannel(entry);
+        else Logger::warn(STATUSRECORDER, "No status entry named %s to record", name);
+    }
+}
+
+void StatusRecorder::addChannel(const StatusEntry &entry)
+{
+    if (entry.varType == STRING) return;
+    if (numChannels >= CFG_RECORDER_MAX_CHANNELS)
+    {
+        Logger::warn(STATUSRECORDER, "Too many channels, %s not recorded", entry.statusName);
+        return;
+    }
+    channels[numChannels].varPtr = entry.varPtr;
+    channels[numChannels].name = entry.statusName;
+    channels[numChannels].varType = entry.varType;
+    numChannels++;
+}
+
+//Named after this boot's log file so the two can be matched up. Another recording in the same boot gets the next free part number.
+bool StatusRecorder::openFile()
+{
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+    char fn[40];
+    uint8_t part = 0;
+    do
+    {
+        snprintf(fn, sizeof(fn), "%s%06lu_%02u.gvr", RECORDER_FILENAME, (unsigned long)Logger::getLogIndex(), part++);
+    } while (SD.sdfs.exists(fn) && part < 100);
+
+    recFile = SD.sdfs.open(fn, O_RDWR | O_CREAT | O_TRUNC);
+    if (!recFile)
+    {
+        Logger::error(STATUSRECORDER, "Could not open %s", fn);
+        return false;
+    }
+    recBuf.begin(&recFile);
+
+    uint8_t header[9] = {'G', 'V', 'R', 'E', 'C', 1, (uint8_t)config->sampleRate, (uint8_t)(config->sampleRate >> 8), numChannels};
+    recBuf.write(header, sizeof(header));
+    for (int i = 0; i < numChannels; i++)
+    {
+        uint8_t len = strlen(channels[i].name);
+        recBuf.write(&channels[i].varType, 1);
+        recBuf.write(&len, 1);
+        recBuf.write((const uint8_t *)channels[i].name, len);
+    }
+    Logger::info(STATUSRECORDER, "Recording %u status entries at %u Hz to %s", numChannels, config->sampleRate, fn);
+    return true;
+}
+
+/*
+Encodes one row into the buffer. If the buffer is too full to take it the sample is dropped and the next
+one is written in full, otherwise the differences after it would be from a row that isn't in the file.
+*/
+void StatusRecorder::sample()
+{
+    if (!recording) return;
+    uint32_t startCycles = ARM_DWT_CYCCNT;
+    uint8_t row[REC_MAX_ROW];
+    uint8_t *out = row;
+    uint32_t now = micros();
+
+    if (needKeyframe || (millis() - lastKeyframeTime) >= RECORDER_KEYFRAME_INTERVAL)
+    {
+        *out++ = REC_KEYFRAME;
+        memcpy(out, &now, 4);
+        out += 4;
+        for (int i = 0; i < numChannels; i++)
+        {
+            int64_t val = readChannel(channels[i].varPtr, channels[i].varType);
+            lastValues[i] = val;
+            if (channels[i].varType == FLOAT)
+            {
+                memcpy(out, channels[i].varPtr, 4);
+                out += 4;
+            }
+            else out = putVarint(out, zigzag(val));
+        }
+    }
+    else
+    {
+        *out++ = REC_DELTA;
+        out = putVarint(out, now - lastSampleMicros);
+        uint8_t *bitmap = out;
+        int bitmapLen = (numChannels + 7) / 8;
+        memset(bitmap, 0, bitmapLen);
+        out += bitmapLen;
+        for (int i = 0; i < numChannels; i++)
+        {
+            int64_t val = readChannel(channels[i].varPtr, channels[i].varType);
+            if (val == lastValues[i]) continue;
+            bitmap[i >> 3] |= 1 << (i & 7);
+            if (channels[i].varType == FLOAT)
+            {
+                memcpy(out, channels[i].varPtr, 4);
+                out += 4;
+            }
+            else out = putVarint(out, zigzag(val - lastValues[i]));
+            lastValues[i] = val;
+        }
+        if (out == bitmap + bitmapLen)
+        {
+            //nothing changed, the bitmap isn't needed
+            row[0] = REC_SAME;
+            out = bitmap;
+        }
+    }
+
+    size_t len = out - row;
+    if (recBuf.bytesFree() < len)
+    {
+        droppedSamples++;
+        needKeyframe = true;
+        return;
+    }
+    recBuf.write(row, len);
+    if (row[0] == REC_KEYFRAME)
+    {
+        keyframes++;
+        needKeyframe = false;
+        lastKeyframeTime = millis();
+    }
+    lastSampleMicros = now;
+    samples++;
+    bytesEncoded += len;
+
+    uint32_t cycles = ARM_DWT_CYCCNT - startCycles;
+    sampleCycles += cycles;
+    if (cycles > maxSampleCycles) maxSampleCycles = cycles;
+}
+
+//Same pattern as the log file. Whole sectors when the card isn't busy, a partial one now and then, an occasional sync.
+void StatusRecorder::writeOut()
+{
+    if (!recording) return;
+    size_t n = recBuf.bytesUsed();
+    size_t writeBytes = 0;
+    if (n >= 512)
+    {
+        size_t sectors = n / 512;
+        if (sectors > 1 || !recFile.isBusy())
+            writeBytes = min(sectors, (size_t)RECORDER_MAX_WRITE_SECTORS) * 512;
+    }
+    else if (n > 0 && (millis() - lastWriteTime) > RECORDER_PARTIAL_INTERVAL && !recFile.isBusy()) writeBytes = n;
+
+    if (writeBytes)
+    {
+        uint32_t writeStart = micros();
+        size_t ret = recBuf.writeOut(writeBytes);
+        writeMicros += micros() - writeStart;
+        bytesWritten += ret;
+        if (ret != writeBytes)
+        {
+            Logger::error(STATUSRECORDER, "Write to recording failed, stopping");
+            tickHandler.detach(this);
+            recording = false;
+            recFile.close();
+            return;
+        }
+        lastWriteTime = millis();
+        needSync = true;
+    }
+    else if (needSync && (millis() - lastSyncTime) > RECORDER_SYNC_INTERVAL && !recFile.isBusy())
+    {
+        recFile.flush();
+        lastSyncTime = millis();
+        needSync = false;
+    }
+}
+
+void StatusRecorder::printStats()
+{
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+    if (!config) return;
+    Logger::console("Status recorder: %s, %u channels at %u Hz", recording ? "recording" : "stopped", numChannels, config->sampleRate);
+    if (!samples) return;
+    Logger::console("%lu samples (%lu in full), %lu dropped. %lu bytes per sample on average",
+                    samples, keyframes, droppedSamples, (uint32_t)(bytesEncoded / samples));
+    Logger::console("Sampling takes %lu cycles on average (%lu us), %lu at most",
+                    (uint32_t)(sampleCycles / samples), (uint32_t)(sampleCycles / samples) / (F_CPU_ACTUAL / 1000000), maxSampleCycles);
+    Logger::console("%lu KB written, %lu KB/s while writing, %u bytes buffered", (uint32_t)(bytesWritten / 1024),
+                    writeMicros ? (uint32_t)(bytesWritten * 1000 / writeMicros) : 0, recBuf.bytesUsed());
+}
+
+DeviceId StatusRecorder::getId() {
+    return (STATUSRECORDER);
+}
+
+DeviceType StatusRecorder::getType()
+{
+    return DEVICE_MISC;
+}
+
+void StatusRecorder::loadConfiguration() {
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+
+    if (!config) {
+        config = new StatusRecorderConfiguration();
+        setConfiguration(config);
+    }
+
+    Device::loadConfiguration(); // call parent
+
+    prefsHandler->read("SampleRate", &config->sampleRate, 50);
+    prefsHandler->read("EntryList", config->entryList, "*");
+}
+
+//Settings only change from the console or wifi, start a new recording so the file header matches
+void StatusRecorder::saveConfiguration() {
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)getConfiguration();
+
+    Device::saveConfiguration(); // call parent
+
+    prefsHandler->write("SampleRate", config->sampleRate);
+    prefsHandler->write("EntryList", config->entryList, sizeof(config->entryList) - 1);
+
+    startRecording();
+}
+
+StatusRecorder statusRecorder;
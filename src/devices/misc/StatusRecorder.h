@@ -0,0 +1,108 @@
+/*
+ * StatusRecorder.h - samples chosen status entries at a fixed rate into a compact binary file
+ on the sdcard for drive analysis.
+ *
+ Copyright (c) 2021 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+
+ The above copyright notice and this permission notice shall be included
+ in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef STATUSRECORDER_H_
+#define STATUSRECORDER_H_
+
+#include <Arduino.h>
+#include "../../config.h"
+#include "../Device.h"
+#include "../../TickHandler.h"
+#include "../../Logger.h"
+#include "../../DeviceManager.h"
+
+#define STATUSRECORDER 0x3400
+#define RECORDER_FILENAME "GevcuRec"
+#define RECORDER_KEYFRAME_INTERVAL  1000 //ms between samples with every value in full. A damaged spot only loses up to the next one
+#define RECORDER_PARTIAL_INTERVAL   1000 //ms before whatever is buffered goes out even if it isn't a whole sector
+#define RECORDER_SYNC_INTERVAL      5000 //ms between updates of the directory entry and FAT
+#define RECORDER_MAX_WRITE_SECTORS  8
+
+class StatusRecorderConfiguration: public DeviceConfiguration {
+public:
+    uint16_t sampleRate; //samples per second
+    char entryList[128]; //comma separated status entry names, * for all of them
+};
+
+/*
+Records the value of a list of status entries every sample period. The file starts with a header naming each
+channel and its type, then every sample is a row that only holds what changed since the row before, as the
+difference for integers. A row where nothing moved is just its time. See tools/gvrec2csv.py for the layout
+and for turning a recording into CSV.
+*/
+class StatusRecorder: public Device {
+public:
+    StatusRecorder();
+    void setup();
+    void earlyInit();
+    void handleTick();
+    void disableDevice();
+    DeviceId getId();
+    DeviceType getType();
+    StartupPhase getStartupPhase();
+
+    void loadConfiguration();
+    void saveConfiguration();
+    void printStats();
+
+private:
+    struct Channel
+    {
+        const void *varPtr;
+        const char *name;
+        uint8_t varType;
+    };
+    Channel channels[CFG_RECORDER_MAX_CHANNELS];
+    int64_t lastValues[CFG_RECORDER_MAX_CHANNELS]; //integers as themselves, floats as their bit pattern
+    uint8_t numChannels;
+    bool recording;
+    bool needKeyframe;
+    bool needSync;
+    uint32_t lastSampleMicros;
+    uint32_t lastKeyframeTime;
+    uint32_t lastWriteTime;
+    uint32_t lastSyncTime;
+
+    uint32_t samples;
+    uint32_t keyframes;
+    uint32_t droppedSamples;
+    uint64_t bytesEncoded;
+    uint64_t sampleCycles;
+    uint32_t maxSampleCycles;
+    uint64_t bytesWritten;
+    uint32_t writeMicros;
+
+    void startRecording();
+    void stopRecording();
+    void selectChannels();
+    void addChannel(const StatusEntry &entry);
+    bool openFile();
+    void sample();
+    void writeOut();
+};
+
+#endif
@@ -25,6 +25,8 @@
  */
 
 #include "SystemDevice.h"
+#include "../../sys_io.h"
+#include <array>
 
 SystemConfiguration *sysConfig;
 
@@ -55,7 +57,7 @@ void SystemDevice::setup() {
 
     SystemConfiguration *config = (SystemConfiguration *)getConfiguration();
 
-    cfgEntries.reserve(25);
+    cfgEntries.reserve(50);
     char buff[20];
 
     ConfigEntry entry;
@@ -71,6 +73,15 @@ void SystemDevice::setup() {
         snprintf(buff, 20, "ADCOFF%u", i);
         entry = {buff, "Set offset for ADC input. 0 is normal value", &config->adcOffset[i], CFG_ENTRY_VAR_TYPE::UINT16, 0, 60000, 0, nullptr};
         cfgEntries.push_back(entry);
+        snprintf(buff, 20, "ADCMED%u", i);
+        entry = {buff, "Set median filter length of ADC input, knocks out spikes (1=off, 3 or 5)", &config->adcMedian[i], CFG_ENTRY_VAR_TYPE::BYTE, 1, ANALOG_FILTER_MAX_MEDIAN, 0, nullptr};
+        cfgEntries.push_back(entry);
+        snprintf(buff, 20, "ADCAVG%u", i);
+        entry = {buff, "Set number of samples averaged for ADC input (1=off)", &config->adcAverage[i], CFG_ENTRY_VAR_TYPE::BYTE, 1, ANALOG_FILTER_MAX_AVERAGE, 0, nullptr};
+        cfgEntries.push_back(entry);
+        snprintf(buff, 20, "ADCIIR%u", i);
+        entry = {buff, "Set low pass strength of ADC input. Each step doubles the time constant (0=off)", &config->adcIIRShift[i], CFG_ENTRY_VAR_TYPE::BYTE, 0, ANALOG_FILTER_MAX_SHIFT, 0, nullptr};
+        cfgEntries.push_back(entry);
     }
 
     entry = {"CAN0SPEED", "Set speed of CAN0 bus", &config->canSpeed[0], CFG_ENTRY_VAR_TYPE::UINT32, 33333, 1000000, 0, nullptr};
@@ -109,6 +120,64 @@ DeviceType SystemDevice::getType()
  * If possible values are read from EEPROM. If not, reasonable default values
  * are chosen and the configuration is overwritten in the EEPROM.
  */
+//Everything the system device keeps in EEPROM apart from the log levels, which get converted on the way in.
+//Load and save both use this table so they can't get out of step. The per input keys are spelled out for
+//all eight analog inputs.
+static_assert(NUM_ANALOG == 8, "one set of ADC prefs per analog input");
+static constexpr Pref<uint8_t> prefSysType("SysType", 2); //revision level
+static constexpr Pref<uint16_t> prefAdcGain[NUM_ANALOG] = {
+    {"Adc0Gain", 1024}, {"Adc1Gain", 1024}, {"Adc2Gain", 1024}, {"Adc3Gain", 1024},
+    {"Adc4Gain", 1024}, {"Adc5Gain", 1024}, {"Adc6Gain", 1024}, {"Adc7Gain", 1024}
+};
+static constexpr Pref<uint16_t> prefAdcOffset[NUM_ANALOG] = {
+    {"Adc0Offset", 0}, {"Adc1Offset", 0}, {"Adc2Offset", 0}, {"Adc3Offset", 0},
+    {"Adc4Offset", 0}, {"Adc5Offset", 0}, {"Adc6Offset", 0}, {"Adc7Offset", 0}
+};
+static constexpr Pref<uint8_t> prefAdcMedian[NUM_ANALOG] = {
+    {"Adc0Median", 3}, {"Adc1Median", 3}, {"Adc2Median", 3}, {"Adc3Median", 3},
+    {"Adc4Median", 3}, {"Adc5Median", 3}, {"Adc6Median", 3}, {"Adc7Median", 3}
+};
+static constexpr Pref<uint8_t> prefAdcAvg[NUM_ANALOG] = {
+    {"Adc0Avg", 4}, {"Adc1Avg", 4}, {"Adc2Avg", 4}, {"Adc3Avg", 4},
+    {"Adc4Avg", 4}, {"Adc5Avg", 4}, {"Adc6Avg", 4}, {"Adc7Avg", 4}
+};
+static constexpr Pref<uint8_t> prefAdcIIR[NUM_ANALOG] = {
+    {"Adc0IIR", 0}, {"Adc1IIR", 0}, {"Adc2IIR", 0}, {"Adc3IIR", 0},
+    {"Adc4IIR", 0}, {"Adc5IIR", 0}, {"Adc6IIR", 0}, {"Adc7IIR", 0}
+};
+static constexpr Pref<uint32_t> prefCANSpeed[4] = {
+    {"CAN0Speed", 500000}, {"CAN1Speed", 500000}, {"CAN2Speed", 500000}, {"CANFDSpeed", 2000000}
+};
+static constexpr Pref<uint8_t> prefSWCANMode("SWCANMode", 0);
+
+static std::array<PrefBinding, 46> bindPrefs(SystemConfiguration *config)
+{
+    return {{
+        {prefSysType, &config->systemType},
+        {prefAdcGain[0], &config->adcGain[0]}, {prefAdcOffset[0], &config->adcOffset[0]},
+        {prefAdcGain[1], &config->adcGain[1]}, {prefAdcOffset[1], &config->adcOffset[1]},
+        {prefAdcGain[2], &config->adcGain[2]}, {prefAdcOffset[2], &config->adcOffset[2]},
+        {prefAdcGain[3], &config->adcGain[3]}, {prefAdcOffset[3], &config->adcOffset[3]},
+        {prefAdcGain[4], &config->adcGain[4]}, {prefAdcOffset[4], &config->adcOffset[4]},
+        {prefAdcGain[5], &config->adcGain[5]}, {prefAdcOffset[5], &config->adcOffset[5]},
+        {prefAdcGain[6], &config->adcGain[6]}, {prefAdcOffset[6], &config->adcOffset[6]},
+        {prefAdcGain[7], &config->adcGain[7]}, {prefAdcOffset[7], &config->adcOffset[7]},
+        {prefAdcMedian[0], &config->adcMedian[0]}, {prefAdcAvg[0], &config->adcAverage[0]}, {prefAdcIIR[0], &config->adcIIRShift[0]},
+        {prefAdcMedian[1], &config->adcMedian[1]}, {prefAdcAvg[1], &config->adcAverage[1]}, {prefAdcIIR[1], &config->adcIIRShift[1]},
+        {prefAdcMedian[2], &config->adcMedian[2]}, {prefAdcAvg[2], &config->adcAverage[2]}, {prefAdcIIR[2], &config->adcIIRShift[2]},
+        {prefAdcMedian[3], &config->adcMedian[3]}, {prefAdcAvg[3], &config->adcAverage[3]}, {prefAdcIIR[3], &config->adcIIRShift[3]},
+        {prefAdcMedian[4], &config->adcMedian[4]}, {prefAdcAvg[4], &config->adcAverage[4]}, {prefAdcIIR[4], &config->adcIIRShift[4]},
+        {prefAdcMedian[5], &config->adcMedian[5]}, {prefAdcAvg[5], &config->adcAverage[5]}, {prefAdcIIR[5], &config->adcIIRShift[5]},
+        {prefAdcMedian[6], &config->adcMedian[6]}, {prefAdcAvg[6], &config->adcAverage[6]}, {prefAdcIIR[6], &config->adcIIRShift[6]},
+        {prefAdcMedian[7], &config->adcMedian[7]}, {prefAdcAvg[7], &config->adcAverage[7]}, {prefAdcIIR[7], &config->adcIIRShift[7]},
+        {prefCANSpeed[0], &config->canSpeed[0]},
+        {prefCANSpeed[1], &config->canSpeed[1]},
+        {prefCANSpeed[2], &config->canSpeed[2]},
+        {prefCANSpeed[3], &config->canSpeed[3]},
+        {prefSWCANMode, &config->swcanMode}
+    }};
+}
+
 void SystemDevice::loadConfiguration() {
     SystemConfiguration *config = (SystemConfiguration *) getConfiguration();
 
@@ -126,28 +195,18 @@ void SystemDevice::loadConfiguration() {
     prefsHandler->read("LogLevel", &temp, 1);
     config->logLevel = (int16_t) temp;
     if (config->logLevel == 255) config->logLevel = -1;
-    prefsHandler->read("SysType", &config->systemType, 2); //revision level
-    prefsHandler->read("Adc0Gain", &config->adcGain[0], 1024);
-    prefsHandler->read("Adc0Offset", &config->adcOffset[0], 0);
-    prefsHandler->read("Adc1Gain", &config->adcGain[1], 1024);
-    prefsHandler->read("Adc1Offset", &config->adcOffset[1], 0);
-    prefsHandler->read("Adc2Gain", &config->adcGain[2], 1024);
-    prefsHandler->read("Adc2Offset", &config->adcOffset[2], 0);
-    prefsHandler->read("Adc3Gain", &config->adcGain[3], 1024);
-    prefsHandler->read("Adc3Offset", &config->adcOffset[3], 0);
-    prefsHandler->read("Adc4Gain", &config->adcGain[4], 1024);
-    prefsHandler->read("Adc4Offset", &config->adcOffset[4], 0);
-    prefsHandler->read("Adc5Gain", &config->adcGain[5], 1024);
-    prefsHandler->read("Adc5Offset", &config->adcOffset[5], 0);
-    prefsHandler->read("Adc6Gain", &config->adcGain[6], 1024);
-    prefsHandler->read("Adc6Offset", &config->adcOffset[6], 0);
-    prefsHandler->read("Adc7Gain", &config->adcGain[7], 1024);
-    prefsHandler->read("Adc7Offset", &config->adcOffset[7], 0);
-    prefsHandler->read("CAN0Speed", &config->canSpeed[0], 500000);
-    prefsHandler->read("CAN1Speed", &config->canSpeed[1], 500000);
-    prefsHandler->read("CAN2Speed", &config->canSpeed[2], 500000);
-    prefsHandler->read("CANFDSpeed", &config->canSpeed[3], 2000000);
-    prefsHandler->read("SWCANMode", &config->swcanMode, 0);
+    Logger::attachSystemLevel(&config->logLevel);
+    prefsHandler->read("CanLogLevel", &temp, Logger::Default);
+    Logger::setDeviceLogLevel(CANHANDLER, (Logger::LogLevel)(int8_t)temp);
+    auto prefs = bindPrefs(config);
+    prefsHandler->read(prefs.data(), prefs.size());
+}
+
+//CAN frame logging isn't a device so its own level is kept with the system settings
+void SystemDevice::setCanLogLevel(int8_t level)
+{
+    Logger::setDeviceLogLevel(CANHANDLER, (Logger::LogLevel)level);
+    prefsHandler->write("CanLogLevel", (uint8_t)level);
 }
 
 /*
@@ -159,31 +218,13 @@ void SystemDevice::saveConfiguration() {
     Device::saveConfiguration(); // call parent
 
     prefsHandler->write("LogLevel", (uint8_t)config->logLevel);
-    prefsHandler->write("SysType", config->systemType);
-    prefsHandler->write("Adc0Gain", config->adcGain[0]);
-    prefsHandler->write("Adc0Offset", config->adcOffset[0]);
-    prefsHandler->write("Adc1Gain", config->adcGain[1]);
-    prefsHandler->write("Adc1Offset", config->adcOffset[1]);
-    prefsHandler->write("Adc2Gain", config->adcGain[2]);
-    prefsHandler->write("Adc2Offset", config->adcOffset[2]);
-    prefsHandler->write("Adc3Gain", config->adcGain[3]);
-    prefsHandler->write("Adc3Offset", config->adcOffset[3]);
-    prefsHandler->write("Adc4Gain", config->adcGain[4]);
-    prefsHandler->write("Adc4Offset", config->adcOffset[4]);
-    prefsHandler->write("Adc5Gain", config->adcGain[5]);
-    prefsHandler->write("Adc5Offset", config->adcOffset[5]);
-    prefsHandler->write("Adc6Gain", config->adcGain[6]);
-    prefsHandler->write("Adc6Offset", config->adcOffset[6]);
-    prefsHandler->write("Adc7Gain", config->adcGain[7]);
-    prefsHandler->write("Adc7Offset", config->adcOffset[7]);
-    prefsHandler->write("CAN0Speed", config->canSpeed[0]);
-    prefsHandler->write("CAN1Speed", config->canSpeed[1]);
-    prefsHandler->write("CAN2Speed", config->canSpeed[2]);
-    prefsHandler->write("CANFDSpeed", config->canSpeed[3]);
-    prefsHandler->write("SWCANMode", config->swcanMode);
+    auto prefs = bindPrefs(config);
+    prefsHandler->write(prefs.data(), prefs.size());
     
     prefsHandler->saveChecksum();
     prefsHandler->forceCacheWrite();
+
+    systemIO.setupAnalogFilters(); //new filter settings take effect right away
 }
 
 SystemDevice sysDev;
@@ -39,6 +39,9 @@ public:
     uint8_t systemType;
     uint16_t adcGain[NUM_ANALOG];
     uint16_t adcOffset[NUM_ANALOG];
+    uint8_t adcMedian[NUM_ANALOG]; //median window of the input filter, 1 for none
+    uint8_t adcAverage[NUM_ANALOG]; //samples averaged after the median, 1 for none
+    uint8_t adcIIRShift[NUM_ANALOG]; //low pass as new = old + (in - old) / 2^shift, 0 for none
     uint32_t canSpeed[4];
     uint8_t swcanMode; //should can0 be in SWCAN mode?
     int16_t logLevel;
@@ -55,6 +58,7 @@ public:
 
     void loadConfiguration();
     void saveConfiguration();
+    void setCanLogLevel(int8_t level);
 
 protected:
 
@@ -142,6 +142,11 @@ DeviceId VehicleSpecific::getId() {
     return (VEHICLESPECIFIC);
 }
 
+const DeviceType *VehicleSpecific::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_MOTORCTRL, DEVICE_NONE};
+    return deps;
+}
+
 DeviceType VehicleSpecific::getType()
 {
     return DEVICE_MISC;
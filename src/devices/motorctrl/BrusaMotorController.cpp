@@ -26,6 +26,7 @@
  */
 
 #include "BrusaMotorController.h"
+#include <array>
 
 /*
  Warning:
@@ -142,7 +143,7 @@ void BrusaMotorController::sendControl() {
     }
 
     if (Logger::isDebug())
-        Logger::debug(BRUSA_DMC5, "requested Speed: %i rpm, requested Torque: %.2f Nm", speedRequested, (float)torqueRequested);
+        Logger::debug(BRUSA_DMC5, "requested Speed: %i rpm, requested Torque: %.2f Nm", speedRequested.get(), torqueRequested.get());
 
     canHandlerIsolated.sendFrame(outputFrame);
 }
@@ -255,7 +256,7 @@ void BrusaMotorController::processStatus(const uint8_t data[]) {
     speedActual = (int16_t)(data[7] | (data[6] << 8));
 
     if(Logger::isDebug())
-        Logger::debug(BRUSA_DMC5, "status: %X, torque avail: %.2fNm, actual torque: %.2fNm, speed actual: %urpm", brusaStatus, (float)torqueAvailable/100.0F, (float)torqueActual/100.0F, speedActual);
+        Logger::debug(BRUSA_DMC5, "status: %X, torque avail: %.2fNm, actual torque: %.2fNm, speed actual: %urpm", brusaStatus, torqueAvailable.get()/100.0F, torqueActual.get()/100.0F, speedActual.get());
 
     ready = (brusaStatus & stateReady) != 0 ? true : false;
     running = (brusaStatus & stateRunning) != 0 ? true : false;
@@ -341,6 +342,28 @@ uint32_t BrusaMotorController::getTickInterval() {
  *
  * If not available or the checksum is invalid, default values are chosen.
  */
+//Brusa specific settings, the ones every motor controller has are in MotorController's table
+static constexpr Pref<uint16_t> prefMaxMecPowerMotor("maxMecPowerMotor", 50000);
+static constexpr Pref<uint16_t> prefMaxMecPowerRegen("maxMecPowerRegen", 0);
+static constexpr Pref<float> prefDcVoltLimMotor("dcVoltLimMotor", 1000);
+static constexpr Pref<float> prefDcVoltLimRegen("dcVoltLimRegen", 0);
+static constexpr Pref<float> prefDcCurrLimMotor("dcCurrLimMotor", 0);
+static constexpr Pref<float> prefDcCurrLimRegen("dcCurrLimRegen", 0);
+static constexpr Pref<uint8_t> prefEnableOscLim("enableOscLim", 0);
+
+static std::array<PrefBinding, 7> bindPrefs(BrusaMotorControllerConfiguration *config)
+{
+    return {{
+        {prefMaxMecPowerMotor, &config->maxMechanicalPowerMotor},
+        {prefMaxMecPowerRegen, &config->maxMechanicalPowerRegen},
+        {prefDcVoltLimMotor, &config->dcVoltLimitMotor},
+        {prefDcVoltLimRegen, &config->dcVoltLimitRegen},
+        {prefDcCurrLimMotor, &config->dcCurrentLimitMotor},
+        {prefDcCurrLimRegen, &config->dcCurrentLimitRegen},
+        {prefEnableOscLim, (uint8_t *)&config->enableOscillationLimiter}
+    }};
+}
+
 void BrusaMotorController::loadConfiguration() {
     BrusaMotorControllerConfiguration *config = (BrusaMotorControllerConfiguration *)getConfiguration();
 
@@ -357,13 +380,8 @@ void BrusaMotorController::loadConfiguration() {
 //		prefsHandler->read(EEMC_, &config->minimumLevel1);
 //    } else { //checksum invalid. Reinitialize values and store to EEPROM
 //        Logger::warn(BRUSA_DMC5, (char *)Constants::invalidChecksum);
-        prefsHandler->read("maxMecPowerMotor", &config->maxMechanicalPowerMotor, 50000);
-        prefsHandler->read("maxMecPowerRegen", &config->maxMechanicalPowerRegen, 0);
-        prefsHandler->read("dcVoltLimMotor", &config->dcVoltLimitMotor, 1000);
-        prefsHandler->read("dcVoltLimRegen", &config->dcVoltLimitRegen, 0);
-        prefsHandler->read("dcCurrLimMotor", &config->dcCurrentLimitMotor, 0);
-        prefsHandler->read("dcCurrLimRegen", &config->dcCurrentLimitRegen, 0);
-        prefsHandler->read("enableOscLim", (uint8_t *)&config->enableOscillationLimiter, (uint8_t)0);
+        auto prefs = bindPrefs(config);
+        prefsHandler->read(prefs.data(), prefs.size());
     //}
     Logger::debug(BRUSA_DMC5, "Max mech power motor: %f kW, max mech power regen: %f ", config->maxMechanicalPowerMotor, config->maxMechanicalPowerRegen);
     Logger::debug(BRUSA_DMC5, "DC limit motor: %f Volt, DC limit regen: %f Volt", config->dcVoltLimitMotor, config->dcVoltLimitRegen);
@@ -377,13 +395,8 @@ void BrusaMotorController::saveConfiguration() {
     BrusaMotorControllerConfiguration *config = (BrusaMotorControllerConfiguration *)getConfiguration();
 
     MotorController::saveConfiguration(); // call parent
-    prefsHandler->write("maxMecPowerMotor", config->maxMechanicalPowerMotor);
-	prefsHandler->write("maxMecPowerRegen", config->maxMechanicalPowerRegen);
-	prefsHandler->write("dcVoltLimMotor", config->dcVoltLimitMotor);
-	prefsHandler->write("dcVoltLimRegen", config->dcVoltLimitRegen);
-	prefsHandler->write("dcCurrLimMotor", config->dcCurrentLimitMotor);
-	prefsHandler->write("dcCurrLimRegen", config->dcCurrentLimitRegen);
-	prefsHandler->write("enableOscLim", (uint8_t)config->enableOscillationLimiter);
+    auto prefs = bindPrefs(config);
+    prefsHandler->write(prefs.data(), prefs.size());
     prefsHandler->saveChecksum();
 }
 
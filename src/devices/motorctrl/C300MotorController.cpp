@@ -271,7 +271,7 @@ void C300MotorController::sendCmdUS()
 
     torqueCommand = 20000; //set offset  for zero torque commanded (5000 / 0.25)
 
-    Logger::debug("Throttle requested: %i", throttleRequested);
+    Logger::debug("Throttle requested: %i", throttleRequested.get());
 
     torqueRequested = 0;
     if (actualState == ENABLE) { //don't even try sending torque commands until the DMOC reports it is ready
@@ -333,7 +333,7 @@ void C300MotorController::sendCmdCanada()
 
     torqueCommand = 30000;
 
-    Logger::debug("Throttle requested: %i", throttleRequested);
+    Logger::debug("Throttle requested: %i", throttleRequested.get());
 
     torqueRequested = 0;
     if (allowedToOperate) { //don't even try sending torque commands until the controller reports it is ready
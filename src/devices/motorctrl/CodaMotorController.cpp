@@ -112,7 +112,7 @@ void CodaMotorController::handleCanFrame(const CAN_message_t &frame)
         dcCurrent = (((frame.buf[5] * 256) + frame.buf[4])-32128) / 10.0f;
         speedActual = abs((((frame.buf[7] * 256) + frame.buf[6])-32128) / 2.0f);
 
-        Logger::debug("UQM Actual Torque: %f DC Voltage: %f Amps: %f RPM: %u", torqueActual, dcVoltage, dcCurrent, speedActual);
+        Logger::debug("UQM Actual Torque: %f DC Voltage: %f Amps: %f RPM: %u", torqueActual.get(), dcVoltage.get(), dcCurrent.get(), speedActual.get());
         break;
 
     case 0x20A:    //System Status Message
@@ -143,7 +143,7 @@ void CodaMotorController::handleCanFrame(const CAN_message_t &frame)
         else {
             temperatureMotor = (StatorTemp-40);
         }
-        Logger::debug("UQM 20E Inverter temp: %i Motor temp: %i", temperatureInverter,temperatureMotor);
+        Logger::debug("UQM 20E Inverter temp: %i Motor temp: %i", temperatureInverter.get(),temperatureMotor.get());
         break;
 
     case 0x20F:    //CAN Watchdog Status Message
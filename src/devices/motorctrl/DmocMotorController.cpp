@@ -80,12 +80,12 @@ void DmocMotorController::setup() {
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name       var         type              prevVal  obj
-    stat = {"MC_ActualState", &actualState, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    //        name       var         type              obj
+    stat = {"MC_ActualState", &actualState, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_Alive", &alive, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_Alive", &alive, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_torqueCmd", &torqueCommand, CFG_ENTRY_VAR_TYPE::UINT16, 0, this};
+    stat = {"MC_torqueCmd", &torqueCommand, CFG_ENTRY_VAR_TYPE::UINT16, this};
     deviceManager.addStatusEntry(stat);
 
     setAttachedCANBus(config->canbusNum);
@@ -116,7 +116,7 @@ void DmocMotorController::handleCanFrame(const CAN_message_t &frame) {
     int temp;
     online = true; //if a frame got to here then it passed the filter and must have been from the DMOC
 
-    Logger::debug(DMOC645, "CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame.id,frame.buf[0] ,frame.buf[1],frame.buf[2],frame.buf[3],frame.buf[4],frame.buf[5],frame.buf[6],frame.buf[7]);
+    LOG_DEV_DEBUG(DMOC645, "CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame.id,frame.buf[0] ,frame.buf[1],frame.buf[2],frame.buf[3],frame.buf[4],frame.buf[5],frame.buf[6],frame.buf[7]);
 
 
     switch (frame.id) {
@@ -187,7 +187,7 @@ void DmocMotorController::handleCanFrame(const CAN_message_t &frame) {
             faulted=true;
             break;
         }
-        Logger::debug(DMOC645, "Reported OpState: %d", temp);
+        LOG_DEV_DEBUG(DMOC645, "Reported OpState: %d", temp);
         activityCount++;
         break;
 
@@ -217,7 +217,7 @@ void DmocMotorController::handleTick() {
         if (activityCount > 40) //If we are receiving regular CAN messages from DMOC, this will very quickly get to over 40. We'll limit
             // it to 60 so if we lose communications, within 20 ticks we will decrement below this value.
         {
-            Logger::debug(DMOC645, "Enable Input Active? %u         Reverse Input Active? %u" ,systemIO.getDigitalIn(getEnableIn()),systemIO.getDigitalIn(getReverseIn()));
+            LOG_DEV_DEBUG(DMOC645, "Enable Input Active? %u         Reverse Input Active? %u" ,systemIO.getDigitalIn(getEnableIn()),systemIO.getDigitalIn(getReverseIn()));
             if(getEnableIn()<0)setOpState(ENABLE); //If we HAVE an enableinput 0-3, we'll let that handle opstate. Otherwise set it to ENABLE
             if(getReverseIn()<0)setSelectedGear(DRIVE); //If we HAVE a reverse input, we'll let that determine forward/reverse.  Otherwise set it to DRIVE
         }
@@ -286,7 +286,7 @@ void DmocMotorController::sendCmd1() {
 
     output.buf[7] = calcChecksum(output);
  
-    Logger::debug(DMOC645, "0x232 tx: %X %X %X %X %X %X %X %X", output.buf[0], output.buf[1], output.buf[2], output.buf[3],
+    LOG_DEV_DEBUG(DMOC645, "0x232 tx: %X %X %X %X %X %X %X %X", output.buf[0], output.buf[1], output.buf[2], output.buf[3],
                   output.buf[4], output.buf[5], output.buf[6], output.buf[7]);
 
     attachedCANBus->sendFrame(output);
@@ -319,7 +319,7 @@ void DmocMotorController::sendCmd2() {
 
     torqueCommand = 30000; //set offset  for zero torque commanded
 
-    Logger::debug(DMOC645, "Throttle requested: %i", throttleRequested);
+    LOG_DEV_DEBUG(DMOC645, "Throttle requested: %i", throttleRequested.get());
 
     torqueRequested=0;
     if (actualState == ENABLE) { //don't even try sending torque commands until the DMOC reports it is ready
@@ -369,7 +369,7 @@ void DmocMotorController::sendCmd2() {
     attachedCANBus->sendFrame(output);
 
     timestamp();
-    Logger::debug(DMOC645, "Torque command: %X  %X  %X  %X  %X  %X  %X  CRC: %X",output.buf[0],
+    LOG_DEV_DEBUG(DMOC645, "Torque command: %X  %X  %X  %X  %X  %X  %X  CRC: %X",output.buf[0],
                   output.buf[1],output.buf[2],output.buf[3],output.buf[4],output.buf[5],output.buf[6],output.buf[7]);
 
 }
@@ -473,6 +473,8 @@ uint32_t DmocMotorController::getTickInterval()
     return CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC;
 }
 
+static constexpr Pref<uint8_t> prefCanbusNum("CanbusNum", 1);
+
 void DmocMotorController::loadConfiguration() {
     DmocMotorControllerConfiguration *config = (DmocMotorControllerConfiguration *)getConfiguration();
 
@@ -483,7 +485,8 @@ void DmocMotorController::loadConfiguration() {
 
     MotorController::loadConfiguration(); // call parent
 
-    prefsHandler->read("CanbusNum", &config->canbusNum, 1);
+    const PrefBinding prefs[] = { PrefBinding(prefCanbusNum, &config->canbusNum) };
+    prefsHandler->read(prefs, 1);
 }
 
 void DmocMotorController::saveConfiguration() {
@@ -494,7 +497,8 @@ void DmocMotorController::saveConfiguration() {
         setConfiguration(config);
     }
 
-    prefsHandler->write("CanbusNum", config->canbusNum);
+    const PrefBinding prefs[] = { PrefBinding(prefCanbusNum, &config->canbusNum) };
+    prefsHandler->write(prefs, 1);
 
     MotorController::saveConfiguration();
 }
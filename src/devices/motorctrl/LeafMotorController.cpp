@@ -63,12 +63,12 @@ void LeafMotorController::setup() {
     cfgEntries.push_back(entry);
 
     StatusEntry stat;
-    //        name       var         type              prevVal  obj
-    stat = {"MC_ActualState", &actualState, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    //        name       var         type              obj
+    stat = {"MC_ActualState", &actualState, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_Alive", &alive, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_Alive", &alive, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_torqueCmd", &torqueCommand, CFG_ENTRY_VAR_TYPE::UINT16, 0, this};
+    stat = {"MC_torqueCmd", &torqueCommand, CFG_ENTRY_VAR_TYPE::UINT16, this};
     deviceManager.addStatusEntry(stat);
 
     setAttachedCANBus(config->canbusNum);
@@ -289,6 +289,8 @@ uint32_t LeafMotorController::getTickInterval()
     return CFG_TICK_INTERVAL_MOTOR_CONTROLLER_LEAF;
 }
 
+static constexpr Pref<uint8_t> prefCanbusNum("CanbusNum", 1);
+
 void LeafMotorController::loadConfiguration() {
     LeafMotorControllerConfiguration *config = (LeafMotorControllerConfiguration *)getConfiguration();
 
@@ -299,7 +301,8 @@ void LeafMotorController::loadConfiguration() {
 
     MotorController::loadConfiguration(); // call parent
 
-    prefsHandler->read("CanbusNum", &config->canbusNum, 1);
+    const PrefBinding prefs[] = { PrefBinding(prefCanbusNum, &config->canbusNum) };
+    prefsHandler->read(prefs, 1);
 }
 
 void LeafMotorController::saveConfiguration() {
@@ -310,7 +313,8 @@ void LeafMotorController::saveConfiguration() {
         setConfiguration(config);
     }
 
-    prefsHandler->write("CanbusNum", config->canbusNum);
+    const PrefBinding prefs[] = { PrefBinding(prefCanbusNum, &config->canbusNum) };
+    prefsHandler->write(prefs, 1);
 
     MotorController::saveConfiguration();
 }
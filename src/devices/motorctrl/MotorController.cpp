@@ -27,6 +27,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "MotorController.h"
+#include "../../PersistJournal.h"
+#include <array>
 
 MotorController::MotorController() : Device() {
     ready = false;
@@ -57,6 +59,8 @@ MotorController::MotorController() : Device() {
     acCurrent = 0;
 
     skipcounter = 0;
+    lastEnergyMicros = 0;
+    energyOut = energyIn = 0.0f;
     testenableinput = 0;
     testreverseinput = 0;
 }
@@ -90,46 +94,46 @@ void MotorController::setup() {
     statusBitfield.bitfield = 0;
 
     StatusEntry stat;
-    //        name       var         type              prevVal  obj
-    stat = {"MC_Ready", &ready, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    //        name       var         type              obj
+    stat = {"MC_Ready", &ready, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_Running", &running, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_Running", &running, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_Faulted", &faulted, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_Faulted", &faulted, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_Warning", &warning, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_Warning", &warning, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_Gear", &selectedGear, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_Gear", &selectedGear, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_PowerMode", &powerMode, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_PowerMode", &powerMode, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_OpState", &operationState, CFG_ENTRY_VAR_TYPE::BYTE, 0, this};
+    stat = {"MC_OpState", &operationState, CFG_ENTRY_VAR_TYPE::BYTE, this};
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_ThrottleReq", &throttleRequested, CFG_ENTRY_VAR_TYPE::INT16, 0, this};
+    stat = StatusEntry("MC_ThrottleReq", &throttleRequested, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_SpeedReq", &speedRequested, CFG_ENTRY_VAR_TYPE::INT16, 0, this};
+    stat = StatusEntry("MC_SpeedReq", &speedRequested, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_SpeedAct", &speedActual, CFG_ENTRY_VAR_TYPE::INT16, 0, this};
+    stat = StatusEntry("MC_SpeedAct", &speedActual, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_TorqueReq", &torqueRequested, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_TorqueReq", &torqueRequested, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_TorqueAct", &torqueActual, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_TorqueAct", &torqueActual, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_TorqueMax", &torqueAvailable, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_TorqueMax", &torqueAvailable, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_DCVoltage", &dcVoltage, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_DCVoltage", &dcVoltage, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_DCCurrent", &dcCurrent, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_DCCurrent", &dcCurrent, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_ACCurrent", &acCurrent, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_ACCurrent", &acCurrent, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_MechPower", &mechanicalPower, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_MechPower", &mechanicalPower, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_MotorTemp", &temperatureMotor, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_MotorTemp", &temperatureMotor, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_InverterTemp", &temperatureInverter, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_InverterTemp", &temperatureInverter, this);
     deviceManager.addStatusEntry(stat);
-    stat = {"MC_SysTemp", &temperatureSystem, CFG_ENTRY_VAR_TYPE::FLOAT, 0, this};
+    stat = StatusEntry("MC_SysTemp", &temperatureSystem, this);
     deviceManager.addStatusEntry(stat);
 
     Device::setup();
@@ -146,6 +150,7 @@ void MotorController::handleTick() {
 
     //Calculate killowatts and kilowatt hours
     mechanicalPower = dcVoltage * dcCurrent / 1000.0f; //In kilowatts.
+    updateEnergy();
 
     //Throttle check
     Throttle *accelerator = deviceManager.getAccelerator();
@@ -164,6 +169,33 @@ void MotorController::handleTick() {
     }
 }
 
+//Integrates the DC power since the last tick into the lifetime energy counters in the persistent journal.
+//Whole watt hours are handed over as they add up, the fraction stays here until the next tick.
+void MotorController::updateEnergy()
+{
+    uint32_t now = micros();
+    if (lastEnergyMicros != 0)
+    {
+        float wattHours = dcVoltage * dcCurrent * (float)(now - lastEnergyMicros) / 3600000000.0f;
+        if (wattHours > 0.0f) energyOut += wattHours;
+        else energyIn -= wattHours;
+    }
+    lastEnergyMicros = now;
+
+    if (energyOut >= 1.0f)
+    {
+        uint32_t whole = (uint32_t)energyOut;
+        persistJournal.setValue(JV_WH_OUT, persistJournal.getValue(JV_WH_OUT) + whole);
+        energyOut -= whole;
+    }
+    if (energyIn >= 1.0f)
+    {
+        uint32_t whole = (uint32_t)energyIn;
+        persistJournal.setValue(JV_WH_IN, persistJournal.getValue(JV_WH_IN) + whole);
+        energyIn -= whole;
+    }
+}
+
 /*
 //If we have a brakelight output configured, this will set it anytime regen greater than 10 Newton meters
 void MotorController::checkBrakeLight()
@@ -267,6 +299,12 @@ DeviceType MotorController::getType() {
     return (DEVICE_MOTORCTRL);
 }
 
+//torque requests are built from the throttle and brake
+const DeviceType *MotorController::getDependencies() {
+    static const DeviceType deps[] = {DEVICE_THROTTLE, DEVICE_BRAKE, DEVICE_NONE};
+    return deps;
+}
+
 void MotorController::setOpState(OperationState op) {
     operationState = op;
 }
@@ -362,6 +400,32 @@ bool MotorController::isReady() {
     return false;
 }
 
+//Settings every motor controller has. Load and save both use this table so they can't get out of step.
+static constexpr Pref<uint16_t> prefMaxRPM("MaxRPM", 6000);
+static constexpr Pref<float> prefMaxTorque("MaxTorque", 300.0f);
+static constexpr Pref<uint16_t> prefRPMSlew("RPMSlew", 10000);
+static constexpr Pref<float> prefTorqueSlew("TorqueSlew", 600.0f);
+static constexpr Pref<uint8_t> prefReversePercentage("ReversePercentage", 50);
+static constexpr Pref<uint8_t> prefEnableDIN("Enable_DIN", 0);
+static constexpr Pref<uint8_t> prefReverseDIN("Reverse_DIN", 1);
+static constexpr Pref<uint16_t> prefRegenTaperUpper("RegenTaperUpper", 500);
+static constexpr Pref<uint16_t> prefRegenTaperLower("RegenTaperLower", 75);
+
+static std::array<PrefBinding, 9> bindPrefs(MotorControllerConfiguration *config)
+{
+    return {{
+        {prefMaxRPM, &config->speedMax},
+        {prefMaxTorque, &config->torqueMax},
+        {prefRPMSlew, &config->speedSlewRate},
+        {prefTorqueSlew, &config->torqueSlewRate},
+        {prefReversePercentage, &config->reversePercent},
+        {prefEnableDIN, &config->enableIn},
+        {prefReverseDIN, &config->reverseIn},
+        {prefRegenTaperUpper, &config->regenTaperUpper},
+        {prefRegenTaperLower, &config->regenTaperLower}
+    }};
+}
+
 void MotorController::loadConfiguration() {
     MotorControllerConfiguration *config = (MotorControllerConfiguration *)getConfiguration();
 
@@ -369,15 +433,8 @@ void MotorController::loadConfiguration() {
 
     //if (prefsHandler->checksumValid()) { //checksum is good, read in the values stored in EEPROM
         Logger::info((char *)Constants::validChecksum);
-        prefsHandler->read("MaxRPM", &config->speedMax, 6000);
-        prefsHandler->read("MaxTorque", &config->torqueMax, 300.0f);
-        prefsHandler->read("RPMSlew", &config->speedSlewRate, 10000);
-        prefsHandler->read("TorqueSlew", &config->torqueSlewRate, 600.0f);
-        prefsHandler->read("ReversePercentage", &config->reversePercent, 50);
-        prefsHandler->read("Enable_DIN", &config->enableIn, 0);
-        prefsHandler->read("Reverse_DIN", &config->reverseIn, 1);
-        prefsHandler->read("RegenTaperUpper", &config->regenTaperUpper, 500);
-        prefsHandler->read("RegenTaperLower", &config->regenTaperLower, 75);
+        auto prefs = bindPrefs(config);
+        prefsHandler->read(prefs.data(), prefs.size());
         if (config->regenTaperLower < 0 || config->regenTaperLower > 10000 ||
             config->regenTaperUpper < config->regenTaperLower || config->regenTaperUpper > 10000) {
             config->regenTaperLower = 75;
@@ -392,15 +449,8 @@ void MotorController::saveConfiguration() {
 
     Device::saveConfiguration(); // call parent
 
-    prefsHandler->write("MaxRPM", config->speedMax);
-    prefsHandler->write("MaxTorque", config->torqueMax);
-    prefsHandler->write("RPMSlew", config->speedSlewRate);
-    prefsHandler->write("TorqueSlew", config->torqueSlewRate);
-    prefsHandler->write("ReversePercentage", config->reversePercent);
-    prefsHandler->write("Enable_DIN", config->enableIn);
-    prefsHandler->write("Reverse_DIN", config->reverseIn);
-    prefsHandler->write("RegenTaperLower", config->regenTaperLower);
-    prefsHandler->write("RegenTaperUpper", config->regenTaperUpper);
+    auto prefs = bindPrefs(config);
+    prefsHandler->write(prefs.data(), prefs.size());
     
     prefsHandler->saveChecksum();
     prefsHandler->forceCacheWrite();
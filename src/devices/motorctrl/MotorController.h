@@ -115,6 +115,7 @@ public:
 
     MotorController();
     DeviceType getType();
+    const DeviceType *getDependencies();
     void setup();
     void handleTick();
     uint32_t getTickInterval();
@@ -182,22 +183,25 @@ protected:
     PowerMode powerMode;
     OperationState operationState; //the op state we want
 
-    int16_t throttleRequested; // -1000 to 1000 (per mille of throttle level)
-    int16_t speedRequested; // in rpm
-    int16_t speedActual; // in rpm
-    float torqueRequested; // in Nm
-    float torqueActual; // in Nm
-    float torqueAvailable; // the maximum available torque in Nm
-
-    float dcVoltage; // DC voltage in Volts
-    float dcCurrent; // DC current in Amps
-    float acCurrent; // AC current in Amps
-    float mechanicalPower; // mechanical power of the motor kW
-    float temperatureMotor; // temperature of motor in degree C
-    float temperatureInverter; // temperature of inverter power stage in degree C
-    float temperatureSystem; // temperature of controller in degree C
+    StatusVar<int16_t> throttleRequested; // -1000 to 1000 (per mille of throttle level)
+    StatusVar<int16_t> speedRequested; // in rpm
+    StatusVar<int16_t> speedActual; // in rpm
+    StatusVar<float> torqueRequested; // in Nm
+    StatusVar<float> torqueActual; // in Nm
+    StatusVar<float> torqueAvailable; // the maximum available torque in Nm
+
+    StatusVar<float> dcVoltage; // DC voltage in Volts
+    StatusVar<float> dcCurrent; // DC current in Amps
+    StatusVar<float> acCurrent; // AC current in Amps
+    StatusVar<float> mechanicalPower; // mechanical power of the motor kW
+    StatusVar<float> temperatureMotor; // temperature of motor in degree C
+    StatusVar<float> temperatureInverter; // temperature of inverter power stage in degree C
+    StatusVar<float> temperatureSystem; // temperature of controller in degree C
 
     uint32_t skipcounter;
+    void updateEnergy();
+    uint32_t lastEnergyMicros; //when the DC power was last integrated into the energy counters
+    float energyOut, energyIn; //watt hours not yet added to the journal counters
 };
 
 #endif
@@ -92,7 +92,7 @@ void RMSMotorController::handleCanFrame(const CAN_message_t &frame)
     
     running = true;
     
-    Logger::debug("inverter msg: %X   %X   %X   %X   %X   %X   %X   %X  %X", frame.id, frame.buf[0],
+    LOG_DEV_DEBUG(RINEHARTINV, "inverter msg: %X   %X   %X   %X   %X   %X   %X   %X  %X", frame.id, frame.buf[0],
                   frame.buf[1],frame.buf[2],frame.buf[3],frame.buf[4],
                   frame.buf[5],frame.buf[6],frame.buf[7]);
 
@@ -157,7 +157,7 @@ void RMSMotorController::handleCANMsgTemperature1(uint8_t *data)
 	igbtTemp2 = data[2] + (data[3] * 256) / 10.0f;
     igbtTemp3 = data[4] + (data[5] * 256) / 10.0f;
     gateTemp = data[6] + (data[7] * 256) / 10.0f;
-    Logger::debug("IGBT Temps - 1: %f  2: %f  3: %f     Gate Driver: %f    (C)", igbtTemp1, igbtTemp2, igbtTemp3, gateTemp);
+    LOG_DEV_DEBUG(RINEHARTINV, "IGBT Temps - 1: %f  2: %f  3: %f     Gate Driver: %f    (C)", igbtTemp1, igbtTemp2, igbtTemp3, gateTemp);
     temperatureInverter = igbtTemp1;
     if (igbtTemp2 > temperatureInverter) temperatureInverter = igbtTemp2;
     if (igbtTemp3 > temperatureInverter) temperatureInverter = igbtTemp3;
@@ -171,7 +171,7 @@ void RMSMotorController::handleCANMsgTemperature2(uint8_t *data)
 	rtdTemp1 = data[2] + (data[3] * 256) / 10.0f;
     rtdTemp2 = data[4] + (data[5] * 256) / 10.0f;
     rtdTemp3 = data[6] + (data[7] * 256) / 10.0f;
-    Logger::debug("Ctrl Temp: %f  RTD1: %f   RTD2: %f   RTD3: %f    (C)", ctrlTemp, rtdTemp1, rtdTemp2, rtdTemp3);
+    LOG_DEV_DEBUG(RINEHARTINV, "Ctrl Temp: %f  RTD1: %f   RTD2: %f   RTD3: %f    (C)", ctrlTemp, rtdTemp1, rtdTemp2, rtdTemp3);
 	temperatureSystem = ctrlTemp;
 }
 
@@ -182,7 +182,7 @@ void RMSMotorController::handleCANMsgTemperature3(uint8_t *data)
 	rtdTemp5 = data[2] + (data[3] * 256) / 10.0f;
     motorTemp = data[4] + (data[5] * 256) / 10.0f;
     torqueShudder = data[6] + (data[7] * 256);
-    Logger::debug("RTD4: %f   RTD5: %f   Motor Temp: %f    Torque Shudder: %f", rtdTemp4, rtdTemp5, motorTemp, torqueShudder);
+    LOG_DEV_DEBUG(RINEHARTINV, "RTD4: %f   RTD5: %f   Motor Temp: %f    Torque Shudder: %f", rtdTemp4, rtdTemp5, motorTemp, torqueShudder);
 	temperatureMotor = motorTemp;
 }
 
@@ -193,7 +193,7 @@ void RMSMotorController::handleCANMsgAnalogInputs(uint8_t *data)
 	analog2 = data[2] + (data[3] * 256);
     analog3 = data[4] + (data[5] * 256);
     analog4 = data[6] + (data[7] * 256);
-	Logger::debug("RMS  A1: %i   A2: %i   A3: %i   A4: %i", analog1, analog2, analog3, analog4);
+	LOG_DEV_DEBUG(RINEHARTINV, "RMS  A1: %i   A2: %i   A3: %i   A4: %i", analog1, analog2, analog3, analog4);
 }
 
 void RMSMotorController::handleCANMsgDigitalInputs(uint8_t *data)
@@ -205,7 +205,7 @@ void RMSMotorController::handleCANMsgDigitalInputs(uint8_t *data)
 	{
 		if (data[i] == 1) digInputs |= 1 << i;
 	}
-	Logger::debug("Digital Inputs: %x", digInputs);
+	LOG_DEV_DEBUG(RINEHARTINV, "Digital Inputs: %x", digInputs);
 }
 
 void RMSMotorController::handleCANMsgMotorPos(uint8_t *data)
@@ -216,7 +216,7 @@ void RMSMotorController::handleCANMsgMotorPos(uint8_t *data)
     elecFreq = data[4] + (data[5] * 256);
     deltaResolver = data[6] + (data[7] * 256);
 	speedActual = motorSpeed;
-	Logger::debug("Angle: %i   Speed: %i   Freq: %i    Delta: %i", motorAngle, motorSpeed, elecFreq, deltaResolver);
+	LOG_DEV_DEBUG(RINEHARTINV, "Angle: %i   Speed: %i   Freq: %i    Delta: %i", motorAngle, motorSpeed, elecFreq, deltaResolver);
 }
 
 void RMSMotorController::handleCANMsgCurrent(uint8_t *data)
@@ -230,7 +230,7 @@ void RMSMotorController::handleCANMsgCurrent(uint8_t *data)
 	acCurrent = phaseCurrentA;
 	if (phaseCurrentB > acCurrent) acCurrent = phaseCurrentB;
 	if (phaseCurrentC > acCurrent) acCurrent = phaseCurrentC;
-	Logger::debug("Phase A: %f    B: %f   C: %f    Bus Current: %f", phaseCurrentA, phaseCurrentB, phaseCurrentC, busCurrent);
+	LOG_DEV_DEBUG(RINEHARTINV, "Phase A: %f    B: %f   C: %f    Bus Current: %f", phaseCurrentA, phaseCurrentB, phaseCurrentC, busCurrent);
 }
 
 void RMSMotorController::handleCANMsgVoltage(uint8_t *data)
@@ -240,7 +240,7 @@ void RMSMotorController::handleCANMsgVoltage(uint8_t *data)
 	outVoltage = data[2] + (data[3] * 256) / 10.0f;
     Vd = data[4] + (data[5] * 256) / 10.0f;
     Vq = data[6] + (data[7] * 256) / 10.0f;
-	Logger::debug("Bus Voltage: %f    OutVoltage: %f   Vd: %f    Vq: %f", dcVoltage, outVoltage, Vd, Vq);
+	LOG_DEV_DEBUG(RINEHARTINV, "Bus Voltage: %f    OutVoltage: %f   Vd: %f    Vq: %f", dcVoltage, outVoltage, Vd, Vq);
 }
 
 void RMSMotorController::handleCANMsgFlux(uint8_t *data)
@@ -250,7 +250,7 @@ void RMSMotorController::handleCANMsgFlux(uint8_t *data)
 	fluxEst = data[2] + (data[3] * 256) / 10.0f;
     Id = data[4] + (data[5] * 256) / 10.0f;
     Iq = data[6] + (data[7] * 256) / 10.0f;
-	Logger::debug("Flux Cmd: %f  Flux Est: %f   Id: %f    Iq: %f", fluxCmd, fluxEst, Id, Iq);
+	LOG_DEV_DEBUG(RINEHARTINV, "Flux Cmd: %f  Flux Est: %f   Id: %f    Iq: %f", fluxCmd, fluxEst, Id, Iq);
 }
 
 void RMSMotorController::handleCANMsgIntVolt(uint8_t *data)
@@ -260,7 +260,7 @@ void RMSMotorController::handleCANMsgIntVolt(uint8_t *data)
 	volts25 = data[2] + (data[3] * 256) / 10.0f;
     volts50 = data[4] + (data[5] * 256) / 10.0f;
     volts120 = data[6] + (data[7] * 256) / 10.0f;
-	Logger::debug("1.5V: %f   2.5V: %f   5.0V: %f    12V: %f", volts15, volts25, volts50, volts120);
+	LOG_DEV_DEBUG(RINEHARTINV, "1.5V: %f   2.5V: %f   5.0V: %f    12V: %f", volts15, volts25, volts50, volts120);
 }
 
 void RMSMotorController::handleCANMsgIntState(uint8_t *data)
@@ -280,69 +280,69 @@ void RMSMotorController::handleCANMsgIntState(uint8_t *data)
     switch (vsmState)
 	{
     case 0:
-	    Logger::debug("VSM Start");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Start");
 		break;		
     case 1:
-	    Logger::debug("VSM Precharge Init");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Precharge Init");
 		break;		
     case 2:
-	    Logger::debug("VSM Precharge Active");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Precharge Active");
 		break;		
     case 3:
-	    Logger::debug("VSM Precharge Complete");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Precharge Complete");
 		break;		
     case 4:
-	    Logger::debug("VSM Wait");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Wait");
 		break;		
     case 5:
-	    Logger::debug("VSM Ready");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Ready");
 		break;		
     case 6:
-	    Logger::debug("VSM Motor Running");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Motor Running");
 		break;		
     case 7:
-	    Logger::debug("VSM Blink Fault Code");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Blink Fault Code");
 		break;		
     case 14:
-	    Logger::debug("VSM Shutdown in process");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Shutdown in process");
 		break;		
     case 15:
-	    Logger::debug("VSM Recycle power state");
+	    LOG_DEV_DEBUG(RINEHARTINV, "VSM Recycle power state");
 		break;		
     default:
-	    Logger::debug("Unknown VSM State!");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Unknown VSM State!");
 		break;				
 	}	
 	
 	switch (invState)
 	{
     case 0:
-	    Logger::debug("Inv - Power On");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Power On");
 		break;		
     case 1:
-	    Logger::debug("Inv - Stop");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Stop");
 		break;		
     case 2:
-	    Logger::debug("Inv - Open Loop");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Open Loop");
 		break;		
     case 3:
-	    Logger::debug("Inv - Closed Loop");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Closed Loop");
 		break;		
     case 4:
-	    Logger::debug("Inv - Wait");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Wait");
 		break;		
     case 8:
-	    Logger::debug("Inv - Idle Run");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Idle Run");
 		break;		
     case 9:
-	    Logger::debug("Inv - Idle Stop");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Inv - Idle Stop");
 		break;		
     default:
-	    Logger::debug("Internal Inverter State");
+	    LOG_DEV_DEBUG(RINEHARTINV, "Internal Inverter State");
 		break;				
 	}
 	
-	Logger::debug ("Relay States: %x", relayState);
+	LOG_DEV_DEBUG(RINEHARTINV, "Relay States: %x", relayState);
 	
 	if (invRunMode) powerMode = modeSpeed;
 	else powerMode = modeTorque;
@@ -350,34 +350,34 @@ void RMSMotorController::handleCANMsgIntState(uint8_t *data)
 	switch (invActiveDischarge)
 	{
 	case 0:
-		Logger::debug("Active Discharge Disabled");
+		LOG_DEV_DEBUG(RINEHARTINV, "Active Discharge Disabled");
 		break;
 	case 1:
-		Logger::debug("Active Discharge Enabled - Waiting");
+		LOG_DEV_DEBUG(RINEHARTINV, "Active Discharge Enabled - Waiting");
 		break;
 	case 2:
-		Logger::debug("Active Discharge Checking Speed");
+		LOG_DEV_DEBUG(RINEHARTINV, "Active Discharge Checking Speed");
 		break;
 	case 3:
-		Logger::debug("Active Discharge In Process");
+		LOG_DEV_DEBUG(RINEHARTINV, "Active Discharge In Process");
 		break;
 	case 4:
-		Logger::debug("Active Discharge Completed");
+		LOG_DEV_DEBUG(RINEHARTINV, "Active Discharge Completed");
 		break;		
 	}
 	
 	if (invCmdMode)
 	{
-		Logger::debug("VSM Mode Active");
+		LOG_DEV_DEBUG(RINEHARTINV, "VSM Mode Active");
 		isCANControlled = false;
 	}
 	else
 	{
-		Logger::debug("CAN Mode Active");
+		LOG_DEV_DEBUG(RINEHARTINV, "CAN Mode Active");
 		isCANControlled = true;
 	}
 	
-	Logger::debug("Enabled: %u    Forward: %u", isEnabled, invDirection);
+	LOG_DEV_DEBUG(RINEHARTINV, "Enabled: %u    Forward: %u", isEnabled, invDirection);
 }
 
 void RMSMotorController::handleCANMsgFaults(uint8_t *data)
@@ -457,7 +457,7 @@ void RMSMotorController::handleCANMsgTorqueTimer(uint8_t *data)
 	cmdTorque = data[0] + (data[1] * 256) / 10.0f;
 	actTorque = data[2] + (data[3] * 256) / 10.0f;
 	uptime = data[4] + (data[5] * 256) + (data[6] * 65536ul) + (data[7] * 16777216ul);
-	Logger::debug("Torque Cmd: %f   Actual: %f     Uptime: %lu", cmdTorque, actTorque, uptime);
+	LOG_DEV_DEBUG(RINEHARTINV, "Torque Cmd: %f   Actual: %f     Uptime: %lu", cmdTorque, actTorque, uptime);
 	torqueActual = actTorque;
 	//torqueCommand = cmdTorque; //should this be here? We set commanded torque and probably shouldn't overwrite here.
 }
@@ -469,7 +469,7 @@ void RMSMotorController::handleCANMsgModFluxWeaken(uint8_t *data)
 	fieldWeak = data[2] + (data[3] * 256);
     IdCmd = data[4] + (data[5] * 256);
     IqCmd = data[6] + (data[7] * 256);
-	Logger::debug("Mod: %i  Weaken: %i   Id: %i   Iq: %i", modIdx, fieldWeak, IdCmd, IqCmd);
+	LOG_DEV_DEBUG(RINEHARTINV, "Mod: %i  Weaken: %i   Id: %i   Iq: %i", modIdx, fieldWeak, IdCmd, IqCmd);
 }
 
 void RMSMotorController::handleCANMsgFirmwareInfo(uint8_t *data)
@@ -479,7 +479,7 @@ void RMSMotorController::handleCANMsgFirmwareInfo(uint8_t *data)
 	firmVersion = data[2] + (data[3] * 256);
     dateMMDD = data[4] + (data[5] * 256);
     dateYYYY = data[6] + (data[7] * 256);
-	Logger::debug("EEVer: %u  Firmware: %u   Date: %u %u", EEVersion, firmVersion, dateMMDD, dateYYYY);
+	LOG_DEV_DEBUG(RINEHARTINV, "EEVer: %u  Firmware: %u   Date: %u %u", EEVersion, firmVersion, dateMMDD, dateYYYY);
 }
 
 void RMSMotorController::handleCANMsgDiagnostic(uint8_t *data)
@@ -557,14 +557,14 @@ void RMSMotorController::sendCmdFrame()
     
     if (torqueRequested < 0) torqueRequested = 0;
     
-    Logger::debug("ThrottleRequested: %i     TorqueRequested: %i", throttleRequested, torqueRequested);
+    LOG_DEV_DEBUG(RINEHARTINV, "ThrottleRequested: %i     TorqueRequested: %i", throttleRequested.get(), torqueRequested.get());
 	
     output.buf[1] = (torqueCommand & 0xFF00) >> 8;  //Stow torque command in bytes 0 and 1.
     output.buf[0] = (torqueCommand & 0x00FF);
     
     attachedCANBus->sendFrame(output);  //Mail it.
 
-    Logger::debug("CAN Command Frame: %X  %X  %X  %X  %X  %X  %X  %X",output.id, output.buf[0],
+    LOG_DEV_DEBUG(RINEHARTINV, "CAN Command Frame: %X  %X  %X  %X  %X  %X  %X  %X",output.id, output.buf[0],
                   output.buf[1],output.buf[2],output.buf[3],output.buf[4],
 				  output.buf[5],output.buf[6],output.buf[7]);
 }
@@ -579,6 +579,8 @@ uint32_t RMSMotorController::getTickInterval()
     return CFG_TICK_INTERVAL_MOTOR_CONTROLLER;
 }
 
+static constexpr Pref<uint8_t> prefCanbusNum("CanbusNum", 1);
+
 void RMSMotorController::loadConfiguration()
 {
     RMSMotorControllerConfiguration *config = (RMSMotorControllerConfiguration *)getConfiguration();
@@ -590,14 +592,16 @@ void RMSMotorController::loadConfiguration()
 
     MotorController::loadConfiguration(); // call parent
 
-    prefsHandler->read("CanbusNum", &config->canbusNum, 1);
+    const PrefBinding prefs[] = { PrefBinding(prefCanbusNum, &config->canbusNum) };
+    prefsHandler->read(prefs, 1);
 }
 
 void RMSMotorController::saveConfiguration()
 {
     RMSMotorControllerConfiguration *config = (RMSMotorControllerConfiguration *)getConfiguration();
     
-    prefsHandler->write("CanbusNum", config->canbusNum);
+    const PrefBinding prefs[] = { PrefBinding(prefCanbusNum, &config->canbusNum) };
+    prefsHandler->write(prefs, 1);
 
     MotorController::saveConfiguration();
 }
@@ -119,8 +119,8 @@ void TestMotorController::handleTick() {
     temperatureSystem = (temperatureInverter + temperatureMotor) / 2;
     
     Logger::debug(TESTINVERTER, "PowerMode: %i, Gear: %i", powerMode, selectedGear);
-    Logger::debug(TESTINVERTER, "TorqueReq: %f, SpeedReq: %i", torqueRequested, speedRequested);
-    Logger::debug(TESTINVERTER, "dcCurrent: %f, mechPower: %f", dcCurrent, mechanicalPower);
+    Logger::debug(TESTINVERTER, "TorqueReq: %f, SpeedReq: %i", torqueRequested.get(), speedRequested.get());
+    Logger::debug(TESTINVERTER, "dcCurrent: %f, mechPower: %f", dcCurrent.get(), mechanicalPower.get());
     
 }
 
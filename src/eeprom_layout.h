@@ -56,6 +56,10 @@ length should also encode status flags. That way an entry could move by setting
 the current location as "empty" leaving its size alone and maybe setting the hash to some
 set value. In fact, the set value hash could be the signal that an entry is open.
 
+PrefHandler now does more or less that. A setting that changes size gets a fresh record at the end
+of the block and the old record's hash is set to PREF_DEAD_HASH with its length left alone.
+PrefCompactor squeezes the dead records back out in the background.
+
 */
 
 /*
@@ -74,11 +78,19 @@ First device entry is 0xDEAD if valid - otherwise table is initialized
 #define EE_SYSTEM_START         128
 
 #define EE_MAIN_OFFSET          0 //offset from start of EEPROM where main config is
-#define EE_LKG_OFFSET           34816  //start EEPROM addr where last known good config is
+//Every device block has a second copy here. Transactional saves go to whichever copy isn't active and
+//the generation in the block header picks the newest valid one at boot, so the other copy is always the
+//last known good config. This used to be 34816 but the main blocks of the higher table slots run into that.
+#define EE_LKG_OFFSET           131072
 
 //start EEPROM addr where the system log starts. <SYS LOG YET TO BE DEFINED>
 #define EE_SYS_LOG              69632
 
+//The first 32K of the system log area is the wear leveled journal used by PersistJournal
+//for values that update often (runtime, watt hours in and out, SOC). 128 pages of 256 bytes.
+#define EE_JOURNAL_START        EE_SYS_LOG
+#define EE_JOURNAL_SIZE         32768
+
 //start EEPROM addr for fault log (Used by fault_handler)
 #define EE_FAULT_LOG            102400
 
@@ -90,6 +102,9 @@ the end of the stardard data. The below numbers are offsets from the device's ee
 //first, things in common to all devices - leave 20 bytes for this
 #define EE_CHECKSUM              0 //1 byte - checksum for this section of EEPROM to makesure it is valid
 #define EE_DEVICE_ID             1 //2 bytes - the value of the ENUM DEVID of this device.
+#define EE_GENERATION            3 //4 bytes - bumped on every committed transaction
+#define EE_GENERATION_CHECK      7 //4 bytes - inverse of the generation. If it doesn't match the copy was never committed
+#define EE_HEADER_END            11 //header bytes above are written last when committing a transaction
 
 #define EEFAULT_VALID            0 //1 byte - Set to value of 0xB2 if fault data has been initialized
 #define EEFAULT_READPTR          1 //2 bytes - index where reading should start (first unacknowledged fault)
@@ -33,6 +33,19 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #undef HID_ENABLED
 
+//Drives the analog sampler. TickHandler has the GPT, PIT, TMR4 and TCK timers, TMR1 is free
+static PeriodicTimer adcTimer(TMR1);
+
+static void adcTimerInt()
+{
+    systemIO.handleADCInterrupt();
+}
+
+static void pcaInterrupt()
+{
+    systemIO.handlePCAInterrupt();
+}
+
 SystemIO::SystemIO()
 {
     for (int i = 0; i < NUM_EXT_IO; i++)
@@ -48,7 +61,26 @@ SystemIO::SystemIO()
     numAnaIn = NUM_ANALOG;
     numAnaOut = 0;
     pcaDigitalOutputCache = 0; //all outputs off by default
+    pcaOutputsWritten = 0;
+    pcaOutputPins = 0;
+    pcaInputCache = 0;
+    pcaInputsChanged = false;
+    pcaLastRefresh = 0;
+    pcaStatsStart = 0;
+    pcaTransactions = 0;
+    pcaAccesses = 0;
     adcMuxSelect = 0;
+    adcConverting = false;
+    adcSampling = false;
+    adcInterrupts = 0;
+    adcCycles = 0;
+    adcMaxCycles = 0;
+    adcFilterCycles = 0;
+    for (int i = 0; i < NUM_ANALOG; i++)
+    {
+        analogRings[i].count = 0;
+        analogRings[i].lastMicros = 0;
+    }
 
     for (int i = 0; i < NUM_OUTPUT; i++)
     {
@@ -73,7 +105,7 @@ void SystemIO::setSystemType(SystemType systemType) {
         sysConfig->systemType = systemType;
         Device *sysDev;
         sysDev = deviceManager.getDeviceByID(SYSTEM);
-        sysDev->saveConfiguration();
+        sysDev->commitConfiguration();
     }
 }
 
@@ -123,6 +155,132 @@ void SystemIO::setup() {
     adc->adc1->setResolution(12);                                           // set bits of resolution
     adc->adc1->setConversionSpeed(ADC_CONVERSION_SPEED::HIGH_SPEED);       // change the conversion speed
     adc->adc1->setSamplingSpeed(ADC_SAMPLING_SPEED::HIGH_SPEED );           // change the sampling speed
+
+    setupAnalogFilters();
+    startADCSampler();
+}
+
+//Takes the per input filter settings from the system config. Starts the filters over, the next sample primes them
+void SystemIO::setupAnalogFilters()
+{
+    noInterrupts();
+    for (int i = 0; i < NUM_ANALOG; i++)
+    {
+        analogFilters[i].configure(sysConfig->adcMedian[i], sysConfig->adcAverage[i], sysConfig->adcIIRShift[i]);
+    }
+    interrupts();
+}
+
+/*
+The analog inputs are read in the background. Both ADCs hang off the same mux, ADC0 gets inputs 0-3 and
+ADC1 gets 4-7, so each mux position gives two inputs at once. Every sampler interrupt does one of two things:
+start a conversion on both ADCs, or pick up the finished results and move the mux on. The mux then has a
+whole interval to settle before the next conversion starts, nothing ever waits on the mux or the ADC.
+*/
+void SystemIO::startADCSampler()
+{
+    setAnalogMux(0);
+    adcConverting = false;
+    for (int i = 0; i < NUM_ANALOG; i++)
+    {
+        analogRings[i].count = 0;
+        analogFilters[i].reset();
+    }
+    adcInterrupts = 0;
+    adcCycles = 0;
+    adcFilterCycles = 0;
+    adcStartMicros = micros();
+    adcSampling = true;
+    adcTimer.begin(adcTimerInt, (uint32_t)CFG_ADC_SAMPLE_INTERVAL);
+    //don't hand out zeros before every input has been read once. That's one trip around the mux, well under a ms
+    uint32_t start = millis();
+    while (analogRings[NUM_ANALOG - 1].count == 0 && (millis() - start) < 5) {}
+}
+
+//Stops the sampler with no conversion left running so the ADCs can be used directly
+void SystemIO::stopADCSampler()
+{
+    adcTimer.stop();
+    adcSampling = false;
+    if (adcConverting)
+    {
+        while (!adc->adc0->isComplete() || !adc->adc1->isComplete()) {}
+        adc->adc0->readSingle();
+        adc->adc1->readSingle();
+        adcConverting = false;
+    }
+}
+
+void SystemIO::handleADCInterrupt()
+{
+    uint32_t startCycles = ARM_DWT_CYCCNT;
+    if (!adcConverting)
+    {
+        adc->adc0->startSingleRead(0);
+        adc->adc1->startSingleRead(1);
+        adcConverting = true;
+    }
+    else if (adc->adc0->isComplete() && adc->adc1->isComplete()) //always should be by now but don't read a half done one
+    {
+        uint32_t now = micros();
+        int16_t valu[2] = {(int16_t)adc->adc0->readSingle(), (int16_t)adc->adc1->readSingle()};
+        for (int i = 0; i < 2; i++)
+        {
+            int which = adcMuxSelect + i * 4;
+            AnalogRing &r = analogRings[which];
+            r.ring[r.count % CFG_ADC_RING_SIZE] = valu[i];
+            uint32_t filterStart = ARM_DWT_CYCCNT;
+            r.filtered = analogFilters[which].process(valu[i]);
+            adcFilterCycles += ARM_DWT_CYCCNT - filterStart;
+            r.lastMicros = now;
+            r.count = r.count + 1;
+        }
+        adcConverting = false;
+        setAnalogMux((adcMuxSelect + 1) & 3);
+    }
+    adcInterrupts++;
+    uint32_t cycles = ARM_DWT_CYCCNT - startCycles;
+    adcCycles += cycles;
+    if (cycles > adcMaxCycles) adcMaxCycles = cycles;
+}
+
+/*
+Shows what the background sampler costs and how often each input gets read. Then stops it for a moment to time
+the blocking reads that used to happen on every getAnalogIn against the ring reads that happen now.
+*/
+void SystemIO::printADCStats()
+{
+    uint32_t elapsed = micros() - adcStartMicros;
+    if (adcSampling && adcInterrupts && elapsed)
+    {
+        uint32_t cyclesPerUs = F_CPU_ACTUAL / 1000000;
+        Logger::console("Analog sampler: %lu interrupts, %lu cycles on average, %lu at most. %lu.%02lu%% of the CPU",
+                        adcInterrupts, (uint32_t)(adcCycles / adcInterrupts), adcMaxCycles,
+                        (uint32_t)(adcCycles / cyclesPerUs * 100 / elapsed), (uint32_t)(adcCycles / cyclesPerUs * 10000 / elapsed) % 100);
+        uint32_t totalSamples = 0;
+        for (int i = 0; i < NUM_ANALOG; i++) totalSamples += analogRings[i].count;
+        if (totalSamples) Logger::console("Filtering takes %lu cycles per sample on average", (uint32_t)(adcFilterCycles / totalSamples));
+        for (int i = 0; i < NUM_ANALOG; i++)
+        {
+            Logger::console("ADC%i: %lu samples/s, newest %lu us old", i,
+                            (uint32_t)((uint64_t)analogRings[i].count * 1000000ull / elapsed), micros() - analogRings[i].lastMicros);
+        }
+    }
+
+    uint32_t start = ARM_DWT_CYCCNT;
+    volatile int16_t sink;
+    for (int i = 0; i < NUM_ANALOG; i++) sink = getAnalogIn(i);
+    uint32_t ringCycles = ARM_DWT_CYCCNT - start;
+
+    bool wasSampling = adcSampling;
+    if (wasSampling) stopADCSampler();
+    start = ARM_DWT_CYCCNT;
+    for (int i = 0; i < NUM_ANALOG; i++) sink = _pGetAnalogRaw(i);
+    uint32_t blockingCycles = ARM_DWT_CYCCNT - start;
+    (void)sink;
+    if (wasSampling) startADCSampler();
+
+    Logger::console("Reading all %i inputs: %lu cycles from the sampler, %lu cycles with blocking reads", NUM_ANALOG, ringCycles, blockingCycles);
 }
 
 void SystemIO::installExtendedIO(ExtIODevice *device)
@@ -261,6 +419,23 @@ int SystemIO::numAnalogOutputs()
     return numAnaOut;
 }
 
+void SystemIO::setAnalogMux(int mux)
+{
+    if (sysConfig->systemType != GEVCU7B)
+    {
+        digitalWrite(2, (mux & 2) ? HIGH : LOW);
+    }
+    else 
+    {
+        digitalWrite(6, (mux & 2) ? HIGH : LOW);
+    }
+
+    digitalWrite(3, (mux & 1) ? HIGH : LOW);
+    //Logger::debug("ADC for %u mux1 %u mux2 %u", which, (mux & 1), (mux & 2));
+    adcMuxSelect = mux;
+}
+
+//Blocking read straight from the ADC. Only for when the background sampler isn't running
 int16_t SystemIO::_pGetAnalogRaw(uint8_t which)
 {
     int32_t valu;
@@ -273,18 +448,7 @@ int16_t SystemIO::_pGetAnalogRaw(uint8_t which)
     int neededMux = which % 4;
     if (neededMux != adcMuxSelect) //must change mux to read this
     {
-        if (sysConfig->systemType != GEVCU7B)
-        {
-            digitalWrite(2, (neededMux & 2) ? HIGH : LOW);
-        }
-        else 
-        {
-            digitalWrite(6, (neededMux & 2) ? HIGH : LOW);
-        }
-
-        digitalWrite(3, (neededMux & 1) ? HIGH : LOW);
-        //Logger::debug("ADC for %u mux1 %u mux2 %u", which, (neededMux & 1), (neededMux & 2));
-        adcMuxSelect = neededMux;
+        setAnalogMux(neededMux);
         //the analog multiplexor input switch pins are on direct outputs from the teensy
         //and so will change very rapidly. The multiplexor also switches inputs in less than
         //1 microsecond. The inputs are all buffered with 1uF caps and so perhaps the slowest
@@ -314,10 +478,31 @@ int16_t SystemIO::_pGetAnalogRaw(uint8_t which)
 }
 
 
+//Newest sample the background sampler took of this input
+int16_t SystemIO::_pGetAnalogLatest(uint8_t which, uint32_t *timestamp)
+{
+    if (!adcSampling) 
+    {
+        if (timestamp) *timestamp = micros();
+        return _pGetAnalogRaw(which);
+    }
+    AnalogRing &r = analogRings[which];
+    uint32_t count = r.count;
+    if (timestamp) *timestamp = r.lastMicros;
+    if (!count) return 0;
+    return r.ring[(count - 1) % CFG_ADC_RING_SIZE];
+}
+
 /*
 get value of one of the analog inputs
 */
 int16_t SystemIO::getAnalogIn(uint8_t which) {
+    return getAnalogIn(which, nullptr);
+}
+
+//Same but also says when the value was sampled, in micros(). Doesn't wait on the ADC, the local inputs come
+//from what the background sampler read last.
+int16_t SystemIO::getAnalogIn(uint8_t which, uint32_t *timestamp) {
     int valu;
 
     if (which > numAnaIn)
@@ -327,7 +512,12 @@ int16_t SystemIO::getAnalogIn(uint8_t which) {
         
     if (which < NUM_ANALOG)
     {
-        valu = _pGetAnalogRaw(which);
+        if (adcSampling && analogRings[which].count) //filtered, once there is something to filter
+        {
+            valu = analogRings[which].filtered;
+            if (timestamp) *timestamp = analogRings[which].lastMicros;
+        }
+        else valu = _pGetAnalogLatest(which, timestamp);
         valu -= sysConfig->adcOffset[which];
         valu = (valu * sysConfig->adcGain[which]) / 1024;
         return valu;
@@ -336,6 +526,7 @@ int16_t SystemIO::getAnalogIn(uint8_t which) {
     {        
         //handle an extended I/O call
         ExtIODevice *dev = extendedAnalogIn[which - NUM_ANALOG].device;
+        if (timestamp) *timestamp = micros();
         if (dev) return dev->getAnalogInput(extendedAnalogIn[which - NUM_ANALOG].localOffset);
         return 0;
     }
@@ -484,6 +675,7 @@ void SystemIO::handleTick()
     lastMicros = now;
     uint8_t outputMask;
     uint8_t tempCache = pcaDigitalOutputCache;
+    uint32_t nowMs = millis();
 
     for (int i = 0; i < NUM_OUTPUT; i++)
     {
@@ -507,16 +699,65 @@ void SystemIO::handleTick()
         if (digPWMOutput[i].progress > digPWMOutput[i].freqInterval) digPWMOutput[i].progress -= digPWMOutput[i].freqInterval;
     }
 
-    //only update the chip if we actually changed anything
-    if (pcaDigitalOutputCache != tempCache)
+    if (pcaDigitalOutputCache != tempCache) pcaAccesses++;
+
+    //everything set since the last tick, PWM or not, goes out as one write. And only if it differs
+    flushDigitalOutputs();
+
+    //the line stays low until the inputs are read so a missed edge still gets picked up
+    if (pcaInputsChanged || !digitalRead(PCA_INT_PIN) || (nowMs - pcaLastRefresh) >= CFG_PCA_REFRESH_INTERVAL)
+        refreshDigitalInputs();
+}
+
+//DIG_INT went low, an input changed. No I2C in here, just have the next tick read the inputs
+void SystemIO::handlePCAInterrupt()
+{
+    pcaInputsChanged = true;
+}
+
+//Both ports in one go, the register pointer then a repeated start and two bytes. The chip steps from
+//input port 0 to input port 1 on its own. Reading also lets go of DIG_INT
+void SystemIO::refreshDigitalInputs()
+{
+    pcaInputsChanged = false; //cleared first so a change during the read still causes another one
+    pcaLastRefresh = millis();
+    pcaTransactions++;
+    Wire.beginTransmission(PCA_ADDR);
+    Wire.write(PCA_READ_IN0);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(PCA_ADDR, 2);
+    if (Wire.available() >= 2)
     {
-        Wire.beginTransmission(PCA_ADDR);
-        Wire.write(PCA_WRITE_OUT0);
-        Wire.write(pcaDigitalOutputCache);
-        Wire.endTransmission();
+        pcaOutputPins = Wire.read();
+        pcaInputCache = Wire.read();
     }
 }
 
+void SystemIO::flushDigitalOutputs()
+{
+    if (pcaDigitalOutputCache == pcaOutputsWritten) return;
+    pcaOutputsWritten = pcaDigitalOutputCache;
+    pcaTransactions++;
+    Wire.beginTransmission(PCA_ADDR);
+    Wire.write(PCA_WRITE_OUT0);
+    Wire.write(pcaOutputsWritten);
+    Wire.endTransmission();
+}
+
+//accesses are what the old read/write per call code would have cost in transactions
+void SystemIO::printDigitalStats()
+{
+    uint32_t elapsed = millis() - pcaStatsStart;
+    if (elapsed == 0) elapsed = 1;
+    Logger::console("Digital IO: inputs %02X, outputs %02X wanted, %02X on the pins", pcaInputCache, pcaDigitalOutputCache, pcaOutputPins);
+    Logger::console("PCA9535: %lu accesses/s would have been transactions, %lu transactions/s done",
+                    (uint32_t)(pcaAccesses * 1000ull / elapsed), (uint32_t)(pcaTransactions * 1000ull / elapsed));
+    pcaAccesses = 0;
+    pcaTransactions = 0;
+    pcaStatsStart = millis();
+}
+
 /*
  * adc is the adc port to calibrate, update if true will write the new value to EEPROM automatically
  */
@@ -528,7 +769,7 @@ bool SystemIO::calibrateADCOffset(int adc, bool update)
     
     for (int j = 0; j < 500; j++)
     {
-        accum += _pGetAnalogRaw(adc);
+        accum += _pGetAnalogLatest(adc, nullptr);
         //normally one shouldn't call watchdog reset in multiple
         //places but this is a special case.
         //watchdogReset();
@@ -551,7 +792,7 @@ bool SystemIO::calibrateADCGain(int adc, int32_t target, bool update)
     
     for (int j = 0; j < 500; j++)
     {
-        accum += _pGetAnalogRaw(adc);
+        accum += _pGetAnalogLatest(adc, nullptr);
 
         //normally one shouldn't call watchdog reset in multiple
         //places but this is a special case.
@@ -596,6 +837,7 @@ void SystemIO::initDigitalMultiplexor()
     Wire.write(PCA_WRITE_OUT0);
     Wire.write(0); //all outputs should start out OFF!
     Wire.endTransmission();
+    pcaOutputsWritten = 0; //anything set before now goes out on the first tick
 
     Wire.beginTransmission(PCA_ADDR);  // setup to write to PCA chip
     Wire.write(PCA_CFG_0);
@@ -611,24 +853,20 @@ void SystemIO::initDigitalMultiplexor()
     Wire.write(PCA_POLARITY_1);
     Wire.write(0xFF); //all inputs are active low so invert all those
     Wire.endTransmission();
-    
+
+    pinMode(PCA_INT_PIN, INPUT_PULLUP); //open drain on the chip
+    attachInterrupt(digitalPinToInterrupt(PCA_INT_PIN), pcaInterrupt, FALLING);
+    refreshDigitalInputs();
+    pcaAccesses = 0;
+    pcaTransactions = 0;
+    pcaStatsStart = millis();
 }
 
 int SystemIO::_pGetDigitalInput(int pin) //all inputs are on port 1
 {
     if ( (pin < 0) || (pin > 7) ) return 0;
-    Wire.beginTransmission(PCA_ADDR);
-    Wire.write(PCA_READ_IN1);
-    Wire.endTransmission();
-
-    Wire.requestFrom(PCA_ADDR, 1); //get one byte
-    if (Wire.available())
-    {
-        uint8_t c = Wire.read();
-        c = (c >> pin) & 1;
-        return c;
-    }
-    return 0; //fallback in case something messes up
+    pcaAccesses++;
+    return (pcaInputCache >> pin) & 1; //from the last refresh, at most CFG_PCA_REFRESH_INTERVAL old
 }
 
 void SystemIO::_pSetDigitalOutput(int pin, int state)
@@ -638,28 +876,16 @@ void SystemIO::_pSetDigitalOutput(int pin, int state)
     uint8_t outputMask = ~(1<<pin);
     pcaDigitalOutputCache &= outputMask;
     if (state != 0) pcaDigitalOutputCache |= (1<<pin);
-
-    Wire.beginTransmission(PCA_ADDR);
-    Wire.write(PCA_WRITE_OUT0);
-    Wire.write(pcaDigitalOutputCache);
-    Wire.endTransmission();
+    pcaAccesses++;
+    //written out on the next tick together with whatever else changed by then
 }
 
 int SystemIO::_pGetDigitalOutput(int pin)
 {
     if ( (pin < 0) || (pin > 7) ) return 0;
-    Wire.beginTransmission(PCA_ADDR);
-    Wire.write(PCA_READ_IN0);
-    Wire.endTransmission();
-
-    Wire.requestFrom(PCA_ADDR, 1); //get one byte
-    if (Wire.available())
-    {
-        uint8_t c = Wire.read();
-        c = (c >> pin) & 1;
-        return c;
-    }
-    return 0; //fallback in case something messes up
+    pcaAccesses++;
+    //what was asked for, even if it hasn't gone out yet. The pins themselves are in pcaOutputPins
+    return (pcaDigitalOutputCache >> pin) & 1;
 }
 
 SystemIO systemIO;
@@ -38,6 +38,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Logger.h"
 #include <ADC.h> //better ADC library compared to the built-in ADC functions
 #include "TickHandler.h"
+#include "AnalogFilter.h"
 
 class ExtIODevice;
 
@@ -68,6 +69,17 @@ public:
 #define PCA_CFG_1       7
 #define PCA_WRITE       0
 #define PCA_READ        1
+#define PCA_INT_PIN     4 //DIG_INT, the expander pulls it low when an input changes
+
+//Recent samples of one analog input. Filled from the sampler interrupt, count only ever goes up so the
+//newest sample is always ring[(count - 1) % CFG_ADC_RING_SIZE]
+struct AnalogRing
+{
+    volatile int16_t ring[CFG_ADC_RING_SIZE];
+    volatile int16_t filtered; //newest output of this input's AnalogFilter
+    volatile uint32_t count;
+    volatile uint32_t lastMicros; //when the newest sample was taken
+};
 
 struct PWM_SPECS
 {
@@ -86,6 +98,7 @@ public:
     void setup_ADC_params();
 
     int16_t getAnalogIn(uint8_t which); //get value of one of the 4 analog inputs
+    int16_t getAnalogIn(uint8_t which, uint32_t *timestamp);
     boolean setAnalogOut(uint8_t which, int32_t level);
     int32_t getAnalogOut(uint8_t which);
     boolean getDigitalIn(uint8_t which); //get value of one of the 4 digital inputs
@@ -111,6 +124,11 @@ public:
     SystemType getSystemType();
     bool calibrateADCOffset(int, bool);
     bool calibrateADCGain(int, int32_t, bool);
+    void handleADCInterrupt(); // must be public when from the non-class functions
+    void printADCStats();
+    void handlePCAInterrupt();
+    void printDigitalStats();
+    void setupAnalogFilters();
 
 private:
     void initDigitalMultiplexor();
@@ -118,14 +136,37 @@ private:
     void _pSetDigitalOutput(int pin, int state);
     int _pGetDigitalOutput(int pin);
     int16_t _pGetAnalogRaw(uint8_t which);
+    int16_t _pGetAnalogLatest(uint8_t which, uint32_t *timestamp);
+    void setAnalogMux(int mux);
+    void startADCSampler();
+    void stopADCSampler();
+    void refreshDigitalInputs();
+    void flushDigitalOutputs();
 
     ADC *adc;
 
     SystemType sysType;
 
-    int adcMuxSelect;
-
-    uint8_t pcaDigitalOutputCache;
+    volatile int adcMuxSelect;
+    volatile bool adcConverting; //both ADCs were started on the last sampler interrupt
+    bool adcSampling;
+    AnalogRing analogRings[NUM_ANALOG];
+    AnalogFilter analogFilters[NUM_ANALOG];
+    uint64_t adcFilterCycles; //cycles spent filtering, one count per sample
+    uint32_t adcStartMicros;
+    uint32_t adcInterrupts;
+    uint64_t adcCycles; //total and worst cycles spent in the sampler interrupt
+    uint32_t adcMaxCycles;
+
+    uint8_t pcaDigitalOutputCache; //what the outputs should be
+    uint8_t pcaOutputsWritten; //what was last sent to the chip
+    uint8_t pcaOutputPins; //port 0 as read back on the last refresh
+    uint8_t pcaInputCache; //port 1 as of the last refresh
+    volatile bool pcaInputsChanged;
+    uint32_t pcaLastRefresh;
+    uint32_t pcaStatsStart;
+    uint32_t pcaTransactions; //I2C transactions actually done
+    uint32_t pcaAccesses; //reads and writes asked for, each used to be a transaction of its own
     
     int numDigIn;
     int numDigOut;
@@ -0,0 +1,6 @@
+#pragma once
+#include <Arduino.h>
+enum class ADC_CONVERSION_SPEED { VERY_LOW_SPEED, LOW_SPEED, MED_SPEED, HIGH_SPEED, VERY_HIGH_SPEED };
+enum class ADC_SAMPLING_SPEED { VERY_LOW_SPEED, LOW_SPEED, MED_SPEED, HIGH_SPEED, VERY_HIGH_SPEED };
+class ADC_Module { public: void setAveraging(uint8_t); void setResolution(uint8_t); void setConversionSpeed(ADC_CONVERSION_SPEED); void setSamplingSpeed(ADC_SAMPLING_SPEED); int analogRead(uint8_t); bool startSingleRead(uint8_t); bool isComplete(); int readSingle(); void enableInterrupts(void(*)(), uint8_t=255); void disableInterrupts(); bool startContinuous(uint8_t); int analogReadContinuous(); void stopContinuous(); };
+class ADC { public: ADC_Module *adc0; ADC_Module *adc1; };
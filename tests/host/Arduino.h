@@ -0,0 +1,231 @@
+/*
+ * Arduino.h - just enough of the Teensy core to build parts of the firmware on a PC for the tests.
+ * Things that are only declared here are never called by the code under test. If a test starts
+ * needing one it gets a definition in host.cpp.
+ *
+ * Time is simulated. Every call to micros() moves the clock on by one microsecond so anything
+ * that polls the clock (EEPROM write cycles and the like) finishes without really waiting, and
+ * tests can jump ahead with hostAdvanceMicros().
+ */
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <string>
+#include <algorithm>
+
+typedef bool boolean;
+typedef uint8_t byte;
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define HEX 16
+#define DEC 10
+#define A0 14
+#define A1 15
+#define RISING 3
+#define FALLING 2
+#define CHANGE 4
+using std::min;
+using std::max;
+
+class Print {
+public:
+    size_t print(const char *);
+    size_t print(int);
+    size_t print(unsigned);
+    size_t print(long);
+    size_t print(unsigned long);
+    size_t print(double);
+    size_t print(char);
+    size_t println(const char * = "");
+    size_t println(int);
+    size_t println(unsigned);
+    size_t println(long);
+    size_t println(unsigned long);
+    size_t println(double);
+    size_t print(const class String &);
+    size_t println(const class String &);
+    virtual size_t write(uint8_t) { return 1; }
+    virtual size_t write(const uint8_t *, size_t len) { return len; }
+    int printf(const char *, ...);
+    virtual ~Print() {}
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    void begin(uint32_t) {}
+    size_t readBytes(char *, size_t) { return 0; }
+    operator bool() { return true; }
+};
+
+//Arduino's String on top of std::string, enough of it for what the firmware uses
+class String {
+public:
+    String() {}
+    String(const char *str) : s(str ? str : "") {}
+    String(const String &other) : s(other.s) {}
+    String(const std::string &str) : s(str) {}
+    String(int val, int base = 10) : s(number((long)val, base)) {}
+    String(unsigned val, int base = 10) : s(number((unsigned long)val, base)) {}
+    String(long val, int base = 10) : s(number(val, base)) {}
+    String(unsigned long val, int base = 10) : s(number(val, base)) {}
+    String(float val, int places = 2) : s(decimal(val, places)) {}
+    String(double val, int places = 2) : s(decimal(val, places)) {}
+    String(char c) : s(1, c) {}
+    String(unsigned char val, int base = 10) : s(number((unsigned long)val, base)) {}
+    String &operator=(const String &other) { s = other.s; return *this; }
+    String &operator=(const char *str) { s = str ? str : ""; return *this; }
+    String &operator+=(const String &other) { s += other.s; return *this; }
+    String &operator+=(const char *str) { s += str; return *this; }
+    String &operator+=(char c) { s += c; return *this; }
+    String &operator+=(int val) { s += number((long)val, 10); return *this; }
+    String &operator+=(unsigned val) { s += number((unsigned long)val, 10); return *this; }
+    const char *c_str() const { return s.c_str(); }
+    unsigned length() const { return s.length(); }
+    bool operator==(const String &other) const { return s == other.s; }
+    bool operator==(const char *str) const { return s == str; }
+    bool operator!=(const String &other) const { return s != other.s; }
+    void concat(const String &other) { s += other.s; }
+    void toUpperCase() { for (auto &c : s) c = toupper(c); }
+    void toLowerCase() { for (auto &c : s) c = tolower(c); }
+    char operator[](unsigned i) const { return i < s.length() ? s[i] : 0; }
+    int toInt() const { return atoi(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    String substring(unsigned from, unsigned to = 0) const
+    {
+        if (to == 0 || to > s.length()) to = s.length();
+        return from < to ? String(s.substr(from, to - from)) : String();
+    }
+    int indexOf(char c) const { size_t i = s.find(c); return i == std::string::npos ? -1 : (int)i; }
+    void reserve(unsigned n) { s.reserve(n); }
+    void trim()
+    {
+        size_t a = s.find_first_not_of(" \t\r\n");
+        size_t b = s.find_last_not_of(" \t\r\n");
+        s = (a == std::string::npos) ? "" : s.substr(a, b - a + 1);
+    }
+    bool startsWith(const String &other) const { return s.compare(0, other.s.length(), other.s) == 0; }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(s.c_str(), other.s.c_str()) == 0; }
+
+private:
+    std::string s;
+    static std::string number(unsigned long val, int base)
+    {
+        char buf[40];
+        snprintf(buf, sizeof(buf), base == 16 ? "%lX" : "%lu", val);
+        return buf;
+    }
+    static std::string number(long val, int base)
+    {
+        if (base != 10) return number((unsigned long)val, base);
+        return std::to_string(val);
+    }
+    static std::string decimal(double val, int places)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", places, val);
+        return buf;
+    }
+};
+inline String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+inline String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+
+//Everything printed to Serial is kept in hostSerialOutput so tests can look at what the firmware said
+extern std::string hostSerialOutput;
+class HostSerial : public Stream {
+public:
+    size_t write(uint8_t b) { hostSerialOutput += (char)b; return 1; }
+    size_t write(const uint8_t *buf, size_t len) { hostSerialOutput.append((const char *)buf, len); return len; }
+};
+extern HostSerial Serial;
+extern Stream SerialUSB, SerialUSB1, Serial1, Serial2, Serial3;
+
+uint32_t millis();
+uint32_t micros();
+void hostAdvanceMicros(uint32_t us);
+inline void delay(uint32_t ms) { hostAdvanceMicros(ms * 1000); }
+inline void delayMicroseconds(uint32_t us) { hostAdvanceMicros(us); }
+inline void yield() {}
+
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+int analogRead(uint8_t);
+void analogReadRes(int);
+void analogWrite(uint8_t, int);
+void attachInterrupt(uint8_t, void (*)(), int);
+void detachInterrupt(uint8_t);
+int digitalPinToInterrupt(int);
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+//cycle counter, counts up by one per read like the clock does
+extern volatile uint32_t hostCycleCounter;
+#define ARM_DWT_CYCCNT (hostCycleCounter++)
+#define F_CPU_ACTUAL 600000000
+extern uint32_t F_CPU;
+
+class elapsedMillis {
+public:
+    elapsedMillis() { start = millis(); }
+    operator uint32_t() const { return millis() - start; }
+    elapsedMillis &operator=(uint32_t val) { start = millis() - val; return *this; }
+private:
+    uint32_t start;
+};
+class elapsedMicros {
+public:
+    elapsedMicros() { start = micros(); }
+    operator uint32_t() const { return micros() - start; }
+    elapsedMicros &operator=(uint32_t val) { start = micros() - val; return *this; }
+private:
+    uint32_t start;
+};
+
+#define PROGMEM
+#define F(x) x
+#define FLASHMEM
+#define DMAMEM
+#define EXTMEM
+#define FASTRUN
+
+class IntervalTimer {
+public:
+    bool begin(void (*)(), uint32_t);
+    void end();
+    void priority(uint8_t);
+};
+
+class CrashReportClass : public Print {
+public:
+    operator bool();
+    void breadcrumb(unsigned, unsigned);
+    void clear();
+};
+extern CrashReportClass CrashReport;
+
+#ifndef constrain
+#define constrain(a, l, h) ((a) < (l) ? (l) : ((a) > (h) ? (h) : (a)))
+#endif
+long map(long, long, long, long, long);
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+#include <Arduino.h>
+//Declarations only as far as the firmware uses them. Documents stay empty on the host
+class JsonObject; class JsonString { public: const char* c_str() const { return ""; } };
+class JsonVariant { public: template<class T> JsonVariant& operator=(const T&) { return *this; } template<class T> T as() const { return T(); } JsonVariant operator[](const char*) const { return JsonVariant(); } template<class T> operator T() const { return T(); } bool isNull() const { return true; } };
+class JsonPair { public: JsonString key() const { return JsonString(); } JsonVariant value() const { return JsonVariant(); } };
+class JsonObject { public: JsonVariant operator[](const char*) { return JsonVariant(); } JsonObject createNestedObject(const char*) { return JsonObject(); } JsonPair* begin() { return nullptr; } JsonPair* end() { return nullptr; } };
+class DynamicJsonDocument { public: DynamicJsonDocument(size_t) {} JsonVariant operator[](const char*) { return JsonVariant(); } JsonObject createNestedObject(const char*) { return JsonObject(); } template<class T> T as() { return T(); } void clear() {} };
+typedef DynamicJsonDocument JsonDocument;
+template<class S> int deserializeJson(DynamicJsonDocument&, S&);
+int deserializeJson(DynamicJsonDocument&, const char*);
+template<class S> size_t serializeJsonPretty(const DynamicJsonDocument&, S&);
+template<class S> size_t serializeJson(const DynamicJsonDocument&, S&);
+size_t serializeJson(const DynamicJsonDocument&, char*, size_t);
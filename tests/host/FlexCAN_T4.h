@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+struct CAN_message_t { uint32_t id=0; uint16_t timestamp=0; uint8_t idhit=0; struct { bool extended=0; bool remote=0; bool overrun=0; bool reserved=0; } flags; uint8_t len=8; uint8_t buf[8]={0}; int8_t mb=0; uint8_t bus=0; bool seq=0; };
+struct CANFD_message_t { uint32_t id=0; uint16_t timestamp=0; uint8_t idhit=0; bool brs=1; bool esi=0; bool edl=1; struct { bool extended=0; bool overrun=0; bool reserved=0; } flags; uint8_t len=8; uint8_t buf[64]={0}; int8_t mb=0; uint8_t bus=0; bool seq=0; };
+struct CANFD_timings_t { double baudrate; double baudrateFD; double propdelay; double bus_length; double sample; };
+enum CAN_DEV_TABLE { CAN1, CAN2, CAN3 };
+enum FLEXCAN_RXQUEUE_TABLE { RX_SIZE_2=2, RX_SIZE_256=256 }; enum FLEXCAN_TXQUEUE_TABLE { TX_SIZE_2=2, TX_SIZE_16=16 };
+enum FLEXCAN_MAILBOX { MB0, MB1 }; enum FLEXCAN_IDE { STD, EXT, RTR, NONE };
+enum FLEXCAN_FDRATES { CLK_24MHz, CLK_40MHz }; enum FLEXCAN_CLOCK { CLK_60MHz };
+
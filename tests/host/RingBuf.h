@@ -0,0 +1,57 @@
+/*
+ * RingBuf.h - the SdFat ring buffer, a real one so that what goes into it comes out the other end in the file
+ */
+
+#ifndef HOST_RINGBUF_H_
+#define HOST_RINGBUF_H_
+
+#include <Arduino.h>
+
+template <class F, size_t N>
+class RingBuf : public Print {
+public:
+    RingBuf() : file(nullptr), head(0), tail(0), count(0), writeError(false) {}
+    void begin(F *f) { file = f; head = tail = count = 0; writeError = false; }
+    size_t bytesUsed() { return count; }
+    size_t bytesFree() { return N - count; }
+    size_t write(uint8_t b) { return write(&b, 1); }
+    size_t write(const void *buf, size_t len) { return write((const uint8_t *)buf, len); }
+    size_t write(const uint8_t *buf, size_t len)
+    {
+        if (len > bytesFree())
+        {
+            writeError = true;
+            return 0;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            data[head] = buf[i];
+            head = (head + 1) % N;
+        }
+        count += len;
+        return len;
+    }
+    size_t memcpyIn(const void *buf, size_t len) { return write((const uint8_t *)buf, len); }
+    size_t writeOut(size_t len)
+    {
+        len = std::min(len, count);
+        for (size_t i = 0; i < len; i++)
+        {
+            file->write(&data[tail], 1);
+            tail = (tail + 1) % N;
+        }
+        count -= len;
+        return len;
+    }
+    size_t sync() { return writeOut(count); }
+    bool getWriteError() { return writeError; }
+    void clearWriteError() { writeError = false; }
+
+private:
+    F *file;
+    uint8_t data[N];
+    size_t head, tail, count;
+    bool writeError;
+};
+
+#endif
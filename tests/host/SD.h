@@ -0,0 +1,12 @@
+#ifndef HOST_SD_H_
+#define HOST_SD_H_
+
+#include "SdFat.h"
+
+class SDClass {
+public:
+    SdFs sdfs;
+};
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * SdFat.h - an in memory stand in for the sdcard. Files live in a map for as long as the test program
+ * runs so a test can write a log or a recording through the firmware and read it back afterwards.
+ */
+
+#ifndef HOST_SDFAT_H_
+#define HOST_SDFAT_H_
+
+#include <Arduino.h>
+#include <map>
+
+#define O_RDONLY 0
+#define O_READ 0
+#define O_WRONLY 1
+#define O_RDWR 2
+#define O_CREAT 0x40
+#define O_TRUNC 0x200
+#define O_APPEND 0x400
+#define O_WRITE 1
+#define FIFO_SDIO 0
+
+inline std::map<std::string, std::string> &hostFiles()
+{
+    static std::map<std::string, std::string> files;
+    return files;
+}
+
+class SdioConfig {
+public:
+    SdioConfig(int) {}
+};
+
+class FsFile : public Stream {
+public:
+    FsFile() : data(nullptr), pos(0) {}
+    bool open(const char *name, int flags = 0)
+    {
+        std::map<std::string, std::string> &files = hostFiles();
+        if (!files.count(name) && !(flags & O_CREAT)) return false;
+        fileName = name;
+        data = &files[name];
+        if (flags & O_TRUNC) data->clear();
+        pos = (flags & O_APPEND) ? data->size() : 0;
+        return true;
+    }
+    bool close() { data = nullptr; return true; }
+    bool isOpen() { return data != nullptr; }
+    operator bool() { return data != nullptr; }
+    bool isBusy() { return false; }
+    size_t write(uint8_t b) { return write(&b, 1); }
+    size_t write(const uint8_t *buf, size_t len) { return write((const void *)buf, len); }
+    size_t write(const void *buf, size_t len)
+    {
+        if (!data) return 0;
+        if (pos + len > data->size()) data->resize(pos + len);
+        memcpy(&(*data)[pos], buf, len);
+        pos += len;
+        return len;
+    }
+    int read(void *buf, size_t len)
+    {
+        if (!data || pos >= data->size()) return 0;
+        len = std::min(len, (size_t)(data->size() - pos));
+        memcpy(buf, data->data() + pos, len);
+        pos += len;
+        return len;
+    }
+    int read() { uint8_t b; return read(&b, 1) ? b : -1; }
+    int available() { return data ? (int)(data->size() - pos) : 0; }
+    bool preAllocate(uint64_t) { return false; }
+    bool truncate() { if (data) data->resize(pos); return data != nullptr; }
+    bool truncate(uint64_t len) { if (data) data->resize(len); return data != nullptr; }
+    uint64_t size() { return data ? data->size() : 0; }
+    uint64_t fileSize() { return size(); }
+    uint64_t curPosition() { return pos; }
+    bool seek(uint64_t p) { pos = p; return true; }
+    bool seekSet(uint64_t p) { pos = p; return true; }
+    bool sync() { return true; }
+    void flush() {}
+    bool getName(char *name, size_t len) { snprintf(name, len, "%s", fileName.c_str()); return true; }
+    bool rename(const char *name)
+    {
+        std::map<std::string, std::string> &files = hostFiles();
+        files[name] = *data;
+        files.erase(fileName);
+        fileName = name;
+        data = &files[name];
+        return true;
+    }
+    bool remove() { hostFiles().erase(fileName); data = nullptr; return true; }
+
+private:
+    std::string fileName;
+    std::string *data;
+    size_t pos;
+};
+
+class SdFs {
+public:
+    bool begin(SdioConfig) { return true; }
+    FsFile open(const char *name, int flags = 0) { FsFile f; f.open(name, flags); return f; }
+    bool remove(const char *name) { return hostFiles().erase(name) > 0; }
+    bool exists(const char *name) { return hostFiles().count(name) > 0; }
+    bool rename(const char *from, const char *to)
+    {
+        if (!exists(from)) return false;
+        hostFiles()[to] = hostFiles()[from];
+        hostFiles().erase(from);
+        return true;
+    }
+    bool mkdir(const char *) { return true; }
+};
+
+#endif
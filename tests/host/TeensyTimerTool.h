@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+namespace TeensyTimerTool {
+enum TimerGenerator { GPT1, GPT2, TMR1, TMR2, TMR3, TMR4, PIT, TCK, TCK64, TCK_RTC };
+typedef std::function<void()> callback_t;
+enum errorCode { OK };
+class PeriodicTimer { public: PeriodicTimer(TimerGenerator = PIT) {} errorCode begin(callback_t, uint32_t, bool = true) { return OK; } errorCode start() { return OK; } errorCode stop() { return OK; } float getMaxPeriod() const { return 1e6f; } errorCode setPeriod(uint32_t) { return OK; } errorCode setNextPeriod(uint32_t) { return OK; } };
+class OneShotTimer { public: OneShotTimer(TimerGenerator = PIT) {} errorCode begin(callback_t) { return OK; } errorCode trigger(uint32_t) { return OK; } };
+}
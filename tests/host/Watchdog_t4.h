@@ -0,0 +1,5 @@
+#pragma once
+#include <Arduino.h>
+enum WDT_DEV_TABLE { WDT1, WDT2, WDT3 };
+struct WDT_timings_t { uint32_t timeout; uint32_t window; void (*callback)(); };
+template<WDT_DEV_TABLE T> class WDT_T4 { public: void begin(WDT_timings_t) {} void feed() {} void reset() {} };
@@ -0,0 +1,176 @@
+/*
+ * host.cpp - stand ins for the Teensy core, the I2C bus and the parts of the firmware that the code
+ * under test calls but that aren't built for the host (TickHandler, CanHandler). The Logger, Device and
+ * DeviceManager stand ins are in host_log.cpp, host_device.cpp and host_devmgr.cpp so tests can link the
+ * real ones instead.
+ */
+
+#include <Arduino.h>
+#include "i2c_driver_wire.h"
+#include "Logger.h"
+#include "TickHandler.h"
+#include "MemCache.h"
+#include "DeviceManager.h"
+#include "CanHandler.h"
+#include "HeapMonitor.h"
+#include "devices/misc/SystemDevice.h"
+#include <SD.h>
+#include <Watchdog_t4.h>
+#include "test.h"
+#include <malloc.h>
+#include <errno.h>
+
+static uint64_t hostMicros = 0;
+volatile uint32_t hostCycleCounter = 0;
+uint32_t F_CPU = 600000000;
+
+uint32_t micros()
+{
+    return (uint32_t)(++hostMicros);
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(hostMicros / 1000);
+}
+
+void hostAdvanceMicros(uint32_t us)
+{
+    hostMicros += us;
+}
+
+//No chip answers on the host bus, every transaction NAKs
+class HostI2CMaster : public I2CMaster {
+public:
+    void begin(uint32_t) {}
+    void end() {}
+    bool finished() { return true; }
+    size_t get_bytes_transferred() { return 0; }
+    void write_async(uint8_t, uint8_t *, size_t, bool) {}
+    void read_async(uint8_t, uint8_t *, size_t, bool) {}
+};
+
+class HostI2CSlave : public I2CSlave {
+public:
+    void listen(uint8_t) {}
+    void listen(uint8_t, uint8_t) {}
+    void listen_range(uint8_t, uint8_t) {}
+    void after_receive(std::function<void(size_t length, uint16_t address)>) {}
+    void stop_listening() {}
+    void before_transmit(std::function<void(uint16_t address)>) {}
+    void after_transmit(std::function<void(uint16_t address)>) {}
+    void set_transmit_buffer(uint8_t *, size_t) {}
+    void set_receive_buffer(uint8_t *, size_t) {}
+};
+
+I2CDriver::I2CDriver() {}
+static HostI2CMaster hostMaster;
+static HostI2CSlave hostSlave;
+I2CDriverWire::I2CDriverWire(I2CMaster &m, I2CSlave &s) : master(m), slave(s) {}
+void I2CDriverWire::beginTransmission(int) {}
+uint8_t I2CDriverWire::endTransmission(int) { return 2; }
+size_t I2CDriverWire::write(uint8_t) { return 1; }
+size_t I2CDriverWire::write(const uint8_t *, size_t length) { return length; }
+uint8_t I2CDriverWire::requestFrom(int, int, int) { return 0; }
+int I2CDriverWire::read() { return no_more_bytes; }
+int I2CDriverWire::peek() { return no_more_bytes; }
+I2CDriverWire Wire(hostMaster, hostSlave);
+
+WDT_T4<WDT3> wdt;
+MemCache *memCache;
+SDClass SD;
+bool sdCardPresent = false;
+
+std::string hostSerialOutput;
+HostSerial Serial;
+
+size_t Print::print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+size_t Print::print(int n) { return printf("%d", n); }
+size_t Print::print(unsigned n) { return printf("%u", n); }
+size_t Print::print(long n) { return printf("%ld", n); }
+size_t Print::print(unsigned long n) { return printf("%lu", n); }
+size_t Print::print(double n) { return printf("%.2f", n); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(const String &s) { return print(s.c_str()); }
+size_t Print::println(const char *s) { return print(s) + print("\r\n"); }
+size_t Print::println(int n) { return print(n) + println(); }
+size_t Print::println(unsigned n) { return print(n) + println(); }
+size_t Print::println(long n) { return print(n) + println(); }
+size_t Print::println(unsigned long n) { return print(n) + println(); }
+size_t Print::println(double n) { return print(n) + println(); }
+size_t Print::println(const String &s) { return println(s.c_str()); }
+
+int Print::printf(const char *format, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len > (int)sizeof(buf) - 1) len = sizeof(buf) - 1;
+    return write((const uint8_t *)buf, len);
+}
+
+//On the board every heap call goes through the newlib malloc lock. Here the test program takes over malloc
+//and friends itself, counts, and hands the work to glibc's allocator. That catches operator new and anything
+//inside the C library that allocates too.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t align, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static uint32_t hostHeapOps = 0;
+static int64_t hostHeapInUse = 0; //signed, the loader frees a few blocks it got before we were in place
+static int64_t hostHeapHighWater = 0;
+
+static void *hostHeapTrack(void *ptr)
+{
+    hostHeapOps++;
+    if (ptr) hostHeapInUse += malloc_usable_size(ptr);
+    if (hostHeapInUse > hostHeapHighWater) hostHeapHighWater = hostHeapInUse;
+    return ptr;
+}
+
+extern "C" void *malloc(size_t size) { return hostHeapTrack(__libc_malloc(size)); }
+extern "C" void *calloc(size_t count, size_t size) { return hostHeapTrack(__libc_calloc(count, size)); }
+extern "C" void *memalign(size_t align, size_t size) { return hostHeapTrack(__libc_memalign(align, size)); }
+extern "C" void *aligned_alloc(size_t align, size_t size) { return memalign(align, size); }
+extern "C" int posix_memalign(void **ptr, size_t align, size_t size)
+{
+    *ptr = memalign(align, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+extern "C" void free(void *ptr)
+{
+    if (!ptr) return;
+    hostHeapOps++;
+    hostHeapInUse -= malloc_usable_size(ptr);
+    __libc_free(ptr);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (ptr) hostHeapInUse -= malloc_usable_size(ptr);
+    return hostHeapTrack(__libc_realloc(ptr, size));
+}
+
+uint32_t HeapMonitor::getOpCount() { return hostHeapOps; }
+uint32_t HeapMonitor::getInUse() { return hostHeapInUse > 0 ? (uint32_t)hostHeapInUse : 0; }
+uint32_t HeapMonitor::getHighWater() { return (uint32_t)hostHeapHighWater; }
+void HeapMonitor::printStats() {}
+
+//Ticks are driven by the tests calling handleTick themselves
+void TickObserver::handleTick() {}
+TickHandler::TickHandler() {}
+void TickHandler::attach(TickObserver *, uint32_t) {}
+void TickHandler::detach(TickObserver *) {}
+TickHandler tickHandler;
+
+CanHandler::CanHandler(CanBusNode) {}
+void CanHandler::detachAll(CanObserver *) {}
+CanHandler canHandlerBus0(CanHandler::CAN_BUS_0);
+CanHandler canHandlerBus1(CanHandler::CAN_BUS_1);
+CanHandler canHandlerBus2(CanHandler::CAN_BUS_2);
+SystemConfiguration *sysConfig = nullptr;
@@ -0,0 +1,7 @@
+/*
+ * host_device.cpp - the one Device call the Logger makes, for the tests that don't build the real Device.
+ */
+
+#include "devices/Device.h"
+
+const char *Device::getShortName() { return ""; }
@@ -0,0 +1,28 @@
+/*
+ * host_devmgr.cpp - DeviceManager for the tests that don't test the DeviceManager itself.
+ */
+
+#include "DeviceManager.h"
+
+//No devices on the host, and messages go nowhere. Status entries are kept so they can be looked up by name
+DeviceManager::DeviceManager() {}
+void DeviceManager::handleTick() {}
+void DeviceManager::addDevice(Device *) {}
+Device *DeviceManager::getDeviceByID(DeviceId) { return nullptr; }
+void DeviceManager::sendMessage(DeviceType, DeviceId, uint32_t, void *) {}
+bool DeviceManager::postMessage(DeviceType, DeviceId, uint32_t, void *) { return true; }
+const ConfigEntry *DeviceManager::findConfigEntry(Device *, const char *) { return nullptr; }
+void DeviceManager::addStatusEntry(const StatusEntry &entry) { statusEntries.add(entry); }
+bool DeviceManager::findStatusEntry(const char *statusName, StatusEntry *entry)
+{
+    bool found = false;
+    forEachStatusEntry([&](const StatusEntry &e) {
+        if (!found && !strcmp(e.statusName, statusName))
+        {
+            *entry = e;
+            found = true;
+        }
+    });
+    return found;
+}
+DeviceManager deviceManager;
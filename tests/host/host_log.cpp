@@ -0,0 +1,47 @@
+/*
+ * host_log.cpp - Logger for the tests that don't test the Logger itself. Nothing is printed unless
+ * hostLogVerbose is set, errors and warnings are counted so tests can check something was (or wasn't) reported.
+ */
+
+#include <Arduino.h>
+#include "Logger.h"
+#include "test.h"
+
+uint32_t hostLogErrors = 0;
+uint32_t hostLogWarnings = 0;
+bool hostLogVerbose = false;
+
+static void hostLog(const char *level, const char *format, va_list args)
+{
+    if (!hostLogVerbose) return;
+    printf("  [%s] ", level);
+    vprintf(format, args);
+    printf("\n");
+}
+
+#define HOST_LOG_FN(name, label, counter) \
+    void Logger::name(const char *format, ...) { va_list a; va_start(a, format); counter; hostLog(label, format, a); va_end(a); } \
+    void Logger::name(DeviceId, const char *format, ...) { va_list a; va_start(a, format); counter; hostLog(label, format, a); va_end(a); }
+
+HOST_LOG_FN(avalanche, "AVALANCHE", (void)0)
+HOST_LOG_FN(debug, "DEBUG", (void)0)
+HOST_LOG_FN(info, "INFO", (void)0)
+HOST_LOG_FN(warn, "WARN", hostLogWarnings++)
+HOST_LOG_FN(error, "ERROR", hostLogErrors++)
+
+void Logger::console(const char *format, ...)
+{
+    va_list a;
+    va_start(a, format);
+    hostLog("CONSOLE", format, a);
+    va_end(a);
+}
+
+void Logger::closeFile() {}
+uint32_t Logger::getLogIndex() { return 0; }
+void Logger::setDeviceLogLevel(DeviceId, LogLevel) {}
+const int16_t *Logger::systemLevel = nullptr;
+uint8_t Logger::numDeviceLevels = 0;
+int8_t Logger::lowestDeviceLevel = Logger::Off;
+bool Logger::checkDeviceLevel(DeviceId, LogLevel) { return true; }
+
@@ -0,0 +1,23 @@
+/*
+ * test.h - the few helpers the host tests share. A failed CHECK prints where and keeps going so one
+ * run shows everything that's wrong, TEST_RESULT() at the end of main turns that into the exit code.
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+extern uint32_t hostLogErrors;
+extern uint32_t hostLogWarnings;
+extern bool hostLogVerbose;
+
+static int testFailures __attribute__((unused)) = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); testFailures++; } } while (0)
+#define CHECK_EQ(a, b) do { long long _a = (long long)(a), _b = (long long)(b); if (_a != _b) { \
+    printf("FAIL %s:%d: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); testFailures++; } } while (0)
+#define TEST_RESULT() (printf("%s: %s\n", __FILE__, testFailures ? "FAILED" : "ok"), testFailures ? 1 : 0)
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * test_analogfilter.cpp - the analog input filter chain. The median has to match a plain sort for every
+ * window, the average has to be the rounded mean and the IIR has to settle on a step without drifting.
+ * Also times the whole chain per sample since it runs from the sampler interrupt.
+ */
+
+#include "AnalogFilter.h"
+#include "test.h"
+#include <algorithm>
+#include <chrono>
+
+//Runs the given window through a median only filter. After as many samples as the median is long the
+//window holds exactly them, so the output has to be their middle value.
+static int16_t filterMedian(const int16_t *win, uint8_t len)
+{
+    AnalogFilter filter;
+    filter.configure(len, 1, 0);
+    int16_t out = 0;
+    for (int i = 0; i < len; i++) out = filter.process(win[i]);
+    return out;
+}
+
+static int16_t sortedMedian(const int16_t *win, uint8_t len)
+{
+    int16_t sorted[ANALOG_FILTER_MAX_MEDIAN];
+    std::copy(win, win + len, sorted);
+    std::sort(sorted, sorted + len);
+    return sorted[len / 2];
+}
+
+//Every window of five values out of 0..4 covers all the orderings and ties the sorting network can see
+static void testMedian()
+{
+    int16_t win[5];
+    int bad3 = 0, bad5 = 0;
+    for (int n = 0; n < 5 * 5 * 5 * 5 * 5; n++)
+    {
+        int v = n;
+        for (int i = 0; i < 5; i++, v /= 5) win[i] = (int16_t)(v % 5 * 1000 - 2000);
+        if (filterMedian(win, 5) != sortedMedian(win, 5)) bad5++;
+        if (n < 5 * 5 * 5 && filterMedian(win, 3) != sortedMedian(win, 3)) bad3++;
+    }
+    CHECK_EQ(bad3, 0);
+    CHECK_EQ(bad5, 0);
+
+    //a single spike never gets through a median of three
+    AnalogFilter filter;
+    filter.configure(3, 1, 0);
+    bool spiked = false;
+    for (int i = 0; i < 100; i++)
+    {
+        if (filter.process((i % 10 == 5) ? 4095 : 1000) != 1000) spiked = true;
+    }
+    CHECK(!spiked);
+}
+
+static void testAverage()
+{
+    AnalogFilter filter;
+    filter.configure(1, ANALOG_FILTER_MAX_AVERAGE, 0);
+    uint32_t seed = 1;
+    int16_t history[ANALOG_FILTER_MAX_AVERAGE];
+    for (int i = 0; i < ANALOG_FILTER_MAX_AVERAGE; i++) history[i] = 0;
+    for (int i = 0; i < ANALOG_FILTER_MAX_AVERAGE; i++) filter.process(0);
+    bool ok = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int16_t sample = (seed >> 16) % 4096;
+        history[i % ANALOG_FILTER_MAX_AVERAGE] = sample;
+        int32_t sum = 0;
+        for (int j = 0; j < ANALOG_FILTER_MAX_AVERAGE; j++) sum += history[j];
+        int16_t expect = (sum + ANALOG_FILTER_MAX_AVERAGE / 2) / ANALOG_FILTER_MAX_AVERAGE;
+        if (filter.process(sample) != expect) ok = false;
+    }
+    CHECK(ok);
+
+    //lengths past what fits are clamped instead of running off the window
+    filter.configure(9, 200, 30);
+    for (int i = 0; i < 100; i++) filter.process(2000);
+    CHECK_EQ(filter.value(), 2000);
+}
+
+//A step from 0 to 4000 has to come within one count of it and stay there, and the first sample
+//after a reset starts the output off at the input instead of dragging up from zero
+static void testIIR()
+{
+    for (uint8_t shift = 1; shift <= ANALOG_FILTER_MAX_SHIFT; shift++)
+    {
+        AnalogFilter filter;
+        filter.configure(1, 1, shift);
+        CHECK_EQ(filter.process(0), 0);
+        int settle = -1;
+        for (int i = 0; i < 5000; i++)
+        {
+            int16_t out = filter.process(4000);
+            if (settle < 0 && out >= 3999) settle = i;
+        }
+        CHECK(settle > 0);
+        CHECK(settle < (20 << shift));
+        CHECK(filter.value() >= 3999);
+    }
+
+    AnalogFilter filter;
+    filter.configure(3, 4, 4);
+    CHECK_EQ(filter.process(2500), 2500);
+}
+
+static void benchmark()
+{
+    const int samples = 10000000;
+    AnalogFilter filter;
+    filter.configure(5, 16, 4);
+    uint32_t seed = 7;
+    volatile int16_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        sink = filter.process((seed >> 20) & 0xFFF);
+    }
+    (void)sink;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples;
+    printf("bench analogfilter: median 5, average 16, IIR 4: %.1f ns per sample on the host\n", ns);
+}
+
+int main()
+{
+    testMedian();
+    testAverage();
+    testIIR();
+    benchmark();
+    return TEST_RESULT();
+}
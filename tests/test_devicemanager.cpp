@@ -0,0 +1,290 @@
+/*
+ * test_devicemanager.cpp - DeviceManager over the real Device and PrefHandler. Every config and status name
+ * has to come back out of the name index as the right entry of the right device, and names the index doesn't
+ * know about yet have to be found by the slow scan. Reports the time per lookup against a plain linear scan.
+ * Posted broadcasts have to reach each enabled device of the type once, and a soft fault stuck behind slow
+ * handlers gets its worst delivery latency reported apart from the messages it waited on.
+ */
+
+#include "DeviceManager.h"
+#include "MemCache.h"
+#include "test.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#define NUM_DEVICES 20
+#define ENTRIES_PER_DEVICE 25
+
+static SimEEPROMBackend sim(5000);
+
+//An enabled device that can be handed config entries from the outside
+class TestDevice : public Device {
+public:
+    TestDevice(DeviceId devId) : id(devId)
+    {
+        prefsHandler = new PrefHandler(id);
+        prefsHandler->setEnabledStatus(true);
+    }
+    ~TestDevice()
+    {
+        deviceManager.removeAllEntriesForDevice(this);
+        deviceManager.removeDevice(this);
+        delete prefsHandler;
+    }
+    DeviceId getId() { return id; }
+    DeviceType getType() { return DEVICE_MISC; }
+    void addConfig(const char *name, uint16_t *var)
+    {
+        ConfigEntry entry = {name, "", var, CFG_ENTRY_VAR_TYPE::UINT16, 0, 65535, 0, nullptr};
+        cfgEntries.push_back(entry);
+    }
+
+private:
+    DeviceId id;
+};
+
+//Takes a while over MSG_BUSY and counts the soft faults it hears
+#define MSG_BUSY 0x7F00
+#define BUSY_MICROS 200
+
+class MessageDevice : public Device {
+public:
+    MessageDevice(DeviceId devId, DeviceType devType, bool enabled) : faults(0), id(devId), type(devType)
+    {
+        prefsHandler = new PrefHandler(id);
+        prefsHandler->setEnabledStatus(enabled);
+        deviceManager.addDevice(this);
+    }
+    ~MessageDevice()
+    {
+        deviceManager.removeDevice(this);
+        delete prefsHandler;
+    }
+    DeviceId getId() { return id; }
+    DeviceType getType() { return type; }
+    void handleMessage(uint32_t msgType, const void *message)
+    {
+        if (msgType == MSG_BUSY) hostAdvanceMicros(BUSY_MICROS);
+        else if (msgType == MSG_SOFT_FAULT) faults++;
+        else Device::handleMessage(msgType, message);
+    }
+    int faults;
+
+private:
+    DeviceId id;
+    DeviceType type;
+};
+
+static std::unique_ptr<TestDevice> devices[NUM_DEVICES];
+static uint16_t configVars[NUM_DEVICES][ENTRIES_PER_DEVICE];
+static uint32_t statusVars[NUM_DEVICES][ENTRIES_PER_DEVICE];
+static std::vector<std::string> configNames, statusNames;
+
+static void setupDevices()
+{
+    for (int d = 0; d < NUM_DEVICES; d++)
+    {
+        devices[d].reset(new TestDevice(0x4000 + d));
+        for (int i = 0; i < ENTRIES_PER_DEVICE; i++)
+        {
+            configNames.push_back("CFG" + std::to_string(d) + "_" + std::to_string(i));
+            statusNames.push_back("ST" + std::to_string(d) + "_" + std::to_string(i));
+        }
+    }
+    //the names have to stay put once registered, so only take pointers once the vectors are done growing
+    for (int d = 0; d < NUM_DEVICES; d++)
+    {
+        for (int i = 0; i < ENTRIES_PER_DEVICE; i++)
+        {
+            devices[d]->addConfig(configNames[d * ENTRIES_PER_DEVICE + i].c_str(), &configVars[d][i]);
+            deviceManager.addStatusEntry(StatusEntry(statusNames[d * ENTRIES_PER_DEVICE + i].c_str(), &statusVars[d][i], UINT32,
+                                                     devices[d].get()));
+        }
+    }
+}
+
+//How findConfigEntry and findStatusEntry looked before the index
+static const ConfigEntry *linearConfig(const char *name, Device **matching)
+{
+    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
+    {
+        Device *dev = deviceManager.getDeviceByIdx(i);
+        if (!dev || !dev->isEnabled()) continue;
+        const std::vector<ConfigEntry> *entries = dev->getConfigEntries();
+        for (size_t idx = 0; idx < entries->size(); idx++)
+        {
+            if (!strcmp(name, entries->at(idx).cfgName.c_str()))
+            {
+                *matching = dev;
+                return &entries->at(idx);
+            }
+        }
+    }
+    return nullptr;
+}
+
+static bool linearStatus(const char *name, StatusEntry *entry)
+{
+    bool found = false;
+    deviceManager.forEachStatusEntry([&](const StatusEntry &e) {
+        if (!found && !strcmp(e.statusName, name))
+        {
+            *entry = e;
+            found = true;
+        }
+    });
+    return found;
+}
+
+static void testLookups()
+{
+    int wrongConfig = 0, wrongStatus = 0;
+    for (int d = 0; d < NUM_DEVICES; d++)
+    {
+        for (int i = 0; i < ENTRIES_PER_DEVICE; i++)
+        {
+            Device *dev = nullptr;
+            const ConfigEntry *cfg = deviceManager.findConfigEntry(configNames[d * ENTRIES_PER_DEVICE + i].c_str(), &dev);
+            if (!cfg || dev != devices[d].get() || cfg->varPtr != &configVars[d][i]) wrongConfig++;
+            if (deviceManager.findConfigEntry(devices[d].get(), configNames[d * ENTRIES_PER_DEVICE + i].c_str()) != cfg) wrongConfig++;
+
+            StatusEntry entry;
+            if (!deviceManager.findStatusEntry(statusNames[d * ENTRIES_PER_DEVICE + i].c_str(), &entry) ||
+                entry.device != devices[d].get() || entry.varPtr != &statusVars[d][i]) wrongStatus++;
+        }
+    }
+    CHECK_EQ(wrongConfig, 0);
+    CHECK_EQ(wrongStatus, 0);
+
+    //a status name isn't a config name or the other way around, and asking the wrong device finds nothing
+    Device *dev = nullptr;
+    StatusEntry entry;
+    CHECK(deviceManager.findConfigEntry("ST3_4", &dev) == nullptr);
+    CHECK(!deviceManager.findStatusEntry("CFG3_4", &entry));
+    CHECK(deviceManager.findConfigEntry(devices[1].get(), "CFG3_4") == nullptr);
+    CHECK(deviceManager.findConfigEntry("NoSuchSetting", &dev) == nullptr);
+    CHECK(!deviceManager.findStatusEntry("NoSuchStatus", &entry));
+}
+
+//Devices can push config entries without telling anyone. The index doesn't have them so the lookup has to
+//fall back to the slow scan, which then finds them for this device only
+static void testLateEntries()
+{
+    static uint16_t late;
+    Device *dev = nullptr;
+    deviceManager.buildNameIndex();
+    devices[7]->addConfig("LateSetting", &late);
+    const ConfigEntry *cfg = deviceManager.findConfigEntry("LateSetting", &dev);
+    CHECK(cfg && cfg->varPtr == &late);
+    CHECK(dev == devices[7].get());
+    CHECK(deviceManager.findConfigEntry(devices[7].get(), "LateSetting") == cfg);
+    CHECK(deviceManager.findConfigEntry(devices[8].get(), "LateSetting") == nullptr);
+
+    //the scan marked the index stale, after the rebuild everything is still found
+    cfg = deviceManager.findConfigEntry("LateSetting", &dev);
+    CHECK(cfg && cfg->varPtr == &late);
+    CHECK(deviceManager.findConfigEntry("CFG19_24", &dev) != nullptr && dev == devices[19].get());
+}
+
+static void benchmark()
+{
+    const int rounds = 200;
+    size_t total = configNames.size();
+    Device *dev;
+    StatusEntry entry;
+    size_t found = 0;
+    deviceManager.buildNameIndex();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < total; i++)
+        {
+            if (deviceManager.findConfigEntry(configNames[i].c_str(), &dev)) found++;
+            if (deviceManager.findStatusEntry(statusNames[i].c_str(), &entry)) found++;
+        }
+    }
+    double indexNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * total * 2);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < total; i++)
+        {
+            if (linearConfig(configNames[i].c_str(), &dev)) found++;
+            if (linearStatus(statusNames[i].c_str(), &entry)) found++;
+        }
+    }
+    double linearNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * total * 2);
+    CHECK_EQ(found, rounds * total * 4);
+
+    printf("bench devicemanager: %zu config and %zu status names, %.0f ns per lookup through the index, %.0f ns by linear scan\n",
+           total, statusNames.size(), indexNs, linearNs);
+    CHECK(indexNs < linearNs);
+}
+
+//Passes of the main loop until every device in list has heard want faults, giving up after 100
+static int runUntilHeard(std::unique_ptr<MessageDevice> *list, int count, int want)
+{
+    for (int pass = 1; pass <= 100; pass++)
+    {
+        deviceManager.processMessages();
+        hostAdvanceMicros(1000); //the rest of the main loop
+        bool all = true;
+        for (int i = 0; i < count; i++) if (list[i]->faults < want) all = false;
+        if (all) return pass;
+    }
+    return -1;
+}
+
+//A soft fault posted after a pile of slow messages. Each busy message costs more than the loop budget, so
+//only one goes per pass and the fault waits for all of them
+static void testPostedFault()
+{
+    const int numBusy = 10;
+    std::unique_ptr<MessageDevice> motors[6], bms[2];
+    for (int i = 0; i < 6; i++) motors[i].reset(new MessageDevice(0x4100 + i, DEVICE_MOTORCTRL, true));
+    for (int i = 0; i < 2; i++) bms[i].reset(new MessageDevice(0x4110 + i, DEVICE_BMS, true));
+    MessageDevice off(0x4120, DEVICE_MOTORCTRL, false);
+
+    for (int i = 0; i < numBusy; i++) CHECK(deviceManager.postMessage(DEVICE_MOTORCTRL, INVALID, MSG_BUSY, nullptr));
+    CHECK(deviceManager.postMessage(DEVICE_ANY, INVALID, MSG_SOFT_FAULT, nullptr));
+    CHECK(runUntilHeard(motors, 6, 1) > numBusy - 1);
+    CHECK(runUntilHeard(bms, 2, 1) > 0);
+    for (auto &dev : motors) CHECK_EQ(dev->faults, 1);
+    for (auto &dev : bms) CHECK_EQ(dev->faults, 1);
+    CHECK_EQ(off.faults, 0);
+
+    uint32_t faultLatency = deviceManager.getMaxMsgLatency(MSG_SOFT_FAULT);
+    uint32_t busyLatency = deviceManager.getMaxMsgLatency(MSG_BUSY);
+    CHECK(faultLatency >= numBusy * 6 * BUSY_MICROS);
+    CHECK(busyLatency > 0 && busyLatency < faultLatency);
+    CHECK_EQ(deviceManager.getMaxMsgLatency(MSG_HARD_FAULT), 0u);
+
+    //sent to one type, the others don't hear it
+    CHECK(deviceManager.postMessage(DEVICE_BMS, INVALID, MSG_SOFT_FAULT, nullptr));
+    CHECK_EQ(runUntilHeard(bms, 2, 2), 1);
+    for (auto &dev : bms) CHECK_EQ(dev->faults, 2);
+    for (auto &dev : motors) CHECK_EQ(dev->faults, 1);
+
+    printf("bench devicemanager: MSG_SOFT_FAULT behind %d busy messages to 6 devices, worst latency %u us (busy messages %u us)\n",
+           numBusy, faultLatency, busyLatency);
+}
+
+int main()
+{
+    CHECK(sim.begin());
+    memCache = new MemCache(&sim);
+    memCache->setup();
+
+    setupDevices();
+    testLookups();
+    testLateEntries();
+    benchmark();
+    testPostedFault();
+
+    for (auto &dev : devices) dev.reset();
+    return TEST_RESULT();
+}
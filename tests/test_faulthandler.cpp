@@ -0,0 +1,81 @@
+/*
+ * test_faulthandler.cpp - FaultHandler keeps the total runtime in the persistent journal. The runtime has
+ * to come back after a reboot without the cache having been flushed, and an hour of running is used as a
+ * benchmark of how many EEPROM writes that costs.
+ */
+
+#include "FaultHandler.h"
+#include "PersistJournal.h"
+#include "Heartbeat.h"
+#include "test.h"
+#include <new>
+
+static SimEEPROMBackend sim(5000);
+
+//Drops whatever the cache hadn't written, then scans the journal again like a fresh boot would
+static void reboot()
+{
+    memCache->~MemCache();
+    new (memCache) MemCache(&sim);
+    memCache->setup();
+    persistJournal.~PersistJournal();
+    new (&persistJournal) PersistJournal();
+    persistJournal.setup();
+}
+
+//Runs the heartbeat ticks (fault handler then journal) and the cache ticks in between for the given time
+static void run(uint32_t seconds)
+{
+    const uint32_t cacheTicks = CFG_TICK_INTERVAL_HEARTBEAT / CFG_TICK_INTERVAL_MEM_CACHE;
+    for (uint32_t beat = 0; beat < seconds * 1000000ul / CFG_TICK_INTERVAL_HEARTBEAT; beat++)
+    {
+        faultHandler.handleTick();
+        persistJournal.handleTick();
+        for (uint32_t t = 0; t < cacheTicks; t++)
+        {
+            hostAdvanceMicros(CFG_TICK_INTERVAL_MEM_CACHE);
+            memCache->handleTick();
+        }
+    }
+}
+
+static void testRuntimeSurvivesReboot()
+{
+    run(60);
+    uint32_t runtime = persistJournal.getValue(JV_RUNTIME);
+    CHECK(runtime >= 580); //set on the last heartbeat, two seconds before the end
+    reboot();
+    CHECK(persistJournal.isValid());
+    uint32_t restored = persistJournal.getValue(JV_RUNTIME);
+    //whatever was committed and aged out made it, at most one commit interval plus the cache aging is lost
+    uint32_t maxLoss = (JOURNAL_COMMIT_TICKS * CFG_TICK_INTERVAL_HEARTBEAT + MAX_AGE * CFG_TICK_INTERVAL_MEM_CACHE) / 100000;
+    CHECK(restored <= runtime);
+    CHECK(runtime - restored <= maxLoss);
+}
+
+static void benchmark()
+{
+    uint32_t writesBefore = sim.getTotalWrites();
+    run(3600);
+    uint32_t writes = sim.getTotalWrites() - writesBefore;
+    uint32_t worstPage = 0;
+    for (uint32_t page = EE_JOURNAL_START / 256; page < (EE_JOURNAL_START + EE_JOURNAL_SIZE) / 256; page++)
+    {
+        worstPage = max(worstPage, sim.getPageWrites(page));
+    }
+    printf("bench faulthandler: one hour of runtime updates took %u EEPROM writes, busiest journal page %u\n", writes, worstPage);
+    CHECK(writes <= 3600 / (JOURNAL_COMMIT_TICKS * CFG_TICK_INTERVAL_HEARTBEAT / 1000000) + 1);
+}
+
+int main()
+{
+    CHECK(sim.begin());
+    memCache = new MemCache(&sim);
+    memCache->setup();
+    faultHandler.setup();
+    persistJournal.setup();
+
+    testRuntimeSurvivesReboot();
+    benchmark();
+    return TEST_RESULT();
+}
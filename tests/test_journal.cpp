@@ -0,0 +1,133 @@
+/*
+ * test_journal.cpp - the wear leveled journal. Values have to come back after a reboot, a record cut short
+ * by a power loss must never be taken for a good one, and a simulated day of driving is used to project
+ * how long the EEPROM lasts at the commit rate the journal uses.
+ */
+
+#include "PersistJournal.h"
+#include "Heartbeat.h"
+#include "test.h"
+#include <new>
+
+//AT24CM02 datasheet endurance
+#define EEPROM_ENDURANCE  1000000ul
+
+static SimEEPROMBackend sim(5000);
+
+static void reboot()
+{
+    memCache->~MemCache();
+    new (memCache) MemCache(&sim);
+    memCache->setup();
+    persistJournal.~PersistJournal();
+    new (&persistJournal) PersistJournal();
+    persistJournal.setup();
+}
+
+//One heartbeat worth of driving: every value changes, then the cache runs until the next heartbeat
+static void heartbeat(uint32_t beat)
+{
+    persistJournal.setValue(JV_RUNTIME, beat * 20);
+    persistJournal.setValue(JV_WH_OUT, beat * 3);
+    persistJournal.setValue(JV_WH_IN, beat / 2);
+    persistJournal.setValue(JV_SOC, 1000 - (beat / 100) % 1000);
+    persistJournal.handleTick();
+    for (uint32_t t = 0; t < CFG_TICK_INTERVAL_HEARTBEAT / CFG_TICK_INTERVAL_MEM_CACHE; t++)
+    {
+        hostAdvanceMicros(CFG_TICK_INTERVAL_MEM_CACHE);
+        memCache->handleTick();
+    }
+}
+
+static void testRestore()
+{
+    for (uint32_t beat = 1; beat <= 100; beat++) heartbeat(beat);
+    memCache->FlushAllPages();
+    reboot();
+    CHECK(persistJournal.isValid());
+    CHECK_EQ(persistJournal.getValue(JV_RUNTIME), 100 * 20);
+    CHECK_EQ(persistJournal.getValue(JV_WH_OUT), 100 * 3);
+    CHECK_EQ(persistJournal.getValue(JV_WH_IN), 50);
+}
+
+//Cut the power at every byte of one record write. The next boot gets either the record before it or
+//the new one, never a half written mix.
+static void testPowerLoss()
+{
+    uint32_t cuts = 0;
+    for (uint32_t cut = 0; ; cut++)
+    {
+        persistJournal.setValue(JV_RUNTIME, 7777);
+        persistJournal.commit();
+        memCache->FlushAllPages();
+        reboot();
+
+        persistJournal.setValue(JV_RUNTIME, 8888);
+        persistJournal.setValue(JV_SOC, 555);
+        persistJournal.commit();
+        sim.injectPowerLoss(cut);
+        memCache->FlushAllPages();
+        bool finished = sim.hasPower();
+        sim.restorePower();
+        reboot();
+
+        CHECK(persistJournal.isValid());
+        uint32_t runtime = persistJournal.getValue(JV_RUNTIME);
+        CHECK(runtime == 7777 || (runtime == 8888 && persistJournal.getValue(JV_SOC) == 555));
+        cuts++;
+        if (finished)
+        {
+            CHECK_EQ(runtime, 8888);
+            break;
+        }
+    }
+    printf("journal power loss: %u cut points\n", cuts);
+}
+
+//A day of running with the values changing on every heartbeat. Also checks that finding the newest
+//record at boot only touches a few pages of the journal.
+static void wearSimulation()
+{
+    const uint32_t beatsPerDay = 86400ul * 1000000ul / CFG_TICK_INTERVAL_HEARTBEAT;
+    uint32_t firstPage = EE_JOURNAL_START / 256;
+    uint32_t numPages = EE_JOURNAL_SIZE / 256;
+    uint32_t before[EE_JOURNAL_SIZE / 256];
+    for (uint32_t p = 0; p < numPages; p++) before[p] = sim.getPageWrites(firstPage + p);
+
+    for (uint32_t beat = 1; beat <= beatsPerDay; beat++) heartbeat(beat);
+
+    uint32_t total = 0, worst = 0;
+    for (uint32_t p = 0; p < numPages; p++)
+    {
+        uint32_t writes = sim.getPageWrites(firstPage + p) - before[p];
+        total += writes;
+        worst = max(worst, writes);
+    }
+    double years = (double)EEPROM_ENDURANCE / worst / 365.0;
+    printf("wear: %u journal writes in a day spread over %u pages, busiest page %u writes/day, lifetime %.0f years at %lu cycles\n",
+           total, numPages, worst, years, EEPROM_ENDURANCE);
+    CHECK(worst <= total / numPages + 8);
+    CHECK(years > 20.0);
+
+    memCache->FlushAllPages();
+    reboot();
+    memCache->resetStats();
+    reboot();
+    const MemCacheStats *stats = memCache->getStats();
+    printf("journal boot scan: %u page reads\n", stats->misses);
+    CHECK(stats->misses <= 12);
+    CHECK_EQ(persistJournal.getValue(JV_RUNTIME), beatsPerDay * 20);
+}
+
+int main()
+{
+    CHECK(sim.begin());
+    memCache = new MemCache(&sim);
+    memCache->setup();
+    persistJournal.setup();
+
+    testRestore();
+    testPowerLoss();
+    wearSimulation();
+    return TEST_RESULT();
+}
@@ -0,0 +1,244 @@
+/*
+ * test_logcompressor.cpp - LZ4 blocks for the sdcard log. Whatever goes in has to come back out of a plain
+ * LZ4 decoder byte for byte, whether it compresses well, not at all, or is shorter than a match can be.
+ * A whole frame is also handed to the lz4 tool when it is installed. Reports the ratio and speed on log text
+ * and on a CAN frame dump.
+ */
+
+#include "LogCompressor.h"
+#include "test.h"
+#include <vector>
+#include <chrono>
+
+typedef std::vector<uint8_t> Bytes;
+
+//Straight from the LZ4 block format description. Returns false for anything that reads or copies out of bounds
+static bool decodeBlock(const uint8_t *src, size_t len, Bytes &out)
+{
+    size_t ip = 0;
+    while (ip < len)
+    {
+        uint8_t token = src[ip++];
+        size_t litLen = token >> 4;
+        if (litLen == 15)
+        {
+            uint8_t b;
+            do {
+                if (ip >= len) return false;
+                b = src[ip++];
+                litLen += b;
+            } while (b == 255);
+        }
+        if (ip + litLen > len) return false;
+        out.insert(out.end(), src + ip, src + ip + litLen);
+        ip += litLen;
+        if (ip == len) return true; //the last sequence is literals only
+
+        if (ip + 2 > len) return false;
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        size_t matchLen = (token & 15);
+        if (matchLen == 15)
+        {
+            uint8_t b;
+            do {
+                if (ip >= len) return false;
+                b = src[ip++];
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += 4;
+        if (offset == 0 || offset > out.size()) return false;
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < matchLen; i++) out.push_back(out[from + i]);
+    }
+    return false;
+}
+
+//Compresses data a block at a time into a whole frame, the way the logger writes the file
+static Bytes compressFrame(LogCompressor &comp, const Bytes &data)
+{
+    Bytes frame(LogCompressor::frameHeader, LogCompressor::frameHeader + sizeof(LogCompressor::frameHeader));
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        pos += comp.append(data.data() + pos, data.size() - pos);
+        if (comp.isFull() || pos == data.size())
+        {
+            size_t n = comp.compress();
+            frame.insert(frame.end(), comp.output(), comp.output() + n);
+        }
+    }
+    frame.insert(frame.end(), LogCompressor::endMark, LogCompressor::endMark + sizeof(LogCompressor::endMark));
+    return frame;
+}
+
+static bool decodeFrame(const Bytes &frame, Bytes &out)
+{
+    size_t pos = sizeof(LogCompressor::frameHeader);
+    if (memcmp(frame.data(), LogCompressor::frameHeader, pos)) return false;
+    while (pos + 4 <= frame.size())
+    {
+        uint32_t size = frame[pos] | (frame[pos + 1] << 8) | (frame[pos + 2] << 16) | ((uint32_t)frame[pos + 3] << 24);
+        pos += 4;
+        if (size == 0) return pos == frame.size();
+        bool stored = size & 0x80000000u;
+        size &= 0x7FFFFFFFu;
+        if (size > LOG_COMPRESS_MAX_OUT - 4 || pos + size > frame.size()) return false;
+        Bytes block;
+        if (stored) block.assign(frame.begin() + pos, frame.begin() + pos + size);
+        else if (!decodeBlock(frame.data() + pos, size, block)) return false;
+        if (block.size() > LOG_COMPRESS_BLOCK) return false;
+        out.insert(out.end(), block.begin(), block.end());
+        pos += size;
+    }
+    return false;
+}
+
+//Log lines like the firmware writes, with the timestamps and values moving along
+static Bytes logText(size_t len)
+{
+    static const char *names[] = {"DMOC645", "THROTTLE", "BMS", "CAN", "SYS"};
+    Bytes text;
+    uint32_t seed = 99;
+    char line[200];
+    for (uint32_t i = 0; text.size() < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int n = snprintf(line, sizeof(line), "D(%lu.%06lu) [%s] Torque cmd: %d  speed: %u rpm  dc: %u.%uV  temp %uC\r\n",
+                         (unsigned long)(i / 25), (unsigned long)(i % 25) * 40000, names[(seed >> 8) % 5],
+                         (int)((seed >> 12) % 3000) - 1000, (seed >> 4) % 9000, 300 + (seed >> 20) % 100, (seed >> 3) % 10,
+                         20 + (seed >> 24) % 40);
+        text.insert(text.end(), line, line + n);
+    }
+    text.resize(len);
+    return text;
+}
+
+//A bus dump the way CanHandler::logFrame() writes it: a dozen classic frames every 10ms with counters and
+//slowly moving values in them, and two 64 byte CANFD frames
+static Bytes canTrace(size_t len)
+{
+    static const uint32_t ids[] = {0x1A5, 0x1A6, 0x1A7, 0x23A, 0x23B, 0x300, 0x301, 0x351, 0x355, 0x356, 0x6B0, 0x6B1};
+    static const uint32_t fdIds[] = {0x18FF50E5, 0x18FF51E5};
+    Bytes text;
+    uint32_t seed = 42;
+    uint8_t data[64];
+    char line[400];
+    for (uint32_t cycle = 0; text.size() < len; cycle++)
+    {
+        uint32_t time = cycle * 10000;
+        for (size_t f = 0; f < sizeof(ids) / sizeof(ids[0]) + 2; f++)
+        {
+            bool fd = f >= sizeof(ids) / sizeof(ids[0]);
+            uint32_t id = fd ? fdIds[f - sizeof(ids) / sizeof(ids[0])] : ids[f];
+            int dlc = fd ? 64 : 8;
+            for (int b = 0; b < dlc; b++)
+            {
+                seed = seed * 1103515245 + 12345;
+                if (b == 0) data[b] = cycle & 0xFF; //rolling counter
+                else if (b < 4) data[b] = (uint8_t)((id * b + cycle / 50) & 0xFF); //slow values
+                else data[b] = ((seed >> 28) == 0) ? (uint8_t)(seed >> 16) : (uint8_t)(id >> b); //mostly steady, now and then noise
+            }
+            int n = snprintf(line, sizeof(line), "D(%lu.%06lu) [CAN] ", (unsigned long)(time / 1000000), (unsigned long)(time % 1000000));
+            if (fd)
+            {
+                n += snprintf(line + n, sizeof(line) - n, "CANFD: bus=%i id=%X dlc=%u ide=%X data=", 2, id, dlc, 1);
+                for (int b = 0; b < dlc; b++) n += snprintf(line + n, sizeof(line) - n, "%X,", data[b]);
+            }
+            else n += snprintf(line + n, sizeof(line) - n, "CAN: bus=%i id=%X dlc=%u ide=%X data=%X,%X,%X,%X,%X,%X,%X,%X", 0, id, dlc, 0,
+                               data[0], data[1], data[2], data[3], data[4], data[5], data[6], data[7]);
+            n += snprintf(line + n, sizeof(line) - n, "\r\n");
+            text.insert(text.end(), line, line + n);
+            time += 137;
+        }
+    }
+    text.resize(len);
+    return text;
+}
+
+static bool roundTrip(const Bytes &data, size_t *compressedSize = nullptr)
+{
+    static LogCompressor comp; //too big for the stack, the firmware keeps it static too
+    Bytes frame = compressFrame(comp, data);
+    Bytes back;
+    if (compressedSize) *compressedSize = frame.size();
+    return decodeFrame(frame, back) && back == data;
+}
+
+static void testRoundTrip()
+{
+    //shorter than a match is allowed to be, and right around the limits at the end of a block
+    for (size_t len = 1; len <= 40; len++) CHECK(roundTrip(Bytes(len, 'a')));
+    CHECK(roundTrip(Bytes(LOG_COMPRESS_BLOCK, 0)));
+    CHECK(roundTrip(Bytes(LOG_COMPRESS_BLOCK + 1, 'x')));
+    CHECK(roundTrip(logText(LOG_COMPRESS_BLOCK * 5 + 123)));
+    CHECK(roundTrip(canTrace(LOG_COMPRESS_BLOCK * 5 + 321)));
+
+    //noise doesn't compress, those blocks go in stored and must not grow past the limit
+    Bytes noise(LOG_COMPRESS_BLOCK * 3);
+    uint32_t seed = 5;
+    for (auto &b : noise)
+    {
+        seed = seed * 1103515245 + 12345;
+        b = seed >> 24;
+    }
+    size_t size;
+    CHECK(roundTrip(noise, &size));
+    CHECK(size <= noise.size() + 3 * 4 + sizeof(LogCompressor::frameHeader) + sizeof(LogCompressor::endMark));
+
+    //long runs need the 255 length bytes on both literals and matches
+    Bytes mixed = noise;
+    mixed.resize(700);
+    mixed.insert(mixed.end(), 2000, 'z');
+    mixed.insert(mixed.end(), noise.begin(), noise.begin() + 300);
+    CHECK(roundTrip(mixed));
+}
+
+//The real lz4 tool has to accept the file, header checksum and all. Skipped if it isn't installed.
+static void testLz4Tool()
+{
+    if (system("command -v lz4 >/dev/null 2>&1") != 0)
+    {
+        printf("lz4 not installed, frame not checked against it\n");
+        return;
+    }
+    static LogCompressor comp;
+    Bytes text = logText(LOG_COMPRESS_BLOCK * 3 + 77);
+    Bytes frame = compressFrame(comp, text);
+    const char *path = "build/test_logcompressor.lz4";
+    FILE *f = fopen(path, "wb");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fwrite(frame.data(), 1, frame.size(), f);
+    fclose(f);
+
+    FILE *p = popen("lz4 -dc build/test_logcompressor.lz4", "r");
+    Bytes back;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p)) > 0) back.insert(back.end(), buf, buf + n);
+    CHECK_EQ(pclose(p), 0);
+    CHECK(back == text);
+}
+
+static double benchmark(const char *what, const Bytes &text)
+{
+    static LogCompressor comp;
+    auto start = std::chrono::steady_clock::now();
+    Bytes frame = compressFrame(comp, text);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double ratio = 100.0 * frame.size() / text.size();
+    printf("bench logcompressor: %zu KB of %s down to %zu KB (%.0f%%), %.0f MB/s on the host\n", text.size() / 1024, what,
+           frame.size() / 1024, ratio, text.size() / secs / 1e6);
+    return ratio;
+}
+
+int main()
+{
+    testRoundTrip();
+    testLz4Tool();
+    CHECK(benchmark("log text", logText(4 * 1024 * 1024)) < 50.0);
+    CHECK(benchmark("CAN frame dump", canTrace(4 * 1024 * 1024)) < 50.0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,173 @@
+/*
+ * test_logger.cpp - the deferred log path. Messages have to come out in the order they were logged whether
+ * they were queued, sent because the ring filled up, or are errors that skip the queue. The longest line
+ * there is, a full CANFD frame, has to come out whole either way. Logging must never touch the heap.
+ */
+
+#include "Logger.h"
+#include "HeapMonitor.h"
+#include "test.h"
+#include <algorithm>
+
+//Where each of the given markers first shows up in what went out the serial port, -1 if it didn't
+static long position(const char *marker)
+{
+    size_t pos = hostSerialOutput.find(marker);
+    return (pos == std::string::npos) ? -1 : (long)pos;
+}
+
+static void testErrorOrder()
+{
+    hostSerialOutput.clear();
+    Logger::setDeferred(true);
+    Logger::info("first %d", 1);
+    Logger::warn("second %s", "queued");
+    Logger::error("third, an error");
+    Logger::info("fourth %u", 4u);
+    Logger::flush();
+    CHECK(position("first 1") >= 0);
+    CHECK(position("first 1") < position("second queued"));
+    CHECK(position("second queued") < position("third, an error"));
+    CHECK(position("third, an error") < position("fourth 4"));
+    Logger::setDeferred(false);
+}
+
+//Fill the ring well past full. Everything still comes out once and in order
+static void testRingFull()
+{
+    hostSerialOutput.clear();
+    Logger::setDeferred(true);
+    for (int i = 0; i < 1000; i++) Logger::info("line %d of many with a double %f", i, i * 0.5);
+    Logger::flush();
+    long last = -1;
+    bool ordered = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        char marker[32];
+        snprintf(marker, sizeof(marker), "line %d of", i);
+        long pos = position(marker);
+        if (pos <= last) ordered = false;
+        last = pos;
+    }
+    CHECK(ordered);
+    Logger::setDeferred(false);
+
+    hostSerialOutput.clear();
+    Logger::printStats();
+    CHECK(position("Ring filled up 0 times") < 0);
+    CHECK(position("0 messages too big to queue") >= 0);
+}
+
+//More arguments than a record holds. It goes out directly and isn't counted as the ring filling up
+static void testTooBig()
+{
+    hostSerialOutput.clear();
+    Logger::setDeferred(true);
+    Logger::info("%.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f %.0f",
+                 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 11.0, 12.0, 13.0, 14.0, 15.0, 16.0, 17.0, 18.0, 19.0, 20.0, 21.0, 22.0, 23.0, 24.0, 25.0, 26.0, 27.0, 28.0, 29.0, 30.0, 31.0, 32.0);
+    CHECK(position("1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32") >= 0);
+    Logger::setDeferred(false);
+
+    hostSerialOutput.clear();
+    Logger::printStats();
+    CHECK(position("1 messages too big to queue") >= 0);
+}
+
+//The same text CanHandler::logFrame() makes for a 64 byte frame, with every number at its widest and the
+//clock near where micros() wraps
+static void testCanFdLine()
+{
+    char data[64 * 3 + 1] = "";
+    for (int i = 0; i < 64; i++) strcat(data, "AB,");
+    char line[400];
+    snprintf(line, sizeof(line), "CANFD: bus=2 id=1FFFFFFF dlc=64 ide=1 data=%s\r\n", data);
+    hostAdvanceMicros(4294000000ul - micros());
+
+    for (int deferred = 0; deferred < 2; deferred++)
+    {
+        hostSerialOutput.clear();
+        Logger::setDeferred(deferred);
+        Logger::info(CANHANDLER, "CANFD: bus=%i id=%X dlc=%u ide=%X data=%s", 2, 0x1FFFFFFF, 64, 1, data);
+        Logger::flush();
+        CHECK(position("(4294.") == 1);
+        CHECK(position(line) >= 0);
+    }
+    Logger::setDeferred(false);
+}
+
+//Ten million messages of every kind, queued and direct, with ints, strings, floats and device IDs. Not one
+//heap call is allowed and the heap may not grow. The captured output is emptied between batches into space
+//reserved up front so the test itself doesn't allocate either.
+static void testNoHeap()
+{
+    const uint32_t messages = 10000000;
+    const uint32_t batch = 1000;
+    static const char *states[] = {"ready", "running", "faulted", "precharging"};
+    hostSerialOutput.clear();
+    hostSerialOutput.reserve(1 << 20);
+
+    //once through everything first so whatever gets set up on first use (stdio, the ring) is there already
+    Logger::setDeferred(true);
+    Logger::info("warm up %d %s %f", 1, "x", 1.5);
+    Logger::info(CANHANDLER, "warm up %u", 2u);
+    Logger::flush();
+    Logger::setDeferred(false);
+    Logger::info("warm up %d %s %f", 1, "x", 1.5);
+    hostSerialOutput.clear();
+
+    uint32_t opsBefore = HeapMonitor::getOpCount();
+    uint32_t highWaterBefore = HeapMonitor::getHighWater();
+    uint64_t lines = 0;
+    for (uint32_t i = 0; i < messages; i++)
+    {
+        if (i % 256 == 0) Logger::setDeferred(i & 256); //switch between queued and direct now and then
+        switch (i % 5)
+        {
+        case 0:
+            Logger::info("Torque cmd: %d  speed: %u rpm", (int)(i % 3000) - 1000, i % 9000);
+            break;
+        case 1:
+            Logger::warn(CANHANDLER, "state %s after %lu ms", states[i % 4], (unsigned long)i);
+            break;
+        case 2:
+            Logger::info("dc: %f V  %.2f A", 300.0 + (i % 100) / 10.0, (i % 400) * 0.25);
+            break;
+        case 3:
+            Logger::debug(SYSTEM, "device %X sent %d bytes, %s", 0x1000 + i % 16, (int)(i % 64), "ok");
+            break;
+        case 4:
+            if (i % 1000 == 4) Logger::error("fault %u on device %X", i, FAULTSYS);
+            else Logger::info(CANHANDLER, "CAN: bus=%i id=%X dlc=%u data=%X,%X", 0, 0x1A5 + i % 8, 8, i & 0xFF, (i >> 8) & 0xFF);
+            break;
+        }
+        if (i % batch == batch - 1)
+        {
+            Logger::flush();
+            lines += std::count(hostSerialOutput.begin(), hostSerialOutput.end(), '\n');
+            hostSerialOutput.clear();
+        }
+    }
+    Logger::setDeferred(false);
+
+    uint32_t ops = HeapMonitor::getOpCount() - opsBefore;
+    printf("no heap: %u messages, %llu lines out, %u heap calls, heap high water %u bytes before and %u after\n", messages,
+           (unsigned long long)lines, ops, highWaterBefore, HeapMonitor::getHighWater());
+    CHECK_EQ(lines, messages);
+    CHECK_EQ(ops, 0);
+    CHECK_EQ(HeapMonitor::getHighWater(), highWaterBefore);
+
+    //and the heap monitor does see heap calls
+    opsBefore = HeapMonitor::getOpCount();
+    std::string grow(4096, 'x');
+    CHECK(HeapMonitor::getOpCount() > opsBefore);
+}
+
+int main()
+{
+    testErrorOrder();
+    testRingFull();
+    testTooBig();
+    testCanFdLine();
+    testNoHeap();
+    return TEST_RESULT();
+}
@@ -0,0 +1,155 @@
+/*
+ * test_memcache.cpp - MemCache on top of the simulated EEPROM. Checks the cache counters, that only
+ * the dirty span of a page gets written, that a failed write keeps the page dirty, and runs a small
+ * settings-like workload as a benchmark.
+ */
+
+#include "MemCache.h"
+#include "test.h"
+
+#define WRITE_CYCLE_MICROS 5000
+
+static SimEEPROMBackend sim(WRITE_CYCLE_MICROS);
+
+static void testHitsAndMisses(MemCache &cache)
+{
+    cache.InvalidateAll();
+    cache.resetStats();
+    uint8_t val;
+    cache.Read(0x100, &val); //miss
+    cache.Read(0x101, &val); //hit, same page
+    cache.Write(0x102, (uint8_t)7); //hit
+    cache.Write(0x200, (uint8_t)8); //miss
+    const MemCacheStats *stats = cache.getStats();
+    CHECK_EQ(stats->hits, 2);
+    CHECK_EQ(stats->misses, 2);
+    CHECK_EQ(stats->evictions, 0);
+
+    //zero length is nothing to do, not a failure
+    CHECK(cache.Write(0x300, &val, 0));
+    CHECK(cache.Read(0x300, &val, 0));
+    cache.FlushAllPages();
+}
+
+//One more page than fits. Every page is a single miss and exactly one page gets evicted
+static void testEviction(MemCache &cache)
+{
+    cache.InvalidateAll();
+    cache.resetStats();
+    uint8_t val;
+    for (uint32_t page = 0; page <= NUM_CACHED_PAGES; page++) cache.Read(page << 8, &val);
+    CHECK_EQ(cache.getStats()->misses, NUM_CACHED_PAGES + 1);
+    CHECK_EQ(cache.getStats()->evictions, 1);
+
+    //a write miss goes through the eviction scan once as well
+    cache.Write((uint32_t)(NUM_CACHED_PAGES + 1) << 8, (uint8_t)1);
+    CHECK_EQ(cache.getStats()->misses, NUM_CACHED_PAGES + 2);
+    CHECK_EQ(cache.getStats()->evictions, 2);
+    cache.FlushAllPages();
+}
+
+static void testDirtySpan(MemCache &cache)
+{
+    cache.InvalidateAll();
+    cache.resetStats();
+    uint32_t writesBefore = sim.getTotalWrites();
+    cache.Write(0x1010, (uint16_t)0xBEEF);
+    cache.Write(0x1020, (uint8_t)0x55);
+    cache.FlushAllPages();
+    CHECK_EQ(cache.getStats()->flushes, 1);
+    CHECK_EQ(cache.getStats()->bytesWritten, 0x1020 - 0x1010 + 1);
+    CHECK_EQ(sim.getTotalWrites() - writesBefore, 1);
+    CHECK_EQ(sim.getRawData()[0x1010], 0xEF);
+    CHECK_EQ(sim.getRawData()[0x1011], 0xBE);
+    CHECK_EQ(sim.getRawData()[0x1020], 0x55);
+}
+
+//A write the chip doesn't take must not lose the data
+static void testFailedWrite(MemCache &cache)
+{
+    cache.InvalidateAll();
+    cache.resetStats();
+    uint32_t errorsBefore = hostLogErrors;
+    cache.Write(0x2040, (uint32_t)0x12345678);
+
+    sim.injectPowerLoss(0);
+    cache.FlushAllPages();
+    CHECK(cache.IsAddressDirty(0x2040));
+    CHECK_EQ(cache.getStats()->writeFailures, 1);
+    CHECK_EQ(hostLogErrors - errorsBefore, 1);
+
+    //invalidating a page that can't be written keeps it around
+    cache.InvalidateAddress(0x2040);
+    CHECK(cache.IsAddressDirty(0x2040));
+    CHECK_EQ(cache.getStats()->writeFailures, 2);
+    uint32_t val = 0;
+    cache.Read(0x2040, &val);
+    CHECK_EQ(val, 0x12345678);
+
+    sim.restorePower();
+    cache.FlushAllPages();
+    CHECK(!cache.IsAddressDirty(0x2040));
+    CHECK_EQ(cache.getStats()->writeFailures, 2);
+    uint32_t stored;
+    memcpy(&stored, sim.getRawData() + 0x2040, 4);
+    CHECK_EQ(stored, 0x12345678);
+
+    //a page that ages out while the chip is gone stays dirty too
+    cache.Write(0x2050, (uint8_t)9);
+    sim.injectPowerLoss(0);
+    cache.AgeFullyAddress(0x2050);
+    cache.handleTick();
+    CHECK(cache.IsAddressDirty(0x2050));
+    sim.restorePower();
+    cache.FlushAllPages();
+    CHECK(!cache.IsAddressDirty(0x2050));
+}
+
+//Settings-like traffic: a few hot values rewritten often, the rest touched now and then, the cache
+//ticking along at its normal 40ms. Reports what reached the EEPROM.
+static void benchmark(MemCache &cache)
+{
+    cache.InvalidateAll();
+    cache.resetStats();
+    uint32_t writesBefore = sim.getTotalWrites();
+    uint32_t seed = 12345;
+    const int ticks = 25 * 60 * 10; //ten minutes
+    for (int t = 0; t < ticks; t++)
+    {
+        for (int n = 0; n < 4; n++)
+        {
+            seed = seed * 1103515245 + 12345;
+            uint32_t addr = (seed >> 8) % 64; //hot: the first 64 bytes of a few pages
+            addr += ((seed >> 20) % 4) * 256;
+            cache.Write(addr, (uint8_t)seed);
+        }
+        if (t % 25 == 0)
+        {
+            seed = seed * 1103515245 + 12345;
+            uint8_t val;
+            cache.Read((seed >> 4) % (256 * 1024), &val);
+        }
+        hostAdvanceMicros(CFG_TICK_INTERVAL_MEM_CACHE);
+        cache.handleTick();
+    }
+    cache.FlushAllPages();
+    const MemCacheStats *stats = cache.getStats();
+    printf("bench memcache: %u accesses, hit rate %.1f%%, %u page writes (%u on the chip), %u bytes written, %u ms blocked\n",
+           stats->hits + stats->misses, 100.0 * stats->hits / (stats->hits + stats->misses), stats->flushes,
+           sim.getTotalWrites() - writesBefore, stats->bytesWritten, stats->blockedMicros / 1000);
+    CHECK(stats->flushes < (uint32_t)ticks / 10);
+}
+
+int main()
+{
+    CHECK(sim.begin());
+    MemCache *cache = new MemCache(&sim);
+    cache->setup();
+
+    testHitsAndMisses(*cache);
+    testEviction(*cache);
+    testDirtySpan(*cache);
+    testFailedWrite(*cache);
+    benchmark(*cache);
+    return TEST_RESULT();
+}
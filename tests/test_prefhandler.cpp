@@ -0,0 +1,440 @@
+/*
+ * test_prefhandler.cpp - PrefHandler over the real MemCache and the simulated EEPROM. Settings have to
+ * survive a reboot and a transaction cut short by a power loss has to come back as either all the old
+ * values or all the new ones, never a mix. Settings that change size and background compaction have to
+ * keep every value through a power loss at any point too.
+ */
+
+#include "PrefHandler.h"
+#include "MemCache.h"
+#include "test.h"
+#include <new>
+#include <chrono>
+
+#define TEST_DEVICE ((DeviceId)0x1234)
+
+static SimEEPROMBackend sim(5000);
+
+//Throws away everything the cache hadn't written yet, the same as the power going off
+static PrefHandler *reboot(PrefHandler *prefs)
+{
+    delete prefs;
+    memCache->~MemCache();
+    new (memCache) MemCache(&sim);
+    memCache->setup();
+    return new PrefHandler(TEST_DEVICE);
+}
+
+static void testReadWrite(PrefHandler *&prefs)
+{
+    uint8_t v8;
+    uint16_t v16;
+    uint32_t v32;
+    float vf;
+    char str[32];
+
+    prefs->resetEEPROM();
+    prefs->read("Missing", &v16, 77);
+    CHECK_EQ(v16, 77);
+
+    prefs->write("Byte", (uint8_t)5);
+    prefs->write("Word", (uint16_t)1234);
+    prefs->write("Long", (uint32_t)0xDEADBEEF);
+    prefs->write("Float", 2.5f);
+    prefs->write("Name", "hello", 16);
+    prefs->saveChecksum();
+    prefs->forceCacheWrite();
+
+    prefs = reboot(prefs);
+    CHECK(prefs->checksumValid());
+    prefs->read("Byte", &v8, 0);
+    prefs->read("Word", &v16, 0);
+    prefs->read("Long", &v32, 0);
+    prefs->read("Float", &vf, 0.0f);
+    prefs->read("Name", str, "");
+    CHECK_EQ(v8, 5);
+    CHECK_EQ(v16, 1234);
+    CHECK_EQ(v32, 0xDEADBEEF);
+    CHECK(vf == 2.5f);
+    CHECK(strcmp(str, "hello") == 0);
+
+    //a value that isn't flushed is gone after a power loss, the rest is not
+    prefs->write("Word", (uint16_t)999);
+    prefs = reboot(prefs);
+    prefs->read("Word", &v16, 0);
+    CHECK_EQ(v16, 1234);
+    prefs->read("Long", &v32, 0);
+    CHECK_EQ(v32, 0xDEADBEEF);
+}
+
+static void testTableReadWrite(PrefHandler *&prefs)
+{
+    static constexpr Pref<uint16_t> prefA("TableA", 10);
+    static constexpr Pref<uint8_t> prefB("TableB", 20);
+    uint16_t a = 0;
+    uint8_t b = 0;
+    const PrefBinding table[] = { PrefBinding(prefA, &a), PrefBinding(prefB, &b) };
+
+    prefs->resetEEPROM();
+    prefs->read(table, 2);
+    CHECK_EQ(a, 10);
+    CHECK_EQ(b, 20);
+    a = 300;
+    b = 40;
+    prefs->write(table, 2);
+    prefs->forceCacheWrite();
+    a = b = 0;
+    prefs = reboot(prefs);
+    prefs->read(table, 2);
+    CHECK_EQ(a, 300);
+    CHECK_EQ(b, 40);
+
+    //devices moved over to tables have to keep reading what the key by key calls stored, and the other way
+    static constexpr Pref<float> prefTorque("MaxTorque", 300.0f);
+    float torque = 0.0f;
+    const PrefBinding torqueTable[] = { PrefBinding(prefTorque, &torque) };
+    prefs->write("MaxTorque", 125.5f);
+    prefs->read(torqueTable, 1);
+    CHECK(torque == 125.5f);
+    uint16_t v16 = 0;
+    prefs->read("TableA", &v16, 0);
+    CHECK_EQ(v16, 300);
+}
+
+//Cuts the power after every possible number of bytes while a transaction commits. Whatever made it
+//to the chip, the next boot must see one complete set of settings.
+static void testCommitPowerLoss(PrefHandler *&prefs)
+{
+    int mixed = 0, oldSets = 0, newSets = 0;
+
+    for (uint32_t cut = 0; ; cut++)
+    {
+        prefs->resetEEPROM();
+        for (int i = 0; i < 8; i++)
+        {
+            char key[16];
+            sprintf(key, "Tx%d", i);
+            prefs->write(key, (uint32_t)i);
+        }
+        prefs->saveChecksum();
+        prefs->forceCacheWrite();
+
+        prefs->beginTransaction();
+        for (int i = 0; i < 8; i++)
+        {
+            char key[16];
+            sprintf(key, "Tx%d", i);
+            prefs->write(key, (uint32_t)(100 + i));
+        }
+        prefs->saveChecksum();
+        sim.injectPowerLoss(cut);
+        prefs->commitTransaction();
+        bool finished = sim.hasPower();
+        sim.restorePower();
+        prefs = reboot(prefs);
+
+        int oldCount = 0, newCount = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            char key[16];
+            uint32_t val;
+            sprintf(key, "Tx%d", i);
+            prefs->read(key, &val, 0xFFFF);
+            if (val == (uint32_t)i) oldCount++;
+            if (val == (uint32_t)(100 + i)) newCount++;
+        }
+        if (oldCount == 8) oldSets++;
+        else if (newCount == 8) newSets++;
+        else mixed++;
+        CHECK(prefs->checksumValid());
+        if (finished) break;
+    }
+    printf("commit power loss: %d cut points, %d came back old, %d new\n", oldSets + newSets + mixed, oldSets, newSets);
+    CHECK_EQ(mixed, 0);
+    CHECK(oldSets > 0);
+    CHECK(newSets > 0);
+}
+
+//Fills the block with filler records so the next one lands on the second EEPROM page of the block
+static void fillFirstPage(PrefHandler *prefs)
+{
+    for (int i = 0; i < 30; i++)
+    {
+        char key[16];
+        sprintf(key, "Fill%d", i);
+        prefs->write(key, (uint32_t)i);
+    }
+}
+
+//A setting that changes size is moved to the end of the block, which here is on another page than the
+//old record. Cut the power at every point of the write back: one of the two records has to survive.
+static void testMovePowerLoss(PrefHandler *&prefs)
+{
+    static constexpr Pref<uint16_t> prefSmall("Resize", 0);
+    static constexpr Pref<uint32_t> prefBig("Resize", 0);
+    int lost = 0, cuts = 0;
+
+    for (uint32_t cut = 0; ; cut++)
+    {
+        prefs->resetEEPROM();
+        prefs->write("Resize", (uint16_t)1111);
+        fillFirstPage(prefs);
+        prefs->saveChecksum();
+        prefs->forceCacheWrite();
+
+        sim.injectPowerLoss(cut);
+        prefs->write("Resize", (uint32_t)222222);
+        prefs->forceCacheWrite();
+        bool finished = sim.hasPower();
+        sim.restorePower();
+        prefs = reboot(prefs);
+
+        uint16_t small = 0;
+        uint32_t big = 0;
+        const PrefBinding table[] = { PrefBinding(prefSmall, &small), PrefBinding(prefBig, &big) };
+        prefs->read(table, 2);
+        if (small != 1111 && big != 222222) lost++;
+        cuts++;
+        if (finished)
+        {
+            CHECK_EQ(big, 222222);
+            break;
+        }
+    }
+    printf("move power loss: %d cut points, setting lost %d times\n", cuts, lost);
+    CHECK_EQ(lost, 0);
+}
+
+//Leaves a block with plenty of dead records behind so it is worth compacting
+static void makeGarbage(PrefHandler *prefs)
+{
+    prefs->resetEEPROM();
+    for (int i = 0; i < 12; i++)
+    {
+        char key[16];
+        sprintf(key, "Grow%d", i);
+        prefs->write(key, (uint16_t)i);
+        prefs->write(key, (uint32_t)(1000 + i)); //moves it and leaves the old record dead
+    }
+    prefs->saveChecksum();
+    prefs->forceCacheWrite();
+}
+
+static bool checkGrown(PrefHandler *prefs, uint32_t last)
+{
+    bool ok = true;
+    for (int i = 0; i < 12; i++)
+    {
+        char key[16];
+        uint32_t val;
+        sprintf(key, "Grow%d", i);
+        prefs->read(key, &val, 0);
+        if (val != (uint32_t)((i == 11) ? last : 1000 + i)) ok = false;
+    }
+    return ok;
+}
+
+//Runs the background compaction to the end, saving a setting (and the checksum, as devices do) after
+//the given number of ticks. Returns how many ticks it took.
+static int compact(PrefHandler *prefs, int saveAt, uint32_t saveVal, int maxTicks = 1000)
+{
+    uint32_t val;
+    prefs->read("Grow0", &val, 0); //the compactor only looks at blocks used since boot
+    prefCompactor.compactAll();
+    int tick;
+    for (tick = 0; tick < maxTicks; tick++)
+    {
+        if (tick == saveAt)
+        {
+            prefs->write("Grow11", saveVal);
+            prefs->saveChecksum();
+        }
+        prefCompactor.handleTick();
+        memCache->handleTick();
+        if (tick > saveAt && !prefs->inTransaction()) break;
+    }
+    return tick;
+}
+
+//Saves landing at every stage of a compaction, including after the new header went out, must end up
+//on the chip with a checksum that matches
+static void testCompactionLateSave(PrefHandler *&prefs)
+{
+    makeGarbage(prefs);
+    int ticks = compact(prefs, -1, 0);
+    CHECK(!prefs->needsCompaction());
+    CHECK(ticks < 1000);
+
+    for (int saveAt = 0; saveAt <= ticks + 1; saveAt++)
+    {
+        makeGarbage(prefs);
+        compact(prefs, saveAt, 5000 + saveAt);
+        prefs->forceCacheWrite();
+        prefs = reboot(prefs);
+        CHECK(prefs->checksumValid());
+        CHECK(checkGrown(prefs, 5000 + saveAt));
+    }
+}
+
+//Power lost at any point of a compaction leaves either block intact
+static void testCompactionPowerLoss(PrefHandler *&prefs)
+{
+    int cuts = 0;
+    for (uint32_t cut = 0; ; cut++)
+    {
+        makeGarbage(prefs);
+        prefs = reboot(prefs);
+        sim.injectPowerLoss(cut);
+        compact(prefs, -1, 0, 200);
+        bool finished = sim.hasPower();
+        sim.restorePower();
+        prefs = reboot(prefs);
+        CHECK(prefs->checksumValid());
+        CHECK(checkGrown(prefs, 1011));
+        cuts++;
+        if (finished) break;
+    }
+    printf("compaction power loss: %d cut points\n", cuts);
+}
+
+//A device worth of settings looked up over and over. The key index means a lookup costs one cache
+//read for the value no matter how far into the block the key is.
+static void benchmark(PrefHandler *&prefs)
+{
+    char key[16];
+    uint32_t val;
+
+    prefs->resetEEPROM();
+    for (int i = 0; i < 60; i++)
+    {
+        sprintf(key, "Bench%d", i);
+        prefs->write(key, (uint32_t)i);
+    }
+    prefs->forceCacheWrite();
+    prefs = reboot(prefs);
+    memCache->resetStats();
+    uint32_t lookupsBefore = PrefHandler::getLookupCount();
+    bool ok = true;
+    for (int round = 0; round < 100; round++)
+    {
+        for (int i = 0; i < 60; i++)
+        {
+            sprintf(key, "Bench%d", i);
+            prefs->read(key, &val, 0);
+            if (val != (uint32_t)i) ok = false;
+        }
+    }
+    CHECK(ok);
+    const MemCacheStats *stats = memCache->getStats();
+    uint32_t lookups = PrefHandler::getLookupCount() - lookupsBefore;
+    double perLookup = (double)(stats->hits + stats->misses) / lookups;
+    printf("bench prefhandler: %u lookups, %.2f cache reads each, %u misses\n", lookups, perLookup, stats->misses);
+    CHECK(perLookup < 1.1);
+}
+
+//The motor controller's settings, the same keys and types as its bindPrefs() table
+static constexpr Pref<uint16_t> prefMaxRPM("MaxRPM", 6000);
+static constexpr Pref<float> prefMaxTorque("MaxTorque", 300.0f);
+static constexpr Pref<uint16_t> prefRPMSlew("RPMSlew", 10000);
+static constexpr Pref<float> prefTorqueSlew("TorqueSlew", 600.0f);
+static constexpr Pref<uint8_t> prefReversePercentage("ReversePercentage", 50);
+static constexpr Pref<uint8_t> prefEnableDIN("Enable_DIN", 0);
+static constexpr Pref<uint8_t> prefReverseDIN("Reverse_DIN", 1);
+static constexpr Pref<uint16_t> prefRegenTaperUpper("RegenTaperUpper", 500);
+static constexpr Pref<uint16_t> prefRegenTaperLower("RegenTaperLower", 75);
+
+struct MotorSettings
+{
+    uint16_t speedMax, speedSlewRate, regenTaperUpper, regenTaperLower;
+    float torqueMax, torqueSlewRate;
+    uint8_t reversePercent, enableIn, reverseIn;
+};
+
+//What loadConfiguration() did before the tables, one lookup per key
+static void readPerKey(PrefHandler *prefs, MotorSettings &s)
+{
+    prefs->read("MaxRPM", &s.speedMax, 6000);
+    prefs->read("MaxTorque", &s.torqueMax, 300.0f);
+    prefs->read("RPMSlew", &s.speedSlewRate, 10000);
+    prefs->read("TorqueSlew", &s.torqueSlewRate, 600.0f);
+    prefs->read("ReversePercentage", &s.reversePercent, 50);
+    prefs->read("Enable_DIN", &s.enableIn, 0);
+    prefs->read("Reverse_DIN", &s.reverseIn, 1);
+    prefs->read("RegenTaperUpper", &s.regenTaperUpper, 500);
+    prefs->read("RegenTaperLower", &s.regenTaperLower, 75);
+}
+
+//Loads a motor controller's settings from a freshly booted cache, once with the table and once key by key,
+//and reports the time and the cache and I2C page reads each way takes
+static void benchmarkLoad(PrefHandler *&prefs)
+{
+    const int boots = 2000;
+    MotorSettings stored = {5500, 8000, 600, 80, 250.0f, 500.0f, 40, 2, 3};
+    MotorSettings s;
+    const PrefBinding table[] = {
+        PrefBinding(prefMaxRPM, &s.speedMax), PrefBinding(prefMaxTorque, &s.torqueMax), PrefBinding(prefRPMSlew, &s.speedSlewRate),
+        PrefBinding(prefTorqueSlew, &s.torqueSlewRate), PrefBinding(prefReversePercentage, &s.reversePercent),
+        PrefBinding(prefEnableDIN, &s.enableIn), PrefBinding(prefReverseDIN, &s.reverseIn),
+        PrefBinding(prefRegenTaperUpper, &s.regenTaperUpper), PrefBinding(prefRegenTaperLower, &s.regenTaperLower)
+    };
+    const size_t count = sizeof(table) / sizeof(table[0]);
+    uint32_t wayReads[2];
+
+    prefs->resetEEPROM();
+    s = stored;
+    prefs->write(table, count);
+    prefs->saveChecksum();
+    prefs->forceCacheWrite();
+
+    for (int way = 0; way < 2; way++)
+    {
+        double secs = 0;
+        uint32_t cacheReads = 0, pageReads = 0;
+        bool ok = true;
+        for (int i = 0; i < boots; i++)
+        {
+            prefs = reboot(prefs);
+            memCache->InvalidateAll(); //the device table lookup at boot pulled in a page, start the load cold
+            memset(&s, 0, sizeof(s));
+            memCache->resetStats();
+            uint32_t pagesBefore = sim.getTotalReads();
+            auto start = std::chrono::steady_clock::now();
+            if (way == 0) prefs->read(table, count);
+            else readPerKey(prefs, s);
+            secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const MemCacheStats *stats = memCache->getStats();
+            cacheReads += stats->hits + stats->misses;
+            pageReads += sim.getTotalReads() - pagesBefore;
+            if (s.speedMax != stored.speedMax || s.torqueMax != stored.torqueMax || s.speedSlewRate != stored.speedSlewRate ||
+                s.torqueSlewRate != stored.torqueSlewRate || s.reversePercent != stored.reversePercent ||
+                s.enableIn != stored.enableIn || s.reverseIn != stored.reverseIn ||
+                s.regenTaperUpper != stored.regenTaperUpper || s.regenTaperLower != stored.regenTaperLower) ok = false;
+        }
+        CHECK(ok);
+        wayReads[way] = cacheReads;
+        printf("bench prefhandler: %zu motor settings %s: %.2f us, %.1f cache reads, %.1f I2C page reads per load\n", count,
+               way ? "key by key" : "as a table", secs * 1e6 / boots, (double)cacheReads / boots, (double)pageReads / boots);
+    }
+    CHECK(wayReads[0] < wayReads[1]);
+}
+
+int main()
+{
+    CHECK(sim.begin());
+    memCache = new MemCache(&sim);
+    memCache->setup();
+    PrefHandler *prefs = new PrefHandler(TEST_DEVICE);
+    memCache->FlushAllPages();
+
+    testReadWrite(prefs);
+    testTableReadWrite(prefs);
+    testCommitPowerLoss(prefs);
+    testMovePowerLoss(prefs);
+    testCompactionLateSave(prefs);
+    testCompactionPowerLoss(prefs);
+    benchmark(prefs);
+    benchmarkLoad(prefs);
+
+    delete prefs;
+    return TEST_RESULT();
+}
@@ -0,0 +1,234 @@
+/*
+ * test_statusrecorder.cpp - the status recorder file format. A recording made from known values has to decode
+ * back to exactly those values row by row, with the channel names and types in the header and the timestamps
+ * adding up. Reports how many bytes a row takes against writing every value out in full.
+ */
+
+#include "devices/misc/StatusRecorder.h"
+#include "MemCache.h"
+#include <SdFat.h>
+#include "test.h"
+#include <vector>
+
+#define SAMPLE_MICROS 20000 //the default 50 Hz
+#define NUM_SAMPLES 500
+
+extern bool sdCardPresent;
+extern StatusRecorder statusRecorder;
+
+static SimEEPROMBackend sim(5000);
+
+//What a vehicle might be showing: some values sit still, some creep and some jump around
+static uint8_t gear;
+static int16_t torque;
+static uint16_t rpm;
+static int32_t current;
+static uint32_t odometer;
+static float voltage;
+static char state[16] = "ready";
+
+static const char *names[] = {"Gear", "Torque", "RPM", "Current", "Odometer", "Voltage"};
+static const CFG_ENTRY_VAR_TYPE types[] = {BYTE, INT16, UINT16, INT32, UINT32, FLOAT};
+#define NUM_CHANNELS 6
+
+struct Row
+{
+    int64_t values[NUM_CHANNELS];
+};
+
+static void registerEntries()
+{
+    deviceManager.addStatusEntry(StatusEntry("Gear", &gear, BYTE, nullptr));
+    deviceManager.addStatusEntry(StatusEntry("Torque", &torque, INT16, nullptr));
+    deviceManager.addStatusEntry(StatusEntry("RPM", &rpm, UINT16, nullptr));
+    deviceManager.addStatusEntry(StatusEntry("Current", &current, INT32, nullptr));
+    deviceManager.addStatusEntry(StatusEntry("Odometer", &odometer, UINT32, nullptr));
+    deviceManager.addStatusEntry(StatusEntry("Voltage", &voltage, FLOAT, nullptr));
+    deviceManager.addStatusEntry(StatusEntry("State", state, STRING, nullptr));
+}
+
+static Row currentRow()
+{
+    Row row;
+    uint32_t bits;
+    memcpy(&bits, &voltage, 4);
+    int64_t vals[NUM_CHANNELS] = {gear, torque, rpm, current, odometer, bits};
+    memcpy(row.values, vals, sizeof(vals));
+    return row;
+}
+
+static void step(int i, uint32_t &seed)
+{
+    if (i >= 300 && i < 320) return; //parked for a moment, nothing moves
+    seed = seed * 1103515245 + 12345;
+    if (i % 100 == 50) gear = (gear + 1) % 3;
+    if (i % 7 != 0) torque = (int16_t)((seed >> 8) % 4000) - 2000;
+    if (i % 40 < 30) rpm += (seed >> 16) % 50;
+    if (i == 200) current = -2000000000;
+    else if (i % 3 == 0) current += (int32_t)((seed >> 4) % 201) - 100;
+    if (i % 25 == 0) odometer += 1;
+    if (i % 11 == 0) voltage = 350.0f + (seed >> 20) % 100 / 10.0f;
+}
+
+//Reads one zigzag varint, false if the file ends part way through it
+static bool getVarint(const std::string &data, size_t &pos, uint64_t &val)
+{
+    val = 0;
+    for (int shift = 0; shift < 70; shift += 7)
+    {
+        if (pos >= data.size()) return false;
+        uint8_t b = data[pos++];
+        val |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static int64_t unzigzag(uint64_t val)
+{
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+//Truncates a value to what its channel's type holds, the same as the recorder's differences wrap
+static int64_t wrap(int64_t val, uint8_t type)
+{
+    switch (type)
+    {
+    case BYTE: return (uint8_t)val;
+    case INT16: return (int16_t)val;
+    case UINT16: return (uint16_t)val;
+    case INT32: return (int32_t)val;
+    default: return (uint32_t)val;
+    }
+}
+
+//Decodes a whole recording the way tools/gvrec2csv.py does, checking every row against what was sampled
+static void checkFile(const std::string &data, const std::vector<Row> &expected)
+{
+    size_t pos = 0;
+    CHECK(data.compare(0, 5, "GVREC") == 0);
+    CHECK_EQ((uint8_t)data[5], 1);
+    CHECK_EQ((uint8_t)data[6] | ((uint8_t)data[7] << 8), 1000000 / SAMPLE_MICROS);
+    CHECK_EQ((uint8_t)data[8], NUM_CHANNELS); //the string entry and the unknown name are left out
+    pos = 9;
+    uint8_t chanTypes[NUM_CHANNELS];
+    for (int i = 0; i < NUM_CHANNELS; i++)
+    {
+        chanTypes[i] = data[pos++];
+        uint8_t len = data[pos++];
+        CHECK_EQ(chanTypes[i], types[i]);
+        CHECK(data.compare(pos, len, names[i]) == 0 && strlen(names[i]) == len);
+        pos += len;
+    }
+
+    int64_t values[NUM_CHANNELS] = {0};
+    uint32_t time = 0, lastTime = 0;
+    size_t rows = 0, keyframes = 0, same = 0, mismatches = 0, badTimes = 0;
+    while (pos < data.size())
+    {
+        uint8_t tag = data[pos++];
+        uint64_t v;
+        if (tag == 'K')
+        {
+            memcpy(&time, data.data() + pos, 4);
+            pos += 4;
+            for (int i = 0; i < NUM_CHANNELS; i++)
+            {
+                if (chanTypes[i] == FLOAT)
+                {
+                    uint32_t bits;
+                    memcpy(&bits, data.data() + pos, 4);
+                    pos += 4;
+                    values[i] = bits;
+                }
+                else
+                {
+                    CHECK(getVarint(data, pos, v));
+                    values[i] = unzigzag(v);
+                }
+            }
+            keyframes++;
+        }
+        else if (tag == 'D' || tag == 'S')
+        {
+            CHECK(getVarint(data, pos, v));
+            time += (uint32_t)v;
+            if (tag == 'D')
+            {
+                const uint8_t *bitmap = (const uint8_t *)data.data() + pos;
+                pos += (NUM_CHANNELS + 7) / 8;
+                for (int i = 0; i < NUM_CHANNELS; i++)
+                {
+                    if (!(bitmap[i >> 3] & (1 << (i & 7)))) continue;
+                    if (chanTypes[i] == FLOAT)
+                    {
+                        uint32_t bits;
+                        memcpy(&bits, data.data() + pos, 4);
+                        pos += 4;
+                        values[i] = bits;
+                    }
+                    else
+                    {
+                        CHECK(getVarint(data, pos, v));
+                        values[i] = wrap(values[i] + unzigzag(v), chanTypes[i]);
+                    }
+                }
+            }
+            else same++;
+        }
+        else
+        {
+            CHECK(false); //unknown row type, nothing after it can be trusted
+            break;
+        }
+
+        if (rows < expected.size() && memcmp(values, expected[rows].values, sizeof(values))) mismatches++;
+        if (rows && (time - lastTime) < SAMPLE_MICROS) badTimes++;
+        lastTime = time;
+        rows++;
+    }
+    CHECK_EQ(rows, expected.size());
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(badTimes, 0);
+    CHECK(keyframes >= NUM_SAMPLES * SAMPLE_MICROS / 1000000 / (RECORDER_KEYFRAME_INTERVAL / 1000));
+    CHECK(same > 0);
+
+    size_t raw = 0;
+    for (int i = 0; i < NUM_CHANNELS; i++) raw += (types[i] == BYTE) ? 1 : (types[i] == INT16 || types[i] == UINT16) ? 2 : 4;
+    double perRow = (double)(data.size() - 9) / rows;
+    printf("bench statusrecorder: %zu rows (%zu in full, %zu unchanged), %.1f bytes per row against %zu for the values in full\n",
+           rows, keyframes, same, perRow, raw + 4);
+    CHECK(perRow < raw + 4);
+}
+
+int main()
+{
+    CHECK(sim.begin());
+    memCache = new MemCache(&sim);
+    memCache->setup();
+    sdCardPresent = true;
+    registerEntries();
+
+    statusRecorder.earlyInit();
+    statusRecorder.setup();
+    StatusRecorderConfiguration *config = (StatusRecorderConfiguration *)statusRecorder.getConfiguration();
+    config->sampleRate = 1000000 / SAMPLE_MICROS;
+    strcpy(config->entryList, "Gear,Torque,RPM, Current,Odometer,Voltage,State,NoSuchEntry");
+    hostFiles().clear();
+    statusRecorder.saveConfiguration(); //starts a new recording with these channels
+
+    std::vector<Row> expected;
+    uint32_t seed = 3;
+    for (int i = 0; i < NUM_SAMPLES; i++)
+    {
+        step(i, seed);
+        expected.push_back(currentRow());
+        statusRecorder.handleTick();
+        hostAdvanceMicros(SAMPLE_MICROS);
+    }
+    statusRecorder.disableDevice();
+
+    CHECK_EQ(hostFiles().size(), 1);
+    if (hostFiles().size()) checkFile(hostFiles().begin()->second, expected);
+    return TEST_RESULT();
+}
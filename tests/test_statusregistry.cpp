@@ -0,0 +1,254 @@
+/*
+ * test_statusregistry.cpp - status entries in DeviceManager and the packed registry behind it. Taking entries
+ * out from the middle or the end of a column, or everything one device registered, has to leave every other
+ * entry findable by name and still sent to the observers when it changes. Strings are compared by their text.
+ * Also times a dispatch pass over a few hundred and a thousand StatusVars with nothing and with some changed.
+ */
+
+#include "DeviceManager.h"
+#include "test.h"
+#include <set>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+//Owns status entries or watches them. Remembers the names of the updates it was sent
+class TestDevice : public Device {
+public:
+    TestDevice(DeviceId devId) : id(devId) {}
+    ~TestDevice() { deviceManager.removeDevice(this); }
+    DeviceId getId() { return id; }
+    DeviceType getType() { return DEVICE_MISC; }
+    void handleMessage(uint32_t msgType, const void *message)
+    {
+        if (msgType == MSG_CONFIG_CHANGE) heard.insert(((const StatusEntry *)message)->statusName);
+        else Device::handleMessage(msgType, message);
+    }
+    std::set<std::string> heard;
+
+private:
+    DeviceId id;
+};
+
+//The names of everything in the registry, checking each one still points at the variable it was added with
+static std::set<std::string> registryNames(StatusRegistry &reg, const void *firstVar, size_t varSize, bool &varsOk)
+{
+    std::set<std::string> names;
+    reg.forEachColumn([&](auto &col) {
+        for (size_t i = 0; i < col.size(); i++)
+        {
+            StatusEntry entry;
+            CHECK(reg.getEntry(col.varType, i, &entry));
+            names.insert(entry.statusName);
+            int n = atoi(entry.statusName + 1);
+            if (entry.varPtr != (const uint8_t *)firstVar + n * varSize) varsOk = false;
+        }
+    });
+    return names;
+}
+
+//Removing swaps the last entry of the column into the hole. Its variable and last seen value have to go with it
+static void testRegistryRemove()
+{
+    StatusRegistry reg;
+    static uint16_t vals[6];
+    static const char *names[] = {"U0", "U1", "U2", "U3", "U4", "U5"};
+    for (int i = 0; i < 6; i++)
+    {
+        vals[i] = 100 + i;
+        reg.add(StatusEntry(names[i], &vals[i], UINT16, nullptr));
+    }
+    CHECK_EQ(reg.getPolledCount(), 6);
+
+    CHECK_EQ(reg.remove("U5"), 1); //the end of the column
+    CHECK_EQ(reg.remove("U1"), 1); //the middle, U4 moves into its spot
+    CHECK_EQ(reg.remove("U1"), 0);
+    CHECK_EQ(reg.size(), 4);
+    CHECK_EQ(reg.getPolledCount(), 4);
+    bool varsOk = true;
+    CHECK(registryNames(reg, vals, sizeof(vals[0]), varsOk) == std::set<std::string>({"U0", "U2", "U3", "U4"}));
+    CHECK(varsOk);
+
+    //nothing changed, so nothing may look changed after the move. Then exactly what does change shows up
+    int changed = 0;
+    reg.forEachColumn([&](auto &col) { for (size_t i = 0; i < col.size(); i++) if (col.changed(i)) changed++; });
+    CHECK_EQ(changed, 0);
+    vals[4] = 7;
+    std::set<std::string> seen;
+    reg.forEachColumn([&](auto &col) { for (size_t i = 0; i < col.size(); i++) if (col.changed(i)) seen.insert(col.info[i].name); });
+    CHECK(seen == std::set<std::string>({"U4"}));
+
+    //StatusVars aren't polled, taking one out leaves the polled count alone
+    static StatusVar<uint16_t> var;
+    reg.add(StatusEntry("V", &var, nullptr));
+    CHECK_EQ(reg.getPolledCount(), 4);
+    CHECK_EQ(reg.remove("V"), 1);
+    CHECK_EQ(reg.getPolledCount(), 4);
+    CHECK_EQ(reg.removeDevice(nullptr), 4);
+    CHECK_EQ(reg.size(), 0);
+    CHECK_EQ(reg.getPolledCount(), 0);
+}
+
+//Three devices with one entry of each number type, every column holds one entry from each of them
+struct DeviceVars
+{
+    uint8_t b;
+    int16_t i16;
+    uint32_t u32;
+    float f;
+};
+
+static void testDeviceManagerRemove()
+{
+    TestDevice owners[3] = {TestDevice(0x3001), TestDevice(0x3002), TestDevice(0x3003)};
+    TestDevice observer(0x3004);
+    static DeviceVars vars[3];
+    static const char *names[3][4] = {{"B0", "I0", "U0", "F0"}, {"B1", "I1", "U1", "F1"}, {"B2", "I2", "U2", "F2"}};
+    for (int d = 0; d < 3; d++)
+    {
+        deviceManager.addStatusEntry(StatusEntry(names[d][0], &vars[d].b, BYTE, &owners[d]));
+        deviceManager.addStatusEntry(StatusEntry(names[d][1], &vars[d].i16, INT16, &owners[d]));
+        deviceManager.addStatusEntry(StatusEntry(names[d][2], &vars[d].u32, UINT32, &owners[d]));
+        deviceManager.addStatusEntry(StatusEntry(names[d][3], &vars[d].f, FLOAT, &owners[d]));
+    }
+    CHECK(deviceManager.addStatusObserver(&observer));
+    deviceManager.dispatchStatusChanges();
+
+    StatusEntry entry;
+    CHECK(deviceManager.findStatusEntry("I1", &entry));
+    deviceManager.removeStatusEntry(entry); //middle of the int16 column
+    deviceManager.removeStatusEntry("U2"); //end of the uint32 column
+    deviceManager.removeAllEntriesForDevice(&owners[0]);
+
+    std::set<std::string> left = {"B1", "U1", "F1", "B2", "I2", "F2"};
+    const void *expectVar[] = {&vars[1].b, &vars[1].u32, &vars[1].f, &vars[2].b, &vars[2].i16, &vars[2].f};
+    int idx = 0;
+    for (const char *name : {"B1", "U1", "F1", "B2", "I2", "F2"})
+    {
+        bool found = deviceManager.findStatusEntry(name, &entry);
+        CHECK(found);
+        if (found)
+        {
+            CHECK(entry.varPtr == expectVar[idx]);
+            CHECK(entry.device == &owners[1 + idx / 3]);
+        }
+        idx++;
+    }
+    for (const char *name : {"B0", "I0", "U0", "F0", "I1", "U2"}) CHECK(!deviceManager.findStatusEntry(name, &entry));
+
+    //change every variable, removed or not. Only the ones still registered may be sent
+    for (int d = 0; d < 3; d++)
+    {
+        vars[d].b++;
+        vars[d].i16 -= 5;
+        vars[d].u32 += 1000;
+        vars[d].f += 0.5f;
+    }
+    observer.heard.clear();
+    deviceManager.dispatchStatusChanges();
+    CHECK(observer.heard == left);
+
+    for (int d = 0; d < 3; d++) deviceManager.removeAllEntriesForDevice(&owners[d]);
+    deviceManager.removeStatusObserver(&observer);
+}
+
+//"ab" and "ba" add up to the same number, the text has to be compared. Anything that turns a string into a
+//number must stop at the terminator, an empty string included
+static void testStringChanges()
+{
+    TestDevice observer(0x3005);
+    static char word[16] = "ab";
+    deviceManager.addStatusEntry(StatusEntry("Word", word, STRING, &observer));
+    CHECK(deviceManager.addStatusObserver(&observer));
+    deviceManager.dispatchStatusChanges();
+    observer.heard.clear();
+
+    StatusEntry entry;
+    CHECK(deviceManager.findStatusEntry("Word", &entry));
+    double before = entry.getValueAsDouble();
+    strcpy(word, "ba");
+    CHECK(entry.getValueAsDouble() == before);
+    deviceManager.dispatchStatusChanges();
+    CHECK(observer.heard.count("Word") == 1);
+
+    observer.heard.clear();
+    strcpy(word, "ba"); //written again but the same text
+    deviceManager.dispatchStatusChanges();
+    CHECK(observer.heard.empty());
+
+    word[0] = 0;
+    CHECK(entry.getValueAsDouble() == 0.0);
+    deviceManager.dispatchStatusChanges();
+    CHECK(observer.heard.count("Word") == 1);
+
+    deviceManager.removeStatusObserver(&observer);
+    deviceManager.removeAllEntriesForDevice(&observer);
+}
+
+//Registers count StatusVars, spread over the number types, with every observer slot taken. Times a pass
+//with nothing changed and one with dirty of them changed, and checks each change reached every observer
+static void benchmark(size_t count, size_t dirty)
+{
+    const int passes = 2000;
+    std::unique_ptr<TestDevice> observers[CFG_STATUS_NUM_OBSERVERS];
+    for (int i = 0; i < CFG_STATUS_NUM_OBSERVERS; i++)
+    {
+        observers[i].reset(new TestDevice(0x3100 + i));
+        CHECK(deviceManager.addStatusObserver(observers[i].get()));
+    }
+    TestDevice owner(0x3200);
+    std::vector<std::string> names(count);
+    std::unique_ptr<StatusVar<int16_t>[]> shorts(new StatusVar<int16_t>[count]);
+    std::unique_ptr<StatusVar<uint32_t>[]> longs(new StatusVar<uint32_t>[count]);
+    std::unique_ptr<StatusVar<float>[]> floats(new StatusVar<float>[count]);
+    for (size_t i = 0; i < count; i++)
+    {
+        names[i] = "Bench" + std::to_string(i);
+        if (i % 3 == 0) deviceManager.addStatusEntry(StatusEntry(names[i].c_str(), &shorts[i], &owner));
+        else if (i % 3 == 1) deviceManager.addStatusEntry(StatusEntry(names[i].c_str(), &longs[i], &owner));
+        else deviceManager.addStatusEntry(StatusEntry(names[i].c_str(), &floats[i], &owner));
+    }
+    deviceManager.dispatchStatusChanges();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < passes; p++) deviceManager.dispatchStatusChanges();
+    double idleNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / passes;
+
+    for (auto &obs : observers) obs->heard.clear();
+    double dirtyNs = 0;
+    bool allHeard = true;
+    for (int p = 0; p < passes; p++)
+    {
+        for (size_t d = 0; d < dirty; d++)
+        {
+            size_t i = (d * count / dirty + p) % count;
+            if (i % 3 == 0) shorts[i] += 1;
+            else if (i % 3 == 1) longs[i] += 1;
+            else floats[i] += 1.0f;
+        }
+        for (auto &obs : observers) obs->heard.clear();
+        start = std::chrono::steady_clock::now();
+        deviceManager.dispatchStatusChanges();
+        dirtyNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        for (auto &obs : observers) if (obs->heard.size() != dirty) allHeard = false;
+    }
+    dirtyNs /= passes;
+    CHECK(allHeard);
+    printf("bench statusregistry: %zu StatusVars, %d observers: %.0f ns a pass with nothing changed, %.1f us with %zu changed\n",
+           count, CFG_STATUS_NUM_OBSERVERS, idleNs, dirtyNs / 1000, dirty);
+    CHECK(idleNs < 1000); //nothing dirty is a counter compare, not a walk over the entries
+
+    deviceManager.removeAllEntriesForDevice(&owner);
+    for (auto &obs : observers) deviceManager.removeStatusObserver(obs.get());
+}
+
+int main()
+{
+    testRegistryRemove();
+    testDeviceManagerRemove();
+    testStringChanges();
+    benchmark(200, 10);
+    benchmark(1000, 10);
+    return TEST_RESULT();
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Decompresses a compressed GEVCU log (GevcuLogNNNNNN.lz4 from the sdcard, written with CFG_LOG_COMPRESS).
+These are plain LZ4 frames so "lz4 -d" works as well, this is for when that isn't installed or the file
+was cut short by the power going off, which lz4 refuses to read past.
+
+    gvlz4.py GevcuLog000042.lz4 > GevcuLog000042.txt
+    gvlz4.py GevcuLog000042.lz4 -o GevcuLog000042.txt
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x184D2204
+
+
+def decompress_block(src, out):
+    """Appends one LZ4 block worth of output to out (a bytearray)"""
+    ip = 0
+    end = len(src)
+    while ip < end:
+        token = src[ip]
+        ip += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = src[ip]
+                ip += 1
+                lit += b
+                if b != 255:
+                    break
+        out += src[ip:ip + lit]
+        ip += lit
+        if ip >= end:
+            break  #the last sequence is only literals
+        offset = src[ip] | (src[ip + 1] << 8)
+        ip += 2
+        if offset == 0 or offset > len(out):
+            raise ValueError("bad match offset")
+        mlen = token & 15
+        if mlen == 15:
+            while True:
+                b = src[ip]
+                ip += 1
+                mlen += b
+                if b != 255:
+                    break
+        mlen += 4
+        start = len(out) - offset
+        if offset >= mlen:
+            out += out[start:start + mlen]
+        else:
+            for i in range(mlen):  #overlapping, repeats the last offset bytes
+                out.append(out[start + i])
+
+
+def decompress(data):
+    """Returns (decompressed bytes, blocks read, whether the frame ended properly)"""
+    if len(data) < 7 or struct.unpack('<I', data[:4])[0] != MAGIC:
+        raise ValueError("not an LZ4 frame")
+    flg = data[4]
+    pos = 7
+    if flg & 0x08:
+        pos += 8  #content size
+    if flg & 0x01:
+        pos += 4  #dictionary id
+    block_checksum = bool(flg & 0x10)
+    out = bytearray()
+    blocks = 0
+    while pos + 4 <= len(data):
+        size = struct.unpack('<I', data[pos:pos + 4])[0]
+        pos += 4
+        if size == 0:
+            return bytes(out), blocks, True
+        raw = size & 0x80000000
+        size &= 0x7FFFFFFF
+        if pos + size > len(data):
+            break
+        try:
+            if raw:
+                out += data[pos:pos + size]
+            else:
+                block = bytearray()
+                decompress_block(data[pos:pos + size], block)
+                out += block
+        except (IndexError, ValueError):
+            #the rest of a preallocated file after a power cut is whatever was on the card before
+            break
+        pos += size + (4 if block_checksum else 0)
+        blocks += 1
+    return bytes(out), blocks, False
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decompress a GEVCU LZ4 log")
+    parser.add_argument('file')
+    parser.add_argument('-o', '--output', help="file to write, default is stdout")
+    args = parser.parse_args()
+
+    with open(args.file, 'rb') as f:
+        data = f.read()
+    text, blocks, complete = decompress(data)
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(text)
+    else:
+        sys.stdout.buffer.write(text)
+    sys.stderr.write("%d blocks, %d bytes from %d (%.1f%%)%s\n" % (blocks, len(text), len(data),
+                     100.0 * len(data) / len(text) if text else 0, "" if complete else ", no end mark"))
+
+
+if __name__ == '__main__':
+    main()
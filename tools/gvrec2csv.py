@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Turns a status recording (GevcuRecNNNNNN_NN.gvr from the sdcard) into CSV.
+One row per sample, the first column is seconds since the recording started.
+
+    gvrec2csv.py GevcuRec000042_00.gvr > drive.csv
+    gvrec2csv.py GevcuRec000042_00.gvr -o drive.csv
+
+The file layout is described at the top of src/devices/misc/StatusRecorder.cpp.
+"""
+
+import argparse
+import struct
+import sys
+
+#CFG_ENTRY_VAR_TYPE
+BYTE, STRING, INT16, UINT16, INT32, UINT32, FLOAT = range(7)
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def left(self):
+        return len(self.data) - self.pos
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def take(self, n):
+        if self.left() < n:
+            raise EOFError
+        out = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return out
+
+    def varint(self):
+        val = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            val |= (b & 0x7F) << shift
+            if not b & 0x80:
+                return val
+            shift += 7
+            if shift > 63:
+                raise ValueError("bad varint")
+
+    def zigzag(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+
+def as_float(bits):
+    return struct.unpack('<f', struct.pack('<I', bits & 0xFFFFFFFF))[0]
+
+
+def read_header(rd):
+    if rd.take(5) != b'GVREC':
+        raise ValueError("not a status recording")
+    version = rd.byte()
+    if version != 1:
+        raise ValueError("unknown recording version %d" % version)
+    rate, count = struct.unpack('<HB', rd.take(3))
+    channels = []
+    for _ in range(count):
+        vtype = rd.byte()
+        name = rd.take(rd.byte()).decode('ascii', 'replace')
+        channels.append((name, vtype))
+    return rate, channels
+
+
+def rows(rd, channels):
+    """Yields (micros since start, [values]) for every sample in the file"""
+    count = len(channels)
+    values = [0] * count
+    now = None
+    start = 0
+    while rd.left():
+        try:
+            tag = rd.byte()
+            if tag == ord('K'):
+                stamp = struct.unpack('<I', rd.take(4))[0]
+                if now is None:
+                    now = start = stamp
+                else:
+                    now += (stamp - now) & 0xFFFFFFFF  #micros() wraps every 71 minutes
+                for i, (_, vtype) in enumerate(channels):
+                    if vtype == FLOAT:
+                        values[i] = struct.unpack('<I', rd.take(4))[0]
+                    else:
+                        values[i] = rd.zigzag()
+            elif tag in (ord('D'), ord('S')) and now is not None:
+                now += rd.varint()
+                if tag == ord('D'):
+                    bitmap = rd.take((count + 7) // 8)
+                    for i, (_, vtype) in enumerate(channels):
+                        if not bitmap[i >> 3] & (1 << (i & 7)):
+                            continue
+                        if vtype == FLOAT:
+                            values[i] = struct.unpack('<I', rd.take(4))[0]
+                        else:
+                            values[i] += rd.zigzag()
+            else:
+                #the rest of the file after a power cut can be anything. Stop at the first thing that isn't a row
+                return
+        except (EOFError, IndexError, ValueError):
+            return
+        yield now - start, [as_float(v) if channels[i][1] == FLOAT else v for i, v in enumerate(values)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a GEVCU status recording to CSV")
+    parser.add_argument('file')
+    parser.add_argument('-o', '--output', help="CSV file to write, default is stdout")
+    args = parser.parse_args()
+
+    with open(args.file, 'rb') as f:
+        rd = Reader(f.read())
+    rate, channels = read_header(rd)
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    out.write(','.join(['time'] + [name for name, _ in channels]) + '\n')
+    samples = 0
+    for micros, vals in rows(rd, channels):
+        out.write('%.6f,' % (micros / 1e6) + ','.join('%g' % v if isinstance(v, float) else str(v) for v in vals) + '\n')
+        samples += 1
+    if out is not sys.stdout:
+        out.close()
+    sys.stderr.write("%d channels at %d Hz, %d samples, %.1f bytes per sample\n" %
+                     (len(channels), rate, samples, rd.pos / samples if samples else 0))
+
+
+if __name__ == '__main__':
+    main()